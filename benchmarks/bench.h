@@ -0,0 +1,27 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <stdio.h>
+
+double bench_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// runs body repetitions times and returns the best time in seconds
+template<typename F>
+double bench_best_of(unsigned repetitions, F body) {
+	double best = 1e300;
+
+	for(unsigned i = 0; i < repetitions; i++) {
+		double start = bench_now();
+		body();
+		double elapsed = bench_now() - start;
+
+		if(elapsed < best) best = elapsed;
+	}
+
+	return best;
+}
+
+#endif
@@ -0,0 +1,96 @@
+#include "parser.h"
+#include "nbe.h"
+#include "case_tree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// A function of two arguments over k constructors, one case per constructor
+// matched on both arguments and a default case, applied 2^depth - 1 times
+// to the last constructor. Trying the cases in order tests the first argument
+// against every case before the last one, the decision tree tests each
+// argument once with one lookup.
+
+std::string constructor(unsigned i) {
+	return "K" + std::to_string(i);
+}
+
+std::string calls(unsigned depth, const std::string & leaf) {
+	if(depth == 0) return leaf;
+
+	std::string inner = calls(depth - 1, leaf);
+
+	return "f (" + inner + ") (" + inner + ")";
+}
+
+std::string program(unsigned k, unsigned depth) {
+	std::string src = "let T : Type in ";
+
+	for(unsigned i = 0; i < k; i++) {
+		src += "let " + constructor(i) + " : T in ";
+	}
+
+	src += "let f : T -> T -> T = ";
+
+	for(unsigned i = 0; i < k; i++) {
+		src += "case " + constructor(i) + " . " + constructor(i) + " then " + constructor(i) + ", ";
+	}
+
+	src += "case x . y then x in ";
+
+	return src + "let r : T = " + calls(depth, constructor(k - 1)) + ";";
+}
+
+double bench_cases(struct ast_t * ast, int trees, unsigned long * steps) {
+	struct nbe_t nbe;
+
+	nbe_init(&nbe);
+
+	nbe.decision_trees = trees;
+
+	double time = bench_best_of(3, [&]() {
+		nbe.steps = 0;
+		ast_free(nbe_normalize(&nbe, ast));
+	});
+
+	*steps = nbe.steps;
+
+	nbe_destroy(&nbe);
+
+	return time;
+}
+
+int main() {
+	const unsigned depth = 14;
+
+	printf("%6s %8s | %9s %9s | %12s %9s\n", "k", "matches", "nodes", "tree ms", "sequential ms", "speedup");
+
+	for(unsigned k = 4; k <= 256; k *= 4) {
+		struct ast_t * ast = parse(program(k, depth).c_str());
+
+		struct ast_t * cases = ast;
+
+		while(cases->rhs->rhs) cases = cases->rhs;
+
+		struct case_tree_t * tree = case_tree_compile(cases->lhs->rhs);
+
+		unsigned long tree_steps;
+		unsigned long sequential_steps;
+
+		double tree_time = bench_cases(ast, 1, &tree_steps);
+		double sequential_time = bench_cases(ast, 0, &sequential_steps);
+
+		if(tree_steps != sequential_steps) {
+			printf("the decision tree took %lu cases, the sequential matching %lu\n", tree_steps, sequential_steps);
+			abort();
+		}
+
+		printf("%6u %8lu | %9u %9.2f | %12.2f %8.1fx\n", k, tree_steps, tree->nodes, tree_time * 1e3, sequential_time * 1e3, sequential_time / tree_time);
+
+		case_tree_free(tree);
+		ast_free(ast);
+	}
+
+	return 0;
+}
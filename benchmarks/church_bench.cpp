@@ -0,0 +1,101 @@
+#include "parser.h"
+#include "reduction.h"
+#include "nbe.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Church numeral arithmetic normalized by evaluation (nbe.h) and by repeated
+// substitution (reduction.h). Both get the same program, the numerals and the
+// operators as definitions and the result as the last one.
+
+std::string church_numeral(unsigned n) {
+	std::string src = "fn f:t. fn x:t. ";
+
+	for(unsigned i = 0; i < n; i++) src += "f (";
+
+	src += "x";
+
+	for(unsigned i = 0; i < n; i++) src += ")";
+
+	return src;
+}
+
+std::string church_program(const char * op, unsigned a, unsigned b) {
+	std::string src;
+
+	src += "let plus : t = fn m:t. fn n:t. fn f:t. fn x:t. m f (n f x) in\n";
+	src += "let mult : t = fn m:t. fn n:t. fn f:t. m (n f) in\n";
+	src += "let pow : t = fn m:t. fn n:t. n m in\n";
+	src += "let a : t = " + church_numeral(a) + " in\n";
+	src += "let b : t = " + church_numeral(b) + " in\n";
+	src += "let r : t = " + std::string(op) + " a b;";
+
+	return src;
+}
+
+template<typename F>
+double time_normalize(const std::string & src, unsigned repetitions, F normalize) {
+	double best = 1e300;
+
+	for(unsigned i = 0; i < repetitions; i++) {
+		struct ast_t * ast = parse(src.c_str());
+
+		double start = bench_now();
+		struct ast_t * normal = normalize(ast);
+		double elapsed = bench_now() - start;
+
+		if(elapsed < best) best = elapsed;
+
+		if(normal != ast) ast_free(normal);
+		ast_free(ast);
+	}
+
+	return best;
+}
+
+void bench_church(const char * op, unsigned a, unsigned b) {
+	std::string src = church_program(op, a, b);
+
+	struct nbe_t nbe;
+
+	nbe_init(&nbe);
+
+	double nbe_time = time_normalize(src, 5, [&](struct ast_t * ast) {
+		nbe.steps = 0;
+		return nbe_normalize(&nbe, ast);
+	});
+
+	unsigned long substitution_steps = 0;
+
+	double substitution_time = time_normalize(src, 1, [&](struct ast_t * ast) {
+		substitution_steps = 0;
+		return ast_reduce_program(ast, &substitution_steps);
+	});
+
+	printf("%-5s %4u %4u | %12.1f %10lu | %12.1f %10lu | %9.0fx\n", op, a, b,
+				 nbe_time * 1e6, nbe.steps, substitution_time * 1e6, substitution_steps,
+				 substitution_time / nbe_time);
+
+	nbe_destroy(&nbe);
+}
+
+int main() {
+	printf("%-5s %4s %4s | %12s %10s | %12s %10s | %10s\n", "op", "a", "b", "nbe us", "steps", "subst us", "steps", "speedup");
+
+	bench_church("plus", 100, 100);
+	bench_church("plus", 1000, 1000);
+
+	bench_church("mult", 10, 10);
+	bench_church("mult", 30, 30);
+	bench_church("mult", 100, 100);
+
+	bench_church("pow", 2, 6);
+	bench_church("pow", 2, 8);
+	bench_church("pow", 2, 10);
+	bench_church("pow", 2, 12);
+	bench_church("pow", 2, 14);
+
+	return 0;
+}
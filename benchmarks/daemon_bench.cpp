@@ -0,0 +1,203 @@
+#include "daemon.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Load generator for the daemon. Client threads keep one connection each and
+// send a mix of hash, typecheck and normalize requests against a generated
+// prelude, at 1, 2, 4 and 8 concurrent clients, and report the throughput and
+// the latency percentiles of the requests.
+//
+// The baseline is the work of a fresh process per query: parsing and checking
+// the prelude, then parsing and answering the query, without the daemon, the
+// socket or the resident cache.
+//
+// daemon_bench [socket] connects to a running daemon started with the prelude
+// printed by daemon_bench --prelude, otherwise a daemon is started in process.
+
+const unsigned definitions = 256;
+const unsigned requests_per_client = 2000;
+
+std::string bench_prelude() {
+	std::string prelude = "let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in\n";
+
+	prelude += "let f0 : Nat -> Nat = fn x:Nat. Succ x";
+
+	for(unsigned i = 1; i < definitions; i++) {
+		prelude += " in\nlet f" + std::to_string(i) + " : Nat -> Nat = fn x:Nat. Succ (f" + std::to_string(i - 1) + " x)";
+	}
+
+	return prelude + ";\n";
+}
+
+typedef struct bench_query_t {
+	enum daemon_operation_t operation;
+	std::string source;
+} bench_query_t;
+
+// the i-th request of a client, a normalize in four unfolds a few dozen lets
+struct bench_query_t bench_query(unsigned client, unsigned i) {
+	std::string f = "f" + std::to_string((client * 7 + i * 13) % 32);
+
+	switch(i % 4) {
+		case 0: return { DAEMON_HASH, "fn y:Nat. " + f + " (Succ y)" };
+		case 1: return { DAEMON_TYPECHECK, f + " (Succ Zero)" };
+		case 2: return { DAEMON_HASH, "fn y:Nat. fn z:Nat. " + f + " (" + f + " z)" };
+		default: return { DAEMON_NORMALIZE, f + " Zero" };
+	}
+}
+
+double percentile(std::vector<double> & sorted, double p) {
+	unsigned long at = (unsigned long)(p * (sorted.size() - 1) + 0.5);
+
+	return sorted[at];
+}
+
+void bench_clients(const char * path, unsigned clients) {
+	std::vector<std::vector<double>> latencies(clients);
+	std::vector<std::thread> threads;
+	std::atomic<unsigned> failed(0);
+
+	double start = bench_now();
+
+	for(unsigned c = 0; c < clients; c++) {
+		threads.push_back(std::thread([&, c]() {
+			struct daemon_client_t client;
+
+			if(!daemon_client_connect(&client, path)) {
+				failed += requests_per_client;
+				daemon_client_close(&client);
+				return;
+			}
+
+			latencies[c].reserve(requests_per_client);
+
+			for(unsigned i = 0; i < requests_per_client; i++) {
+				struct bench_query_t query = bench_query(c, i);
+
+				double before = bench_now();
+
+				int ok = daemon_client_call(&client, query.operation, 0, query.source.c_str()) && daemon_client_ok(&client);
+
+				latencies[c].push_back(bench_now() - before);
+
+				if(!ok) failed += 1;
+			}
+
+			daemon_client_close(&client);
+		}));
+	}
+
+	for(unsigned c = 0; c < clients; c++) threads[c].join();
+
+	double elapsed = bench_now() - start;
+
+	std::vector<double> all;
+
+	for(unsigned c = 0; c < clients; c++) all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+
+	std::sort(all.begin(), all.end());
+
+	if(all.empty()) {
+		printf("%7u %10s\n", clients, "no connection");
+		return;
+	}
+
+	printf("%7u %10.0f %8.1f %8.1f %8.1f %8.1f %8.1f %7u\n", clients, all.size() / elapsed,
+		percentile(all, 0.5) * 1e6, percentile(all, 0.9) * 1e6, percentile(all, 0.99) * 1e6,
+		percentile(all, 0.999) * 1e6, all.back() * 1e6, failed.load());
+}
+
+// one query answered from scratch, as a process started for it would
+void baseline_query(const std::string & prelude, struct bench_query_t * query) {
+	struct ast_t * program = parse(prelude.c_str());
+
+	struct typecheck_t checker;
+
+	typecheck_init(&checker);
+	typecheck_program(&checker, program);
+
+	struct ast_t * ast = parse(query->source.c_str());
+
+	if(query->operation == DAEMON_HASH) {
+		ast_hash(ast);
+	} else if(query->operation == DAEMON_TYPECHECK) {
+		typecheck_program(&checker, ast);
+	} else {
+		struct ast_t * term = typecheck_unfold(&checker, ast);
+
+		reduce_with_budget(&term, DAEMON_NORMALIZE_STEPS, 0, 0);
+
+		ast_free(term);
+	}
+
+	ast_free(ast);
+	typecheck_destroy(&checker);
+	ast_free(program);
+}
+
+int main(int argc, char ** argv) {
+	std::string prelude = bench_prelude();
+
+	if(argc > 1 && strcmp(argv[1], "--prelude") == 0) {
+		printf("%s", prelude.c_str());
+		return 0;
+	}
+
+	struct daemon_t daemon;
+	std::thread server;
+
+	char path[64];
+
+	const char * socket_path = argc > 1 ? argv[1] : path;
+
+	if(argc <= 1) {
+		snprintf(path, sizeof(path), "/tmp/daemon_bench_%d.sock", (int)getpid());
+
+		// a worker per client, a connection keeps its worker until it closes
+		if(!daemon_init(&daemon, path, prelude.c_str(), 8)) return 1;
+
+		server = std::thread(daemon_run, &daemon);
+	}
+
+	printf("%u definitions, %u requests per client, latencies in us\n\n", definitions, requests_per_client);
+	printf("%7s %10s %8s %8s %8s %8s %8s %7s\n", "clients", "req/s", "p50", "p90", "p99", "p99.9", "max", "failed");
+
+	for(unsigned clients = 1; clients <= 8; clients *= 2) bench_clients(socket_path, clients);
+
+	unsigned samples = 40;
+	double total = 0;
+
+	for(unsigned i = 0; i < samples; i++) {
+		struct bench_query_t query = bench_query(0, i);
+
+		double start = bench_now();
+
+		baseline_query(prelude, &query);
+
+		total += bench_now() - start;
+	}
+
+	printf("\nprocess per query %10.0f req/s, %.1f us per query, without process startup\n", samples / total, total / samples * 1e6);
+
+	if(argc <= 1) {
+		struct daemon_client_t client;
+
+		if(daemon_client_connect(&client, path)) daemon_client_call(&client, DAEMON_STOP, 0, 0);
+
+		daemon_client_close(&client);
+
+		server.join();
+
+		printf("\n");
+
+		daemon_report(&daemon, stdout);
+		daemon_destroy(&daemon);
+	}
+}
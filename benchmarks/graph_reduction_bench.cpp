@@ -0,0 +1,91 @@
+#include "parser.h"
+#include "reduction.h"
+#include "graph_reduction.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// The copying reducer (reduction.h) against graph reduction with shared
+// arguments (graph_reduction.h): steps, nodes built, peak live nodes and time.
+// The chains pass an unreduced argument to a function that uses it twice, k
+// times over, where copying reduces the innermost redex 2^k times. Church
+// arithmetic shows the common case.
+
+std::string church_numeral(unsigned n) {
+	std::string src = "fn f:t. fn x:t. ";
+
+	for(unsigned i = 0; i < n; i++) src += "f (";
+
+	src += "x";
+
+	for(unsigned i = 0; i < n; i++) src += ")";
+
+	return src;
+}
+
+// the parser groups a b c as a (b c) after the first application
+std::string church_apply(const std::string & f, const std::string & x) {
+	return "(" + f + ") (" + x + ")";
+}
+
+// (fn x. c x x) (... ((fn x. c x x) ((fn z. z) a)))
+std::string sharing_chain(unsigned k) {
+	std::string src = "(fn z:t. z) a";
+
+	for(unsigned i = 0; i < k; i++) {
+		src = church_apply("fn x:t. c x x", src);
+	}
+
+	return src;
+}
+
+void bench_term(const char * label, const std::string & src) {
+	struct reduction_stats_t tree;
+	struct reduction_stats_t graph;
+
+	double tree_time = bench_best_of(3, [&]() {
+		struct ast_t * ast = parse(src.c_str());
+		tree = reduce_with_budget(&ast, 0, 0);
+		ast_free(ast);
+	});
+
+	double graph_time = bench_best_of(3, [&]() {
+		reduction_stats_init(&graph);
+
+		struct ast_t * ast = parse(src.c_str());
+		ast_free(graph_reduce(ast, &graph));
+		ast_free(ast);
+	});
+
+	printf("%-14s | %9lu %10lu %9lu %9.2f | %9lu %10lu %9lu %9.2f\n", label,
+		tree.steps, tree.nodes_copied, tree.peak_live_nodes, tree_time * 1e3,
+		graph.steps, graph.nodes_copied, graph.peak_live_nodes, graph_time * 1e3);
+}
+
+void bench_church(const char * op, const char * op_src, unsigned a, unsigned b) {
+	char label[64];
+
+	snprintf(label, 64, "%s %u %u", op, a, b);
+
+	bench_term(label, church_apply(church_apply(op_src, church_numeral(a)), church_numeral(b)));
+}
+
+int main() {
+	printf("%-14s | %9s %10s %9s %9s | %9s %10s %9s %9s\n", "term", "steps", "copied", "peak", "copy ms", "steps", "built", "peak", "graph ms");
+
+	for(unsigned k = 4; k <= 12; k += 2) {
+		char label[64];
+
+		snprintf(label, 64, "chain %u", k);
+
+		bench_term(label, sharing_chain(k));
+	}
+
+	bench_church("plus", "fn m:t. fn n:t. fn f:t. fn x:t. m f (n f x)", 500, 500);
+	bench_church("mult", "fn m:t. fn n:t. fn f:t. m (n f)", 30, 30);
+	bench_church("mult", "fn m:t. fn n:t. fn f:t. m (n f)", 60, 60);
+	bench_church("pow", "fn m:t. fn n:t. n m", 2, 10);
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include "ast_hash.h"
+#include "bench.h"
+#include "term_generator.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// Scaling of alpha hashing on generated terms. Every shape is generated at
+// sizes growing by about 3x, and each size runs the fused ast_hash and the
+// summary pipeline pass by pass: summaryse, summary_hash_structure,
+// summary_hash_free_variables, summary_hash_positions and summary_free. The
+// exponent k of time ~ n^k is fitted by least squares on the logs, about 1
+// for a linear pass and 2 for a quadratic one.
+//
+// The terms are well scoped, the binders are typed by the free variable t and
+// only the many free shape has other free variables. A pass is skipped once a
+// quadratic extrapolation of its last time goes past the budget, so the large
+// sizes only run the passes that can finish.
+//
+// hash_bench [max nodes], 10^6 by default, 10^7 needs a few GB.
+
+const double budget = 8.0;
+
+typedef struct ast_t * (*generate_t)(struct generator_t *, unsigned);
+
+typedef struct shape_t {
+	const char * name;
+	generate_t generate;
+} shape_t;
+
+enum pass_t {
+	PASS_FUSED,
+	PASS_SUMMARYSE,
+	PASS_STRUCTURE,
+	PASS_FREE_VARIABLES,
+	PASS_POSITIONS,
+	PASS_SUMMARY_FREE,
+	TOTAL_PASSES,
+};
+
+const char * pass_names[TOTAL_PASSES] = { "ast_hash", "summaryse", "structure", "free_vars", "positions", "summary_free" };
+
+typedef struct samples_t {
+	std::vector<double> nodes;
+	std::vector<double> seconds;
+
+	// last time, for the budget
+	double last;
+	double last_nodes;
+} samples_t;
+
+// least squares slope of log seconds over log nodes
+double samples_exponent(struct samples_t * samples) {
+	unsigned count = 0;
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+	for(unsigned i = 0; i < samples->nodes.size(); i++) {
+		// too short to say anything
+		if(samples->seconds[i] < 1e-4) continue;
+
+		double x = log(samples->nodes[i]);
+		double y = log(samples->seconds[i]);
+
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		count += 1;
+	}
+
+	if(count < 2) return NAN;
+
+	return (count * sxy - sx * sy) / (count * sxx - sx * sx);
+}
+
+int samples_affordable(struct samples_t * samples, double nodes) {
+	if(samples->last_nodes == 0) return 1;
+
+	double ratio = nodes / samples->last_nodes;
+
+	return samples->last * ratio * ratio < budget;
+}
+
+// best time of one pass over repetitions, 0 if it is over the budget
+template<typename F>
+int time_pass(struct samples_t * samples, double nodes, unsigned repetitions, F body) {
+	if(!samples_affordable(samples, nodes)) {
+		printf(" %10s %8s", "-", "-");
+		return 0;
+	}
+
+	unsigned long before = memory_allocation_count();
+
+	double elapsed = bench_best_of(repetitions, body);
+
+	unsigned long allocations = (memory_allocation_count() - before) / repetitions;
+
+	samples->nodes.push_back(nodes);
+	samples->seconds.push_back(elapsed);
+	samples->last = elapsed;
+	samples->last_nodes = nodes;
+
+	printf(" %10.2f %8.1f", elapsed * 1e3, allocations / nodes);
+
+	return 1;
+}
+
+unsigned long max_nodes = 1000000;
+
+void bench_shape(struct shape_t * shape) {
+	struct samples_t samples[TOTAL_PASSES];
+
+	for(unsigned p = 0; p < TOTAL_PASSES; p++) {
+		samples[p].last = 0;
+		samples[p].last_nodes = 0;
+	}
+
+	printf("\n%s\n%9s", shape->name, "nodes");
+
+	for(unsigned p = 0; p < TOTAL_PASSES; p++) printf(" %10s %8s", pass_names[p], "alloc/n");
+
+	printf("\n");
+
+	for(double size = 1000; size <= max_nodes * 1.01; size *= sqrt(10.0)) {
+		struct generator_t g;
+
+		g.binders = 0;
+		g.nodes = 0;
+
+		struct ast_t * ast = shape->generate(&g, (unsigned)size);
+
+		double nodes = g.nodes;
+
+		printf("%9u", g.nodes);
+
+		// ast_hash only writes the tags, so it can run again for the best time
+		time_pass(&samples[PASS_FUSED], nodes, 3, [&]() { ast_hash(ast); });
+
+		struct summary_t * summary = 0;
+
+		if(time_pass(&samples[PASS_SUMMARYSE], nodes, 1, [&]() { summary = summaryse(ast); })) {
+			time_pass(&samples[PASS_STRUCTURE], nodes, 1, [&]() { summary_hash_structure(summary); });
+			time_pass(&samples[PASS_FREE_VARIABLES], nodes, 1, [&]() { summary_hash_free_variables(summary); });
+			time_pass(&samples[PASS_POSITIONS], nodes, 1, [&]() { summary_hash_positions(summary); });
+
+			// the tree is freed whatever the budget says
+			samples[PASS_SUMMARY_FREE].last_nodes = 0;
+
+			time_pass(&samples[PASS_SUMMARY_FREE], nodes, 1, [&]() { summary_free(summary); });
+		} else {
+			for(unsigned p = PASS_STRUCTURE; p < TOTAL_PASSES; p++) printf(" %10s %8s", "-", "-");
+		}
+
+		printf("\n");
+
+		ast_free(ast);
+	}
+
+	printf("%9s", "exponent");
+
+	for(unsigned p = 0; p < TOTAL_PASSES; p++) printf(" %10.2f %8s", samples_exponent(&samples[p]), "");
+
+	printf("\n");
+}
+
+void * bench_main(void *) {
+	struct shape_t shapes[] = {
+		{ "balanced", generate_balanced },
+		{ "left deep", generate_left_deep },
+		{ "right deep", generate_right_deep },
+		{ "wide application", generate_wide },
+		{ "many free variables", generate_free },
+	};
+
+	printf("ms per pass and allocations per node\n");
+
+	for(unsigned i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) bench_shape(&shapes[i]);
+
+	return 0;
+}
+
+int main(int argc, char ** argv) {
+	if(argc > 1) max_nodes = strtoul(argv[1], 0, 10);
+
+	// the summary passes and ast_free recurse as deep as the terms
+	pthread_attr_t attributes;
+	pthread_t thread;
+
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, (size_t)4 << 30);
+
+	if(pthread_create(&thread, &attributes, bench_main, 0) != 0) return 1;
+
+	pthread_join(thread, 0);
+	pthread_attr_destroy(&attributes);
+}
@@ -0,0 +1,92 @@
+#include "parser.h"
+#include "typecheck.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Elaborating vectors of length n built with Cons, with the implicit
+// arguments of Cons solved by unification against the arguments written out
+// by hand. The explicit source holds every length, its size and time grow
+// with n^2, the implicit one is linear in n and so should be the checker.
+
+const char * implicit_prelude =
+	"let Nat : Type in "
+	"let Zero : Nat in "
+	"let Succ : Nat -> Nat in "
+	"let Vec : A:Type -> Nat -> Type in "
+	"let Empty : Vec A Zero in "
+	"let Cons : A -> Vec A n -> Vec A (Succ n) in ";
+
+const char * explicit_prelude =
+	"let Nat : Type in "
+	"let Zero : Nat in "
+	"let Succ : Nat -> Nat in "
+	"let Vec : A:Type -> Nat -> Type in "
+	"let Empty : (A:Type) -> Vec A Zero in "
+	"let Cons : (A:Type) -> (n:Nat) -> A -> Vec A n -> Vec A (Succ n) in ";
+
+std::string numeral(unsigned n) {
+	std::string src = "Zero";
+
+	for(unsigned i = 0; i < n; i++) {
+		src = "Succ (" + src + ")";
+	}
+
+	return src;
+}
+
+std::string vector(unsigned n, int implicit) {
+	std::string src = implicit ? "Empty" : "Empty Nat";
+
+	for(unsigned i = 0; i < n; i++) {
+		if(implicit) {
+			src = "(Cons Zero) (" + src + ")";
+		} else {
+			src = "(((Cons Nat) (" + numeral(i) + ")) Zero) (" + src + ")";
+		}
+	}
+
+	return std::string(implicit ? implicit_prelude : explicit_prelude) + "let v : Vec Nat (" + numeral(n) + ") = " + src + ";";
+}
+
+double bench_vector(unsigned n, int implicit, struct typecheck_t * checker, unsigned long * nodes) {
+	std::string src = vector(n, implicit);
+
+	struct ast_t * program = parse(src.c_str());
+
+	*nodes = ast_count_nodes(program);
+
+	double time = bench_best_of(3, [&]() {
+		if(!typecheck_program(checker, program)) {
+			printf("%s\n", checker->error);
+			abort();
+		}
+	});
+
+	ast_free(program);
+
+	return time;
+}
+
+int main() {
+	printf("%6s | %9s %10s | %9s %10s %8s\n", "n", "nodes", "explicit", "nodes", "implicit", "metas");
+
+	for(unsigned n = 100; n <= 1600; n *= 2) {
+		struct typecheck_t checker;
+
+		typecheck_init(&checker);
+
+		unsigned long explicit_nodes;
+		unsigned long implicit_nodes;
+
+		double explicit_time = bench_vector(n, 0, &checker, &explicit_nodes);
+		double implicit_time = bench_vector(n, 1, &checker, &implicit_nodes);
+
+		printf("%6u | %9lu %10.2f | %9lu %10.2f %8u\n", n, explicit_nodes, explicit_time * 1e3, implicit_nodes, implicit_time * 1e3, checker.metas.count);
+
+		typecheck_destroy(&checker);
+	}
+
+	return 0;
+}
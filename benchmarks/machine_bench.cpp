@@ -0,0 +1,102 @@
+#include "parser.h"
+#include "nbe.h"
+#include "machine.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Church numeral arithmetic on the recursive evaluator (nbe.h) and on the lazy
+// machine (machine.h), then 2^k nested applications of the identity, where the
+// evaluator runs out of native stack past k = 13 and the machine only grows its
+// own stacks.
+
+std::string church_numeral(unsigned n) {
+	std::string src = "fn f:t. fn x:t. ";
+
+	for(unsigned i = 0; i < n; i++) src += "f (";
+
+	src += "x";
+
+	for(unsigned i = 0; i < n; i++) src += ")";
+
+	return src;
+}
+
+// the parser groups a b c as a (b c) after the first application
+std::string church_apply(const std::string & f, const std::string & x) {
+	return "(" + f + ") (" + x + ")";
+}
+
+const char * church_operator(const char * op) {
+	if(strcmp(op, "plus") == 0) return "fn m:t. fn n:t. fn f:t. fn x:t. m f (n f x)";
+	if(strcmp(op, "mult") == 0) return "fn m:t. fn n:t. fn f:t. m (n f)";
+	return "fn m:t. fn n:t. n m";
+}
+
+void bench_term(const char * label, const std::string & src, int eager) {
+	struct ast_t * ast = parse(src.c_str());
+
+	double nbe_time = 0;
+
+	if(eager) {
+		nbe_time = bench_best_of(5, [&]() {
+			ast_free(ast_normalize(ast));
+		});
+	}
+
+	struct bytecode_t * code = bytecode_compile(ast);
+
+	struct machine_t machine;
+
+	machine_init(&machine, code);
+
+	double machine_time = bench_best_of(5, [&]() {
+		machine.steps = 0;
+		machine.thunks = 0;
+		ast_free(machine_normalize(&machine));
+	});
+
+	if(eager) {
+		printf("%-16s | %10.1f | %10.1f %10lu %10lu %8u\n", label, nbe_time * 1e6, machine_time * 1e6, machine.steps, machine.thunks, machine.max_stack);
+	} else {
+		printf("%-16s | %10s | %10.1f %10lu %10lu %8u\n", label, "-", machine_time * 1e6, machine.steps, machine.thunks, machine.max_stack);
+	}
+
+	machine_destroy(&machine);
+	bytecode_free(code);
+	ast_free(ast);
+}
+
+void bench_church(const char * op, unsigned a, unsigned b) {
+	char label[64];
+
+	snprintf(label, 64, "%s %u %u", op, a, b);
+
+	bench_term(label, church_apply(church_apply(church_operator(op), church_numeral(a)), church_numeral(b)), 1);
+}
+
+void bench_deep(unsigned k) {
+	char label[64];
+
+	snprintf(label, 64, "id^(2^%u) a", k);
+
+	std::string two_to_k = church_apply(church_apply(church_operator("pow"), church_numeral(2)), church_numeral(k));
+
+	bench_term(label, church_apply(church_apply(two_to_k, "fn z:t. z"), "a"), k <= 12);
+}
+
+int main() {
+	printf("%-16s | %10s | %10s %10s %10s %8s\n", "term", "nbe us", "machine us", "steps", "thunks", "stack");
+
+	bench_church("plus", 1000, 1000);
+	bench_church("mult", 100, 100);
+	bench_church("pow", 2, 10);
+	bench_church("pow", 2, 14);
+
+	for(unsigned k = 8; k <= 22; k += 2) {
+		bench_deep(k);
+	}
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include "name_name_map.h"
+#include "legacy_name_name_map.h"
+#include "bench.h"
+
+#include <stdio.h>
+
+// Compares the swiss table based name_name_map_t against the previous open
+// addressing implementation. Every operation is timed over n distinct names,
+// results are nanoseconds per operation.
+
+struct name_t ** make_names(unsigned n) {
+	struct name_t ** names = (struct name_t**)malloc(sizeof(name_t*) * n);
+
+	char buffer[32];
+
+	for(unsigned i = 0; i < n; i++) {
+		snprintf(buffer, 32, "v%u", i);
+		names[i] = allocate_name(buffer);
+	}
+
+	return names;
+}
+
+struct name_t ** copy_names(struct name_t ** names, unsigned n) {
+	struct name_t ** copies = (struct name_t**)malloc(sizeof(name_t*) * n);
+
+	for(unsigned i = 0; i < n; i++) {
+		copies[i] = name_copy(names[i]);
+	}
+
+	return copies;
+}
+
+volatile unsigned sink = 0;
+
+void bench_size(unsigned n, unsigned rounds) {
+	struct name_t ** names = make_names(n);
+
+	double swiss_add = 0, swiss_get = 0, swiss_rem = 0;
+	double legacy_add = 0, legacy_get = 0, legacy_rem = 0;
+
+	for(unsigned r = 0; r < rounds; r++) {
+		struct name_t ** keys = copy_names(names, n);
+		struct name_t ** vals = copy_names(names, n);
+
+		struct name_name_map_t * map = name_name_map_allocate();
+
+		double t0 = bench_now();
+		for(unsigned i = 0; i < n; i++) name_name_map_add(map, keys[i], vals[i]);
+		double t1 = bench_now();
+		for(unsigned i = 0; i < n; i++) sink += name_name_map_get(map, names[i]) != 0;
+		double t2 = bench_now();
+		for(unsigned i = 0; i < n; i++) name_free(name_name_map_rem(map, names[i]));
+		double t3 = bench_now();
+
+		swiss_add += t1 - t0;
+		swiss_get += t2 - t1;
+		swiss_rem += t3 - t2;
+
+		name_name_map_free(map);
+
+		free(keys);
+		free(vals);
+
+		keys = copy_names(names, n);
+		vals = copy_names(names, n);
+
+		struct legacy_name_name_map_t * legacy = legacy_name_name_map_allocate();
+
+		t0 = bench_now();
+		for(unsigned i = 0; i < n; i++) legacy_name_name_map_add(legacy, keys[i], vals[i]);
+		t1 = bench_now();
+		for(unsigned i = 0; i < n; i++) sink += legacy_name_name_map_get(legacy, names[i]) != 0;
+		t2 = bench_now();
+		for(unsigned i = 0; i < n; i++) {
+			struct name_t * val = legacy_name_name_map_rem(legacy, names[i]);
+			if(val) name_free(val);
+		}
+		t3 = bench_now();
+
+		legacy_add += t1 - t0;
+		legacy_get += t2 - t1;
+		legacy_rem += t3 - t2;
+
+		legacy_name_name_map_free(legacy);
+		free(legacy);
+
+		free(keys);
+		free(vals);
+	}
+
+	double ops = (double)n * rounds / 1e9;
+
+	printf("%9u | %8.1f %8.1f %8.1f | %8.1f %8.1f %8.1f\n", n,
+				 swiss_add / ops, swiss_get / ops, swiss_rem / ops,
+				 legacy_add / ops, legacy_get / ops, legacy_rem / ops);
+
+	for(unsigned i = 0; i < n; i++) name_free(names[i]);
+
+	free(names);
+}
+
+int main() {
+	printf("ns per operation\n");
+	printf("%9s | %8s %8s %8s | %8s %8s %8s\n", "entries", "add", "get", "rem", "old add", "old get", "old rem");
+
+	bench_size(4, 200000);
+	bench_size(64, 20000);
+	bench_size(1024, 1000);
+	bench_size(16384, 50);
+	bench_size(262144, 3);
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+#include "parser.h"
+#include "nbe.h"
+#include "normal_form_cache.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+// Type level computation that normalizes the same shapes over and over, every
+// definition has the type Vec A (id^(2^k) (Succ n)) for one of a few k, computed
+// on Church numerals and written with different binder names each time. The
+// normal forms are small and take thousands of steps. Normalized without a
+// cache, with a cache shared by the threads, and with a cache too small to hold
+// every shape.
+
+std::string church_numeral(const char * f, const char * x, unsigned n) {
+	std::string src = std::string("fn ") + f + ":t. fn " + x + ":t. ";
+
+	for(unsigned i = 0; i < n; i++) src += std::string(f) + " (";
+
+	src += x;
+
+	for(unsigned i = 0; i < n; i++) src += ")";
+
+	return src;
+}
+
+// the parser groups a b c as a (b c) after the first application
+std::string church_apply(const std::string & f, const std::string & x) {
+	return "(" + f + ") (" + x + ")";
+}
+
+std::string type_program(unsigned definitions, unsigned shapes) {
+	std::string src = "let Nat : Type in let Succ : Nat -> Nat in let Vec : (A:Type) -> Nat -> Type in\n";
+
+	for(unsigned i = 0; i < definitions; i++) {
+		std::string m = "m" + std::to_string(i);
+		std::string n = "n" + std::to_string(i);
+
+		std::string pow = "(fn " + m + ":t. fn " + n + ":t. " + n + " " + m + ")";
+
+		std::string nat = church_apply(church_apply(church_apply(pow, church_numeral("f", "x", 2)), church_numeral("g", "y", 10 + i % shapes)), "fn z:t. z");
+
+		src += "let v" + std::to_string(i) + " : Vec A (" + church_apply(nat, "Succ n") + ")";
+		src += i + 1 == definitions ? ";" : " in\n";
+	}
+
+	return src;
+}
+
+void bench_cache(const char * label, struct ast_t * program, unsigned threads, unsigned repetitions, unsigned long max_entries, int cached) {
+	struct normal_form_cache_t cache;
+
+	normal_form_cache_init(&cache, max_entries, 0);
+
+	double start = bench_now();
+
+	auto worker = [&]() {
+		struct nbe_t nbe;
+
+		nbe_init(&nbe);
+
+		if(cached) nbe.cache = &cache;
+
+		for(unsigned i = 0; i < repetitions; i++) {
+			ast_free(nbe_normalize(&nbe, program));
+		}
+
+		nbe_destroy(&nbe);
+	};
+
+	std::thread * workers = new std::thread[threads];
+
+	for(unsigned i = 0; i < threads; i++) {
+		workers[i] = std::thread(worker);
+	}
+
+	for(unsigned i = 0; i < threads; i++) {
+		workers[i].join();
+	}
+
+	delete[] workers;
+
+	double elapsed = bench_now() - start;
+
+	printf("%-22s %2u threads | %9.1f ms | hit rate %.3f, %lu evictions\n", label, threads, elapsed * 1e3,
+				 normal_form_cache_hit_rate(&cache), cache.evictions.load());
+
+	normal_form_cache_destroy(&cache);
+}
+
+int main() {
+	std::string src = type_program(100, 4);
+
+	struct ast_t * program = parse(src.c_str());
+
+	for(unsigned threads = 1; threads <= 4; threads *= 2) {
+		bench_cache("no cache", program, threads, 5, 0, 0);
+		bench_cache("cache", program, threads, 5, 0, 1);
+		bench_cache("cache, 8 entries", program, threads, 5, 8, 1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include "parser.h"
+#include "nbe.h"
+#include "parallel_normalize.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Wide terms normalized by the evaluator (nbe.h) and by the parallel normalizer
+// at several thread counts: a variable applied to many independent Church
+// products, and a chain of non dependent arrows whose sides are products.
+
+std::string church_numeral(unsigned n) {
+	std::string src = "fn f:t. fn x:t. ";
+
+	for(unsigned i = 0; i < n; i++) src += "f (";
+
+	src += "x";
+
+	for(unsigned i = 0; i < n; i++) src += ")";
+
+	return src;
+}
+
+// the parser groups a b c as a (b c) after the first application
+std::string church_apply(const std::string & f, const std::string & x) {
+	return "(" + f + ") (" + x + ")";
+}
+
+std::string church_mult(unsigned a, unsigned b) {
+	return church_apply(church_apply("fn m:t. fn n:t. fn f:t. m (n f)", church_numeral(a)), church_numeral(b));
+}
+
+// k (a0 * b) (a1 * b) ..., a different product per argument
+std::string wide_app(unsigned width, unsigned size) {
+	std::string src = "k";
+
+	for(unsigned i = 0; i < width; i++) {
+		src = church_apply(src, church_mult(size + i % 4, size));
+	}
+
+	return src;
+}
+
+// fn k:(a0 * b) -> (a1 * b) -> ... -> T. k, arrows are only parsed in types
+std::string wide_arrow(unsigned width, unsigned size) {
+	std::string src = "T";
+
+	for(unsigned i = 0; i < width; i++) {
+		src = "(" + church_mult(size + i % 4, size) + ") -> " + src;
+	}
+
+	return "fn k:" + src + ". k";
+}
+
+void bench_wide(const char * label, const std::string & src) {
+	struct ast_t * ast = parse(src.c_str());
+
+	double sequential = bench_best_of(3, [&]() {
+		ast_free(ast_normalize(ast));
+	});
+
+	printf("%-20s | %10.1f |", label, sequential * 1e3);
+
+	unsigned thread_counts[] = { 1, 2, 4, 8 };
+
+	unsigned long spawned = 0;
+	unsigned long stolen = 0;
+
+	for(unsigned t = 0; t < 4; t++) {
+		struct parallel_normalize_t normalizer;
+
+		parallel_normalize_init(&normalizer, thread_counts[t], 0);
+
+		double parallel = bench_best_of(3, [&]() {
+			ast_free(parallel_normalize(&normalizer, ast));
+		});
+
+		spawned = normalizer.pool.spawned;
+		stolen = normalizer.pool.stolen;
+
+		parallel_normalize_destroy(&normalizer);
+
+		printf(" %8.1f", parallel * 1e3);
+	}
+
+	printf(" | %8lu %8lu\n", spawned / 3, stolen / 3);
+
+	ast_free(ast);
+}
+
+int main() {
+	printf("%-20s | %10s | %8s %8s %8s %8s | %8s %8s\n", "term", "nbe ms", "1", "2", "4", "8", "tasks", "steals");
+
+	bench_wide("app 16 x 40*40", wide_app(16, 40));
+	bench_wide("app 64 x 40*40", wide_app(64, 40));
+	bench_wide("app 16 x 100*100", wide_app(16, 100));
+	bench_wide("arrow 16 x 40*40", wide_arrow(16, 40));
+	bench_wide("arrow 64 x 40*40", wide_arrow(64, 40));
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include "parser.h"
+#include "typecheck.h"
+#include "parallel_typecheck.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Libraries of many definitions in shallow dependency graphs, checked by
+// typecheck_program and by the definition graph scheduler at several thread
+// counts. Every definition of a layer uses two definitions of the layer below.
+
+const char * prelude =
+	"let Nat : Type in "
+	"let Zero : Nat in "
+	"let Succ : Nat -> Nat in "
+	"let first : (A:Type) -> A -> A -> A = fn A:Type. fn x:A. fn y:A. x in ";
+
+// the lexer keeps identifiers of up to 7 characters
+std::string definition_name(unsigned layer, unsigned width, unsigned i) {
+	return "d" + std::to_string(layer * width + i);
+}
+
+std::string library(unsigned layers, unsigned width) {
+	std::string src = prelude;
+
+	for(unsigned layer = 0; layer < layers; layer++) {
+		for(unsigned i = 0; i < width; i++) {
+			src += "let " + definition_name(layer, width, i) + " : Nat -> Nat = fn x:Nat. ";
+
+			if(layer == 0) {
+				src += "Succ (Succ x)";
+			} else {
+				std::string a = definition_name(layer - 1, width, i);
+				std::string b = definition_name(layer - 1, width, (i * 7 + 1) % width);
+
+				src += "((first Nat) (" + a + " x)) (" + b + " (Succ x))";
+			}
+
+			src += layer + 1 < layers || i + 1 < width ? " in " : ";";
+		}
+	}
+
+	return src;
+}
+
+void bench_library(unsigned layers, unsigned width) {
+	std::string src = library(layers, width);
+
+	struct ast_t * program = parse(src.c_str());
+
+	struct typecheck_t sequential;
+
+	typecheck_init(&sequential);
+
+	double sequential_time = bench_best_of(3, [&]() {
+		if(!typecheck_program(&sequential, program)) abort();
+	});
+
+	typecheck_destroy(&sequential);
+
+	printf("%6u x %-5u | %10.1f |", layers, width, sequential_time * 1e3);
+
+	unsigned thread_counts[] = { 1, 2, 4, 8 };
+
+	unsigned long edges = 0;
+	unsigned depth = 0;
+
+	for(unsigned t = 0; t < 4; t++) {
+		struct parallel_typecheck_t checker;
+
+		parallel_typecheck_init(&checker, thread_counts[t]);
+
+		double parallel_time = bench_best_of(3, [&]() {
+			if(!parallel_typecheck_program(&checker, program)) abort();
+		});
+
+		edges = checker.graph.edges;
+		depth = checker.graph.depth;
+
+		parallel_typecheck_destroy(&checker);
+
+		printf(" %8.1f", parallel_time * 1e3);
+	}
+
+	printf(" | %8lu %6u\n", edges, depth);
+
+	ast_free(program);
+}
+
+int main() {
+	printf("%-14s | %10s | %8s %8s %8s %8s | %8s %6s\n", "layers x width", "seq ms", "1", "2", "4", "8", "edges", "depth");
+
+	bench_library(4, 1000);
+	bench_library(4, 12500);
+	bench_library(50, 1000);
+
+	return 0;
+}
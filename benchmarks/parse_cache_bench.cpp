@@ -0,0 +1,61 @@
+#include "ast_cache.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// Parsing and hashing a program against reading it from a warm parse cache,
+// and the cost of a miss, which also writes the entry.
+
+std::string program(unsigned lets) {
+	std::string src;
+
+	for(unsigned i = 0; i < lets; i++) {
+		src += "let f" + std::to_string(i) + " : Nat -> Nat -> Nat = fn x:Nat. fn y:Nat. (add (mul x y)) (succ (add x (mul y x))) in ";
+	}
+
+	return src + "let end : Nat = zero;";
+}
+
+int main() {
+	char directory[] = "/tmp/parse_cache_bench_XXXXXX";
+
+	if(mkdtemp(directory) == 0) return 1;
+
+	printf("   lets  source KB | parse+hash ms   miss ms    hit ms\n");
+
+	for(unsigned lets = 1000; lets <= 64000; lets *= 4) {
+		std::string src = program(lets);
+
+		struct ast_cache_t cache;
+
+		ast_cache_init(&cache, directory);
+
+		double parsed = bench_best_of(3, [&]() {
+			struct ast_t * ast = parse(src.c_str());
+
+			ast_hash(ast);
+			ast_free(ast);
+		});
+
+		char * entry = ast_cache_path(&cache, ast_cache_key(src.c_str(), src.size()));
+
+		double missed = bench_best_of(3, [&]() {
+			remove(entry);
+			ast_free(ast_cache_parse(&cache, src.c_str()));
+		});
+
+		double hit = bench_best_of(3, [&]() {
+			ast_free(ast_cache_parse(&cache, src.c_str()));
+		});
+
+		printf("%7u %10.0f | %13.2f %9.2f %9.2f\n", lets, src.size() / 1e3, parsed * 1e3, missed * 1e3, hit * 1e3);
+
+		remove(entry);
+		memory_free(entry);
+		ast_cache_destroy(&cache);
+	}
+
+	rmdir(directory);
+}
@@ -0,0 +1,83 @@
+#include "parser.h"
+#include "ast_printer.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <fcntl.h>
+
+// ast_print against the buffered printer on programs of lets, both writing to
+// /dev/null, and the buffered printer alone into a reused buffer. Throughput
+// is the printed text over the best time.
+
+std::string program(unsigned lets) {
+	std::string src;
+
+	for(unsigned i = 0; i < lets; i++) {
+		src += "let f" + std::to_string(i) + " : Nat -> Nat -> Nat = fn x:Nat. fn y:Nat. (add (mul x y)) (succ (add x (mul y x))) in ";
+	}
+
+	return src + "let end : Nat = zero;";
+}
+
+unsigned ast_count(struct ast_t * ast) {
+	if(ast == 0) return 0;
+
+	return 1 + ast_count(ast->lhs) + ast_count(ast->rhs);
+}
+
+int main() {
+	int null = open("/dev/null", O_WRONLY);
+	FILE * null_file = fdopen(dup(null), "w");
+
+	printf("  nodes      MB | print MB/s  file MB/s  buffer MB/s\n");
+
+	for(unsigned lets = 1000; lets <= 64000; lets *= 4) {
+		struct ast_t * ast = parse(program(lets).c_str());
+
+		struct ast_printer_t printer;
+		struct byte_buffer_t buffer;
+
+		ast_printer_init(&printer, 0);
+		byte_buffer_init(&buffer);
+
+		ast_printer_print(&printer, &buffer, ast);
+
+		double megabytes = buffer.size / 1e6;
+
+		// ast_print writes to stdout, pointed at /dev/null meanwhile
+		fflush(stdout);
+
+		int saved = dup(1);
+
+		dup2(null, 1);
+
+		double print = bench_best_of(3, [&]() {
+			ast_print(ast);
+			fflush(stdout);
+		});
+
+		dup2(saved, 1);
+		close(saved);
+
+		double file = bench_best_of(3, [&]() {
+			ast_print_file(null_file, ast, 0);
+			fflush(null_file);
+		});
+
+		double in_buffer = bench_best_of(3, [&]() {
+			buffer.size = 0;
+			ast_printer_print(&printer, &buffer, ast);
+		});
+
+		printf("%7u %7.2f | %10.1f %10.1f %12.1f\n", ast_count(ast), megabytes, megabytes / print, megabytes / file, megabytes / in_buffer);
+
+		byte_buffer_destroy(&buffer);
+		ast_printer_destroy(&printer);
+		ast_free(ast);
+	}
+
+	fclose(null_file);
+	close(null);
+}
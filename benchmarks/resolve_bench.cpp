@@ -0,0 +1,110 @@
+#include "parser.h"
+#include "alpha_equivalence.h"
+#include "reduction.h"
+#include "resolve.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Named terms against the same terms resolved once to de Bruijn indices and
+// symbols (resolve.h): alpha equivalence and hashing of n nested binders whose
+// body uses all of them, where the named versions search the binder stack for
+// every variable, then normal order reduction of Church arithmetic.
+
+// fn v0:t. ... fn vn-1:t. v0 (v1 (... vn-1)), binders named with prefix
+std::string nested_binders(const char * prefix, unsigned n) {
+	std::string src;
+
+	for(unsigned i = 0; i < n; i++) src += "fn " + (prefix + std::to_string(i)) + ":t. ";
+
+	for(unsigned i = 0; i + 1 < n; i++) src += prefix + std::to_string(i) + " (";
+
+	src += prefix + std::to_string(n - 1);
+
+	for(unsigned i = 0; i + 1 < n; i++) src += ")";
+
+	return src;
+}
+
+std::string church_numeral(unsigned n) {
+	std::string src = "fn f:t. fn x:t. ";
+
+	for(unsigned i = 0; i < n; i++) src += "f (";
+
+	src += "x";
+
+	for(unsigned i = 0; i < n; i++) src += ")";
+
+	return src;
+}
+
+// the parser groups a b c as a (b c) after the first application
+std::string church_apply(const std::string & f, const std::string & x) {
+	return "(" + f + ") (" + x + ")";
+}
+
+void bench_compare(unsigned n) {
+	std::string a_src = nested_binders("v", n);
+	std::string b_src = nested_binders("w", n);
+
+	struct ast_t * a = parse(a_src.c_str());
+	struct ast_t * b = parse(b_src.c_str());
+
+	struct ast_t * a_resolved = parse_resolved(a_src.c_str());
+	struct ast_t * b_resolved = parse_resolved(b_src.c_str());
+
+	int equal = 0;
+	unsigned tags = 0;
+
+	double named_equal = bench_best_of(5, [&]() { equal += ast_alpha_equivalent(a, b); });
+	double resolved_equal = bench_best_of(5, [&]() { equal += ast_resolved_equal(a_resolved, b_resolved); });
+	double named_hash = bench_best_of(5, [&]() { tags += ast_de_bruijn_hash(a).crc32; });
+	double resolved_hash = bench_best_of(5, [&]() { tags += ast_resolved_hash(a_resolved).crc32; });
+	double resolve = bench_best_of(5, [&]() { ast_resolve(a_resolved); });
+
+	printf("%-16u | %10.1f %10.1f | %10.1f %10.1f | %10.1f %s\n", n, named_equal * 1e6, resolved_equal * 1e6, named_hash * 1e6, resolved_hash * 1e6, resolve * 1e6, equal == 10 ? "" : "!");
+
+	ast_free(a);
+	ast_free(b);
+	ast_free(a_resolved);
+	ast_free(b_resolved);
+}
+
+void bench_reduce(const char * op_src, const char * op, unsigned m, unsigned n) {
+	std::string src = church_apply(church_apply(op_src, church_numeral(m)), church_numeral(n));
+
+	unsigned long named_steps = 0;
+	unsigned long resolved_steps = 0;
+
+	double named = bench_best_of(3, [&]() {
+		named_steps = 0;
+		ast_free(ast_reduce(parse(src.c_str()), &named_steps));
+	});
+
+	double resolved = bench_best_of(3, [&]() {
+		resolved_steps = 0;
+		ast_free(ast_resolved_reduce(parse_resolved(src.c_str()), &resolved_steps));
+	});
+
+	printf("%-5s %4u %4u | %10.1f %10.1f | %10lu %10lu\n", op, m, n, named * 1e3, resolved * 1e3, named_steps, resolved_steps);
+}
+
+int main() {
+	printf("%-16s | %10s %10s | %10s %10s | %10s\n", "binders", "alpha us", "indices us", "named hash", "index hash", "resolve us");
+
+	for(unsigned n = 250; n <= 4000; n *= 2) {
+		bench_compare(n);
+	}
+
+	printf("\n%-15s | %10s %10s | %10s %10s\n", "term", "named ms", "indices ms", "steps", "steps");
+
+	const char * plus = "fn m:t. fn n:t. fn f:t. fn x:t. m f (n f x)";
+	const char * mult = "fn m:t. fn n:t. fn f:t. m (n f)";
+
+	bench_reduce(plus, "plus", 500, 500);
+	bench_reduce(mult, "mult", 30, 30);
+	bench_reduce(mult, "mult", 60, 60);
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "parser.h"
+#include "ast_hash.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Allocations and time of parsing and hashing typical programs, a chain of
+// definitions of small lambdas referring to previous definitions. Built twice,
+// with the inline small map storage (small_map_bench) and without it
+// (small_map_bench_no_inline, SWISS_SMALL_CAPACITY=0).
+
+std::string typical_program(unsigned definitions) {
+	std::string src;
+
+	char buffer[256];
+
+	for(unsigned i = 0; i < definitions; i++) {
+		unsigned f = i ? i / 2 : 0;
+		unsigned g = i ? i - 1 : 0;
+
+		snprintf(buffer, 256, "let f%u : t -> t = fn x:a. fn y:b. (f%u x) (f%u (g y x))", i, f, g);
+
+		src += buffer;
+		src += i + 1 == definitions ? ";" : " in\n";
+	}
+
+	return src;
+}
+
+unsigned count_nodes(struct ast_t * ast) {
+	return ast ? 1 + count_nodes(ast->lhs) + count_nodes(ast->rhs) : 0;
+}
+
+void bench_program(unsigned definitions) {
+	std::string src = typical_program(definitions);
+
+	unsigned long before = memory_allocation_count();
+	double t0 = bench_now();
+
+	struct ast_t * ast = parse(src.c_str());
+
+	double t1 = bench_now();
+	unsigned long parse_allocations = memory_allocation_count() - before;
+
+	before = memory_allocation_count();
+	ast_hash(ast);
+	double t2 = bench_now();
+	unsigned long hash_allocations = memory_allocation_count() - before;
+
+	before = memory_allocation_count();
+	ast_hash_summaries(ast);
+	double t3 = bench_now();
+	unsigned long summaries_allocations = memory_allocation_count() - before;
+
+	double nodes = count_nodes(ast);
+
+	printf("%7u %9.0f | %8.2f %8.1f | %8.2f %8.1f | %8.2f %8.1f\n", definitions, nodes,
+				 parse_allocations / nodes, (t1 - t0) * 1e9 / nodes,
+				 hash_allocations / nodes, (t2 - t1) * 1e9 / nodes,
+				 summaries_allocations / nodes, (t3 - t2) * 1e9 / nodes);
+}
+
+int main() {
+	printf("inline map capacity: %u\n", SWISS_SMALL_CAPACITY);
+	printf("allocations and ns per node\n");
+	printf("%7s %9s | %8s %8s | %8s %8s | %8s %8s\n", "defs", "nodes", "parse", "ns", "ast_hash", "ns", "summary", "ns");
+
+	bench_program(10);
+	bench_program(100);
+	bench_program(1000);
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "static_parser.h"
+#include "bench.h"
+
+#include <stdio.h>
+
+// A prelude of 256 lets as a string parsed and hashed at startup, against the
+// same prelude parsed and hashed when compiling and only built into an ast at
+// startup. The allocations are counted once, with the frees, the times are the
+// best of 20 and leave the frees out.
+
+#define PRELUDE_LET(n) "let f" #n " : Nat -> Nat -> Nat = fn x:Nat. fn y:Nat. (add (mul x y)) (succ (add x y)) in\n"
+#define PRELUDE_LETS_4(n) PRELUDE_LET(n##0) PRELUDE_LET(n##1) PRELUDE_LET(n##2) PRELUDE_LET(n##3)
+#define PRELUDE_LETS_16(n) PRELUDE_LETS_4(n##0) PRELUDE_LETS_4(n##1) PRELUDE_LETS_4(n##2) PRELUDE_LETS_4(n##3)
+#define PRELUDE_LETS_64(n) PRELUDE_LETS_16(n##0) PRELUDE_LETS_16(n##1) PRELUDE_LETS_16(n##2) PRELUDE_LETS_16(n##3)
+#define PRELUDE_LETS_256 PRELUDE_LETS_64(0) PRELUDE_LETS_64(1) PRELUDE_LETS_64(2) PRELUDE_LETS_64(3)
+
+#define PRELUDE PRELUDE_LETS_256 "let end : Nat = zero;"
+
+constexpr auto prelude = STATIC_PARSE_HASHED(PRELUDE);
+
+// best time of build over 20 runs, the ast is freed out of the timing
+template<typename F>
+double time_build(F build) {
+	double best = 1e300;
+
+	for(unsigned i = 0; i < 20; i++) {
+		double start = bench_now();
+		struct ast_t * ast = build();
+		double elapsed = bench_now() - start;
+
+		ast_free(ast);
+
+		if(elapsed < best) best = elapsed;
+	}
+
+	return best;
+}
+
+int main() {
+	auto parse_and_hash = []() {
+		struct ast_t * ast = parse(PRELUDE);
+		ast_hash(ast);
+		return ast;
+	};
+
+	auto build = []() { return static_program_ast(&prelude); };
+
+	unsigned long before = memory_allocation_count();
+
+	ast_free(parse_and_hash());
+
+	unsigned long parse_allocations = memory_allocation_count() - before;
+
+	before = memory_allocation_count();
+
+	ast_free(build());
+
+	unsigned long static_allocations = memory_allocation_count() - before;
+
+	double parse_time = time_build(parse_and_hash);
+	double static_time = time_build(build);
+
+	printf("%u nodes, %u bytes of source, %u bytes of table\n", prelude.size, (unsigned)sizeof(PRELUDE), (unsigned)sizeof(prelude));
+	printf("              ms  allocations\n");
+	printf("parse+hash %7.3f  %11lu\n", parse_time * 1e3, parse_allocations);
+	printf("static     %7.3f  %11lu\n", static_time * 1e3, static_allocations);
+}
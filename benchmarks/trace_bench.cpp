@@ -0,0 +1,65 @@
+#include "parser.h"
+#include "ast_hash.h"
+#include "nbe.h"
+#include "trace.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// The front end and a normalization on a program of lets: parse, the fused
+// ast_hash, the summary passes one by one and nbe_normalize. Built twice, as
+// trace_bench with TRACE=1 and as trace_bench_off, the difference of their
+// times is the overhead of the spans. trace_bench [file] writes the trace of
+// the last round to file as Chrome trace events. The sizes are small because
+// summary_hash_free_variables is quadratic on the chain of lets.
+
+std::string program(unsigned lets) {
+	std::string src;
+
+	for(unsigned i = 0; i < lets; i++) {
+		src += "let f" + std::to_string(i) + " : t = fn x:t. fn y:t. (x (y x)) (fn z:t. z y) in ";
+	}
+
+	return src + "let end : t = f0;";
+}
+
+void round(const std::string & src) {
+	struct ast_t * ast = parse(src.c_str());
+
+	ast_hash(ast);
+
+	struct summary_t * summary = summaryse(ast);
+
+	summary_hash_structure(summary);
+	summary_hash_free_variables(summary);
+	summary_free(summary);
+
+	ast_free(ast_normalize(ast));
+	ast_free(ast);
+}
+
+int main(int argc, char ** argv) {
+	printf("tracing %s\n", TRACE ? "on" : "off");
+	printf("   lets | round ms  spans\n");
+
+	for(unsigned lets = 125; lets <= 1000; lets *= 2) {
+		std::string src = program(lets);
+
+		double best = bench_best_of(3, [&]() {
+			trace_clear();
+			round(src);
+		});
+
+		printf("%7u | %8.2f %6llu\n", lets, best * 1e3, trace_count());
+	}
+
+	if(argc > 1) {
+		FILE * out = fopen(argv[1], "w");
+
+		if(out == 0) return 1;
+
+		trace_write_json(out);
+		fclose(out);
+	}
+}
@@ -0,0 +1,87 @@
+#include "parser.h"
+#include "typecheck.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+// Type checking programs with many copies of the same definition body, with
+// and without the inference memo of typecheck.h. Without it the time follows
+// the number of nodes, with it the number of distinct subterms.
+
+const char * prelude =
+	"let Nat : Type in "
+	"let Zero : Nat in "
+	"let Succ : Nat -> Nat in "
+	"let id : (A:Type) -> A -> A = fn A:Type. fn x:A. x in "
+	"let first : (A:Type) -> A -> A -> A = fn A:Type. fn x:A. fn y:A. x in ";
+
+// (id Nat) (((first Nat) (... (Succ Zero))) Zero), depth applications
+std::string nested(unsigned depth) {
+	std::string src = "Succ Zero";
+
+	for(unsigned i = 0; i < depth; i++) {
+		src = i % 2 ? "(id Nat) (" + src + ")" : "((first Nat) (" + src + ")) Zero";
+	}
+
+	return src;
+}
+
+std::string duplicated(unsigned definitions, unsigned depth) {
+	std::string src = prelude;
+	std::string body = nested(depth);
+
+	for(unsigned i = 0; i < definitions; i++) {
+		src += "let v" + std::to_string(i) + " : Nat = " + body;
+		src += i + 1 < definitions ? " in " : ";";
+	}
+
+	return src;
+}
+
+void bench_program(unsigned definitions, unsigned depth) {
+	std::string src = duplicated(definitions, depth);
+
+	struct ast_t * program = parse(src.c_str());
+
+	double times[2];
+
+	struct typecheck_t checkers[2];
+
+	for(unsigned memoize = 0; memoize < 2; memoize++) {
+		struct typecheck_t * checker = &checkers[memoize];
+
+		typecheck_init(checker);
+
+		checker->memoize = memoize;
+
+		times[memoize] = bench_best_of(3, [&]() {
+			if(!typecheck_program(checker, program)) {
+				printf("%s\n", checker->error);
+				abort();
+			}
+		});
+	}
+
+	unsigned long lookups = checkers[1].memo_hits + checkers[1].memo_misses;
+
+	printf("%6u x %-4u | %9lu | %10.2f %10.2f | %8.3f\n", definitions, depth, ast_count_nodes(program),
+		times[0] * 1e3, times[1] * 1e3, lookups ? (double)checkers[1].memo_hits / lookups : 0.0);
+
+	typecheck_destroy(&checkers[0]);
+	typecheck_destroy(&checkers[1]);
+
+	ast_free(program);
+}
+
+int main() {
+	printf("%-13s | %9s | %10s %10s | %8s\n", "defs x depth", "nodes", "plain ms", "memo ms", "hit rate");
+
+	bench_program(10, 16);
+	bench_program(100, 16);
+	bench_program(1000, 16);
+	bench_program(100, 64);
+	bench_program(1000, 64);
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "unit.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// A chain of units, each importing the previous one, against checking the
+// same definitions as one program. A clean build compiles every unit, the
+// rebuilds after editing the value of a definition of the first unit compile
+// that unit only, and those after adding a definition to it compile them all.
+
+// unit i defines b<i> from the b of the previous unit, and count functions
+// that apply it
+std::string definitions(unsigned i, unsigned count) {
+	std::string b = "b" + std::to_string(i);
+	std::string previous = i == 0 ? "Succ" : "b" + std::to_string(i - 1);
+
+	std::string src = "let " + b + " : Nat -> Nat = fn x:Nat. Succ (" + previous + " x) in ";
+
+	for(unsigned k = i * count; k < (i + 1) * count; k++) {
+		src += "let f" + std::to_string(k) + " : Nat -> Nat = fn x:Nat. " + b + " (Succ x) in ";
+	}
+
+	return src;
+}
+
+const char * prelude = "let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in ";
+
+// the source of unit i, the extra text goes in the first unit
+std::string unit_source(unsigned i, unsigned size, const std::string & extra) {
+	std::string src = i == 0 ? std::string(prelude) + extra : "";
+
+	return src + definitions(i, size) + "let u" + std::to_string(i) + " : Nat = Zero;";
+}
+
+double timed_run(struct build_t * build) {
+	double start = bench_now();
+
+	if(!build_run(build)) {
+		build_report(build, stdout);
+		abort();
+	}
+
+	return bench_now() - start;
+}
+
+int main() {
+	const unsigned size = 200;
+
+	printf("%6s %6s | %9s %9s %9s %9s %9s | %9s\n", "units", "defs", "clean ms", "noop ms", "value ms", "compiled", "sig ms", "whole ms");
+
+	for(unsigned units = 4; units <= 32; units *= 2) {
+		char directory[] = "/tmp/unit_bench_XXXXXX";
+
+		if(!mkdtemp(directory)) abort();
+
+		struct build_t build;
+
+		build_init(&build, directory);
+
+		std::string whole;
+
+		for(unsigned i = 0; i < units; i++) {
+			std::string src = unit_source(i, size, "");
+
+			build_add_unit(&build, ("u" + std::to_string(i)).c_str(), src.c_str());
+
+			if(i > 0) build_import(&build, i, i - 1);
+
+			whole += src.substr(0, src.size() - 1) + " in ";
+		}
+
+		whole += "let end : Nat = Zero;";
+
+		double clean = timed_run(&build);
+		double noop = timed_run(&build);
+
+		build_set_source(&build, 0, unit_source(0, size, "let v : Nat = Succ Zero in ").c_str());
+		timed_run(&build);
+
+		build_set_source(&build, 0, unit_source(0, size, "let v : Nat = Succ (Succ Zero) in ").c_str());
+		double value = timed_run(&build);
+		unsigned compiled = build.compiled;
+
+		build_set_source(&build, 0, unit_source(0, size, "let v : Nat = Zero in let v2 : Nat = Zero in ").c_str());
+		double signature = timed_run(&build);
+
+		struct typecheck_t checker;
+
+		typecheck_init(&checker);
+
+		struct ast_t * program = parse(whole.c_str());
+
+		double whole_time = bench_best_of(3, [&]() {
+			if(!typecheck_program(&checker, program)) {
+				printf("%s\n", checker.error);
+				abort();
+			}
+		});
+
+		printf("%6u %6u | %9.2f %9.2f %9.2f %9u %9.2f | %9.2f\n", units, units * size, clean * 1e3, noop * 1e3, value * 1e3, compiled, signature * 1e3, whole_time * 1e3);
+
+		ast_free(program);
+		typecheck_destroy(&checker);
+
+		for(unsigned i = 0; i < units; i++) {
+			std::string path = std::string(directory) + "/u" + std::to_string(i) + ".unit";
+			remove(path.c_str());
+		}
+
+		rmdir(directory);
+
+		build_destroy(&build);
+	}
+
+	return 0;
+}
@@ -0,0 +1,467 @@
+#ifndef ALPHA_EQUIVALENCE_H
+#define ALPHA_EQUIVALENCE_H
+
+#include "ast.h"
+#include "ast_hash.h"
+#include "ast_serialize.h"
+#include "byte_buffer.h"
+#include "memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Exact alpha-equivalence
+//
+// Bound variables are compared by their de Bruijn indices and free variables by
+// their names. As in ast_hash, LAMBDA and ARROW_TYPE nodes whose lhs is a BIND
+// are the binders and their scope is the whole node.
+
+typedef struct binder_stack_t {
+	unsigned size;
+	unsigned capacity;
+
+	struct name_t ** names;
+} binder_stack_t;
+
+void binder_stack_init(struct binder_stack_t * stack) {
+	stack->size = 0;
+	stack->capacity = 16;
+	stack->names = (struct name_t**)memory_alloc(sizeof(name_t*) * stack->capacity);
+}
+
+void binder_stack_destroy(struct binder_stack_t * stack) {
+	memory_free(stack->names);
+}
+
+void binder_stack_push(struct binder_stack_t * stack, struct name_t * name) {
+	if(stack->size == stack->capacity) {
+		stack->capacity *= 2;
+		stack->names = (struct name_t**)memory_realloc(stack->names, sizeof(name_t*) * stack->capacity);
+	}
+
+	stack->names[stack->size++] = name;
+}
+
+void binder_stack_pop(struct binder_stack_t * stack) {
+	stack->size -= 1;
+}
+
+// de Bruijn index of the innermost binder of name, -1 if name is free
+int binder_stack_index_of(struct binder_stack_t * stack, struct name_t * name) {
+	for(unsigned i = stack->size; i > 0; i--) {
+		struct name_t * bound = stack->names[i - 1];
+
+		if(bound->hash.crc32 == name->hash.crc32 && strcmp(bound->identifier, name->identifier) == 0) {
+			return stack->size - i;
+		}
+	}
+
+	return -1;
+}
+
+int ast_alpha_equivalent(struct ast_t * a, struct ast_t * b, struct binder_stack_t * a_binders, struct binder_stack_t * b_binders) {
+	if(a == 0 || b == 0) return a == b;
+
+	if(a->kind != b->kind) return 0;
+
+	if(a->kind == VAR) {
+		int a_index = binder_stack_index_of(a_binders, a->name);
+		int b_index = binder_stack_index_of(b_binders, b->name);
+
+		if(a_index != b_index) return 0;
+
+		if(a_index != -1) return 1;
+
+		return strcmp(a->name->identifier, b->name->identifier) == 0;
+	}
+
+	if(a->kind == CASE) {
+		unsigned count = ast_case_variables(a);
+
+		if(ast_case_variables(b) != count) return 0;
+
+		ast_pattern_foreach_variable(a->lhs, [&](struct ast_t * x) { binder_stack_push(a_binders, x->name); });
+		ast_pattern_foreach_variable(b->lhs, [&](struct ast_t * x) { binder_stack_push(b_binders, x->name); });
+
+		int equivalent = ast_alpha_equivalent(a->lhs, b->lhs, a_binders, b_binders) && ast_alpha_equivalent(a->rhs, b->rhs, a_binders, b_binders);
+
+		a_binders->size -= count;
+		b_binders->size -= count;
+
+		return equivalent;
+	}
+
+	struct name_t * a_bound = ast_bound_name(a);
+	struct name_t * b_bound = ast_bound_name(b);
+
+	if((a_bound == 0) != (b_bound == 0)) return 0;
+
+	if(a_bound) {
+		binder_stack_push(a_binders, a_bound);
+		binder_stack_push(b_binders, b_bound);
+	}
+
+	int equivalent = ast_alpha_equivalent(a->lhs, b->lhs, a_binders, b_binders) && ast_alpha_equivalent(a->rhs, b->rhs, a_binders, b_binders);
+
+	if(a_bound) {
+		binder_stack_pop(a_binders);
+		binder_stack_pop(b_binders);
+	}
+
+	return equivalent;
+}
+
+int ast_alpha_equivalent(struct ast_t * a, struct ast_t * b) {
+	struct binder_stack_t a_binders;
+	struct binder_stack_t b_binders;
+
+	binder_stack_init(&a_binders);
+	binder_stack_init(&b_binders);
+
+	int equivalent = ast_alpha_equivalent(a, b, &a_binders, &b_binders);
+
+	binder_stack_destroy(&a_binders);
+	binder_stack_destroy(&b_binders);
+
+	return equivalent;
+}
+
+// Hash of the de Bruijn form of ast, independent from ast_hash. Alpha-equivalent
+// terms always agree on it, so it is used to find the candidates of a class.
+struct hash_t ast_de_bruijn_hash(struct ast_t * ast, struct binder_stack_t * binders) {
+	if(ast == 0) return hash("");
+
+	if(ast->kind == VAR) {
+		int index = binder_stack_index_of(binders, ast->name);
+
+		return index == -1 ? hash_combine(hash("free"), ast->name->hash) : hash_combine(hash("bound"), hash((unsigned)index));
+	}
+
+	struct name_t * bound = ast_bound_name(ast);
+
+	if(bound) binder_stack_push(binders, bound);
+
+	unsigned patterns = 0;
+
+	if(ast->kind == CASE) {
+		ast_pattern_foreach_variable(ast->lhs, [&](struct ast_t * x) { binder_stack_push(binders, x->name); patterns += 1; });
+	}
+
+	struct hash_t lh = ast_de_bruijn_hash(ast->lhs, binders);
+	struct hash_t rh = ast_de_bruijn_hash(ast->rhs, binders);
+
+	binders->size -= patterns;
+
+	if(bound) binder_stack_pop(binders);
+
+	return hash_combine(hash((unsigned)ast->kind), hash_combine(lh, rh));
+}
+
+struct hash_t ast_de_bruijn_hash(struct ast_t * ast) {
+	struct binder_stack_t binders;
+
+	binder_stack_init(&binders);
+
+	struct hash_t result = ast_de_bruijn_hash(ast, &binders);
+
+	binder_stack_destroy(&binders);
+
+	return result;
+}
+
+// The de Bruijn form of ast in the layout of ast_serialize, a bound VAR is a 1
+// and its index, a free one a 0 and its name. Alpha-equivalent terms, and only
+// them, are written as the same bytes.
+void ast_serialize_de_bruijn(struct byte_buffer_t * buffer, struct ast_t * ast, struct binder_stack_t * binders) {
+	if(ast == 0) {
+		byte_buffer_u8(buffer, AST_SERIALIZE_NONE);
+		return;
+	}
+
+	byte_buffer_u8(buffer, (unsigned char)ast->kind);
+
+	if(ast->kind == VAR) {
+		int index = binder_stack_index_of(binders, ast->name);
+
+		byte_buffer_u8(buffer, index != -1);
+
+		if(index == -1) {
+			byte_buffer_string(buffer, name_get_str(ast->name));
+		} else {
+			byte_buffer_u32(buffer, (unsigned)index);
+		}
+
+		return;
+	}
+
+	struct name_t * bound = ast_bound_name(ast);
+
+	if(bound) binder_stack_push(binders, bound);
+
+	unsigned patterns = 0;
+
+	if(ast->kind == CASE) {
+		ast_pattern_foreach_variable(ast->lhs, [&](struct ast_t * x) { binder_stack_push(binders, x->name); patterns += 1; });
+	}
+
+	ast_serialize_de_bruijn(buffer, ast->lhs, binders);
+	ast_serialize_de_bruijn(buffer, ast->rhs, binders);
+
+	binders->size -= patterns;
+
+	if(bound) binder_stack_pop(binders);
+}
+
+void ast_serialize_de_bruijn(struct byte_buffer_t * buffer, struct ast_t * ast) {
+	struct binder_stack_t binders;
+
+	binder_stack_init(&binders);
+
+	ast_serialize_de_bruijn(buffer, ast, &binders);
+
+	binder_stack_destroy(&binders);
+}
+
+// Hash verification
+//
+// Collects terms hashed by ast_hash and checks the tags against the exact
+// checker: terms with equal tags must be alpha-equivalent (otherwise it is a
+// collision) and alpha-equivalent terms must have equal tags (otherwise it is
+// a miss). Terms are grouped by tag and every group is split in alpha classes
+// with ast_alpha_equivalent. Then the classes are grouped by their de Bruijn
+// hash and compared again, equivalent classes in different tag groups are the
+// misses.
+
+typedef struct hash_verifier_t {
+	unsigned size;
+	unsigned capacity;
+
+	struct ast_t ** terms;
+
+	// when not zero at most sample terms are verified, picked at random
+	unsigned sample;
+	unsigned seed;
+
+	// number of buckets of the tag distribution
+	unsigned buckets;
+
+	// results of hash_verifier_run
+	unsigned verified;
+	unsigned distinct_tags;
+	unsigned largest_tag_group;
+	unsigned alpha_classes;
+
+	// pairs of alpha classes that share a tag
+	unsigned collisions;
+	// extra tag groups holding an alpha class already seen in another group
+	unsigned misses;
+
+	unsigned bucket_max;
+	double bucket_mean;
+	double bucket_chi_squared;
+} hash_verifier_t;
+
+void hash_verifier_init(struct hash_verifier_t * verifier, unsigned sample, unsigned buckets) {
+	verifier->size = 0;
+	verifier->capacity = 64;
+	verifier->terms = (struct ast_t**)memory_alloc(sizeof(ast_t*) * verifier->capacity);
+
+	verifier->sample = sample;
+	verifier->seed = 2166136261u;
+	verifier->buckets = buckets ? buckets : 1024;
+
+	verifier->verified = 0;
+	verifier->distinct_tags = 0;
+	verifier->largest_tag_group = 0;
+	verifier->alpha_classes = 0;
+	verifier->collisions = 0;
+	verifier->misses = 0;
+	verifier->bucket_max = 0;
+	verifier->bucket_mean = 0;
+	verifier->bucket_chi_squared = 0;
+}
+
+void hash_verifier_destroy(struct hash_verifier_t * verifier) {
+	memory_free(verifier->terms);
+}
+
+void hash_verifier_add(struct hash_verifier_t * verifier, struct ast_t * term) {
+	if(verifier->size == verifier->capacity) {
+		verifier->capacity *= 2;
+		verifier->terms = (struct ast_t**)memory_realloc(verifier->terms, sizeof(ast_t*) * verifier->capacity);
+	}
+
+	verifier->terms[verifier->size++] = term;
+}
+
+void hash_verifier_add_subterms(struct hash_verifier_t * verifier, struct ast_t * term) {
+	if(term == 0) return;
+
+	hash_verifier_add(verifier, term);
+
+	hash_verifier_add_subterms(verifier, term->lhs);
+	hash_verifier_add_subterms(verifier, term->rhs);
+}
+
+// Verification mode of ast_hash, hashes ast and registers all of its subterms.
+void ast_hash_verify(struct hash_verifier_t * verifier, struct ast_t * ast) {
+	ast_hash(ast);
+	hash_verifier_add_subterms(verifier, ast);
+}
+
+int hash_verifier_compare_tags(const void * a, const void * b) {
+	unsigned x = (*(struct ast_t**)a)->tag.crc32;
+	unsigned y = (*(struct ast_t**)b)->tag.crc32;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+typedef struct hash_verifier_class_t {
+	struct ast_t * representative;
+	struct hash_t de_bruijn;
+} hash_verifier_class_t;
+
+int hash_verifier_compare_classes(const void * a, const void * b) {
+	unsigned x = ((struct hash_verifier_class_t*)a)->de_bruijn.crc32;
+	unsigned y = ((struct hash_verifier_class_t*)b)->de_bruijn.crc32;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+unsigned hash_verifier_random(struct hash_verifier_t * verifier) {
+	// xorshift32
+	verifier->seed ^= verifier->seed << 13;
+	verifier->seed ^= verifier->seed >> 17;
+	verifier->seed ^= verifier->seed << 5;
+
+	return verifier->seed;
+}
+
+void hash_verifier_run(struct hash_verifier_t * verifier) {
+	unsigned count = verifier->size;
+
+	struct ast_t ** terms = (struct ast_t**)memory_alloc(sizeof(ast_t*) * (count ? count : 1));
+
+	memcpy(terms, verifier->terms, sizeof(ast_t*) * count);
+
+	if(verifier->sample && verifier->sample < count) {
+		// partial Fisher-Yates shuffle
+		for(unsigned i = 0; i < verifier->sample; i++) {
+			unsigned j = i + hash_verifier_random(verifier) % (count - i);
+
+			struct ast_t * tmp = terms[i];
+			terms[i] = terms[j];
+			terms[j] = tmp;
+		}
+
+		count = verifier->sample;
+	}
+
+	qsort(terms, count, sizeof(ast_t*), hash_verifier_compare_tags);
+
+	// representatives of the alpha classes found in each tag group
+	struct hash_verifier_class_t * classes = (struct hash_verifier_class_t*)memory_alloc(sizeof(hash_verifier_class_t) * (count ? count : 1));
+
+	unsigned * buckets = (unsigned*)memory_alloc(sizeof(unsigned) * verifier->buckets);
+
+	for(unsigned i = 0; i < verifier->buckets; i++) {
+		buckets[i] = 0;
+	}
+
+	unsigned classes_size = 0;
+
+	verifier->verified = count;
+	verifier->distinct_tags = 0;
+	verifier->largest_tag_group = 0;
+	verifier->alpha_classes = 0;
+	verifier->collisions = 0;
+	verifier->misses = 0;
+
+	for(unsigned begin = 0, end = 0; begin < count; begin = end) {
+		unsigned tag = terms[begin]->tag.crc32;
+
+		while(end < count && terms[end]->tag.crc32 == tag) end++;
+
+		verifier->distinct_tags += 1;
+
+		buckets[tag % verifier->buckets] += 1;
+
+		if(end - begin > verifier->largest_tag_group) {
+			verifier->largest_tag_group = end - begin;
+		}
+
+		unsigned group_classes = classes_size;
+
+		for(unsigned i = begin; i < end; i++) {
+			unsigned found = 0;
+
+			for(unsigned c = group_classes; c < classes_size && !found; c++) {
+				found = ast_alpha_equivalent(classes[c].representative, terms[i]);
+			}
+
+			if(found) continue;
+
+			verifier->collisions += classes_size - group_classes;
+
+			classes[classes_size].representative = terms[i];
+			classes[classes_size].de_bruijn = ast_de_bruijn_hash(terms[i]);
+			classes_size += 1;
+		}
+	}
+
+	// every alpha class must appear in a single tag group
+	qsort(classes, classes_size, sizeof(hash_verifier_class_t), hash_verifier_compare_classes);
+
+	for(unsigned begin = 0, end = 0; begin < classes_size; begin = end) {
+		while(end < classes_size && classes[end].de_bruijn.crc32 == classes[begin].de_bruijn.crc32) end++;
+
+		for(unsigned i = begin; i < end; i++) {
+			unsigned seen = 0;
+
+			for(unsigned j = begin; j < i && !seen; j++) {
+				seen = ast_alpha_equivalent(classes[j].representative, classes[i].representative);
+			}
+
+			if(seen) {
+				verifier->misses += 1;
+			} else {
+				verifier->alpha_classes += 1;
+			}
+		}
+	}
+
+	verifier->bucket_max = 0;
+	verifier->bucket_mean = verifier->distinct_tags / (double)verifier->buckets;
+	verifier->bucket_chi_squared = 0;
+
+	for(unsigned i = 0; i < verifier->buckets; i++) {
+		if(buckets[i] > verifier->bucket_max) {
+			verifier->bucket_max = buckets[i];
+		}
+
+		double delta = buckets[i] - verifier->bucket_mean;
+
+		if(verifier->bucket_mean > 0) {
+			verifier->bucket_chi_squared += delta * delta / verifier->bucket_mean;
+		}
+	}
+
+	memory_free(buckets);
+	memory_free(classes);
+	memory_free(terms);
+}
+
+void hash_verifier_report(struct hash_verifier_t * verifier, FILE * out) {
+	fprintf(out, "verified terms:      %u\n", verifier->verified);
+	fprintf(out, "alpha classes:       %u\n", verifier->alpha_classes);
+	fprintf(out, "distinct tags:       %u\n", verifier->distinct_tags);
+	fprintf(out, "largest tag group:   %u\n", verifier->largest_tag_group);
+	fprintf(out, "collisions:          %u\n", verifier->collisions);
+	fprintf(out, "misses:              %u\n", verifier->misses);
+	fprintf(out, "buckets:             %u\n", verifier->buckets);
+	fprintf(out, "bucket max / mean:   %u / %.3f\n", verifier->bucket_max, verifier->bucket_mean);
+	fprintf(out, "bucket chi squared:  %.3f (%u degrees of freedom)\n", verifier->bucket_chi_squared, verifier->buckets - 1);
+}
+
+#endif
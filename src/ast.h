@@ -10,6 +10,9 @@
 #include "name.h"
 #include "name_name_map.h"
 
+#define AST_FREE -1
+#define AST_BINDER -2
+
 enum ast_kind_t {
 	VAR = 0,
 	APP,
@@ -19,6 +22,9 @@ enum ast_kind_t {
 	ASSIGNMENT,
 	DECLARATION,	
 	ARROW_TYPE,
+	CASE_LIST,
+	CASE,
+	PATTERN_LIST,
 	TOTAL_KINDS
 };
 
@@ -32,6 +38,13 @@ typedef struct ast_t {
 	struct ast_t* parent;
 
 	struct hash_t tag;
+
+	// VAR nodes after ast_resolve, the de Bruijn index of a bound variable,
+	// AST_FREE for free variables and AST_BINDER for the variable of a binder
+	int de_bruijn_indice;
+
+	// interned name of a free variable, 0 before ast_resolve
+	unsigned symbol;
 	
 	// variable name -> hashed position tree
 	struct name_name_map_t * fv_to_ctx_map;
@@ -39,7 +52,7 @@ typedef struct ast_t {
 
 
 struct ast_t * alloc_node(ast_kind_t kind) {
-	struct ast_t* node = (struct ast_t *)malloc(sizeof(struct ast_t));
+	struct ast_t* node = (struct ast_t *)memory_alloc(sizeof(struct ast_t));
  
 	node->kind = kind;
 	node->parent = 0;
@@ -47,6 +60,9 @@ struct ast_t * alloc_node(ast_kind_t kind) {
 	node->rhs = 0;
 
 	node->name = 0;
+
+	node->de_bruijn_indice = AST_FREE;
+	node->symbol = 0;
 	
 	node->fv_to_ctx_map = name_name_map_allocate();
 	
@@ -158,11 +174,114 @@ struct ast_t * declaration(struct ast_t * lhs) {
 	return node;
 } 
 
+// A case list is a function of as many arguments as each of its cases has
+// patterns: the first case whose patterns match the arguments is taken. In
+// patterns, names starting with an uppercase letter are constructors, _ matches
+// anything and the other names are pattern variables, bound in the body.
+
+// the cases of a list, tail is 0 or another CASE_LIST
+struct ast_t * case_list(struct ast_t * match, struct ast_t * tail) {
+	struct ast_t * node = alloc_node(CASE_LIST);
+
+	assert(match->kind == CASE);
+	assert(tail == 0 || tail->kind == CASE_LIST);
+
+	node->lhs = match;
+	node->rhs = tail;
+
+	match->parent = node;
+
+	if(tail) {
+		tail->parent = node;
+	}
+
+	return node;
+}
+
+struct ast_t * case_statement(struct ast_t * patterns, struct ast_t * body) {
+	struct ast_t * node = alloc_node(CASE);
+
+	assert(patterns->kind == PATTERN_LIST);
+
+	node->lhs = patterns;
+	node->rhs = body;
+
+	patterns->parent = node;
+	body->parent = node;
+
+	return node;
+}
+
+// the patterns of a case, tail is 0 or another PATTERN_LIST
+struct ast_t * pattern_list(struct ast_t * head, struct ast_t * tail) {
+	struct ast_t * node = alloc_node(PATTERN_LIST);
+
+	assert(tail == 0 || tail->kind == PATTERN_LIST);
+
+	node->lhs = head;
+	node->rhs = tail;
+
+	head->parent = node;
+
+	if(tail) {
+		tail->parent = node;
+	}
+
+	return node;
+}
+
+int ast_is_constructor(struct name_t * name) {
+	return name->identifier[0] >= 'A' && name->identifier[0] <= 'Z';
+}
+
+int ast_is_wildcard(struct name_t * name) {
+	return name->identifier[0] == '_' && name->identifier[1] == 0;
+}
+
+// calls f(var) for the pattern variables of pattern, left to right
+template<typename F>
+void ast_pattern_foreach_variable(struct ast_t * pattern, F f) {
+	if(pattern == 0) return;
+
+	if(pattern->kind == VAR) {
+		if(!ast_is_constructor(pattern->name) && !ast_is_wildcard(pattern->name)) f(pattern);
+		return;
+	}
+
+	ast_pattern_foreach_variable(pattern->lhs, f);
+	ast_pattern_foreach_variable(pattern->rhs, f);
+}
+
+// number of pattern variables a case binds
+unsigned ast_case_variables(struct ast_t * match) {
+	unsigned count = 0;
+
+	ast_pattern_foreach_variable(match->lhs, [&](struct ast_t *) { count += 1; });
+
+	return count;
+}
+
+// 1 if name is a pattern variable of the case
+int ast_case_binds(struct ast_t * match, struct name_t * name) {
+	int bound = 0;
+
+	ast_pattern_foreach_variable(match->lhs, [&](struct ast_t * x) { bound |= name_equal(x->name, name); });
+
+	return bound;
+}
+
 void ast_free_node(struct ast_t* ast) {
 	if(ast == 0) return;
 	
-	name_free(ast->name);
-	free(ast);
+	if(ast->name) {
+		name_free(ast->name);
+	}
+
+	if(ast->fv_to_ctx_map) {
+		name_name_map_free(ast->fv_to_ctx_map);
+	}
+
+	memory_free(ast);
 }
 
 void ast_free(struct ast_t* ast) {
@@ -172,10 +291,28 @@ void ast_free(struct ast_t* ast) {
 	ast_free(ast->rhs);
 
 	ast_free_node(ast);
+}
 
-	if(ast->fv_to_ctx_map) {
-		name_name_map_free(ast->fv_to_ctx_map);
+// deep copy, the tag and the free variable maps are not copied
+struct ast_t * ast_copy(struct ast_t * ast) {
+	if(ast == 0) return 0;
+
+	struct ast_t * copy = alloc_node(ast->kind);
+
+	if(ast->name) {
+		copy->name = name_copy(ast->name);
 	}
+
+	copy->de_bruijn_indice = ast->de_bruijn_indice;
+	copy->symbol = ast->symbol;
+
+	copy->lhs = ast_copy(ast->lhs);
+	copy->rhs = ast_copy(ast->rhs);
+
+	if(copy->lhs) copy->lhs->parent = copy;
+	if(copy->rhs) copy->rhs->parent = copy;
+
+	return copy;
 }
 
 void ast_print(struct ast_t * expr) {
@@ -232,6 +369,29 @@ void ast_print(struct ast_t * expr) {
 	if(expr->kind == DECLARATION) {
 		ast_print(expr->lhs);
 	}
+
+	if(expr->kind == CASE_LIST) {
+		ast_print(expr->lhs);
+		if(expr->rhs) {
+			printf(", ");
+			ast_print(expr->rhs);
+		}
+	}
+
+	if(expr->kind == CASE) {
+		printf("case ");
+		ast_print(expr->lhs);
+		printf(" then ");
+		ast_print(expr->rhs);
+	}
+
+	if(expr->kind == PATTERN_LIST) {
+		ast_print(expr->lhs);
+		if(expr->rhs) {
+			printf(" . ");
+			ast_print(expr->rhs);
+		}
+	}
 }
 
 
@@ -0,0 +1,156 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include "ast.h"
+#include "ast_hash.h"
+#include "ast_serialize.h"
+#include "byte_buffer.h"
+#include "memory.h"
+#include "parser.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// Parse cache
+//
+// A directory of parsed and hashed programs, one file per source named after
+// the 64 bit FNV-1a hash of the cache version and the source bytes. A file
+// holds a header and the tagged serialization of the program, so a hit is
+// read back without lexing or hashing. Everything is written in a fixed byte
+// order and the tags only depend on the names and the structure of the
+// program, so a directory can be copied between hosts. Files are replaced by
+// renaming a complete temporary file over them, concurrent builders writing
+// the same entry write the same bytes and a reader never sees a partial file.
+//
+// A file whose header does not match the source, or that does not read back
+// whole, is rejected and written again.
+
+#define AST_CACHE_MAGIC 0x48534148
+
+// bump when the parser, the ast kinds, the tags or the layout change
+#define AST_CACHE_VERSION 3
+
+typedef struct ast_cache_t {
+	char * directory;
+
+	unsigned hits;
+	unsigned misses;
+	unsigned rejected;
+} ast_cache_t;
+
+void ast_cache_init(struct ast_cache_t * cache, const char * directory) {
+	unsigned long length = strlen(directory);
+
+	cache->directory = (char*)memory_alloc(length + 1);
+
+	memcpy(cache->directory, directory, length + 1);
+
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->rejected = 0;
+
+	mkdir(directory, 0755);
+}
+
+void ast_cache_destroy(struct ast_cache_t * cache) {
+	memory_free(cache->directory);
+}
+
+unsigned long long ast_cache_fnv(unsigned long long key, const char * data, unsigned long size) {
+	for(unsigned long i = 0; i < size; i++) {
+		key ^= (unsigned char)data[i];
+		key *= 1099511628211ull;
+	}
+
+	return key;
+}
+
+unsigned long long ast_cache_key(const char * source, unsigned long length) {
+	unsigned char version[4] = { AST_CACHE_VERSION & 0xff, (AST_CACHE_VERSION >> 8) & 0xff, (AST_CACHE_VERSION >> 16) & 0xff, (AST_CACHE_VERSION >> 24) & 0xff };
+
+	unsigned long long key = ast_cache_fnv(14695981039346656037ull, (const char*)version, 4);
+
+	return ast_cache_fnv(key, source, length);
+}
+
+char * ast_cache_path(struct ast_cache_t * cache, unsigned long long key) {
+	unsigned long length = strlen(cache->directory) + 32;
+
+	char * path = (char*)memory_alloc(length);
+
+	snprintf(path, length, "%s/%016llx.ast", cache->directory, key);
+
+	return path;
+}
+
+// the program stored for source in data, 0 if it is not one
+struct ast_t * ast_cache_decode(const char * data, unsigned long size, const char * source, unsigned long length) {
+	struct byte_reader_t reader;
+
+	byte_reader_init(&reader, data, size);
+
+	if(byte_reader_u32(&reader) != AST_CACHE_MAGIC) return 0;
+	if(byte_reader_u32(&reader) != AST_CACHE_VERSION) return 0;
+	if(byte_reader_u32(&reader) != length) return 0;
+	if(byte_reader_u32(&reader) != hash(source).crc32) return 0;
+
+	struct ast_t * ast = ast_deserialize_tagged(&reader);
+
+	if(ast && (reader.failed || reader.at != reader.size)) {
+		ast_free(ast);
+		return 0;
+	}
+
+	return reader.failed ? 0 : ast;
+}
+
+void ast_cache_encode(struct byte_buffer_t * buffer, struct ast_t * ast, const char * source, unsigned long length) {
+	byte_buffer_u32(buffer, AST_CACHE_MAGIC);
+	byte_buffer_u32(buffer, AST_CACHE_VERSION);
+	byte_buffer_u32(buffer, length);
+	byte_buffer_u32(buffer, hash(source).crc32);
+
+	ast_serialize_tagged(buffer, ast);
+}
+
+// parse(source) with the tags of ast_hash, from the cache when it has it
+struct ast_t * ast_cache_parse(struct ast_cache_t * cache, const char * source) {
+	unsigned long length = strlen(source);
+
+	char * path = ast_cache_path(cache, ast_cache_key(source, length));
+
+	struct byte_buffer_t buffer;
+
+	byte_buffer_init(&buffer);
+
+	struct ast_t * ast = 0;
+
+	if(byte_buffer_read_file(&buffer, path)) {
+		ast = ast_cache_decode(buffer.data, buffer.size, source, length);
+
+		if(ast == 0) cache->rejected += 1;
+	}
+
+	if(ast) {
+		cache->hits += 1;
+	} else {
+		cache->misses += 1;
+
+		ast = parse(source);
+		ast_hash(ast);
+
+		buffer.size = 0;
+
+		ast_cache_encode(&buffer, ast, source, length);
+
+		byte_buffer_write_file(path, buffer.data, buffer.size);
+	}
+
+	byte_buffer_destroy(&buffer);
+	memory_free(path);
+
+	return ast;
+}
+
+#endif
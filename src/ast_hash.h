@@ -1,5 +1,11 @@
+#ifndef AST_HASH_H
+#define AST_HASH_H
+
 #include "ast.h"
 #include "hash.h"
+#include "swiss_table.h"
+#include "hamt.h"
+#include "trace.h"
 
 #include <cstdlib>
 #include <cstring>
@@ -12,9 +18,13 @@ enum positions_type_t {
 	POSITION_JOIN,
 };
 
+// position trees are immutable and shared between the variable maps of the
+// summaries, they are reference counted
 typedef struct position_tree_t {
 	enum positions_type_t kind;
 
+	unsigned references;
+
 	struct position_tree_t* lhs;
 	struct position_tree_t* rhs;
 
@@ -54,9 +64,10 @@ void position_tree_to_compressed_string(struct position_tree_t * tree, char * bu
 
 
 struct position_tree_t * position_tree_here() {
-	struct position_tree_t * pos = (position_tree_t*)malloc(sizeof(struct position_tree_t));
+	struct position_tree_t * pos = (position_tree_t*)memory_alloc(sizeof(struct position_tree_t));
 
 	pos->kind = POSITION_HERE;
+	pos->references = 1;
 
 	pos->lhs = 0;
 	pos->rhs = 0;
@@ -65,9 +76,10 @@ struct position_tree_t * position_tree_here() {
 }
 
 struct position_tree_t * position_tree_join(struct position_tree_t * lhs, struct position_tree_t * rhs) {
-	struct position_tree_t * pos = (position_tree_t*)malloc(sizeof(struct position_tree_t));
+	struct position_tree_t * pos = (position_tree_t*)memory_alloc(sizeof(struct position_tree_t));
 
 	pos->kind = POSITION_JOIN;
+	pos->references = 1;
 
 	pos->lhs = lhs;
 	pos->rhs = rhs;
@@ -75,21 +87,28 @@ struct position_tree_t * position_tree_join(struct position_tree_t * lhs, struct
 	return pos;
 }
 
+struct position_tree_t * position_tree_retain(struct position_tree_t * p) {
+	if(p) p->references += 1;
+	return p;
+}
+
+// drops a reference to p
 void position_tree_free(struct position_tree_t * p) {
-	if(p == 0) return;
+	if(p == 0 || --p->references) return;
 	
 	position_tree_free(p->lhs);
 	position_tree_free(p->rhs);
 
-	free(p);
+	memory_free(p);
 }
 
 struct position_tree_t * position_tree_copy(struct position_tree_t * p) {
 	if(p == 0) return 0;
 	
-	struct position_tree_t * pos = (position_tree_t*)malloc(sizeof(struct position_tree_t));
+	struct position_tree_t * pos = (position_tree_t*)memory_alloc(sizeof(struct position_tree_t));
 	
 	pos->kind = p->kind;
+	pos->references = 1;
 
 	pos->lhs = position_tree_copy(p->lhs);
 	pos->rhs = position_tree_copy(p->rhs);
@@ -97,18 +116,23 @@ struct position_tree_t * position_tree_copy(struct position_tree_t * p) {
 	return pos;
 }
 
-typedef struct variable_map_t {
-	unsigned size;
-	unsigned capacity;
-	
-	name_t** names;
-	struct position_tree_t ** trees;
-} variable_map_t;
+void hamt_value_retain(struct position_tree_t * p) {
+	position_tree_retain(p);
+}
+
+void hamt_value_release(struct position_tree_t * p) {
+	position_tree_free(p);
+}
 
+// Persistent map from free variable names to their position trees. The map of
+// a summary shares its unchanged nodes with the maps of its children, so the
+// memory of the summaries grows with the number of changes along the tree and
+// not with the size of the maps. Names are borrowed from the ast.
+typedef hamt_t<name_t*, position_tree_t*> variable_map_t;
 
 typedef struct summary_t {
 	struct ast_t * structure;
-	struct variable_map_t * variable_map;
+	variable_map_t variable_map;
 	struct position_tree_t * position;
 
 	unsigned tag;
@@ -118,35 +142,6 @@ typedef struct summary_t {
 	struct summary_t * rhs;
 } summary_t;
 
-struct variable_map_t* variable_map_allocate() {
-	struct variable_map_t * vm = (struct variable_map_t*)malloc(sizeof(struct variable_map_t));
-	
-	vm->capacity = 4;
-	vm->size = 0;
-
-	vm->names = (struct name_t**)malloc(sizeof(name_t*) * vm->capacity);
-	vm->trees = (struct position_tree_t**)malloc(sizeof(position_tree_t*) * vm->capacity);
-
-	for(unsigned i = 0; i < vm->capacity; i++) {
-		vm->names[i] = 0;
-		vm->trees[i] = 0;
-	}
-
-	return vm;
-}
-
-void variable_map_free(struct variable_map_t* vm) {
-	for(unsigned i = 0; i < vm->capacity; i++) {
-		if(vm->names[i]) {
-			name_free(vm->names[i]);
-			position_tree_free(vm->trees[i]);
-		}
-	}
-
-
-	free(vm->names);
-	free(vm->trees);
-}
 void print_position_tree(struct position_tree_t * tree) {
 	if(tree == 0) return;
 	
@@ -165,198 +160,44 @@ void print_position_tree(struct position_tree_t * tree) {
 		break;
 	}
 }
-void print_map(struct variable_map_t * map) {
-	int printed = 0;
-	
-	for(int i = 0; i < map->capacity; i++) {
-		if(map->names[i]) {
-			printf("%s=", name_get_str(map->names[i]));
-			print_position_tree(map->trees[i]);
-
-			if(printed < map->size - 1) {
-				printf(", ");
-			}
-
-			printed += 1;
-		}
-	}
-}
-
-void variable_map_rehash(struct variable_map_t * vm) {
-	if(vm->size == 0) return;
-	
-	float load = vm->size / (float)vm->capacity;
-	
-	unsigned overloaded = load > 0.8f;
-	unsigned underloaded = load < 0.5f;
-	
-	if (!overloaded && !underloaded) {
-		return;
-	}
-
-	struct name_t ** names = vm->names;
-	struct position_tree_t ** trees = vm->trees;
-
-	unsigned old_cap = vm->capacity;
-	unsigned new_cap = overloaded ? old_cap * 1.3f + 2 : underloaded ? vm->capacity * 0.7f : 0;
-
-	if(new_cap == 0) return;
-	
-	vm->capacity = new_cap;
-	
-	vm->names = (struct name_t**)malloc(sizeof(name_t*) * vm->capacity);
-	vm->trees = (struct position_tree_t**)malloc(sizeof(position_tree_t*) * vm->capacity);
-
-	for(unsigned i = 0; i < vm->capacity; i++) {
-		vm->names[i] = 0;
-		vm->trees[i] = 0;
-	}
-
-	for(unsigned i = 0; i < old_cap; i++) {
-		if(names[i]) {
-			unsigned id = names[i]->hash.crc32 % vm->capacity;
-
-			while(vm->names[id] != 0) {
-				id += 1;
-				id %= vm->capacity;
-			}
-			
-			vm->names[id] = names[i];
-			vm->trees[id] = trees[i];
-		}
-	}
-
-	free(names);
-	free(trees);
-}
-
-int variable_map_add(struct variable_map_t * vm, struct name_t* name, struct position_tree_t * pos_tree) {
-	unsigned id = name->hash.crc32 % vm->capacity;
-
-	while(vm->names[id]) {
-		if (vm->names[id]->hash.crc32 == name->hash.crc32 && strcmp(name_get_str(vm->names[id]), name_get_str(name)) == 0) {
-			return 0;
-		}
-		
-		id = (id + 1) % vm->capacity;
-	}
-	
-	vm->names[id] = name;
-	vm->trees[id] = pos_tree;
-	
-	vm->size += 1;
-
-	variable_map_rehash(vm);
-
-	return 1;
-}
+void print_map(variable_map_t map) {
+	unsigned printed = 0;
 
-struct position_tree_t * variable_map_rem(struct variable_map_t * vm, struct name_t* name) {
-	if(name == 0) return 0;
-	
-	struct hash_t hash = name->hash;
+	hamt_foreach(map, [&](struct name_t * name, struct position_tree_t * tree) {
+		printf("%s=", name_get_str(name));
+		print_position_tree(tree);
 
-	unsigned id = hash.crc32 % vm->capacity;
-	unsigned tmp = id;
-	
-	while (vm->names[id]) {
-		if(vm->names[id]->hash.crc32 == name->hash.crc32 && strcmp(vm->names[id]->identifier, name->identifier) == 0) {
-			break;
+		if(printed < map.size - 1) {
+			printf(", ");
 		}
-		
-		id = (id + 1) % vm->capacity;
-	}
-
-	if(vm->names[id] == 0 ||vm->names[id]->hash.crc32 != name->hash.crc32)  return 0;
-	
-	name_free(vm->names[id]);
-
-	struct position_tree_t * tree = vm->trees[id];
-
-	vm->names[id] = 0;
-	vm->trees[id] = 0;
-
-	if(vm->size != vm->capacity && vm->names[(id + 1) % vm->capacity] != 0) {
-		while(vm->names[(id + 1) % vm->capacity] != 0) {
-			vm->names[id] = vm->names[(id + 1) % vm->capacity];
-			vm->trees[id] = vm->trees[(id + 1) % vm->capacity];
- 
-			id = (id + 1) % vm->capacity;
-		}
-
-		vm->names[id] = vm->names[(id + 1) % vm->capacity];
-		vm->trees[id] = vm->trees[(id + 1) % vm->capacity];
-	}
-	
-	vm->size -= 1;
-
-	variable_map_rehash(vm);
 
-	return tree;
+		printed += 1;
+	});
 }
 
-struct position_tree_t * variable_map_get(struct variable_map_t * vm, struct name_t* name) {
-	if(name->identifier == 0) return 0;
-	
-	struct hash_t hash = name->hash;
-	
-	unsigned id = hash.crc32 % vm->capacity;
-	
-	while (vm->names[id]) {
-		if(vm->names[id]->hash.crc32 == name->hash.crc32 && strcmp(vm->names[id]->identifier, name->identifier) == 0) {
-			return vm->trees[id];
-		}
-		
-		id = (id + 1) % vm->capacity;
-	}
-	
-	return 0;
-}
-
-struct variable_map_t * variable_map_copy(struct variable_map_t * vm) {
-	struct variable_map_t* copy = (struct variable_map_t*)malloc(sizeof(struct variable_map_t));
-
-	copy->capacity = vm->capacity;
-	copy->size = vm->size;
-
-	copy->names = (name_t**)malloc(sizeof(name_t*) * copy->capacity);
-	copy->trees = (position_tree_t**)malloc(sizeof(position_tree_t*) * copy->capacity);
-
-	for(unsigned i = 0; i < vm->capacity; i++) {
-		if(vm->names[i]) {
-			copy->names[i] = name_copy(vm->names[i]);
-			copy->trees[i] = position_tree_copy(vm->trees[i]);
-		} else {
-			copy->names[i] = 0;
-			copy->trees[i] = 0;
-		}
-	}
-
-	return copy;
-}
+// merges smaller into bigger, joining the position trees of the names in both
+variable_map_t variable_map_merge(variable_map_t bigger, variable_map_t smaller) {
+	variable_map_t vm = hamt_retain(bigger);
 
+	hamt_foreach(smaller, [&](struct name_t * name, struct position_tree_t * tree) {
+		struct position_tree_t * joint = position_tree_join(position_tree_retain(hamt_get(vm, name)), position_tree_retain(tree));
 
-struct variable_map_t * variable_map_merge(struct variable_map_t * bigger, struct variable_map_t * smaller) {
-	struct variable_map_t* vm = variable_map_copy(bigger);
+		variable_map_t next = hamt_insert(vm, name, joint);
 
-	for(unsigned i = 0; i < smaller->capacity; i++) {
-		if(smaller->names[i]) {
-			struct position_tree_t * tree = variable_map_rem(vm, smaller->names[i]);
+		hamt_release(vm);
 
-			variable_map_add(vm, name_copy(smaller->names[i]), position_tree_join(tree, position_tree_copy(smaller->trees[i])));
-		}
-	}
+		vm = next;
+	});
 
 	return vm;
 }
 
 struct summary_t * create_summary_var(struct ast_t * expr, struct name_t * name, struct position_tree_t* pos) {
-	struct summary_t * summary = (summary_t*)malloc(sizeof(struct summary_t));
+	struct summary_t * summary = (summary_t*)memory_alloc(sizeof(struct summary_t));
 
 	summary->position = 0;
 	
-	summary->variable_map = variable_map_allocate();
-	variable_map_add(summary->variable_map, name, pos);
+	summary->variable_map = hamt_insert(hamt_empty<name_t*, position_tree_t*>(), name, pos);
 
 	summary->structure = expr;
 
@@ -368,8 +209,8 @@ struct summary_t * create_summary_var(struct ast_t * expr, struct name_t * name,
 }
 
 
-struct summary_t * create_summary_lambda(struct ast_t * expr, struct position_tree_t* pos, struct variable_map_t * vm, struct summary_t * lhs, struct summary_t * rhs) {
-	struct summary_t * summary = (summary_t*)malloc(sizeof(struct summary_t));
+struct summary_t * create_summary_lambda(struct ast_t * expr, struct position_tree_t* pos, variable_map_t vm, struct summary_t * lhs, struct summary_t * rhs) {
+	struct summary_t * summary = (summary_t*)memory_alloc(sizeof(struct summary_t));
 
 	summary->position = pos;
 	summary->variable_map = vm;
@@ -382,8 +223,8 @@ struct summary_t * create_summary_lambda(struct ast_t * expr, struct position_tr
 	return summary;
 }
 
-struct summary_t * create_summary_generic(struct ast_t * expr,  unsigned left_bigger, struct variable_map_t * vm, struct summary_t * lhs, struct summary_t * rhs) {
-	struct summary_t * summary = (summary_t*)malloc(sizeof(struct summary_t));
+struct summary_t * create_summary_generic(struct ast_t * expr,  unsigned left_bigger, variable_map_t vm, struct summary_t * lhs, struct summary_t * rhs) {
+	struct summary_t * summary = (summary_t*)memory_alloc(sizeof(struct summary_t));
 
 	summary->position = 0;
 	summary->structure = expr;
@@ -396,25 +237,25 @@ struct summary_t * create_summary_generic(struct ast_t * expr,  unsigned left_bi
 	return summary;
 }
 
-struct variable_map_t* merge_summaries_variable_maps(struct summary_t * lhs_summary , struct summary_t * rhs_summary, int * left_bigger) {
+variable_map_t merge_summaries_variable_maps(struct summary_t * lhs_summary , struct summary_t * rhs_summary, int * left_bigger) {
 	if(lhs_summary == 0 && rhs_summary == 0) {
-		return 0;
+		return hamt_empty<name_t*, position_tree_t*>();
 	}
 	
 	if(lhs_summary == 0) {
 		*left_bigger = 0;
-		return variable_map_copy(rhs_summary->variable_map);
+		return hamt_retain(rhs_summary->variable_map);
 	}
 	
 	if(rhs_summary == 0) {
 		*left_bigger = 1;
-		return variable_map_copy(lhs_summary->variable_map);
+		return hamt_retain(lhs_summary->variable_map);
 	}
 	
-	*left_bigger = lhs_summary->variable_map->size >= rhs_summary->variable_map->size;
+	*left_bigger = lhs_summary->variable_map.size >= rhs_summary->variable_map.size;
 
-	struct variable_map_t * bigger_vm = *left_bigger ? lhs_summary->variable_map : rhs_summary->variable_map;
-	struct variable_map_t * smaller_vm = *left_bigger ? rhs_summary->variable_map : lhs_summary->variable_map;
+	variable_map_t bigger_vm = *left_bigger ? lhs_summary->variable_map : rhs_summary->variable_map;
+	variable_map_t smaller_vm = *left_bigger ? rhs_summary->variable_map : lhs_summary->variable_map;
 
 	return variable_map_merge(bigger_vm, smaller_vm);
 }
@@ -478,6 +319,20 @@ void print_structure(struct summary_t * summary) {
 		print_structure(summary->rhs);
 		return;
 	}
+	case CASE_LIST:
+	case PATTERN_LIST: {
+		print_structure(summary->lhs);
+		printf(", ");
+		print_structure(summary->rhs);
+		return;
+	}
+	case CASE: {
+		printf("case ");
+		print_structure(summary->lhs);
+		printf(" then ");
+		print_structure(summary->rhs);
+		return;
+	}
 	case TOTAL_KINDS: return;
 	}
 }
@@ -487,6 +342,8 @@ void print_summary(struct summary_t * summary) {
 }
 
 struct summary_t* summaryse(struct ast_t * expr) {
+	TRACE_OUTER_SCOPE("summaryse");
+
 	if(expr == 0) return 0;
 
 	struct summary_t * lhs_summary = summaryse(expr->lhs);
@@ -496,23 +353,25 @@ struct summary_t* summaryse(struct ast_t * expr) {
 
 	switch(expr->kind) {
 	case VAR: {
-		return create_summary_var(expr, name_copy(expr->name), position_tree_here());
+		return create_summary_var(expr, expr->name, position_tree_here());
 	}
 
 	case BIND: {
 		struct name_t * x_name = expr->lhs->name;
-		struct variable_map_t * vm = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
+		variable_map_t vm = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
 		return create_summary_generic(expr, 0, vm, lhs_summary, rhs_summary);
 	}
 
 	case LAMBDA: {
 		struct name_t * x_name = expr->lhs->lhs->name;
-		struct variable_map_t * vm = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
-		struct position_tree_t * x_pos = variable_map_rem(vm, x_name);
+		struct position_tree_t * x_pos = 0;
+		variable_map_t merged = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
+		variable_map_t vm = hamt_remove(merged, x_name, &x_pos);
+		hamt_release(merged);
 		return create_summary_lambda(expr, x_pos, vm, lhs_summary, rhs_summary);	
 	}
 	case DECLARATION: {
-		struct variable_map_t * vm = variable_map_copy(lhs_summary->variable_map);
+		variable_map_t vm = hamt_retain(lhs_summary->variable_map);
 		return create_summary_generic(expr, 0, vm, lhs_summary, rhs_summary);
 	}
 		
@@ -520,8 +379,23 @@ struct summary_t* summaryse(struct ast_t * expr) {
 	case APP:
 	case STATEMENT:
 	case ASSIGNMENT:
-	case ARROW_TYPE: {
-		struct variable_map_t * vm = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
+	case ARROW_TYPE:
+	case CASE_LIST:
+	case PATTERN_LIST: {
+		variable_map_t vm = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
+		return create_summary_generic(expr, left_bigger, vm, lhs_summary, rhs_summary);
+	}
+	case CASE: {
+		variable_map_t vm = merge_summaries_variable_maps(lhs_summary, rhs_summary, &left_bigger);
+
+		ast_pattern_foreach_variable(expr->lhs, [&](struct ast_t * x) {
+			struct position_tree_t * x_pos = 0;
+			variable_map_t next = hamt_remove(vm, x->name, &x_pos);
+			hamt_release(vm);
+			position_tree_free(x_pos);
+			vm = next;
+		});
+
 		return create_summary_generic(expr, left_bigger, vm, lhs_summary, rhs_summary);
 	}
 	default:
@@ -531,45 +405,43 @@ struct summary_t* summaryse(struct ast_t * expr) {
 }
 
 void summary_free(struct summary_t * summary) {
+	TRACE_OUTER_SCOPE("summary_free");
+
 	if(summary == 0) return;
 	
 	summary_free(summary->lhs);
 	summary_free(summary->rhs);
 
-	variable_map_free(summary->variable_map);
+	hamt_release(summary->variable_map);
 	position_tree_free(summary->position);
+
+	memory_free(summary);
 }
 
-void variable_map_to_name_name_map(struct variable_map_t * var_map, struct name_name_map_t * name_map) {
-	for(int i = 0; i < var_map->capacity; i++) {
-		if(var_map->names[i]) {
-			unsigned len = position_tree_tokens_count(var_map->trees[i]);
+void variable_map_to_name_name_map(variable_map_t var_map, struct name_name_map_t * name_map) {
+	hamt_foreach(var_map, [&](struct name_t * name, struct position_tree_t * tree) {
+		unsigned len = position_tree_tokens_count(tree);
 
-			len *= 2;
+		len *= 2;
 
-			// round to next multiple of 8
-			len = ((len + 7) & (-8));
+		// round to next multiple of 8
+		len = ((len + 7) & (-8));
 
-			len /= 8;
-			
-			char * buffer = (char*)malloc(sizeof(char) * len);
-			
-			buffer[len - 1] = 0;
+		len /= 8;
 
-			position_tree_to_compressed_string(var_map->trees[i], buffer, len, 0);
+		// the bits are or-ed in, and the string needs its terminator
+		char * buffer = (char*)memory_alloc(sizeof(char) * (len + 1));
 
-			struct name_t * hash = allocate_name(buffer);
-			
-			name_name_map_add(name_map, var_map->names[i], hash);
+		memset(buffer, 0, len + 1);
 
-			free(buffer);
+		position_tree_to_compressed_string(tree, buffer, len, 0);
 
-			position_tree_free(var_map->trees[i]);
-			
-			var_map->names[i] = 0;
-			var_map->trees[i] = 0;
-		}
-	}
+		struct name_t * hash = allocate_name(buffer);
+
+		name_name_map_add(name_map, name_copy(name), hash);
+
+		memory_free(buffer);
+	});
 }
 
 struct hash_t hash_name_name_map(struct name_name_map_t * name_map) {
@@ -585,12 +457,7 @@ struct hash_t hash_name_name_map(struct name_name_map_t * name_map) {
 	return result;
 }
 
-struct hash_t hash_structure(struct ast_t * ast) {
-	if(ast == 0) return hash("");
-
-	struct hash_t lh = ast->lhs ? ast->lhs->tag : hash("");
-	struct hash_t rh = ast->rhs ? ast->rhs->tag : hash("");
-	
+constexpr struct hash_t hash_structure_of(enum ast_kind_t kind, struct hash_t lh, struct hash_t rh) {
 	struct hash_t hash_ast = hash_combine(lh, rh);
 	struct hash_t hash_app = hash(1607021125);
 	struct hash_t hash_var = hash(4218930572);
@@ -600,8 +467,11 @@ struct hash_t hash_structure(struct ast_t * ast) {
 	struct hash_t hash_ass = hash(995776901);
 	struct hash_t hash_dcl = hash(4154476586);
 	struct hash_t hash_arw = hash(1540463079);
+	struct hash_t hash_cls = hash(3870125113);
+	struct hash_t hash_cas = hash(2049913437);
+	struct hash_t hash_pat = hash(1173820671);
 	
-	switch(ast->kind) {
+	switch(kind) {
 	case APP: return hash_combine(hash_app, hash_ast);
 	case VAR: return hash_combine(hash_var, hash_ast);
 	case LAMBDA: return hash_combine(hash_lbd, hash_ast);
@@ -610,12 +480,27 @@ struct hash_t hash_structure(struct ast_t * ast) {
 	case ASSIGNMENT: return hash_combine(hash_ass, hash_ast);
 	case DECLARATION: return hash_combine(hash_dcl, hash_ast);
 	case ARROW_TYPE: return hash_combine(hash_arw, hash_ast);
+	case CASE_LIST: return hash_combine(hash_cls, hash_ast);
+	case CASE: return hash_combine(hash_cas, hash_ast);
+	case PATTERN_LIST: return hash_combine(hash_pat, hash_ast);
+	default: break;
 	}
 	
 	abort();
 }
 
+struct hash_t hash_structure(struct ast_t * ast) {
+	if(ast == 0) return hash("");
+
+	struct hash_t lh = ast->lhs ? ast->lhs->tag : hash("");
+	struct hash_t rh = ast->rhs ? ast->rhs->tag : hash("");
+
+	return hash_structure_of(ast->kind, lh, rh);
+}
+
 void summary_hash_structure(struct summary_t* summary) {
+	TRACE_OUTER_SCOPE("summary_hash_structure");
+
 	if(summary == 0) return;
 
 	summary_hash_structure(summary->lhs);
@@ -626,12 +511,16 @@ void summary_hash_structure(struct summary_t* summary) {
 }
 
 void summary_hash_free_variables(struct summary_t* summary) {
+	TRACE_OUTER_SCOPE("summary_hash_free_variables");
+
 	if(summary == 0) return;
 
 	struct name_name_map_t* map = name_name_map_allocate();
 
 	variable_map_to_name_name_map(summary->variable_map, map);
 
+	name_name_map_free(summary->structure->fv_to_ctx_map);
+
 	summary->structure->fv_to_ctx_map = map;
 
 	summary_hash_free_variables(summary->lhs);
@@ -641,6 +530,8 @@ void summary_hash_free_variables(struct summary_t* summary) {
 }
 
 void summary_hash_positions(struct summary_t* summary) {
+	TRACE_OUTER_SCOPE("summary_hash_positions");
+
 	if(summary == 0) return;
 
 	summary_hash_positions(summary->lhs);
@@ -651,20 +542,27 @@ void summary_hash_positions(struct summary_t* summary) {
 	if(summary->position) {
 		unsigned len = position_tree_tokens_count(summary->position);
 
-		char * buffer = (char*)malloc(sizeof(char) * len);
+		char * buffer = (char*)memory_alloc(sizeof(char) * (len + 1));
+
+		memset(buffer, 0, len + 1);
 
 		position_tree_to_compressed_string(summary->position, buffer, len, 0);
 
 		h = hash(buffer);
 
-		free(buffer);
+		memory_free(buffer);
 	}
 	
 	summary->structure->tag = hash_combine(summary->structure->tag, h);
 }
 
 
-void ast_hash(struct ast_t * ast) {
+// Summary based hashing, every ingredient of the tag is computed by its own
+// pass over a summary_t tree that mirrors the whole ast. Besides the tags it
+// also fills the fv_to_ctx_map of every node.
+void ast_hash_summaries(struct ast_t * ast) {
+	TRACE_SCOPE("ast_hash_summaries");
+
  struct summary_t * summary =	summaryse(ast);
 
  summary_hash_structure(summary);
@@ -674,8 +572,261 @@ void ast_hash(struct ast_t * ast) {
  summary_free(summary);
 }
 
+// Fused hashing
+//
+// The structure hash, the free variable map hash and the position hash of
+// the bound variables are computed in a single post-order traversal. Position
+// trees are never built, every position tree is replaced by its hash, and the
+// map of the smaller child is merged into the map of the bigger one in place.
+// The maps of a node are released as soon as its parent consumed them, so at
+// any time only the maps of the nodes on the current path are alive.
+//
+// As in Maziarz et al., Hashing Modulo Alpha-Equivalence, a joined position
+// includes the structure of the node where the join happens, so the positions
+// are unambiguous without rewriting the entries of the bigger map, and the
+// entries and the joins are mixed before they are xor-ed into the digest.
+
+// names are borrowed from the ast
+typedef struct position_hash_map_t : swiss_table_t<name_t*, hash_t> {
+	// xor of the hashes of all the entries, independent of insertion order
+	struct hash_t digest;
+} position_hash_map_t;
+
+struct position_hash_map_t * position_hash_map_allocate() {
+	struct position_hash_map_t * map = (struct position_hash_map_t*)memory_alloc(sizeof(struct position_hash_map_t));
+
+	swiss_table_init(map);
+
+	map->digest = hash((unsigned)0);
+
+	return map;
+}
+
+void position_hash_map_free(struct position_hash_map_t * map) {
+	if(map == 0) return;
+
+	swiss_table_destroy(map);
+	memory_free(map);
+}
+
+// murmur3 finalizer. hash_combine is close to an addition, so without it the
+// xor of the entries, or two joins, cancel out when names or positions swap.
+constexpr struct hash_t position_hash_mix(struct hash_t h) {
+	unsigned x = h.crc32;
+
+	x ^= x >> 16;
+	x *= 0x85ebca6bu;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35u;
+	x ^= x >> 16;
+
+	struct hash_t result = { x };
+
+	return result;
+}
+
+constexpr struct hash_t position_hash_entry(struct hash_t name, struct hash_t position) {
+	return position_hash_mix(hash_combine(name, position));
+}
+
+struct hash_t position_hash_map_entry_hash(struct name_t * name, struct hash_t position) {
+	return position_hash_entry(name->hash, position);
+}
+
+// name must not be in the map yet
+void position_hash_map_insert(struct position_hash_map_t * map, struct name_t * name, struct hash_t position) {
+	swiss_table_insert(map, name, position);
+
+	map->digest.crc32 ^= position_hash_map_entry_hash(name, position).crc32;
+}
+
+// returns 1 and writes the position of name if it was in the map
+int position_hash_map_remove(struct position_hash_map_t * map, struct name_t * name, struct hash_t * position) {
+	struct name_t * key = 0;
+
+	if(!swiss_table_remove(map, name, &key, position)) return 0;
+
+	map->digest.crc32 ^= position_hash_map_entry_hash(key, *position).crc32;
+
+	return 1;
+}
+
+constexpr struct hash_t position_hash_here() {
+	return hash(2654435761u);
+}
+
+constexpr struct hash_t position_hash_none() {
+	return hash(40503u);
+}
+
+// position of a name under the node whose structure is node, occurring at lhs
+// in the bigger child and at rhs in the smaller one. The names only in the
+// bigger child keep their positions, the left or right bit in the structure of
+// node tells which child that is.
+constexpr struct hash_t position_hash_join(struct hash_t node, struct hash_t lhs, struct hash_t rhs) {
+	return position_hash_mix(hash_combine(position_hash_mix(hash_combine(hash_combine(hash(2246822519u), node), lhs)), rhs));
+}
+
+typedef struct hash_frame_t {
+	// hash of the node without its free variable names, includes the positions of
+	// the variables bound inside of it
+	struct hash_t structure;
+	struct position_hash_map_t * map;
+} hash_frame_t;
+
+typedef struct hash_visit_t {
+	struct ast_t * ast;
+	unsigned expanded;
+} hash_visit_t;
+
+// merges the smaller map into the bigger one at the node of structure node, the
+// smaller is released
+struct position_hash_map_t * position_hash_map_merge(struct hash_t node, struct position_hash_map_t * bigger, struct position_hash_map_t * smaller) {
+	for(unsigned i = 0; i < smaller->capacity; i++) {
+		if(smaller->keys[i]) {
+			struct hash_t position = position_hash_none();
+
+			position_hash_map_remove(bigger, smaller->keys[i], &position);
+			position_hash_map_insert(bigger, smaller->keys[i], position_hash_join(node, position, smaller->vals[i]));
+		}
+	}
+
+	position_hash_map_free(smaller);
+
+	return bigger;
+}
+
+struct name_t * ast_bound_name(struct ast_t * ast) {
+	if(ast->kind == LAMBDA) {
+		return ast->lhs->lhs->name;
+	}
+
+	if(ast->kind == ARROW_TYPE && ast->lhs->kind == BIND) {
+		return ast->lhs->lhs->name;
+	}
+
+	return 0;
+}
+
+struct hash_frame_t ast_hash_node(struct ast_t * ast, struct hash_frame_t * lhs, struct hash_frame_t * rhs) {
+	struct hash_frame_t frame;
+
+	if(ast->kind == VAR) {
+		frame.map = position_hash_map_allocate();
+		position_hash_map_insert(frame.map, ast->name, position_hash_here());
+		frame.structure = hash_combine(hash_structure_of(VAR, hash(""), hash("")), hash("R"));
+		return frame;
+	}
+
+	unsigned left_bigger = lhs && rhs ? lhs->map->size >= rhs->map->size : lhs != 0;
+
+	frame.structure = hash_structure_of(ast->kind, lhs ? lhs->structure : hash(""), rhs ? rhs->structure : hash(""));
+	frame.structure = hash_combine(frame.structure, hash(left_bigger ? "L" : "R"));
+
+	if(lhs && rhs) {
+		frame.map = left_bigger ? position_hash_map_merge(frame.structure, lhs->map, rhs->map) : position_hash_map_merge(frame.structure, rhs->map, lhs->map);
+	} else {
+		frame.map = lhs ? lhs->map : rhs ? rhs->map : position_hash_map_allocate();
+	}
+
+	if(struct name_t * x_name = ast_bound_name(ast)) {
+		struct hash_t x_pos = position_hash_none();
+
+		position_hash_map_remove(frame.map, x_name, &x_pos);
+
+		frame.structure = hash_combine(frame.structure, x_pos);
+	}
+
+	// the pattern variables, in order, bind their occurrences in the patterns
+	// and in the body
+	if(ast->kind == CASE) {
+		ast_pattern_foreach_variable(ast->lhs, [&](struct ast_t * x) {
+			struct hash_t x_pos = position_hash_none();
+
+			position_hash_map_remove(frame.map, x->name, &x_pos);
+
+			frame.structure = hash_combine(frame.structure, x_pos);
+		});
+	}
+
+	return frame;
+}
+
+void ast_hash_fused(struct ast_t * ast) {
+	TRACE_SCOPE("ast_hash");
+
+	if(ast == 0) return;
+
+	unsigned visits_capacity = 64;
+	unsigned frames_capacity = 64;
+
+	unsigned visits_size = 0;
+	unsigned frames_size = 0;
+
+	struct hash_visit_t * visits = (struct hash_visit_t*)memory_alloc(sizeof(struct hash_visit_t) * visits_capacity);
+	struct hash_frame_t * frames = (struct hash_frame_t*)memory_alloc(sizeof(struct hash_frame_t) * frames_capacity);
+
+	visits[visits_size].ast = ast;
+	visits[visits_size].expanded = 0;
+	visits_size += 1;
+
+	while(visits_size) {
+		struct hash_visit_t visit = visits[--visits_size];
+
+		if(visit.expanded == 0) {
+			if(visits_size + 3 > visits_capacity) {
+				visits_capacity *= 2;
+				visits = (struct hash_visit_t*)memory_realloc(visits, sizeof(struct hash_visit_t) * visits_capacity);
+			}
+
+			visits[visits_size].ast = visit.ast;
+			visits[visits_size].expanded = 1;
+			visits_size += 1;
+
+			if(visit.ast->rhs) {
+				visits[visits_size].ast = visit.ast->rhs;
+				visits[visits_size].expanded = 0;
+				visits_size += 1;
+			}
+
+			if(visit.ast->lhs) {
+				visits[visits_size].ast = visit.ast->lhs;
+				visits[visits_size].expanded = 0;
+				visits_size += 1;
+			}
+
+			continue;
+		}
+
+		struct hash_frame_t * rhs = visit.ast->rhs ? &frames[--frames_size] : 0;
+		struct hash_frame_t * lhs = visit.ast->lhs ? &frames[--frames_size] : 0;
+
+		struct hash_frame_t frame = ast_hash_node(visit.ast, lhs, rhs);
+
+		visit.ast->tag = hash_combine(frame.structure, frame.map->digest);
+
+		if(frames_size == frames_capacity) {
+			frames_capacity *= 2;
+			frames = (struct hash_frame_t*)memory_realloc(frames, sizeof(struct hash_frame_t) * frames_capacity);
+		}
+
+		frames[frames_size++] = frame;
+	}
+
+	position_hash_map_free(frames[0].map);
+
+	memory_free(visits);
+	memory_free(frames);
+}
+
+void ast_hash(struct ast_t * ast) {
+	ast_hash_fused(ast);
+}
+
 void print_hashed_ast(struct ast_t * ast) {
 	if(ast==0) return;
 	printf("%u = hash of ", ast->tag.crc32);
 	ast_print(ast);
 }
+
+#endif
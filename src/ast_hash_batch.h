@@ -0,0 +1,120 @@
+#ifndef AST_HASH_BATCH_H
+#define AST_HASH_BATCH_H
+
+#include "ast_hash.h"
+#include "memory.h"
+#include "parser.h"
+
+#include <atomic>
+#include <thread>
+
+// Batch hashing
+//
+// Hashes many independent programs on a pool of threads. Every worker owns a
+// scratch arena installed as its allocator, the arena is reset after each item,
+// so after warming up the workers neither touch the global heap nor contend on
+// its locks. Tags are written in input order.
+
+#define AST_HASH_BATCH_ARENA_BLOCK_SIZE (1 << 20)
+
+typedef struct ast_hash_batch_t {
+	const char ** sources;
+	struct ast_t ** asts;
+
+	unsigned count;
+
+	struct hash_t * tags;
+
+	// index of the next item to be claimed by a worker
+	std::atomic<unsigned> next;
+} ast_hash_batch_t;
+
+void ast_hash_batch_worker(struct ast_hash_batch_t * batch) {
+	struct arena_t * scratch = arena_create(AST_HASH_BATCH_ARENA_BLOCK_SIZE);
+
+	memory_set_scratch(scratch);
+
+	unsigned i;
+
+	while((i = batch->next.fetch_add(1, std::memory_order_relaxed)) < batch->count) {
+		if(batch->sources) {
+			struct ast_t * ast = parse(batch->sources[i]);
+
+			ast_hash(ast);
+
+			batch->tags[i] = ast->tag;
+		} else {
+			ast_hash(batch->asts[i]);
+
+			batch->tags[i] = batch->asts[i]->tag;
+		}
+
+		arena_reset(scratch);
+	}
+
+	memory_set_scratch(0);
+
+	arena_destroy(scratch);
+}
+
+void ast_hash_batch_run(struct ast_hash_batch_t * batch, unsigned threads) {
+	if(threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+
+	if(threads > batch->count) {
+		threads = batch->count;
+	}
+
+	if(threads <= 1) {
+		ast_hash_batch_worker(batch);
+		return;
+	}
+
+	std::thread * workers = new std::thread[threads - 1];
+
+	for(unsigned i = 0; i < threads - 1; i++) {
+		workers[i] = std::thread(ast_hash_batch_worker, batch);
+	}
+
+	// the calling thread also takes items
+	ast_hash_batch_worker(batch);
+
+	for(unsigned i = 0; i < threads - 1; i++) {
+		workers[i].join();
+	}
+
+	delete[] workers;
+}
+
+// Parses and hashes every source, tags[i] is the tag of the program sources[i].
+// The asts only live in the scratch arenas and are gone after the call.
+// threads = 0 uses one thread per core.
+void ast_hash_batch_sources(const char ** sources, unsigned count, unsigned threads, struct hash_t * tags) {
+	struct ast_hash_batch_t batch;
+
+	batch.sources = sources;
+	batch.asts = 0;
+	batch.count = count;
+	batch.tags = tags;
+	batch.next = 0;
+
+	ast_hash_batch_run(&batch, threads);
+}
+
+// Hashes already parsed programs, the tag of every node is updated and the tag
+// of asts[i] is written to tags[i]. Only the hashing scratch memory comes from
+// the arenas, the asts are left untouched otherwise.
+void ast_hash_batch_asts(struct ast_t ** asts, unsigned count, unsigned threads, struct hash_t * tags) {
+	struct ast_hash_batch_t batch;
+
+	batch.sources = 0;
+	batch.asts = asts;
+	batch.count = count;
+	batch.tags = tags;
+	batch.next = 0;
+
+	ast_hash_batch_run(&batch, threads);
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef AST_PRINTER_H
+#define AST_PRINTER_H
+
+#include "ast.h"
+#include "byte_buffer.h"
+#include "memory.h"
+#include "name.h"
+
+#include <stdio.h>
+
+// Buffered printer
+//
+// Writes the same text as ast_print into a byte buffer. The tree is walked
+// with an explicit stack of pending items, each either a node or a literal, so
+// deep terms do not recurse and nothing is allocated per token: the stack and
+// the buffer only grow, and a printer reused across terms stops allocating.
+
+// prefix the text with the tag of the root, as print_hashed_ast does
+#define AST_PRINT_TAG 1
+
+typedef struct ast_print_item_t {
+	struct ast_t * ast;
+
+	// the literal when ast is 0
+	const char * text;
+	unsigned length;
+} ast_print_item_t;
+
+typedef struct ast_printer_t {
+	struct ast_print_item_t * items;
+	unsigned size;
+	unsigned capacity;
+
+	int flags;
+} ast_printer_t;
+
+void ast_printer_init(struct ast_printer_t * printer, int flags) {
+	printer->items = 0;
+	printer->size = 0;
+	printer->capacity = 0;
+	printer->flags = flags;
+}
+
+void ast_printer_destroy(struct ast_printer_t * printer) {
+	memory_free(printer->items);
+}
+
+// room for count more items
+void ast_printer_reserve(struct ast_printer_t * printer, unsigned count) {
+	if(printer->size + count <= printer->capacity) return;
+
+	unsigned capacity = printer->capacity ? printer->capacity * 2 : 64;
+
+	while(capacity < printer->size + count) capacity *= 2;
+
+	printer->items = (struct ast_print_item_t*)memory_realloc(printer->items, sizeof(struct ast_print_item_t) * capacity);
+	printer->capacity = capacity;
+}
+
+void ast_printer_push_node(struct ast_printer_t * printer, struct ast_t * ast) {
+	if(ast == 0) return;
+
+	struct ast_print_item_t * item = &printer->items[printer->size++];
+
+	item->ast = ast;
+	item->text = 0;
+	item->length = 0;
+}
+
+// length excludes the terminator, so literals are sizeof - 1
+void ast_printer_push_text(struct ast_printer_t * printer, const char * text, unsigned length) {
+	struct ast_print_item_t * item = &printer->items[printer->size++];
+
+	item->ast = 0;
+	item->text = text;
+	item->length = length;
+}
+
+#define AST_PRINTER_TEXT(printer, literal) ast_printer_push_text(printer, literal, sizeof(literal) - 1)
+
+void ast_printer_unsigned(struct byte_buffer_t * buffer, unsigned value) {
+	char digits[10];
+	unsigned count = 0;
+
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while(value);
+
+	byte_buffer_reserve(buffer, count);
+
+	for(unsigned i = 0; i < count; i++) buffer->data[buffer->size++] = digits[count - 1 - i];
+}
+
+// pushes the parts of ast in reverse, so they pop in printing order
+void ast_printer_expand(struct ast_printer_t * printer, struct ast_t * ast) {
+	ast_printer_reserve(printer, 5);
+
+	switch(ast->kind) {
+	case STATEMENT:
+		if(ast->rhs) {
+			ast_printer_push_node(printer, ast->rhs);
+			AST_PRINTER_TEXT(printer, " in\n");
+		} else {
+			AST_PRINTER_TEXT(printer, ";\n");
+		}
+		ast_printer_push_node(printer, ast->lhs);
+		AST_PRINTER_TEXT(printer, "let ");
+		break;
+	case LAMBDA:
+		ast_printer_push_node(printer, ast->rhs);
+		AST_PRINTER_TEXT(printer, " => ");
+		ast_printer_push_node(printer, ast->lhs);
+		AST_PRINTER_TEXT(printer, "fn ");
+		break;
+	case BIND:
+		ast_printer_push_node(printer, ast->rhs);
+		AST_PRINTER_TEXT(printer, ": ");
+		ast_printer_push_node(printer, ast->lhs);
+		break;
+	case ASSIGNMENT:
+		ast_printer_push_node(printer, ast->rhs);
+		AST_PRINTER_TEXT(printer, " = ");
+		ast_printer_push_node(printer, ast->lhs);
+		break;
+	case ARROW_TYPE:
+		ast_printer_push_node(printer, ast->rhs);
+		AST_PRINTER_TEXT(printer, " -> ");
+		ast_printer_push_node(printer, ast->lhs);
+		break;
+	case APP:
+		AST_PRINTER_TEXT(printer, ")");
+		ast_printer_push_node(printer, ast->rhs);
+		AST_PRINTER_TEXT(printer, " ");
+		ast_printer_push_node(printer, ast->lhs);
+		AST_PRINTER_TEXT(printer, "(");
+		break;
+	case DECLARATION:
+		ast_printer_push_node(printer, ast->lhs);
+		break;
+	case CASE_LIST:
+		if(ast->rhs) {
+			ast_printer_push_node(printer, ast->rhs);
+			AST_PRINTER_TEXT(printer, ", ");
+		}
+		ast_printer_push_node(printer, ast->lhs);
+		break;
+	case CASE:
+		ast_printer_push_node(printer, ast->rhs);
+		AST_PRINTER_TEXT(printer, " then ");
+		ast_printer_push_node(printer, ast->lhs);
+		AST_PRINTER_TEXT(printer, "case ");
+		break;
+	case PATTERN_LIST:
+		if(ast->rhs) {
+			ast_printer_push_node(printer, ast->rhs);
+			AST_PRINTER_TEXT(printer, " . ");
+		}
+		ast_printer_push_node(printer, ast->lhs);
+		break;
+	default:
+		break;
+	}
+}
+
+// appends the text of ast to buffer
+void ast_printer_print(struct ast_printer_t * printer, struct byte_buffer_t * buffer, struct ast_t * ast) {
+	if(ast == 0) return;
+
+	if(printer->flags & AST_PRINT_TAG) {
+		ast_printer_unsigned(buffer, ast->tag.crc32);
+		byte_buffer_write(buffer, " = hash of ", sizeof(" = hash of ") - 1);
+	}
+
+	printer->size = 0;
+
+	ast_printer_reserve(printer, 1);
+	ast_printer_push_node(printer, ast);
+
+	while(printer->size) {
+		struct ast_print_item_t item = printer->items[--printer->size];
+
+		if(item.ast == 0) {
+			byte_buffer_write(buffer, item.text, item.length);
+		} else if(item.ast->kind == VAR) {
+			byte_buffer_write(buffer, name_get_str(item.ast->name), name_get_length(item.ast->name));
+		} else {
+			ast_printer_expand(printer, item.ast);
+		}
+	}
+}
+
+// prints ast to file with a single write
+void ast_print_file(FILE * file, struct ast_t * ast, int flags) {
+	struct ast_printer_t printer;
+	struct byte_buffer_t buffer;
+
+	ast_printer_init(&printer, flags);
+	byte_buffer_init(&buffer);
+
+	ast_printer_print(&printer, &buffer, ast);
+
+	fwrite(buffer.data, 1, buffer.size, file);
+
+	byte_buffer_destroy(&buffer);
+	ast_printer_destroy(&printer);
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef AST_SERIALIZE_H
+#define AST_SERIALIZE_H
+
+#include "ast.h"
+#include "byte_buffer.h"
+#include "memory.h"
+#include "name.h"
+
+// Binary form of asts
+//
+// A node is its kind in one byte followed by its name for a VAR and by its two
+// children otherwise, in prefix order. A missing node is the byte
+// AST_SERIALIZE_NONE. Integers are 4 bytes little endian and strings are their
+// length followed by their characters. The tagged form also stores the tag of
+// every node after its kind, the plain form does not and a read ast is hashed
+// again by whoever needs it. Maps are never stored.
+
+#define AST_SERIALIZE_NONE 0xff
+
+// a name read in place of its string, 0 on a short input or an empty name
+struct name_t * byte_reader_name(struct byte_reader_t * reader) {
+	unsigned length = byte_reader_u32(reader);
+
+	const char * bytes = byte_reader_bytes(reader, length);
+
+	if(bytes == 0 || length == 0) {
+		reader->failed = 1;
+		return 0;
+	}
+
+	struct name_t * name = (struct name_t*)memory_alloc(sizeof(struct name_t));
+
+	name->length = length;
+	name->identifier = (char*)memory_alloc(length + 1);
+
+	memcpy(name->identifier, bytes, length);
+	name->identifier[length] = 0;
+
+	name->hash = hash(name->identifier);
+
+	return name;
+}
+
+void ast_serialize_node(struct byte_buffer_t * buffer, struct ast_t * ast, int tagged) {
+	if(ast == 0) {
+		byte_buffer_u8(buffer, AST_SERIALIZE_NONE);
+		return;
+	}
+
+	byte_buffer_u8(buffer, (unsigned char)ast->kind);
+
+	if(tagged) byte_buffer_u32(buffer, ast->tag.crc32);
+
+	if(ast->kind == VAR) {
+		byte_buffer_string(buffer, name_get_str(ast->name));
+		return;
+	}
+
+	ast_serialize_node(buffer, ast->lhs, tagged);
+	ast_serialize_node(buffer, ast->rhs, tagged);
+}
+
+void ast_serialize(struct byte_buffer_t * buffer, struct ast_t * ast) {
+	ast_serialize_node(buffer, ast, 0);
+}
+
+void ast_serialize_tagged(struct byte_buffer_t * buffer, struct ast_t * ast) {
+	ast_serialize_node(buffer, ast, 1);
+}
+
+struct ast_t * ast_deserialize_node(struct byte_reader_t * reader, int tagged) {
+	unsigned char kind = byte_reader_u8(reader);
+
+	if(reader->failed || kind == AST_SERIALIZE_NONE) return 0;
+
+	if(kind >= TOTAL_KINDS) {
+		reader->failed = 1;
+		return 0;
+	}
+
+	struct hash_t tag = hash(tagged ? byte_reader_u32(reader) : 0u);
+
+	if(kind == VAR) {
+		struct name_t * name = byte_reader_name(reader);
+
+		if(name == 0) return 0;
+
+		struct ast_t * node = alloc_node(VAR);
+
+		node->name = name;
+		node->tag = tag;
+
+		return node;
+	}
+
+	struct ast_t * node = alloc_node((enum ast_kind_t)kind);
+
+	node->tag = tag;
+	node->lhs = ast_deserialize_node(reader, tagged);
+	node->rhs = ast_deserialize_node(reader, tagged);
+
+	if(node->lhs) node->lhs->parent = node;
+	if(node->rhs) node->rhs->parent = node;
+
+	if(reader->failed) {
+		ast_free(node);
+		return 0;
+	}
+
+	return node;
+}
+
+// the ast, or 0 for a missing node and on a malformed input
+struct ast_t * ast_deserialize(struct byte_reader_t * reader) {
+	return ast_deserialize_node(reader, 0);
+}
+
+// the ast with the tags it was written with
+struct ast_t * ast_deserialize_tagged(struct byte_reader_t * reader) {
+	return ast_deserialize_node(reader, 1);
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef BYTE_BUFFER_H
+#define BYTE_BUFFER_H
+
+#include "memory.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// Growable byte buffers and bounded readers over bytes. Integers are 4 bytes
+// little endian and strings are their length followed by their characters.
+
+typedef struct byte_buffer_t {
+	char * data;
+	unsigned long size;
+	unsigned long capacity;
+} byte_buffer_t;
+
+void byte_buffer_init(struct byte_buffer_t * buffer) {
+	buffer->data = 0;
+	buffer->size = 0;
+	buffer->capacity = 0;
+}
+
+void byte_buffer_destroy(struct byte_buffer_t * buffer) {
+	memory_free(buffer->data);
+}
+
+// room for size more bytes at data + size
+void byte_buffer_reserve(struct byte_buffer_t * buffer, unsigned long size) {
+	if(buffer->size + size <= buffer->capacity) return;
+
+	unsigned long capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+
+	while(capacity < buffer->size + size) capacity *= 2;
+
+	buffer->data = (char*)memory_realloc(buffer->data, capacity);
+	buffer->capacity = capacity;
+}
+
+void byte_buffer_write(struct byte_buffer_t * buffer, const void * data, unsigned long size) {
+	byte_buffer_reserve(buffer, size);
+
+	memcpy(buffer->data + buffer->size, data, size);
+
+	buffer->size += size;
+}
+
+void byte_buffer_u8(struct byte_buffer_t * buffer, unsigned char value) {
+	byte_buffer_write(buffer, &value, 1);
+}
+
+void byte_buffer_u32(struct byte_buffer_t * buffer, unsigned value) {
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+
+	byte_buffer_write(buffer, bytes, 4);
+}
+
+void byte_buffer_string(struct byte_buffer_t * buffer, const char * str) {
+	unsigned length = strlen(str);
+
+	byte_buffer_u32(buffer, length);
+	byte_buffer_write(buffer, str, length);
+}
+
+// appends the contents of the file at path, returns 0 if it can not be opened
+int byte_buffer_read_file(struct byte_buffer_t * buffer, const char * path) {
+	FILE * file = fopen(path, "rb");
+
+	if(file == 0) return 0;
+
+	char block[4096];
+	unsigned long size;
+
+	while((size = fread(block, 1, sizeof(block), file)) > 0) {
+		byte_buffer_write(buffer, block, size);
+	}
+
+	fclose(file);
+
+	return 1;
+}
+
+// writes data to a temporary file renamed over path, a reader sees either the
+// old file or the new one whole. The temporary name is unique to the process
+// and the call, so concurrent writers of the same path do not mix their bytes.
+// Returns 1 if path was replaced.
+int byte_buffer_write_file(const char * path, const char * data, unsigned long size) {
+	static std::atomic<unsigned> writes(0);
+
+	unsigned long length = strlen(path) + 64;
+
+	char * temporary = (char*)memory_alloc(length);
+
+	snprintf(temporary, length, "%s.%ld.%u.tmp", path, (long)getpid(), writes.fetch_add(1));
+
+	FILE * file = fopen(temporary, "wb");
+
+	int replaced = 0;
+
+	if(file) {
+		int written = fwrite(data, 1, size, file) == size;
+
+		written = fclose(file) == 0 && written;
+
+		replaced = written && rename(temporary, path) == 0;
+
+		if(!replaced) remove(temporary);
+	}
+
+	memory_free(temporary);
+
+	return replaced;
+}
+
+// reads never go past size, a short or malformed input sets failed
+typedef struct byte_reader_t {
+	const char * data;
+	unsigned long size;
+	unsigned long at;
+
+	int failed;
+} byte_reader_t;
+
+void byte_reader_init(struct byte_reader_t * reader, const char * data, unsigned long size) {
+	reader->data = data;
+	reader->size = size;
+	reader->at = 0;
+	reader->failed = 0;
+}
+
+// the next size bytes, 0 if there are not as many left
+const char * byte_reader_bytes(struct byte_reader_t * reader, unsigned long size) {
+	if(reader->failed || size > reader->size - reader->at) {
+		reader->failed = 1;
+		return 0;
+	}
+
+	const char * bytes = reader->data + reader->at;
+
+	reader->at += size;
+
+	return bytes;
+}
+
+unsigned char byte_reader_u8(struct byte_reader_t * reader) {
+	const char * bytes = byte_reader_bytes(reader, 1);
+
+	return bytes ? (unsigned char)bytes[0] : 0;
+}
+
+unsigned byte_reader_u32(struct byte_reader_t * reader) {
+	const unsigned char * bytes = (const unsigned char*)byte_reader_bytes(reader, 4);
+
+	if(bytes == 0) return 0;
+
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned)bytes[3] << 24);
+}
+
+// string allocated with memory_alloc, 0 on a short input
+char * byte_reader_string(struct byte_reader_t * reader) {
+	unsigned length = byte_reader_u32(reader);
+
+	const char * bytes = byte_reader_bytes(reader, length);
+
+	if(bytes == 0) return 0;
+
+	char * str = (char*)memory_alloc(length + 1);
+
+	memcpy(str, bytes, length);
+	str[length] = 0;
+
+	return str;
+}
+
+#endif
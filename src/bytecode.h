@@ -0,0 +1,382 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ast.h"
+#include "name.h"
+#include "memory.h"
+#include "swiss_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Bytecode
+//
+// Linear code for the lazy Krivine machine in machine.h. Variables are resolved
+// to de Bruijn indices at compile time, free variables and binder names go to a
+// constant table. Applications push a thunk of their argument and continue with
+// the function, a lambda grabs an argument and continues with its body, so the
+// code of a term runs straight until it reaches a variable or a value and the
+// code of the arguments is placed after it.
+//
+//   ACCESS i         enter the i-th variable of the environment
+//   FREE k           free variable k, a neutral term
+//   PUSH l           push a thunk of the code at l in the current environment
+//   GRAB k t         lambda binding name k with type at t, the body follows
+//   PI k t b         dependent function type binding k, type at t, body at b
+//   ARROW t b        function type, domain at t, codomain at b
+//
+// As in nbe.h, LAMBDA and ARROW_TYPE nodes whose lhs is a BIND are the binders
+// and the type of the binder is outside of its scope. Ascriptions are erased.
+
+#define BYTECODE_NO_LABEL 0xffffffffu
+
+enum opcode_t {
+	OP_ACCESS = 0,
+	OP_FREE,
+	OP_PUSH,
+	OP_GRAB,
+	OP_PI,
+	OP_ARROW,
+};
+
+typedef struct instruction_t {
+	enum opcode_t op;
+
+	unsigned a;
+	unsigned b;
+	unsigned c;
+} instruction_t;
+
+// a definition or declaration of a program, value is BYTECODE_NO_LABEL for
+// declarations
+typedef struct bytecode_let_t {
+	unsigned name;
+	unsigned type;
+	unsigned value;
+} bytecode_let_t;
+
+typedef struct bytecode_t {
+	unsigned size;
+	unsigned capacity;
+	struct instruction_t * code;
+
+	// copies of the names, free is set for the ones used as free variables
+	unsigned constants_size;
+	unsigned constants_capacity;
+	struct name_t ** constants;
+	unsigned char * free;
+
+	// entry of an expression, BYTECODE_NO_LABEL for programs
+	unsigned entry;
+
+	unsigned lets_size;
+	struct bytecode_let_t * lets;
+} bytecode_t;
+
+// names in scope during the compilation, cells are referred to by index
+typedef struct bytecode_scope_t {
+	struct name_t * name;
+	int parent;
+} bytecode_scope_t;
+
+typedef struct bytecode_pending_t {
+	struct ast_t * ast;
+	int scope;
+
+	// instruction and operand to patch with the label of the code
+	unsigned instruction;
+	unsigned operand;
+} bytecode_pending_t;
+
+typedef struct bytecode_compiler_t {
+	struct bytecode_t * code;
+
+	swiss_table_t<name_t*, unsigned> constant_index;
+
+	unsigned scopes_size;
+	unsigned scopes_capacity;
+	struct bytecode_scope_t * scopes;
+
+	unsigned pending_size;
+	unsigned pending_capacity;
+	struct bytecode_pending_t * pending;
+} bytecode_compiler_t;
+
+unsigned bytecode_emit(struct bytecode_t * code, enum opcode_t op, unsigned a, unsigned b, unsigned c) {
+	if(code->size == code->capacity) {
+		code->capacity *= 2;
+		code->code = (struct instruction_t*)memory_realloc(code->code, sizeof(struct instruction_t) * code->capacity);
+	}
+
+	struct instruction_t * instruction = &code->code[code->size];
+
+	instruction->op = op;
+	instruction->a = a;
+	instruction->b = b;
+	instruction->c = c;
+
+	return code->size++;
+}
+
+unsigned bytecode_constant(struct bytecode_compiler_t * compiler, struct name_t * name, int free) {
+	struct bytecode_t * code = compiler->code;
+
+	unsigned * index = swiss_table_get(&compiler->constant_index, name);
+
+	if(index) {
+		code->free[*index] |= free;
+		return *index;
+	}
+
+	if(code->constants_size == code->constants_capacity) {
+		code->constants_capacity *= 2;
+		code->constants = (struct name_t**)memory_realloc(code->constants, sizeof(struct name_t*) * code->constants_capacity);
+		code->free = (unsigned char*)memory_realloc(code->free, code->constants_capacity);
+	}
+
+	unsigned k = code->constants_size++;
+
+	code->constants[k] = name_copy(name);
+	code->free[k] = free;
+
+	swiss_table_insert(&compiler->constant_index, code->constants[k], k);
+
+	return k;
+}
+
+int bytecode_scope_push(struct bytecode_compiler_t * compiler, int parent, struct name_t * name) {
+	if(compiler->scopes_size == compiler->scopes_capacity) {
+		compiler->scopes_capacity *= 2;
+		compiler->scopes = (struct bytecode_scope_t*)memory_realloc(compiler->scopes, sizeof(struct bytecode_scope_t) * compiler->scopes_capacity);
+	}
+
+	compiler->scopes[compiler->scopes_size].name = name;
+	compiler->scopes[compiler->scopes_size].parent = parent;
+
+	return compiler->scopes_size++;
+}
+
+// de Bruijn index of name in scope, -1 if it is free
+int bytecode_scope_index(struct bytecode_compiler_t * compiler, int scope, struct name_t * name) {
+	for(int i = 0; scope != -1; i++, scope = compiler->scopes[scope].parent) {
+		if(name_equal(compiler->scopes[scope].name, name)) return i;
+	}
+
+	return -1;
+}
+
+// compiles ast later and patches the operand of instruction with its label
+void bytecode_defer(struct bytecode_compiler_t * compiler, struct ast_t * ast, int scope, unsigned instruction, unsigned operand) {
+	if(compiler->pending_size == compiler->pending_capacity) {
+		compiler->pending_capacity *= 2;
+		compiler->pending = (struct bytecode_pending_t*)memory_realloc(compiler->pending, sizeof(struct bytecode_pending_t) * compiler->pending_capacity);
+	}
+
+	struct bytecode_pending_t * pending = &compiler->pending[compiler->pending_size++];
+
+	pending->ast = ast;
+	pending->scope = scope;
+	pending->instruction = instruction;
+	pending->operand = operand;
+}
+
+void bytecode_patch(struct bytecode_t * code, unsigned instruction, unsigned operand, unsigned label) {
+	if(instruction == BYTECODE_NO_LABEL) return;
+
+	struct instruction_t * patched = &code->code[instruction];
+
+	if(operand == 0) patched->a = label;
+	if(operand == 1) patched->b = label;
+	if(operand == 2) patched->c = label;
+}
+
+// emits the code of ast, following the function of applications and the body
+// of lambdas inline and deferring everything else
+void bytecode_compile_inline(struct bytecode_compiler_t * compiler, struct ast_t * ast, int scope) {
+	struct bytecode_t * code = compiler->code;
+
+	while(1) {
+		switch(ast->kind) {
+		case VAR: {
+			int index = bytecode_scope_index(compiler, scope, ast->name);
+
+			if(index == -1) {
+				bytecode_emit(code, OP_FREE, bytecode_constant(compiler, ast->name, 1), 0, 0);
+			} else {
+				bytecode_emit(code, OP_ACCESS, index, 0, 0);
+			}
+
+			return;
+		}
+
+		case APP: {
+			unsigned push = bytecode_emit(code, OP_PUSH, BYTECODE_NO_LABEL, 0, 0);
+			bytecode_defer(compiler, ast->rhs, scope, push, 0);
+			ast = ast->lhs;
+			break;
+		}
+
+		case LAMBDA: {
+			struct ast_t * binder = ast->lhs;
+			struct name_t * name = binder->kind == BIND ? binder->lhs->name : binder->name;
+
+			unsigned grab = bytecode_emit(code, OP_GRAB, bytecode_constant(compiler, name, 0), BYTECODE_NO_LABEL, 0);
+
+			if(binder->kind == BIND) {
+				bytecode_defer(compiler, binder->rhs, scope, grab, 1);
+			}
+
+			scope = bytecode_scope_push(compiler, scope, name);
+			ast = ast->rhs;
+			break;
+		}
+
+		case ARROW_TYPE: {
+			if(ast->lhs->kind == BIND) {
+				struct name_t * name = ast->lhs->lhs->name;
+
+				unsigned pi = bytecode_emit(code, OP_PI, bytecode_constant(compiler, name, 0), BYTECODE_NO_LABEL, BYTECODE_NO_LABEL);
+
+				bytecode_defer(compiler, ast->lhs->rhs, scope, pi, 1);
+				bytecode_defer(compiler, ast->rhs, bytecode_scope_push(compiler, scope, name), pi, 2);
+			} else {
+				unsigned arrow = bytecode_emit(code, OP_ARROW, 0, BYTECODE_NO_LABEL, BYTECODE_NO_LABEL);
+
+				bytecode_defer(compiler, ast->lhs, scope, arrow, 1);
+				bytecode_defer(compiler, ast->rhs, scope, arrow, 2);
+			}
+
+			return;
+		}
+
+		case BIND:
+			ast = ast->lhs;
+			break;
+
+		case CASE_LIST:
+			printf("bytecode: case lists are only evaluated by nbe.h\n");
+			abort();
+
+		default:
+			printf("bytecode: statements can only appear at the top level\n");
+			abort();
+		}
+	}
+}
+
+// compiles ast and everything it deferred, returns its label
+unsigned bytecode_compile_term(struct bytecode_compiler_t * compiler, struct ast_t * ast, int scope) {
+	unsigned label = compiler->code->size;
+
+	bytecode_defer(compiler, ast, scope, BYTECODE_NO_LABEL, 0);
+
+	while(compiler->pending_size) {
+		struct bytecode_pending_t pending = compiler->pending[--compiler->pending_size];
+
+		bytecode_patch(compiler->code, pending.instruction, pending.operand, compiler->code->size);
+		bytecode_compile_inline(compiler, pending.ast, pending.scope);
+	}
+
+	return label;
+}
+
+// Compiles an expression or a program. The code keeps copies of the names and
+// does not refer to ast.
+struct bytecode_t * bytecode_compile(struct ast_t * ast) {
+	struct bytecode_t * code = (struct bytecode_t*)memory_alloc(sizeof(struct bytecode_t));
+
+	code->size = 0;
+	code->capacity = 64;
+	code->code = (struct instruction_t*)memory_alloc(sizeof(struct instruction_t) * code->capacity);
+
+	code->constants_size = 0;
+	code->constants_capacity = 16;
+	code->constants = (struct name_t**)memory_alloc(sizeof(struct name_t*) * code->constants_capacity);
+	code->free = (unsigned char*)memory_alloc(code->constants_capacity);
+
+	code->entry = BYTECODE_NO_LABEL;
+	code->lets_size = 0;
+	code->lets = 0;
+
+	struct bytecode_compiler_t compiler;
+
+	compiler.code = code;
+
+	swiss_table_init(&compiler.constant_index);
+
+	compiler.scopes_size = 0;
+	compiler.scopes_capacity = 16;
+	compiler.scopes = (struct bytecode_scope_t*)memory_alloc(sizeof(struct bytecode_scope_t) * compiler.scopes_capacity);
+
+	compiler.pending_size = 0;
+	compiler.pending_capacity = 16;
+	compiler.pending = (struct bytecode_pending_t*)memory_alloc(sizeof(struct bytecode_pending_t) * compiler.pending_capacity);
+
+	if(ast->kind != STATEMENT) {
+		code->entry = bytecode_compile_term(&compiler, ast, -1);
+	} else {
+		for(struct ast_t * statement = ast; statement; statement = statement->rhs) {
+			code->lets_size += 1;
+		}
+
+		code->lets = (struct bytecode_let_t*)memory_alloc(sizeof(struct bytecode_let_t) * code->lets_size);
+
+		int scope = -1;
+
+		unsigned i = 0;
+
+		for(struct ast_t * statement = ast; statement; statement = statement->rhs, i++) {
+			struct ast_t * let = statement->lhs;
+			struct name_t * name = let->lhs->lhs->name;
+
+			// declared names stay free
+			code->lets[i].name = bytecode_constant(&compiler, name, let->kind == DECLARATION);
+			code->lets[i].type = bytecode_compile_term(&compiler, let->lhs->rhs, scope);
+			code->lets[i].value = let->kind == ASSIGNMENT ? bytecode_compile_term(&compiler, let->rhs, scope) : BYTECODE_NO_LABEL;
+
+			scope = bytecode_scope_push(&compiler, scope, name);
+		}
+	}
+
+	swiss_table_destroy(&compiler.constant_index);
+
+	memory_free(compiler.scopes);
+	memory_free(compiler.pending);
+
+	return code;
+}
+
+void bytecode_free(struct bytecode_t * code) {
+	for(unsigned i = 0; i < code->constants_size; i++) {
+		name_free(code->constants[i]);
+	}
+
+	memory_free(code->constants);
+	memory_free(code->free);
+	memory_free(code->code);
+
+	if(code->lets) {
+		memory_free(code->lets);
+	}
+
+	memory_free(code);
+}
+
+void bytecode_print(struct bytecode_t * code, FILE * out) {
+	for(unsigned pc = 0; pc < code->size; pc++) {
+		struct instruction_t * in = &code->code[pc];
+
+		fprintf(out, "%5u  ", pc);
+
+		switch(in->op) {
+		case OP_ACCESS: fprintf(out, "ACCESS %u\n", in->a); break;
+		case OP_FREE: fprintf(out, "FREE   %s\n", name_get_str(code->constants[in->a])); break;
+		case OP_PUSH: fprintf(out, "PUSH   %u\n", in->a); break;
+		case OP_GRAB: fprintf(out, "GRAB   %s %d\n", name_get_str(code->constants[in->a]), (int)in->b); break;
+		case OP_PI: fprintf(out, "PI     %s %u %u\n", name_get_str(code->constants[in->a]), in->b, in->c); break;
+		case OP_ARROW: fprintf(out, "ARROW  %u %u\n", in->b, in->c); break;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,454 @@
+#ifndef CASE_TREE_H
+#define CASE_TREE_H
+
+#include "ast.h"
+#include "memory.h"
+#include "name.h"
+#include "swiss_table.h"
+
+#include <stdio.h>
+
+// Decision trees
+//
+// A case list is compiled into a tree that tests every argument, and every
+// field of a matched constructor, at most once on any path. The values being
+// matched are kept in registers: the arguments are the first ones, and a
+// switch that matches a constructor puts its fields in the registers starting
+// at first. A switch finds the branch of a constructor with one lookup, the
+// names it does not list go to the default branch. A leaf holds the case
+// taken and the registers of its pattern variables, in the order of
+// ast_pattern_foreach_variable.
+//
+// The compilation is the usual one over a matrix of patterns, one row per
+// case and one column per register. The tested column is the first
+// constructor of the first row. Its rows are specialized for each constructor
+// found in the column, and the rows with a variable there also go to the
+// default branch. Constructor sets are never known to be complete, so every
+// switch may fail. A failure leaves the application stuck.
+
+enum case_node_kind_t {
+	CASE_NODE_FAIL,
+	CASE_NODE_LEAF,
+	CASE_NODE_SWITCH,
+};
+
+typedef struct case_node_t {
+	enum case_node_kind_t kind;
+
+	// SWITCH
+	unsigned occurrence;
+	unsigned first;
+	unsigned count;
+	struct name_t ** constructors;
+	unsigned * arities;
+	struct case_node_t ** branches;
+	struct case_node_t * fallback;
+
+	// constructor -> branch
+	swiss_table_t<name_t*, unsigned> index;
+
+	// LEAF
+	struct ast_t * match;
+	unsigned * registers;
+} case_node_t;
+
+typedef struct case_tree_t {
+	struct ast_t * cases;
+
+	// patterns per case
+	unsigned arity;
+
+	// registers a match needs
+	unsigned registers;
+
+	struct case_node_t * root;
+
+	unsigned nodes;
+
+	// paths with no case, and cases no path reaches
+	unsigned failures;
+	unsigned unreachable;
+} case_tree_t;
+
+typedef struct case_binding_t {
+	struct name_t * name;
+	unsigned occurrence;
+} case_binding_t;
+
+typedef struct case_row_t {
+	struct ast_t * match;
+
+	// one pattern per column, 0 once it matches anything
+	struct ast_t ** patterns;
+
+	unsigned bindings_count;
+	struct case_binding_t * bindings;
+} case_row_t;
+
+// head of the spine of a pattern and its number of arguments
+struct ast_t * case_pattern_head(struct ast_t * pattern, unsigned * arity) {
+	*arity = 0;
+
+	while(pattern->kind == APP) {
+		pattern = pattern->lhs;
+		*arity += 1;
+	}
+
+	return pattern;
+}
+
+// 1 if pattern is a constructor with or without arguments
+int case_pattern_is_constructor(struct ast_t * pattern) {
+	unsigned arity;
+
+	return pattern && ast_is_constructor(case_pattern_head(pattern, &arity)->name);
+}
+
+struct case_node_t * case_node_alloc(struct case_tree_t * tree, enum case_node_kind_t kind) {
+	struct case_node_t * node = (struct case_node_t*)memory_alloc(sizeof(struct case_node_t));
+
+	node->kind = kind;
+	node->occurrence = 0;
+	node->first = 0;
+	node->count = 0;
+	node->constructors = 0;
+	node->arities = 0;
+	node->branches = 0;
+	node->fallback = 0;
+	node->match = 0;
+	node->registers = 0;
+
+	swiss_table_init(&node->index);
+
+	tree->nodes += 1;
+
+	return node;
+}
+
+// copy of row whose pattern in column is replaced by the arity fields, or by
+// as many wildcards when fields is 0, binding the variable it was if any
+struct case_row_t case_row_specialize(struct case_row_t * row, unsigned columns, unsigned column, struct ast_t ** fields, unsigned arity, unsigned occurrence) {
+	struct case_row_t result;
+
+	result.match = row->match;
+	result.patterns = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * (columns - 1 + arity + 1));
+
+	unsigned size = 0;
+
+	for(unsigned j = 0; j < column; j++) result.patterns[size++] = row->patterns[j];
+	for(unsigned k = 0; k < arity; k++) result.patterns[size++] = fields ? fields[k] : 0;
+	for(unsigned j = column + 1; j < columns; j++) result.patterns[size++] = row->patterns[j];
+
+	struct ast_t * pattern = row->patterns[column];
+
+	int binds = pattern && pattern->kind == VAR && !ast_is_constructor(pattern->name) && !ast_is_wildcard(pattern->name);
+
+	result.bindings_count = row->bindings_count + binds;
+	result.bindings = (struct case_binding_t*)memory_alloc(sizeof(struct case_binding_t) * (result.bindings_count + 1));
+
+	// the rows of the clauses start without a bindings array
+	if(row->bindings_count) {
+		memcpy(result.bindings, row->bindings, sizeof(struct case_binding_t) * row->bindings_count);
+	}
+
+	if(binds) {
+		result.bindings[row->bindings_count] = { pattern->name, occurrence };
+	}
+
+	return result;
+}
+
+void case_rows_free(struct case_row_t * rows, unsigned count) {
+	for(unsigned i = 0; i < count; i++) {
+		memory_free(rows[i].patterns);
+		memory_free(rows[i].bindings);
+	}
+
+	memory_free(rows);
+}
+
+struct case_node_t * case_tree_leaf(struct case_tree_t * tree, struct case_row_t * row, unsigned columns, unsigned * occurrences, char * reached) {
+	struct case_node_t * node = case_node_alloc(tree, CASE_NODE_LEAF);
+
+	node->match = row->match;
+
+	unsigned count = ast_case_variables(row->match);
+
+	node->registers = (unsigned*)memory_alloc(sizeof(unsigned) * (count + 1));
+
+	unsigned i = 0;
+
+	// a variable matched a field or argument already tested, or a whole
+	// register that is still a column
+	ast_pattern_foreach_variable(row->match->lhs, [&](struct ast_t * x) {
+		node->registers[i] = 0;
+
+		for(unsigned b = 0; b < row->bindings_count; b++) {
+			if(name_equal(row->bindings[b].name, x->name)) node->registers[i] = row->bindings[b].occurrence;
+		}
+
+		for(unsigned j = 0; j < columns; j++) {
+			struct ast_t * pattern = row->patterns[j];
+
+			if(pattern && pattern->kind == VAR && name_equal(pattern->name, x->name)) node->registers[i] = occurrences[j];
+		}
+
+		i += 1;
+	});
+
+	unsigned index = 0;
+
+	for(struct ast_t * cases = tree->cases; cases->lhs != row->match; cases = cases->rhs) {
+		index += 1;
+	}
+
+	reached[index] = 1;
+
+	return node;
+}
+
+// compiles rows, which are consumed, whose columns are in the given registers
+struct case_node_t * case_tree_compile_rows(struct case_tree_t * tree, struct case_row_t * rows, unsigned count, unsigned * occurrences, unsigned columns, unsigned next, char * reached) {
+	if(next > tree->registers) {
+		tree->registers = next;
+	}
+
+	if(count == 0) {
+		tree->failures += 1;
+
+		memory_free(rows);
+
+		return case_node_alloc(tree, CASE_NODE_FAIL);
+	}
+
+	unsigned column = columns;
+
+	for(unsigned j = 0; j < columns && column == columns; j++) {
+		if(case_pattern_is_constructor(rows[0].patterns[j])) column = j;
+	}
+
+	if(column == columns) {
+		struct case_node_t * leaf = case_tree_leaf(tree, &rows[0], columns, occurrences, reached);
+
+		case_rows_free(rows, count);
+
+		return leaf;
+	}
+
+	struct case_node_t * node = case_node_alloc(tree, CASE_NODE_SWITCH);
+
+	node->occurrence = occurrences[column];
+	node->first = next;
+
+	// the constructors of the column, in order of appearance
+	node->constructors = (struct name_t**)memory_alloc(sizeof(struct name_t*) * count);
+	node->arities = (unsigned*)memory_alloc(sizeof(unsigned) * count);
+
+	for(unsigned i = 0; i < count; i++) {
+		struct ast_t * pattern = rows[i].patterns[column];
+
+		if(!case_pattern_is_constructor(pattern)) continue;
+
+		unsigned arity;
+
+		struct name_t * name = case_pattern_head(pattern, &arity)->name;
+
+		if(swiss_table_get(&node->index, name)) continue;
+
+		swiss_table_insert(&node->index, name, node->count);
+
+		node->constructors[node->count] = name;
+		node->arities[node->count] = arity;
+		node->count += 1;
+	}
+
+	node->branches = (struct case_node_t**)memory_alloc(sizeof(struct case_node_t*) * node->count);
+
+	for(unsigned c = 0; c < node->count; c++) {
+		unsigned arity = node->arities[c];
+		unsigned size = 0;
+
+		struct case_row_t * specialized = (struct case_row_t*)memory_alloc(sizeof(struct case_row_t) * count);
+
+		struct ast_t ** fields = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * (arity + 1));
+
+		for(unsigned i = 0; i < count; i++) {
+			struct ast_t * pattern = rows[i].patterns[column];
+
+			if(case_pattern_is_constructor(pattern)) {
+				unsigned pattern_arity;
+
+				struct ast_t * head = case_pattern_head(pattern, &pattern_arity);
+
+				if(pattern_arity != arity || !name_equal(head->name, node->constructors[c])) continue;
+
+				struct ast_t * spine = pattern;
+
+				for(unsigned k = arity; k > 0; k--, spine = spine->lhs) {
+					fields[k - 1] = spine->rhs;
+				}
+
+				specialized[size++] = case_row_specialize(&rows[i], columns, column, fields, arity, node->occurrence);
+			} else {
+				specialized[size++] = case_row_specialize(&rows[i], columns, column, 0, arity, node->occurrence);
+			}
+		}
+
+		memory_free(fields);
+
+		unsigned * inner = (unsigned*)memory_alloc(sizeof(unsigned) * (columns - 1 + arity + 1));
+		unsigned width = 0;
+
+		for(unsigned j = 0; j < column; j++) inner[width++] = occurrences[j];
+		for(unsigned k = 0; k < arity; k++) inner[width++] = next + k;
+		for(unsigned j = column + 1; j < columns; j++) inner[width++] = occurrences[j];
+
+		node->branches[c] = case_tree_compile_rows(tree, specialized, size, inner, width, next + arity, reached);
+
+		memory_free(inner);
+	}
+
+	// the rows that match any constructor, without the column
+	unsigned size = 0;
+
+	struct case_row_t * fallback = (struct case_row_t*)memory_alloc(sizeof(struct case_row_t) * count);
+
+	for(unsigned i = 0; i < count; i++) {
+		if(!case_pattern_is_constructor(rows[i].patterns[column])) {
+			fallback[size++] = case_row_specialize(&rows[i], columns, column, 0, 0, node->occurrence);
+		}
+	}
+
+	unsigned * inner = (unsigned*)memory_alloc(sizeof(unsigned) * columns);
+	unsigned width = 0;
+
+	for(unsigned j = 0; j < columns; j++) {
+		if(j != column) inner[width++] = occurrences[j];
+	}
+
+	node->fallback = case_tree_compile_rows(tree, fallback, size, inner, width, next, reached);
+
+	memory_free(inner);
+
+	case_rows_free(rows, count);
+
+	return node;
+}
+
+// Compiles a CASE_LIST. Returns 0 if its cases do not all have the same
+// number of patterns.
+struct case_tree_t * case_tree_compile(struct ast_t * cases) {
+	struct case_tree_t * tree = (struct case_tree_t*)memory_alloc(sizeof(struct case_tree_t));
+
+	tree->cases = cases;
+	tree->arity = 0;
+	tree->registers = 0;
+	tree->root = 0;
+	tree->nodes = 0;
+	tree->failures = 0;
+	tree->unreachable = 0;
+
+	for(struct ast_t * patterns = cases->lhs->lhs; patterns; patterns = patterns->rhs) {
+		tree->arity += 1;
+	}
+
+	unsigned count = 0;
+
+	for(struct ast_t * list = cases; list; list = list->rhs) {
+		count += 1;
+	}
+
+	struct case_row_t * rows = (struct case_row_t*)memory_alloc(sizeof(struct case_row_t) * count);
+
+	count = 0;
+
+	for(struct ast_t * list = cases; list; list = list->rhs) {
+		struct case_row_t * row = &rows[count++];
+
+		row->match = list->lhs;
+		row->patterns = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * (tree->arity + 1));
+		row->bindings_count = 0;
+		row->bindings = 0;
+
+		unsigned width = 0;
+
+		for(struct ast_t * patterns = list->lhs->lhs; patterns; patterns = patterns->rhs) {
+			if(width < tree->arity) row->patterns[width] = patterns->lhs;
+			width += 1;
+		}
+
+		if(width != tree->arity) {
+			memory_free(tree);
+			case_rows_free(rows, count);
+			return 0;
+		}
+	}
+
+	unsigned * occurrences = (unsigned*)memory_alloc(sizeof(unsigned) * (tree->arity + 1));
+
+	for(unsigned j = 0; j < tree->arity; j++) {
+		occurrences[j] = j;
+	}
+
+	char * reached = (char*)memory_alloc(count);
+
+	memset(reached, 0, count);
+
+	unsigned cases_count = count;
+
+	tree->root = case_tree_compile_rows(tree, rows, count, occurrences, tree->arity, tree->arity, reached);
+
+	for(unsigned i = 0; i < cases_count; i++) {
+		tree->unreachable += !reached[i];
+	}
+
+	memory_free(reached);
+	memory_free(occurrences);
+
+	return tree;
+}
+
+void case_node_free(struct case_node_t * node) {
+	if(node == 0) return;
+
+	for(unsigned c = 0; c < node->count; c++) {
+		case_node_free(node->branches[c]);
+	}
+
+	case_node_free(node->fallback);
+
+	swiss_table_destroy(&node->index);
+
+	memory_free(node->constructors);
+	memory_free(node->arities);
+	memory_free(node->branches);
+	memory_free(node->registers);
+	memory_free(node);
+}
+
+void case_tree_free(struct case_tree_t * tree) {
+	if(tree == 0) return;
+
+	case_node_free(tree->root);
+	memory_free(tree);
+}
+
+// branch of the constructor name with arity fields, the default branch if
+// the switch does not list it and 0 if the arity differs
+struct case_node_t * case_node_branch(struct case_node_t * node, struct name_t * name, unsigned arity) {
+	unsigned * branch = swiss_table_get(&node->index, name);
+
+	if(branch == 0) return node->fallback;
+
+	return node->arities[*branch] == arity ? node->branches[*branch] : 0;
+}
+
+void case_tree_report(struct case_tree_t * tree, FILE * out) {
+	fprintf(out, "patterns per case:   %u\n", tree->arity);
+	fprintf(out, "registers:           %u\n", tree->registers);
+	fprintf(out, "tree nodes:          %u\n", tree->nodes);
+	fprintf(out, "failure paths:       %u\n", tree->failures);
+	fprintf(out, "unreachable cases:   %u\n", tree->unreachable);
+}
+
+#endif
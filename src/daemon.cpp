@@ -0,0 +1,51 @@
+#include "daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// daemon <socket> [prelude file] [workers]
+//
+// Serves the requests of daemon.h on the socket until a client sends
+// DAEMON_STOP, with the definitions of the prelude file in scope. The workers
+// default to one per core.
+
+int main(int argc, char ** argv) {
+	if(argc < 2) {
+		printf("usage: %s <socket> [prelude file] [workers]\n", argv[0]);
+		return 1;
+	}
+
+	struct byte_buffer_t prelude;
+
+	byte_buffer_init(&prelude);
+
+	if(argc > 2) {
+		if(!byte_buffer_read_file(&prelude, argv[2])) {
+			printf("cannot read %s\n", argv[2]);
+			return 1;
+		}
+
+		byte_buffer_u8(&prelude, 0);
+	}
+
+	unsigned workers = argc > 3 ? (unsigned)strtoul(argv[3], 0, 10) : 0;
+
+	struct daemon_t daemon;
+
+	if(!daemon_init(&daemon, argv[1], argc > 2 ? prelude.data : 0, workers)) {
+		daemon_destroy(&daemon);
+		return 1;
+	}
+
+	byte_buffer_destroy(&prelude);
+
+	printf("listening on %s with %u workers, %u definitions\n", argv[1], daemon.workers_size, daemon.prelude.size);
+	fflush(stdout);
+
+	daemon_run(&daemon);
+
+	daemon_report(&daemon, stdout);
+	daemon_destroy(&daemon);
+
+	return 0;
+}
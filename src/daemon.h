@@ -0,0 +1,649 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "ast.h"
+#include "ast_hash.h"
+#include "ast_serialize.h"
+#include "byte_buffer.h"
+#include "memory.h"
+#include "normal_form_cache.h"
+#include "parser.h"
+#include "reduction.h"
+#include "typecheck.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <errno.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+// Daemon
+//
+// A long running process serving requests over a Unix domain socket, so the
+// prelude is parsed, checked and hashed once rather than by every query. The
+// prelude is checked when the daemon starts and its definitions stay resident
+// with their names, their hashed types and their normal forms, as does a
+// normal form cache shared by every request.
+//
+// A message is a 4 byte little endian length followed by that many bytes. A
+// request is an operation byte, a 32 bit argument and a source string, a
+// response is a status byte followed by the result, or by the error message
+// when the status is DAEMON_ERROR:
+//
+//   DAEMON_PARSE      the plain serialization of the ast (ast_serialize.h)
+//   DAEMON_HASH       the tag of the root
+//   DAEMON_NORMALIZE  the reduction status, the steps, the tag and the plain
+//                     serialization of the term, reduced with at most argument
+//                     steps, capped at DAEMON_NORMALIZE_STEPS which is also
+//                     the budget of a 0 argument, for at most
+//                     DAEMON_NORMALIZE_SECONDS and with its nodes taking at
+//                     most DAEMON_NORMALIZE_BYTES
+//   DAEMON_TYPECHECK  the type of an expression serialized, or a missing node
+//                     for a program of lets
+//   DAEMON_STATS      the requests served, the errors, the normal form cache
+//                     hits and misses and the definitions of the prelude
+//   DAEMON_STOP       nothing, the daemon stops once the response is sent
+//
+// The sources of the requests see the prelude: typecheck resolves their free
+// names to its definitions and normalize unfolds them before reducing.
+//
+// Accepted connections are queued for a pool of workers, a worker serves one
+// connection until the client closes it. Every worker has its own checker and
+// scratch arena, reset after each request, so a request only allocates on the
+// heap what it adds to the cache and the term a normalize reduces. Syntax errors and malformed messages are
+// answered with an error, a message over DAEMON_MAX_MESSAGE closes the
+// connection. A typecheck that does not terminate keeps its worker.
+
+#define DAEMON_MAX_MESSAGE (1 << 24)
+
+#define DAEMON_NORMALIZE_STEPS 100000
+
+// a step of the substitution reducer is linear in the term, steps alone do not
+// keep a client from holding a worker
+#define DAEMON_NORMALIZE_SECONDS 1.0
+
+// nodes a normalize may hold, the term also has to fit in a response
+#define DAEMON_NORMALIZE_BYTES (1 << 24)
+
+#define DAEMON_ARENA_BLOCK_SIZE (1 << 16)
+
+enum daemon_operation_t {
+	DAEMON_PARSE = 0,
+	DAEMON_HASH,
+	DAEMON_NORMALIZE,
+	DAEMON_TYPECHECK,
+	DAEMON_STATS,
+	DAEMON_STOP,
+	TOTAL_DAEMON_OPERATIONS
+};
+
+enum daemon_status_t {
+	DAEMON_OK = 0,
+	DAEMON_ERROR,
+};
+
+typedef struct daemon_t daemon_t;
+
+typedef struct daemon_worker_t {
+	struct daemon_t * daemon;
+
+	struct arena_t * arena;
+	struct typecheck_t checker;
+
+	// connection being served, -1 if none
+	int connection;
+
+	std::thread thread;
+} daemon_worker_t;
+
+typedef struct daemon_t {
+	char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+	int listener;
+
+	// checked once, only read by the workers
+	struct typecheck_t prelude;
+	int prelude_failed;
+
+	struct normal_form_cache_t cache;
+
+	unsigned workers_size;
+	struct daemon_worker_t * workers;
+
+	// accepted connections not taken by a worker yet, in [front, back)
+	std::mutex lock;
+	std::condition_variable ready;
+
+	int * queue;
+	unsigned long front;
+	unsigned long back;
+	unsigned long capacity;
+
+	int stopping;
+
+	std::atomic<unsigned long> requests;
+	std::atomic<unsigned long> errors;
+} daemon_t;
+
+// writes and reads whole buffers, 0 when the peer is gone
+int daemon_write_all(int fd, const char * data, unsigned long size) {
+	while(size) {
+		long written = send(fd, data, size, MSG_NOSIGNAL);
+
+		if(written < 0 && errno == EINTR) continue;
+		if(written <= 0) return 0;
+
+		data += written;
+		size -= written;
+	}
+
+	return 1;
+}
+
+int daemon_read_all(int fd, char * data, unsigned long size) {
+	while(size) {
+		long got = read(fd, data, size);
+
+		if(got < 0 && errno == EINTR) continue;
+		if(got <= 0) return 0;
+
+		data += got;
+		size -= got;
+	}
+
+	return 1;
+}
+
+// the payload of the next message, allocated with memory_alloc, 0 at the end
+// of the connection or on a message over DAEMON_MAX_MESSAGE
+char * daemon_read_message(int fd, unsigned long * size) {
+	unsigned char header[4];
+
+	if(!daemon_read_all(fd, (char*)header, 4)) return 0;
+
+	*size = header[0] | (header[1] << 8) | (header[2] << 16) | ((unsigned long)header[3] << 24);
+
+	if(*size > DAEMON_MAX_MESSAGE) return 0;
+
+	char * payload = (char*)memory_alloc(*size + 1);
+
+	if(!daemon_read_all(fd, payload, *size)) {
+		memory_free(payload);
+		return 0;
+	}
+
+	return payload;
+}
+
+// starts a message in buffer, finished by daemon_message_end
+void daemon_message_begin(struct byte_buffer_t * buffer) {
+	buffer->size = 0;
+	byte_buffer_u32(buffer, 0);
+}
+
+void daemon_message_end(struct byte_buffer_t * buffer) {
+	unsigned size = buffer->size - 4;
+
+	for(unsigned i = 0; i < 4; i++) buffer->data[i] = (char)((size >> (8 * i)) & 0xff);
+}
+
+void daemon_error(struct byte_buffer_t * response, const char * message) {
+	daemon_message_begin(response);
+
+	byte_buffer_u8(response, DAEMON_ERROR);
+	byte_buffer_string(response, message);
+
+	daemon_message_end(response);
+}
+
+struct typecheck_entry_t * daemon_resolve(void * arg, struct name_t * name) {
+	struct daemon_t * daemon = (struct daemon_t*)arg;
+
+	return typecheck_lookup(&daemon->prelude, name);
+}
+
+// Answers the request in payload into response, a whole message. Returns 0
+// for DAEMON_STOP.
+int daemon_handle(struct daemon_worker_t * worker, const char * payload, unsigned long size, struct byte_buffer_t * response) {
+	struct daemon_t * daemon = worker->daemon;
+
+	daemon->requests.fetch_add(1, std::memory_order_relaxed);
+
+	struct byte_reader_t reader;
+
+	byte_reader_init(&reader, payload, size);
+
+	unsigned operation = byte_reader_u8(&reader);
+	unsigned argument = byte_reader_u32(&reader);
+	char * source = byte_reader_string(&reader);
+
+	if(reader.failed || reader.at != reader.size || operation >= TOTAL_DAEMON_OPERATIONS) {
+		daemon->errors.fetch_add(1, std::memory_order_relaxed);
+		daemon_error(response, "malformed request");
+		return 1;
+	}
+
+	if(operation == DAEMON_STATS || operation == DAEMON_STOP) {
+		daemon_message_begin(response);
+
+		byte_buffer_u8(response, DAEMON_OK);
+
+		if(operation == DAEMON_STATS) {
+			byte_buffer_u32(response, (unsigned)daemon->requests.load());
+			byte_buffer_u32(response, (unsigned)daemon->errors.load());
+			byte_buffer_u32(response, (unsigned)daemon->cache.hits.load());
+			byte_buffer_u32(response, (unsigned)daemon->cache.misses.load());
+			byte_buffer_u32(response, daemon->prelude.size);
+		}
+
+		daemon_message_end(response);
+
+		return operation != DAEMON_STOP;
+	}
+
+	char error[256];
+
+	struct ast_t * ast = parse_checked(source, error, sizeof(error));
+
+	if(ast == 0) {
+		daemon->errors.fetch_add(1, std::memory_order_relaxed);
+		daemon_error(response, error);
+		return 1;
+	}
+
+	if(operation == DAEMON_TYPECHECK) {
+		struct typecheck_t * checker = &worker->checker;
+
+		if(!typecheck_program(checker, ast)) {
+			daemon->errors.fetch_add(1, std::memory_order_relaxed);
+			daemon_error(response, checker->error);
+			return 1;
+		}
+
+		daemon_message_begin(response);
+
+		byte_buffer_u8(response, DAEMON_OK);
+		ast_serialize(response, checker->type);
+
+		daemon_message_end(response);
+
+		return 1;
+	}
+
+	daemon_message_begin(response);
+
+	byte_buffer_u8(response, DAEMON_OK);
+
+	if(operation == DAEMON_PARSE) {
+		ast_serialize(response, ast);
+	}
+
+	if(operation == DAEMON_HASH) {
+		ast_hash(ast);
+		byte_buffer_u32(response, ast->tag.crc32);
+	}
+
+	if(operation == DAEMON_NORMALIZE) {
+		ast = typecheck_unfold(&daemon->prelude, ast);
+
+		// on the heap, where the nodes of the contracted redexes are given back,
+		// so the byte budget bounds the memory the reduction holds
+		struct arena_t * scratch = memory_scratch;
+
+		memory_set_scratch(0);
+
+		struct ast_t * term = ast_copy(ast);
+
+		unsigned steps = argument && argument < DAEMON_NORMALIZE_STEPS ? argument : DAEMON_NORMALIZE_STEPS;
+
+		struct reduction_stats_t stats = reduce_with_budget(&term, steps, DAEMON_NORMALIZE_BYTES, &daemon->cache, DAEMON_NORMALIZE_SECONDS);
+
+		ast_hash(term);
+
+		memory_set_scratch(scratch);
+
+		byte_buffer_u8(response, (unsigned char)stats.status);
+		byte_buffer_u32(response, (unsigned)stats.steps);
+		byte_buffer_u32(response, term->tag.crc32);
+
+		ast_serialize(response, term);
+
+		memory_set_scratch(0);
+
+		ast_free(term);
+
+		memory_set_scratch(scratch);
+	}
+
+	daemon_message_end(response);
+
+	return 1;
+}
+
+void daemon_stop(struct daemon_t * daemon);
+
+// serves connection until the client closes it
+void daemon_serve_connection(struct daemon_worker_t * worker, int connection) {
+	struct byte_buffer_t response;
+
+	memory_set_scratch(worker->arena);
+
+	int running = 1;
+
+	while(running) {
+		arena_reset(worker->arena);
+
+		byte_buffer_init(&response);
+
+		unsigned long size = 0;
+
+		char * payload = daemon_read_message(connection, &size);
+
+		if(payload == 0) break;
+
+		running = daemon_handle(worker, payload, size, &response);
+
+		if(!daemon_write_all(connection, response.data, response.size)) break;
+	}
+
+	memory_set_scratch(0);
+
+	if(!running) daemon_stop(worker->daemon);
+}
+
+void daemon_worker_main(struct daemon_worker_t * worker) {
+	struct daemon_t * daemon = worker->daemon;
+
+	while(1) {
+		int connection = -1;
+
+		{
+			std::unique_lock<std::mutex> guard(daemon->lock);
+
+			daemon->ready.wait(guard, [&]() { return daemon->stopping || daemon->front != daemon->back; });
+
+			if(daemon->front == daemon->back) return;
+
+			connection = daemon->queue[daemon->front++ % daemon->capacity];
+
+			worker->connection = connection;
+		}
+
+		daemon_serve_connection(worker, connection);
+
+		{
+			std::lock_guard<std::mutex> guard(daemon->lock);
+
+			worker->connection = -1;
+		}
+
+		close(connection);
+	}
+}
+
+// Checks the prelude, the source of a program of lets or 0, and binds the
+// socket at path, replacing a stale socket file. Returns 0 if the prelude is
+// not well typed or the socket cannot be bound, the error is printed.
+int daemon_init(struct daemon_t * daemon, const char * path, const char * prelude, unsigned workers) {
+	daemon->listener = -1;
+	daemon->prelude_failed = 0;
+	daemon->workers_size = 0;
+	daemon->workers = 0;
+	daemon->queue = 0;
+	daemon->front = 0;
+	daemon->back = 0;
+	daemon->capacity = 0;
+	daemon->stopping = 0;
+	daemon->requests = 0;
+	daemon->errors = 0;
+
+	typecheck_init(&daemon->prelude);
+	normal_form_cache_init(&daemon->cache, 1 << 16, 1 << 24);
+
+	if(strlen(path) >= sizeof(daemon->path)) {
+		printf("socket path too long: %s\n", path);
+		return 0;
+	}
+
+	snprintf(daemon->path, sizeof(daemon->path), "%s", path);
+
+	if(prelude) {
+		char error[256];
+
+		// the prelude is trusted, a library may have any number of definitions
+		struct ast_t * program = parse_checked(prelude, error, sizeof(error), ~0u, ~0u);
+
+		if(program == 0 || !typecheck_program(&daemon->prelude, program)) {
+			printf("prelude: %s\n", program ? daemon->prelude.error : error);
+			daemon->prelude_failed = 1;
+		}
+
+		ast_free(program);
+
+		if(daemon->prelude_failed) return 0;
+	} else {
+		// an empty prelude, the lookups of the requests need its scope
+		struct arena_t * scratch = memory_scratch;
+
+		memory_set_scratch(daemon->prelude.arena);
+
+		typecheck_reset(&daemon->prelude);
+
+		memory_set_scratch(scratch);
+	}
+
+	daemon->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	struct sockaddr_un address;
+
+	memset(&address, 0, sizeof(address));
+
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, daemon->path, strlen(daemon->path));
+
+	unlink(daemon->path);
+
+	if(daemon->listener < 0 || bind(daemon->listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(daemon->listener, 128) != 0) {
+		printf("cannot listen on %s: %s\n", daemon->path, strerror(errno));
+		return 0;
+	}
+
+	workers = workers ? workers : std::thread::hardware_concurrency();
+	workers = workers ? workers : 1;
+
+	daemon->workers_size = workers;
+	daemon->workers = new daemon_worker_t[workers];
+
+	daemon->capacity = 64;
+	daemon->queue = (int*)memory_alloc(sizeof(int) * daemon->capacity);
+
+	for(unsigned i = 0; i < workers; i++) {
+		struct daemon_worker_t * worker = &daemon->workers[i];
+
+		worker->daemon = daemon;
+		worker->arena = arena_create(DAEMON_ARENA_BLOCK_SIZE);
+		worker->connection = -1;
+
+		typecheck_init(&worker->checker);
+
+		worker->checker.resolve = daemon_resolve;
+		worker->checker.resolve_arg = daemon;
+
+		worker->thread = std::thread(daemon_worker_main, worker);
+	}
+
+	return 1;
+}
+
+// Accepts connections until daemon_stop, then waits for the workers to finish
+// their connections.
+void daemon_run(struct daemon_t * daemon) {
+	while(1) {
+		int connection = accept(daemon->listener, 0, 0);
+
+		std::lock_guard<std::mutex> guard(daemon->lock);
+
+		if(daemon->stopping) {
+			if(connection >= 0) close(connection);
+			break;
+		}
+
+		if(connection < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+
+			printf("accept: %s\n", strerror(errno));
+			break;
+		}
+
+		if(daemon->back - daemon->front == daemon->capacity) {
+			int * queue = (int*)memory_alloc(sizeof(int) * daemon->capacity * 2);
+
+			for(unsigned long i = daemon->front; i < daemon->back; i++) queue[i % (daemon->capacity * 2)] = daemon->queue[i % daemon->capacity];
+
+			memory_free(daemon->queue);
+
+			daemon->queue = queue;
+			daemon->capacity *= 2;
+		}
+
+		daemon->queue[daemon->back++ % daemon->capacity] = connection;
+
+		daemon->ready.notify_one();
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(daemon->lock);
+
+		daemon->stopping = 1;
+		daemon->ready.notify_all();
+	}
+
+	for(unsigned i = 0; i < daemon->workers_size; i++) daemon->workers[i].thread.join();
+}
+
+// Makes daemon_run return: no connection is accepted anymore, the queued ones
+// are closed and the ones being served end at their next request.
+void daemon_stop(struct daemon_t * daemon) {
+	std::lock_guard<std::mutex> guard(daemon->lock);
+
+	if(daemon->stopping) return;
+
+	daemon->stopping = 1;
+
+	shutdown(daemon->listener, SHUT_RDWR);
+
+	while(daemon->front != daemon->back) close(daemon->queue[daemon->front++ % daemon->capacity]);
+
+	for(unsigned i = 0; i < daemon->workers_size; i++) {
+		if(daemon->workers[i].connection != -1) shutdown(daemon->workers[i].connection, SHUT_RD);
+	}
+
+	daemon->ready.notify_all();
+}
+
+void daemon_destroy(struct daemon_t * daemon) {
+	for(unsigned i = 0; i < daemon->workers_size; i++) {
+		typecheck_destroy(&daemon->workers[i].checker);
+		arena_destroy(daemon->workers[i].arena);
+	}
+
+	delete[] daemon->workers;
+
+	memory_free(daemon->queue);
+
+	if(daemon->listener >= 0) {
+		close(daemon->listener);
+		unlink(daemon->path);
+	}
+
+	normal_form_cache_destroy(&daemon->cache);
+	typecheck_destroy(&daemon->prelude);
+}
+
+void daemon_report(struct daemon_t * daemon, FILE * out) {
+	fprintf(out, "definitions:         %u\n", daemon->prelude.size);
+	fprintf(out, "workers:             %u\n", daemon->workers_size);
+	fprintf(out, "requests:            %lu\n", daemon->requests.load());
+	fprintf(out, "errors:              %lu\n", daemon->errors.load());
+
+	normal_form_cache_report(&daemon->cache, out);
+}
+
+// Client side
+
+typedef struct daemon_client_t {
+	int fd;
+
+	struct byte_buffer_t request;
+
+	// payload of the last response, its status first
+	char * response;
+	unsigned long response_size;
+} daemon_client_t;
+
+// 1 once connected to the daemon listening at path
+int daemon_client_connect(struct daemon_client_t * client, const char * path) {
+	client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	client->response = 0;
+	client->response_size = 0;
+
+	byte_buffer_init(&client->request);
+
+	struct sockaddr_un address;
+
+	memset(&address, 0, sizeof(address));
+
+	address.sun_family = AF_UNIX;
+
+	if(strlen(path) >= sizeof(address.sun_path)) return 0;
+
+	memcpy(address.sun_path, path, strlen(path));
+
+	return client->fd >= 0 && connect(client->fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+}
+
+void daemon_client_close(struct daemon_client_t * client) {
+	if(client->fd >= 0) close(client->fd);
+
+	byte_buffer_destroy(&client->request);
+	memory_free(client->response);
+}
+
+// Sends a request and waits for its response, in client->response. Returns 0
+// if the daemon closed the connection.
+int daemon_client_call(struct daemon_client_t * client, enum daemon_operation_t operation, unsigned argument, const char * source) {
+	daemon_message_begin(&client->request);
+
+	byte_buffer_u8(&client->request, (unsigned char)operation);
+	byte_buffer_u32(&client->request, argument);
+	byte_buffer_string(&client->request, source ? source : "");
+
+	daemon_message_end(&client->request);
+
+	memory_free(client->response);
+
+	client->response = 0;
+	client->response_size = 0;
+
+	if(!daemon_write_all(client->fd, client->request.data, client->request.size)) return 0;
+
+	client->response = daemon_read_message(client->fd, &client->response_size);
+
+	return client->response != 0 && client->response_size > 0;
+}
+
+// reads the result of the last response, after its status
+void daemon_client_result(struct daemon_client_t * client, struct byte_reader_t * reader) {
+	byte_reader_init(reader, client->response, client->response_size);
+	byte_reader_u8(reader);
+}
+
+int daemon_client_ok(struct daemon_client_t * client) {
+	return client->response && client->response[0] == DAEMON_OK;
+}
+
+#endif
@@ -0,0 +1,476 @@
+#ifndef GRAPH_REDUCTION_H
+#define GRAPH_REDUCTION_H
+
+#include "ast.h"
+#include "alpha_equivalence.h"
+#include "name.h"
+#include "memory.h"
+#include "reduction.h"
+#include "trace.h"
+#include "swiss_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Graph reduction
+//
+// The substitution reducer of reduction.h with shared arguments. Contracting a
+// redex wraps the argument in an indirection node and every occurrence of the
+// bound variable points to it instead of getting its own copy. Reductions
+// inside an indirection update it in place, so an argument used k times is
+// reduced once and not k times. An indirection that reaches normal form is
+// marked and never searched again.
+//
+// Only indirections are shared, every other node has one owner. Copying a body
+// stops at the indirections that do not mention the variable being replaced,
+// they are shared by the copy. Names, capture avoiding renaming, the normal
+// order and the binders (the type outside of the scope) are the same as in
+// reduction.h, the free names of an indirection are computed once and kept.
+// After a reduction its set may hold names that are gone, which only makes the
+// renaming and the copying more conservative.
+//
+// Terms are expressions, not programs. The counters of reduction_stats are
+// updated, so the two strategies can be compared, and the live nodes are the
+// nodes of the graph, which stays smaller than the tree it stands for.
+
+enum graph_kind_t {
+	GRAPH_VAR = 0,
+	GRAPH_APP,
+	GRAPH_LAMBDA,
+	GRAPH_PI,
+	GRAPH_ARROW,
+	GRAPH_INDIRECTION,
+};
+
+typedef struct graph_t {
+	enum graph_kind_t kind;
+
+	// variable, or variable bound by a LAMBDA or PI
+	struct name_t * name;
+
+	// type of the binder of a LAMBDA or PI, may be 0
+	struct graph_t * type;
+
+	// function and argument of an APP, sides of an ARROW, body of a LAMBDA or PI
+	// in rhs, shared term of an INDIRECTION in lhs
+	struct graph_t * lhs;
+	struct graph_t * rhs;
+
+	// INDIRECTION only
+	unsigned refs;
+	int normal;
+
+	// free names of the shared term, 0 until needed
+	struct name_t ** free;
+	unsigned free_count;
+} graph_t;
+
+unsigned swiss_key_hash(struct graph_t * key) {
+	return (unsigned)((unsigned long)key >> 4) * 2654435769u;
+}
+
+int swiss_key_equal(struct graph_t * a, struct graph_t * b) {
+	return a == b;
+}
+
+struct graph_t * graph_alloc(enum graph_kind_t kind) {
+	struct graph_t * node = (struct graph_t*)memory_alloc(sizeof(struct graph_t));
+
+	node->kind = kind;
+	node->name = 0;
+	node->type = 0;
+	node->lhs = 0;
+	node->rhs = 0;
+	node->refs = 1;
+	node->normal = 0;
+	node->free = 0;
+	node->free_count = 0;
+
+	if(reduction_stats) {
+		reduction_stats->nodes_copied += 1;
+		reduction_stats->live_nodes += 1;
+
+		if(reduction_stats->live_nodes > reduction_stats->peak_live_nodes) {
+			reduction_stats->peak_live_nodes = reduction_stats->live_nodes;
+		}
+	}
+
+	return node;
+}
+
+struct graph_t * graph_retain(struct graph_t * node) {
+	node->refs += 1;
+	return node;
+}
+
+void graph_free(struct graph_t * node) {
+	if(node == 0) return;
+
+	if(node->kind == GRAPH_INDIRECTION && --node->refs > 0) return;
+
+	graph_free(node->type);
+	graph_free(node->lhs);
+	graph_free(node->rhs);
+
+	if(node->name) {
+		name_free(node->name);
+	}
+
+	for(unsigned i = 0; i < node->free_count; i++) {
+		name_free(node->free[i]);
+	}
+
+	memory_free(node->free);
+	memory_free(node);
+
+	if(reduction_stats) {
+		reduction_stats->live_nodes -= 1;
+	}
+}
+
+struct graph_t * graph_from_ast(struct ast_t * ast) {
+	if(ast == 0) return 0;
+
+	struct graph_t * node = 0;
+
+	if(ast->kind == VAR) {
+		node = graph_alloc(GRAPH_VAR);
+		node->name = name_copy(ast->name);
+	} else if(ast->kind == APP) {
+		node = graph_alloc(GRAPH_APP);
+		node->lhs = graph_from_ast(ast->lhs);
+		node->rhs = graph_from_ast(ast->rhs);
+	} else if(ast->kind == LAMBDA || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND)) {
+		struct ast_t * binder = ast->lhs->kind == BIND ? ast->lhs->lhs : ast->lhs;
+
+		node = graph_alloc(ast->kind == LAMBDA ? GRAPH_LAMBDA : GRAPH_PI);
+		node->name = name_copy(binder->name);
+		node->type = ast->lhs->kind == BIND ? graph_from_ast(ast->lhs->rhs) : 0;
+		node->rhs = graph_from_ast(ast->rhs);
+	} else if(ast->kind == ARROW_TYPE) {
+		node = graph_alloc(GRAPH_ARROW);
+		node->lhs = graph_from_ast(ast->lhs);
+		node->rhs = graph_from_ast(ast->rhs);
+	} else {
+		printf("graph reduction of a %s is not supported\n", ast->kind == STATEMENT ? "program" : ast->kind == CASE_LIST ? "case list" : "binding");
+		abort();
+	}
+
+	return node;
+}
+
+// the indirections are expanded, every occurrence gets its own copy
+struct ast_t * graph_to_ast(struct graph_t * node) {
+	if(node == 0) return 0;
+
+	switch(node->kind) {
+		case GRAPH_VAR: return var(name_get_str(node->name));
+		case GRAPH_APP: return ast_node(APP, graph_to_ast(node->lhs), graph_to_ast(node->rhs));
+		case GRAPH_ARROW: return ast_node(ARROW_TYPE, graph_to_ast(node->lhs), graph_to_ast(node->rhs));
+		case GRAPH_INDIRECTION: return graph_to_ast(node->lhs);
+		case GRAPH_LAMBDA:
+		case GRAPH_PI:
+			return ast_node(node->kind == GRAPH_LAMBDA ? LAMBDA : ARROW_TYPE, ast_node(BIND, var(name_get_str(node->name)), graph_to_ast(node->type)), graph_to_ast(node->rhs));
+	}
+
+	return 0;
+}
+
+int graph_is_binder(struct graph_t * node) {
+	return node->kind == GRAPH_LAMBDA || node->kind == GRAPH_PI;
+}
+
+void graph_add_free(struct graph_t * indirection, struct name_t * name, struct binder_stack_t * binders) {
+	if(binder_stack_index_of(binders, name) != -1) return;
+
+	for(unsigned i = 0; i < indirection->free_count; i++) {
+		if(name_equal(indirection->free[i], name)) return;
+	}
+
+	indirection->free = (struct name_t**)memory_realloc(indirection->free, sizeof(struct name_t*) * (indirection->free_count + 1));
+	indirection->free[indirection->free_count++] = name_copy(name);
+}
+
+void graph_free_names(struct graph_t * node, struct graph_t * indirection, struct binder_stack_t * binders);
+
+// free names of the term shared by indirection, computed on the first call
+void graph_indirection_free_names(struct graph_t * indirection) {
+	if(indirection->free) return;
+
+	struct binder_stack_t binders;
+
+	binder_stack_init(&binders);
+
+	indirection->free = (struct name_t**)memory_alloc(sizeof(struct name_t*));
+
+	graph_free_names(indirection->lhs, indirection, &binders);
+
+	binder_stack_destroy(&binders);
+}
+
+void graph_free_names(struct graph_t * node, struct graph_t * indirection, struct binder_stack_t * binders) {
+	if(node == 0) return;
+
+	if(node->kind == GRAPH_VAR) {
+		graph_add_free(indirection, node->name, binders);
+	} else if(node->kind == GRAPH_INDIRECTION) {
+		graph_indirection_free_names(node);
+
+		for(unsigned i = 0; i < node->free_count; i++) {
+			graph_add_free(indirection, node->free[i], binders);
+		}
+	} else if(graph_is_binder(node)) {
+		graph_free_names(node->type, indirection, binders);
+
+		binder_stack_push(binders, node->name);
+		graph_free_names(node->rhs, indirection, binders);
+		binder_stack_pop(binders);
+	} else {
+		graph_free_names(node->lhs, indirection, binders);
+		graph_free_names(node->rhs, indirection, binders);
+	}
+}
+
+int graph_occurs_free(struct graph_t * node, struct name_t * x) {
+	if(node == 0) return 0;
+
+	switch(node->kind) {
+		case GRAPH_VAR:
+			return name_equal(node->name, x);
+
+		case GRAPH_INDIRECTION:
+			graph_indirection_free_names(node);
+
+			for(unsigned i = 0; i < node->free_count; i++) {
+				if(name_equal(node->free[i], x)) return 1;
+			}
+
+			return 0;
+
+		case GRAPH_LAMBDA:
+		case GRAPH_PI:
+			if(graph_occurs_free(node->type, x)) return 1;
+
+			return !name_equal(node->name, x) && graph_occurs_free(node->rhs, x);
+
+		default:
+			return graph_occurs_free(node->lhs, x) || graph_occurs_free(node->rhs, x);
+	}
+}
+
+// y with primes appended until it is not free in a nor in b
+struct name_t * graph_fresh_name(struct name_t * y, struct graph_t * a, struct graph_t * b) {
+	char * buffer = (char*)memory_alloc(y->length + 2);
+
+	memcpy(buffer, y->identifier, y->length + 1);
+
+	unsigned length = y->length;
+
+	struct name_t * name = allocate_name(buffer);
+
+	while(graph_occurs_free(a, name) || graph_occurs_free(b, name)) {
+		buffer = (char*)memory_realloc(buffer, length + 2);
+		buffer[length++] = '\'';
+		buffer[length] = 0;
+
+		name_free(name);
+		name = allocate_name(buffer);
+	}
+
+	memory_free(buffer);
+
+	return name;
+}
+
+typedef swiss_table_t<graph_t*, graph_t*> graph_memo_t;
+
+// Copy of node with the free occurrences of x replaced by arg, a variable or an
+// indirection, and no replacement when x is 0. The indirections that x does not
+// occur in are shared, the ones it occurs in are copied once per call.
+struct graph_t * graph_substitute(struct graph_t * node, struct name_t * x, struct graph_t * arg, graph_memo_t * memo) {
+	if(node == 0) return 0;
+
+	if(node->kind == GRAPH_VAR) {
+		if(x && name_equal(node->name, x)) {
+			if(reduction_stats) reduction_stats->substitutions += 1;
+
+			if(arg->kind == GRAPH_INDIRECTION) return graph_retain(arg);
+
+			node = arg;
+		}
+
+		struct graph_t * copy = graph_alloc(GRAPH_VAR);
+
+		copy->name = name_copy(node->name);
+
+		return copy;
+	}
+
+	if(node->kind == GRAPH_INDIRECTION) {
+		if(x == 0 || !graph_occurs_free(node, x)) return graph_retain(node);
+
+		struct graph_t ** copied = swiss_table_get(memo, node);
+
+		if(copied) return graph_retain(*copied);
+
+		struct graph_t * copy = graph_alloc(GRAPH_INDIRECTION);
+
+		copy->lhs = graph_substitute(node->lhs, x, arg, memo);
+
+		swiss_table_insert(memo, node, copy);
+
+		return copy;
+	}
+
+	struct graph_t * copy = graph_alloc(node->kind);
+
+	if(!graph_is_binder(node)) {
+		copy->lhs = graph_substitute(node->lhs, x, arg, memo);
+		copy->rhs = graph_substitute(node->rhs, x, arg, memo);
+
+		return copy;
+	}
+
+	struct name_t * y = node->name;
+
+	copy->type = graph_substitute(node->type, x, arg, memo);
+
+	if(x == 0 || name_equal(y, x)) {
+		copy->name = name_copy(y);
+		copy->rhs = graph_substitute(node->rhs, 0, 0, memo);
+	} else if(graph_occurs_free(arg, y) && graph_occurs_free(node->rhs, x)) {
+		copy->name = graph_fresh_name(y, arg, node->rhs);
+
+		struct graph_t * bound = graph_alloc(GRAPH_VAR);
+
+		bound->name = name_copy(copy->name);
+
+		// the renaming has its own memo, its copies are not copies for x
+		graph_memo_t renaming;
+
+		swiss_table_init(&renaming);
+
+		struct graph_t * renamed = graph_substitute(node->rhs, y, bound, &renaming);
+
+		swiss_table_destroy(&renaming);
+
+		if(reduction_stats) reduction_stats->renamings += 1;
+
+		copy->rhs = graph_substitute(renamed, x, arg, memo);
+
+		graph_free(renamed);
+		graph_free(bound);
+	} else {
+		copy->name = name_copy(y);
+		copy->rhs = graph_substitute(node->rhs, x, arg, memo);
+	}
+
+	return copy;
+}
+
+// the term an indirection chain points to
+struct graph_t * graph_follow(struct graph_t * node) {
+	while(node->kind == GRAPH_INDIRECTION) node = node->lhs;
+
+	return node;
+}
+
+// contracts the redex *slot, an APP whose function is a lambda
+void graph_beta(struct graph_t ** slot) {
+	struct graph_t * redex = *slot;
+	struct graph_t * lambda = graph_follow(redex->lhs);
+
+	struct graph_t * arg = redex->rhs;
+
+	// variables are copied, anything else is shared
+	if(arg->kind != GRAPH_VAR && arg->kind != GRAPH_INDIRECTION) {
+		struct graph_t * indirection = graph_alloc(GRAPH_INDIRECTION);
+
+		indirection->lhs = arg;
+
+		arg = indirection;
+	}
+
+	redex->rhs = 0;
+
+	graph_memo_t memo;
+
+	swiss_table_init(&memo);
+
+	*slot = graph_substitute(lambda->rhs, lambda->name, arg, &memo);
+
+	swiss_table_destroy(&memo);
+
+	graph_free(arg);
+	graph_free(redex);
+
+	if(reduction_stats) reduction_stats->steps += 1;
+}
+
+// contracts the leftmost outermost redex of *slot, returns 0 if there is none
+int graph_reduce_step(struct graph_t ** slot) {
+	struct graph_t * node = *slot;
+
+	if(node == 0) return 0;
+
+	switch(node->kind) {
+		case GRAPH_VAR:
+			return 0;
+
+		case GRAPH_INDIRECTION:
+			if(node->normal) return 0;
+
+			if(graph_reduce_step(&node->lhs)) return 1;
+
+			node->normal = 1;
+
+			return 0;
+
+		case GRAPH_APP:
+			if(graph_follow(node->lhs)->kind == GRAPH_LAMBDA) {
+				graph_beta(slot);
+				return 1;
+			}
+
+			return graph_reduce_step(&node->lhs) || graph_reduce_step(&node->rhs);
+
+		case GRAPH_LAMBDA:
+		case GRAPH_PI:
+			return graph_reduce_step(&node->type) || graph_reduce_step(&node->rhs);
+
+		case GRAPH_ARROW:
+			return graph_reduce_step(&node->lhs) || graph_reduce_step(&node->rhs);
+	}
+
+	return 0;
+}
+
+// Normal form of ast, which is left untouched, by graph reduction. The stats
+// count the nodes of the graph, not of the tree that is returned.
+struct ast_t * graph_reduce(struct ast_t * ast, struct reduction_stats_t * stats) {
+	TRACE_OUTER_SCOPE("graph_reduce");
+
+	struct reduction_stats_t * outer = reduction_stats;
+
+	reduction_stats = stats;
+
+	struct graph_t * graph = graph_from_ast(ast);
+
+	if(stats) stats->nodes_copied = 0;
+
+	while(graph_reduce_step(&graph));
+
+	reduction_stats = outer;
+
+	struct ast_t * result = graph_to_ast(graph);
+
+	reduction_stats = stats;
+
+	graph_free(graph);
+
+	reduction_stats = outer;
+
+	return result;
+}
+
+#endif
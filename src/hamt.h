@@ -0,0 +1,450 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+#include "memory.h"
+#include "swiss_table.h"
+
+// Persistent hash array mapped trie
+//
+// An immutable map, every update returns a new version that shares all the
+// unchanged nodes with the previous one and only copies the path from the root
+// to the updated entry. Nodes are reference counted, a version holds one
+// reference to its root.
+//
+// Every node has a 32 bit bitmap of the 5 hash bits of its level that are in
+// use, and a dense array with one entry per set bit. An entry is either a leaf
+// (key and value) or a child node. When the hash bits run out the keys that
+// are left go to a collision node, a plain list searched linearly.
+//
+// Keys are borrowed, they are hashed and compared like in the swiss table.
+// Values are owned through hamt_value_retain and hamt_value_release, that are
+// overloaded for each value type.
+
+#define HAMT_BITS 5
+#define HAMT_MASK 31
+
+template<typename K, typename V>
+struct hamt_node_t;
+
+template<typename K, typename V>
+struct hamt_entry_t {
+	K key;
+	V val;
+
+	// not null when the entry is a sub trie
+	struct hamt_node_t<K, V> * child;
+};
+
+template<typename K, typename V>
+struct hamt_node_t {
+	unsigned references;
+	unsigned bitmap;
+	unsigned count;
+	unsigned collision;
+
+	struct hamt_entry_t<K, V> entries[1];
+};
+
+template<typename K, typename V>
+struct hamt_t {
+	struct hamt_node_t<K, V> * root;
+	unsigned size;
+};
+
+// counter of the nodes allocated so far, to measure sharing
+static thread_local unsigned long hamt_nodes_allocated = 0;
+
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_allocate(unsigned count) {
+	size_t size = sizeof(struct hamt_node_t<K, V>) + sizeof(struct hamt_entry_t<K, V>) * (count ? count - 1 : 0);
+
+	struct hamt_node_t<K, V> * node = (struct hamt_node_t<K, V>*)memory_alloc(size);
+
+	node->references = 1;
+	node->bitmap = 0;
+	node->count = count;
+	node->collision = 0;
+
+	hamt_nodes_allocated += 1;
+
+	return node;
+}
+
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_retain(struct hamt_node_t<K, V> * node) {
+	if(node) node->references += 1;
+	return node;
+}
+
+template<typename K, typename V>
+void hamt_node_release(struct hamt_node_t<K, V> * node) {
+	if(node == 0 || --node->references) return;
+
+	for(unsigned i = 0; i < node->count; i++) {
+		if(node->entries[i].child) {
+			hamt_node_release(node->entries[i].child);
+		} else {
+			hamt_value_release(node->entries[i].val);
+		}
+	}
+
+	memory_free(node);
+}
+
+template<typename K, typename V>
+void hamt_entry_retain(struct hamt_entry_t<K, V> * entry) {
+	if(entry->child) {
+		hamt_node_retain(entry->child);
+	} else {
+		hamt_value_retain(entry->val);
+	}
+}
+
+// copy of node with count entries, the entries are filled by the caller
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_resize(struct hamt_node_t<K, V> * node, unsigned count) {
+	struct hamt_node_t<K, V> * copy = hamt_node_allocate<K, V>(count);
+
+	copy->bitmap = node->bitmap;
+	copy->collision = node->collision;
+
+	return copy;
+}
+
+// copy of node with entry at index replaced, the other entries are retained
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_replace(struct hamt_node_t<K, V> * node, unsigned index, struct hamt_entry_t<K, V> entry) {
+	struct hamt_node_t<K, V> * copy = hamt_node_resize(node, node->count);
+
+	for(unsigned i = 0; i < node->count; i++) {
+		if(i == index) {
+			copy->entries[i] = entry;
+		} else {
+			copy->entries[i] = node->entries[i];
+			hamt_entry_retain(&copy->entries[i]);
+		}
+	}
+
+	return copy;
+}
+
+// copy of node with entry added at index
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_add(struct hamt_node_t<K, V> * node, unsigned index, struct hamt_entry_t<K, V> entry) {
+	struct hamt_node_t<K, V> * copy = hamt_node_resize(node, node->count + 1);
+
+	for(unsigned i = 0, j = 0; i < copy->count; i++) {
+		if(i == index) {
+			copy->entries[i] = entry;
+		} else {
+			copy->entries[i] = node->entries[j++];
+			hamt_entry_retain(&copy->entries[i]);
+		}
+	}
+
+	return copy;
+}
+
+// copy of node without the entry at index, 0 if nothing is left
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_drop(struct hamt_node_t<K, V> * node, unsigned index) {
+	if(node->count == 1) return 0;
+
+	struct hamt_node_t<K, V> * copy = hamt_node_resize(node, node->count - 1);
+
+	for(unsigned i = 0, j = 0; i < node->count; i++) {
+		if(i == index) continue;
+
+		copy->entries[j] = node->entries[i];
+		hamt_entry_retain(&copy->entries[j]);
+
+		j += 1;
+	}
+
+	return copy;
+}
+
+unsigned hamt_hash(struct name_t * key) {
+	return swiss_key_hash(key);
+}
+
+template<typename K, typename V>
+struct hamt_entry_t<K, V> hamt_leaf(K key, V val) {
+	struct hamt_entry_t<K, V> entry;
+
+	entry.key = key;
+	entry.val = val;
+	entry.child = 0;
+
+	return entry;
+}
+
+template<typename K, typename V>
+struct hamt_entry_t<K, V> hamt_branch(struct hamt_node_t<K, V> * child) {
+	struct hamt_entry_t<K, V> entry;
+
+	entry.key = 0;
+	entry.val = 0;
+	entry.child = child;
+
+	return entry;
+}
+
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_single(unsigned shift, K key, V val, unsigned h) {
+	struct hamt_node_t<K, V> * node = hamt_node_allocate<K, V>(1);
+
+	node->bitmap = 1u << ((h >> shift) & HAMT_MASK);
+	node->entries[0] = hamt_leaf(key, val);
+
+	return node;
+}
+
+// node at the given level holding the two leaves
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_pair(unsigned shift, struct hamt_entry_t<K, V> a, unsigned a_hash, struct hamt_entry_t<K, V> b, unsigned b_hash) {
+	if(shift >= 32) {
+		struct hamt_node_t<K, V> * node = hamt_node_allocate<K, V>(2);
+
+		node->collision = 1;
+		node->entries[0] = a;
+		node->entries[1] = b;
+
+		return node;
+	}
+
+	unsigned a_index = (a_hash >> shift) & HAMT_MASK;
+	unsigned b_index = (b_hash >> shift) & HAMT_MASK;
+
+	if(a_index == b_index) {
+		struct hamt_node_t<K, V> * node = hamt_node_allocate<K, V>(1);
+
+		node->bitmap = 1u << a_index;
+		node->entries[0] = hamt_branch(hamt_node_pair(shift + HAMT_BITS, a, a_hash, b, b_hash));
+
+		return node;
+	}
+
+	struct hamt_node_t<K, V> * node = hamt_node_allocate<K, V>(2);
+
+	node->bitmap = (1u << a_index) | (1u << b_index);
+	node->entries[a_index < b_index ? 0 : 1] = a;
+	node->entries[a_index < b_index ? 1 : 0] = b;
+
+	return node;
+}
+
+// returns the new version of node, *added is set when key was not in node
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_insert(struct hamt_node_t<K, V> * node, unsigned shift, unsigned h, K key, V val, int * added) {
+	if(node == 0) {
+		*added = 1;
+		return hamt_node_single(shift, key, val, h);
+	}
+
+	if(node->collision) {
+		for(unsigned i = 0; i < node->count; i++) {
+			if(swiss_key_equal(node->entries[i].key, key)) {
+				*added = 0;
+				return hamt_node_replace(node, i, hamt_leaf(node->entries[i].key, val));
+			}
+		}
+
+		*added = 1;
+		return hamt_node_add(node, node->count, hamt_leaf(key, val));
+	}
+
+	unsigned bit = 1u << ((h >> shift) & HAMT_MASK);
+	unsigned index = __builtin_popcount(node->bitmap & (bit - 1));
+
+	if((node->bitmap & bit) == 0) {
+		*added = 1;
+
+		struct hamt_node_t<K, V> * copy = hamt_node_add(node, index, hamt_leaf(key, val));
+
+		copy->bitmap |= bit;
+
+		return copy;
+	}
+
+	struct hamt_entry_t<K, V> * entry = &node->entries[index];
+
+	if(entry->child) {
+		struct hamt_node_t<K, V> * child = hamt_node_insert(entry->child, shift + HAMT_BITS, h, key, val, added);
+		return hamt_node_replace(node, index, hamt_branch(child));
+	}
+
+	if(swiss_key_equal(entry->key, key)) {
+		*added = 0;
+		return hamt_node_replace(node, index, hamt_leaf(entry->key, val));
+	}
+
+	*added = 1;
+
+	hamt_value_retain(entry->val);
+
+	struct hamt_node_t<K, V> * child = hamt_node_pair(shift + HAMT_BITS, *entry, hamt_hash(entry->key), hamt_leaf(key, val), h);
+
+	return hamt_node_replace(node, index, hamt_branch(child));
+}
+
+// returns the new version of node, *removed is set and val receives a reference
+// to the value when key was in node, otherwise node itself is retained
+template<typename K, typename V>
+struct hamt_node_t<K, V> * hamt_node_remove(struct hamt_node_t<K, V> * node, unsigned shift, unsigned h, K key, V * val, int * removed) {
+	*removed = 0;
+
+	if(node == 0) return 0;
+
+	if(node->collision) {
+		for(unsigned i = 0; i < node->count; i++) {
+			if(swiss_key_equal(node->entries[i].key, key)) {
+				*removed = 1;
+				*val = node->entries[i].val;
+				hamt_value_retain(*val);
+				return hamt_node_drop(node, i);
+			}
+		}
+
+		return hamt_node_retain(node);
+	}
+
+	unsigned bit = 1u << ((h >> shift) & HAMT_MASK);
+	unsigned index = __builtin_popcount(node->bitmap & (bit - 1));
+
+	if((node->bitmap & bit) == 0) {
+		return hamt_node_retain(node);
+	}
+
+	struct hamt_entry_t<K, V> * entry = &node->entries[index];
+
+	if(entry->child) {
+		struct hamt_node_t<K, V> * child = hamt_node_remove(entry->child, shift + HAMT_BITS, h, key, val, removed);
+
+		if(*removed == 0) {
+			hamt_node_release(child);
+			return hamt_node_retain(node);
+		}
+
+		if(child) {
+			return hamt_node_replace(node, index, hamt_branch(child));
+		}
+	} else if(swiss_key_equal(entry->key, key)) {
+		*removed = 1;
+		*val = entry->val;
+		hamt_value_retain(*val);
+	} else {
+		return hamt_node_retain(node);
+	}
+
+	struct hamt_node_t<K, V> * copy = hamt_node_drop(node, index);
+
+	if(copy) {
+		copy->bitmap &= ~bit;
+	}
+
+	return copy;
+}
+
+template<typename K, typename V>
+struct hamt_t<K, V> hamt_empty() {
+	struct hamt_t<K, V> map;
+
+	map.root = 0;
+	map.size = 0;
+
+	return map;
+}
+
+template<typename K, typename V>
+struct hamt_t<K, V> hamt_retain(struct hamt_t<K, V> map) {
+	hamt_node_retain(map.root);
+	return map;
+}
+
+template<typename K, typename V>
+void hamt_release(struct hamt_t<K, V> map) {
+	hamt_node_release(map.root);
+}
+
+// new version of map with key bound to val, the reference to val is taken
+template<typename K, typename V>
+struct hamt_t<K, V> hamt_insert(struct hamt_t<K, V> map, K key, V val) {
+	int added = 0;
+
+	struct hamt_t<K, V> result;
+
+	result.root = hamt_node_insert(map.root, 0, hamt_hash(key), key, val, &added);
+	result.size = map.size + added;
+
+	return result;
+}
+
+// new version of map without key, val receives a reference to the removed value
+// or 0 if key was not in map
+template<typename K, typename V>
+struct hamt_t<K, V> hamt_remove(struct hamt_t<K, V> map, K key, V * val) {
+	int removed = 0;
+
+	*val = 0;
+
+	struct hamt_t<K, V> result;
+
+	result.root = hamt_node_remove(map.root, 0, hamt_hash(key), key, val, &removed);
+	result.size = map.size - removed;
+
+	return result;
+}
+
+// borrowed value of key, 0 if key is not in map
+template<typename K, typename V>
+V hamt_get(struct hamt_t<K, V> map, K key) {
+	unsigned h = hamt_hash(key);
+
+	struct hamt_node_t<K, V> * node = map.root;
+
+	for(unsigned shift = 0; node; shift += HAMT_BITS) {
+		if(node->collision) {
+			for(unsigned i = 0; i < node->count; i++) {
+				if(swiss_key_equal(node->entries[i].key, key)) return node->entries[i].val;
+			}
+
+			return 0;
+		}
+
+		unsigned bit = 1u << ((h >> shift) & HAMT_MASK);
+
+		if((node->bitmap & bit) == 0) return 0;
+
+		struct hamt_entry_t<K, V> * entry = &node->entries[__builtin_popcount(node->bitmap & (bit - 1))];
+
+		if(entry->child == 0) {
+			return swiss_key_equal(entry->key, key) ? entry->val : 0;
+		}
+
+		node = entry->child;
+	}
+
+	return 0;
+}
+
+template<typename K, typename V, typename F>
+void hamt_node_foreach(struct hamt_node_t<K, V> * node, F & f) {
+	if(node == 0) return;
+
+	for(unsigned i = 0; i < node->count; i++) {
+		if(node->entries[i].child) {
+			hamt_node_foreach(node->entries[i].child, f);
+		} else {
+			f(node->entries[i].key, node->entries[i].val);
+		}
+	}
+}
+
+// calls f(key, val) for every entry, values are borrowed
+template<typename K, typename V, typename F>
+void hamt_foreach(struct hamt_t<K, V> map, F f) {
+	hamt_node_foreach(map.root, f);
+}
+
+#endif
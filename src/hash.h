@@ -2,48 +2,59 @@
 #define HASH_HPP
 
 #include <string.h>
-#include <malloc/malloc.h>
 
 typedef struct hash_t {
 	unsigned crc32;
 } hash_t;
 
-struct hash_t hash(const char *str) {
+// the hashes are constexpr so static_parser.h can tag programs at compile time
+
+constexpr unsigned hash_crc32_byte(unsigned crc, unsigned int byte) {
+    crc = crc ^ byte;
+    for (int j = 7; j >= 0; j--) {
+        unsigned int mask = -(crc & 1);
+        crc = (crc >> 1) ^ (0xEDB88320 & mask);
+    }
+    return crc;
+}
+
+constexpr struct hash_t hash(const char *str) {
 	// crc32 algorithm
-    unsigned int byte, crc, mask;
-    int i = 0, j;
-    crc = 0xFFFFFFFF;
+    unsigned int crc = 0xFFFFFFFF;
+    int i = 0;
     while (str[i] != 0) {
-        byte = str[i];
-        crc = crc ^ byte;
-        for (j = 7; j >= 0; j--) {
-            mask = -(crc & 1);
-            crc = (crc >> 1) ^ (0xEDB88320 & mask);
-        }
+        crc = hash_crc32_byte(crc, (unsigned char)str[i]);
         i = i + 1;
     }
 
-		struct hash_t result;
-
-		result.crc32 = ~crc;
+		struct hash_t result = { ~crc };
 		
 		return result;
 }
 
-struct hash_t hash(unsigned i) {
-	struct hash_t result;
-	result.crc32 = i;
+// hash of the first length characters of str
+constexpr struct hash_t hash(const char *str, unsigned length) {
+    unsigned int crc = 0xFFFFFFFF;
+    for (unsigned i = 0; i < length; i++) {
+        crc = hash_crc32_byte(crc, (unsigned char)str[i]);
+    }
+
+		struct hash_t result = { ~crc };
+
+		return result;
+}
+
+constexpr struct hash_t hash(unsigned i) {
+	struct hash_t result = { i };
 	return result;
 }
 
-struct hash_t hash_combine(hash_t a, hash_t b) {
+constexpr struct hash_t hash_combine(hash_t a, hash_t b) {
 	unsigned seed = a.crc32;
 
 	seed ^= b.crc32 + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 
-	hash_t result;
-	
-	result.crc32 = seed;
+	hash_t result = { seed };
 	
 	return result;
 }
@@ -0,0 +1,564 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include "ast.h"
+#include "bytecode.h"
+#include "memory.h"
+#include "name.h"
+#include "swiss_table.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Lazy Krivine machine
+//
+// Runs the code of bytecode.h in a single loop with an explicit stack. The
+// stack holds the pending arguments and the update markers of the thunks being
+// evaluated, when a thunk reaches a value it is overwritten with it, so every
+// argument is evaluated at most once (call by need). A thunk is also the cell
+// that binds it in the environment, the only allocation of a step is the thunk
+// of a PUSH.
+//
+// The machine stops at weak head normal forms. The full normal form is read
+// back with an explicit task stack as well, going under a binder binds a fresh
+// neutral variable, so neither the evaluation nor the read back recurse however
+// deep the term is. Thunks, values and the read back names live in an arena
+// released after each run, the normal form is a new ast.
+
+enum machine_value_kind_t {
+	MACHINE_CLOSURE = 0,
+	MACHINE_PI,
+	MACHINE_NEUTRAL,
+};
+
+struct machine_value_t;
+
+typedef struct machine_thunk_t {
+	// code and environment, unused once the value is known
+	unsigned pc;
+	struct machine_thunk_t * env;
+
+	struct machine_value_t * value;
+
+	// rest of the environment the thunk is bound in
+	struct machine_thunk_t * next;
+} machine_thunk_t;
+
+typedef struct machine_spine_t {
+	struct machine_thunk_t * arg;
+	struct machine_spine_t * next;
+} machine_spine_t;
+
+typedef struct machine_value_t {
+	enum machine_value_kind_t kind;
+
+	// CLOSURE at a GRAB, PI at a PI or ARROW
+	unsigned pc;
+	struct machine_thunk_t * env;
+
+	// NEUTRAL variables are a free constant or a level of the read back, the
+	// arguments are kept last first
+	int level;
+	unsigned constant;
+	struct machine_spine_t * spine;
+} machine_value_t;
+
+enum machine_frame_kind_t {
+	MACHINE_ARG = 0,
+	MACHINE_UPDATE,
+};
+
+typedef struct machine_frame_t {
+	enum machine_frame_kind_t kind;
+	struct machine_thunk_t * thunk;
+} machine_frame_t;
+
+typedef struct machine_scope_t {
+	struct name_t * name;
+	struct machine_scope_t * next;
+} machine_scope_t;
+
+enum machine_task_kind_t {
+	MACHINE_TASK_EVAL = 0,
+	MACHINE_TASK_FORCE,
+};
+
+// a subterm of the normal form to be read back into *slot
+typedef struct machine_task_t {
+	enum machine_task_kind_t kind;
+
+	unsigned pc;
+	struct machine_thunk_t * env;
+	struct machine_thunk_t * thunk;
+
+	unsigned depth;
+	struct machine_scope_t * scope;
+
+	struct ast_t ** slot;
+	struct ast_t * parent;
+} machine_task_t;
+
+typedef struct machine_t {
+	struct bytecode_t * code;
+
+	struct arena_t * arena;
+
+	unsigned stack_size;
+	unsigned stack_capacity;
+	struct machine_frame_t * stack;
+
+	unsigned tasks_size;
+	unsigned tasks_capacity;
+	struct machine_task_t * tasks;
+
+	// free names of the code, the read back binders are renamed to avoid them
+	swiss_table_t<name_t*, unsigned> free;
+
+	unsigned long steps;
+	unsigned long thunks;
+	unsigned max_stack;
+} machine_t;
+
+#define MACHINE_ARENA_BLOCK_SIZE (1 << 16)
+
+void machine_init(struct machine_t * machine, struct bytecode_t * code) {
+	machine->code = code;
+	machine->arena = arena_create(MACHINE_ARENA_BLOCK_SIZE);
+
+	machine->stack_size = 0;
+	machine->stack_capacity = 64;
+	machine->stack = (struct machine_frame_t*)memory_alloc(sizeof(struct machine_frame_t) * machine->stack_capacity);
+
+	machine->tasks_size = 0;
+	machine->tasks_capacity = 64;
+	machine->tasks = (struct machine_task_t*)memory_alloc(sizeof(struct machine_task_t) * machine->tasks_capacity);
+
+	swiss_table_init(&machine->free);
+
+	for(unsigned i = 0; i < code->constants_size; i++) {
+		if(code->free[i]) {
+			swiss_table_insert(&machine->free, code->constants[i], 1u);
+		}
+	}
+
+	machine->steps = 0;
+	machine->thunks = 0;
+	machine->max_stack = 0;
+}
+
+void machine_destroy(struct machine_t * machine) {
+	arena_destroy(machine->arena);
+	swiss_table_destroy(&machine->free);
+
+	memory_free(machine->stack);
+	memory_free(machine->tasks);
+}
+
+struct machine_thunk_t * machine_thunk(struct machine_t * machine, unsigned pc, struct machine_thunk_t * env, struct machine_value_t * value) {
+	struct machine_thunk_t * thunk = (struct machine_thunk_t*)arena_alloc(machine->arena, sizeof(struct machine_thunk_t));
+
+	thunk->pc = pc;
+	thunk->env = env;
+	thunk->value = value;
+	thunk->next = 0;
+
+	machine->thunks += 1;
+
+	return thunk;
+}
+
+struct machine_value_t * machine_value(struct machine_t * machine, enum machine_value_kind_t kind) {
+	struct machine_value_t * value = (struct machine_value_t*)arena_alloc(machine->arena, sizeof(struct machine_value_t));
+
+	memset(value, 0, sizeof(struct machine_value_t));
+
+	value->kind = kind;
+	value->level = -1;
+
+	return value;
+}
+
+void machine_push(struct machine_t * machine, enum machine_frame_kind_t kind, struct machine_thunk_t * thunk) {
+	if(machine->stack_size == machine->stack_capacity) {
+		machine->stack_capacity *= 2;
+		machine->stack = (struct machine_frame_t*)memory_realloc(machine->stack, sizeof(struct machine_frame_t) * machine->stack_capacity);
+	}
+
+	machine->stack[machine->stack_size].kind = kind;
+	machine->stack[machine->stack_size].thunk = thunk;
+
+	machine->stack_size += 1;
+
+	if(machine->stack_size > machine->max_stack) {
+		machine->max_stack = machine->stack_size;
+	}
+}
+
+// runs the code at pc in env until it reaches a value and the stack is back to
+// base, updating the thunks on the way
+struct machine_value_t * machine_run(struct machine_t * machine, unsigned pc, struct machine_thunk_t * env, unsigned base) {
+	struct instruction_t * code = machine->code->code;
+	struct machine_value_t * value = 0;
+
+	while(1) {
+		if(value == 0) {
+			struct instruction_t * in = &code[pc];
+
+			machine->steps += 1;
+
+			switch(in->op) {
+			case OP_PUSH:
+				machine_push(machine, MACHINE_ARG, machine_thunk(machine, in->a, env, 0));
+				pc += 1;
+				break;
+
+			case OP_ACCESS: {
+				struct machine_thunk_t * thunk = env;
+
+				for(unsigned i = 0; i < in->a; i++) {
+					thunk = thunk->next;
+				}
+
+				if(thunk->value) {
+					value = thunk->value;
+				} else {
+					machine_push(machine, MACHINE_UPDATE, thunk);
+					pc = thunk->pc;
+					env = thunk->env;
+				}
+
+				break;
+			}
+
+			case OP_FREE:
+				value = machine_value(machine, MACHINE_NEUTRAL);
+				value->constant = in->a;
+				break;
+
+			case OP_GRAB:
+				if(machine->stack_size > base && machine->stack[machine->stack_size - 1].kind == MACHINE_ARG) {
+					struct machine_thunk_t * arg = machine->stack[--machine->stack_size].thunk;
+
+					arg->next = env;
+					env = arg;
+					pc += 1;
+				} else {
+					value = machine_value(machine, MACHINE_CLOSURE);
+					value->pc = pc;
+					value->env = env;
+				}
+
+				break;
+
+			case OP_PI:
+			case OP_ARROW:
+				value = machine_value(machine, MACHINE_PI);
+				value->pc = pc;
+				value->env = env;
+				break;
+			}
+
+			continue;
+		}
+
+		if(machine->stack_size == base) {
+			return value;
+		}
+
+		struct machine_frame_t frame = machine->stack[machine->stack_size - 1];
+
+		if(frame.kind == MACHINE_UPDATE) {
+			frame.thunk->value = value;
+			machine->stack_size -= 1;
+			continue;
+		}
+
+		if(value->kind == MACHINE_CLOSURE) {
+			// the GRAB takes the argument
+			pc = value->pc;
+			env = value->env;
+			value = 0;
+			continue;
+		}
+
+		if(value->kind == MACHINE_PI) {
+			printf("machine: a Pi type can not be applied\n");
+			abort();
+		}
+
+		struct machine_spine_t * spine = (struct machine_spine_t*)arena_alloc(machine->arena, sizeof(struct machine_spine_t));
+
+		spine->arg = frame.thunk;
+		spine->next = value->spine;
+
+		struct machine_value_t * applied = machine_value(machine, MACHINE_NEUTRAL);
+
+		applied->level = value->level;
+		applied->constant = value->constant;
+		applied->spine = spine;
+
+		value = applied;
+
+		machine->stack_size -= 1;
+	}
+}
+
+struct machine_value_t * machine_force(struct machine_t * machine, struct machine_thunk_t * thunk) {
+	if(thunk->value) return thunk->value;
+
+	unsigned base = machine->stack_size;
+
+	machine_push(machine, MACHINE_UPDATE, thunk);
+
+	return machine_run(machine, thunk->pc, thunk->env, base);
+}
+
+int machine_name_in_scope(struct machine_t * machine, struct machine_scope_t * scope, struct name_t * name) {
+	if(swiss_table_get(&machine->free, name)) return 1;
+
+	for(; scope; scope = scope->next) {
+		if(name_equal(scope->name, name)) return 1;
+	}
+
+	return 0;
+}
+
+// base with primes appended until it is not free nor bound by an outer binder
+struct machine_scope_t * machine_bind_name(struct machine_t * machine, struct machine_scope_t * scope, struct name_t * base) {
+	struct name_t * name = (struct name_t*)arena_alloc(machine->arena, sizeof(struct name_t));
+
+	name->length = base->length;
+	name->identifier = (char*)arena_alloc(machine->arena, base->length + 1);
+	memcpy(name->identifier, base->identifier, base->length + 1);
+	name->hash = base->hash;
+
+	while(machine_name_in_scope(machine, scope, name)) {
+		char * identifier = (char*)arena_alloc(machine->arena, name->length + 2);
+
+		memcpy(identifier, name->identifier, name->length);
+
+		identifier[name->length++] = '\'';
+		identifier[name->length] = 0;
+
+		name->identifier = identifier;
+		name->hash = hash(identifier);
+	}
+
+	struct machine_scope_t * bound = (struct machine_scope_t*)arena_alloc(machine->arena, sizeof(struct machine_scope_t));
+
+	bound->name = name;
+	bound->next = scope;
+
+	return bound;
+}
+
+struct machine_task_t * machine_task(struct machine_t * machine, enum machine_task_kind_t kind, unsigned depth, struct machine_scope_t * scope, struct ast_t ** slot, struct ast_t * parent) {
+	if(machine->tasks_size == machine->tasks_capacity) {
+		machine->tasks_capacity *= 2;
+		machine->tasks = (struct machine_task_t*)memory_realloc(machine->tasks, sizeof(struct machine_task_t) * machine->tasks_capacity);
+	}
+
+	struct machine_task_t * task = &machine->tasks[machine->tasks_size++];
+
+	task->kind = kind;
+	task->depth = depth;
+	task->scope = scope;
+	task->slot = slot;
+	task->parent = parent;
+
+	return task;
+}
+
+void machine_task_eval(struct machine_t * machine, unsigned pc, struct machine_thunk_t * env, unsigned depth, struct machine_scope_t * scope, struct ast_t ** slot, struct ast_t * parent) {
+	struct machine_task_t * task = machine_task(machine, MACHINE_TASK_EVAL, depth, scope, slot, parent);
+
+	task->pc = pc;
+	task->env = env;
+}
+
+void machine_task_force(struct machine_t * machine, struct machine_thunk_t * thunk, unsigned depth, struct machine_scope_t * scope, struct ast_t ** slot, struct ast_t * parent) {
+	struct machine_task_t * task = machine_task(machine, MACHINE_TASK_FORCE, depth, scope, slot, parent);
+
+	task->thunk = thunk;
+}
+
+struct ast_t * machine_node(enum ast_kind_t kind, struct ast_t ** slot, struct ast_t * parent) {
+	struct ast_t * node = alloc_node(kind);
+
+	node->parent = parent;
+
+	*slot = node;
+
+	return node;
+}
+
+struct ast_t * machine_var(struct name_t * name, struct ast_t ** slot, struct ast_t * parent) {
+	struct ast_t * node = var(name_get_str(name));
+
+	node->parent = parent;
+
+	*slot = node;
+
+	return node;
+}
+
+// reads back the value of one task, queuing the tasks of its subterms
+void machine_read_back_task(struct machine_t * machine, struct machine_task_t task) {
+	struct machine_value_t * value = task.kind == MACHINE_TASK_EVAL ? machine_run(machine, task.pc, task.env, machine->stack_size) : machine_force(machine, task.thunk);
+
+	struct instruction_t * in = value->kind == MACHINE_NEUTRAL ? 0 : &machine->code->code[value->pc];
+
+	if(value->kind == MACHINE_NEUTRAL) {
+		struct ast_t ** slot = task.slot;
+		struct ast_t * parent = task.parent;
+
+		for(struct machine_spine_t * spine = value->spine; spine; spine = spine->next) {
+			struct ast_t * node = machine_node(APP, slot, parent);
+
+			machine_task_force(machine, spine->arg, task.depth, task.scope, &node->rhs, node);
+
+			slot = &node->lhs;
+			parent = node;
+		}
+
+		if(value->level == -1) {
+			machine_var(machine->code->constants[value->constant], slot, parent);
+		} else {
+			struct machine_scope_t * scope = task.scope;
+
+			for(unsigned i = value->level + 1; i < task.depth; i++) {
+				scope = scope->next;
+			}
+
+			machine_var(scope->name, slot, parent);
+		}
+
+		return;
+	}
+
+	if(in->op == OP_ARROW) {
+		struct ast_t * node = machine_node(ARROW_TYPE, task.slot, task.parent);
+
+		machine_task_eval(machine, in->c, value->env, task.depth, task.scope, &node->rhs, node);
+		machine_task_eval(machine, in->b, value->env, task.depth, task.scope, &node->lhs, node);
+
+		return;
+	}
+
+	struct ast_t * node = machine_node(in->op == OP_GRAB ? LAMBDA : ARROW_TYPE, task.slot, task.parent);
+
+	struct machine_scope_t * scope = machine_bind_name(machine, task.scope, machine->code->constants[in->a]);
+
+	struct machine_value_t * bound = machine_value(machine, MACHINE_NEUTRAL);
+
+	bound->level = task.depth;
+
+	struct machine_thunk_t * cell = machine_thunk(machine, 0, 0, bound);
+
+	cell->next = value->env;
+
+	machine_task_eval(machine, in->op == OP_GRAB ? value->pc + 1 : in->c, cell, task.depth + 1, scope, &node->rhs, node);
+
+	if(in->b == BYTECODE_NO_LABEL) {
+		machine_var(scope->name, &node->lhs, node);
+	} else {
+		struct ast_t * binder = machine_node(BIND, &node->lhs, node);
+
+		machine_var(scope->name, &binder->lhs, binder);
+		machine_task_eval(machine, in->b, value->env, task.depth, task.scope, &binder->rhs, binder);
+	}
+}
+
+void machine_read_back(struct machine_t * machine) {
+	while(machine->tasks_size) {
+		machine_read_back_task(machine, machine->tasks[--machine->tasks_size]);
+	}
+}
+
+struct ast_t * machine_normalize_label(struct machine_t * machine, unsigned label, struct machine_thunk_t * env) {
+	struct ast_t * result = 0;
+
+	machine_task_eval(machine, label, env, 0, 0, &result, 0);
+	machine_read_back(machine);
+
+	return result;
+}
+
+struct ast_t * machine_normalize_thunk(struct machine_t * machine, struct machine_thunk_t * thunk) {
+	struct ast_t * result = 0;
+
+	machine_task_force(machine, thunk, 0, 0, &result, 0);
+	machine_read_back(machine);
+
+	return result;
+}
+
+// Normal form of the code. Every definition of a program is normalized with the
+// previous definitions unfolded and evaluated at most once, declarations stay
+// free.
+struct ast_t * machine_normalize(struct machine_t * machine) {
+	TRACE_OUTER_SCOPE("machine_normalize");
+
+	struct bytecode_t * code = machine->code;
+
+	struct ast_t * result = 0;
+
+	if(code->entry != BYTECODE_NO_LABEL) {
+		result = machine_normalize_label(machine, code->entry, 0);
+	} else {
+		struct ast_t ** lets = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * code->lets_size);
+
+		struct machine_thunk_t * env = 0;
+
+		for(unsigned i = 0; i < code->lets_size; i++) {
+			struct bytecode_let_t * let = &code->lets[i];
+			struct name_t * name = code->constants[let->name];
+
+			struct ast_t * type = machine_normalize_label(machine, let->type, env);
+
+			struct machine_thunk_t * thunk = 0;
+
+			if(let->value != BYTECODE_NO_LABEL) {
+				thunk = machine_thunk(machine, let->value, env, 0);
+				lets[i] = assign(bind(var(name_get_str(name)), type), machine_normalize_thunk(machine, thunk));
+			} else {
+				struct machine_value_t * free = machine_value(machine, MACHINE_NEUTRAL);
+				free->constant = let->name;
+				thunk = machine_thunk(machine, 0, 0, free);
+				lets[i] = declaration(bind(var(name_get_str(name)), type));
+			}
+
+			thunk->next = env;
+			env = thunk;
+		}
+
+		for(unsigned i = code->lets_size; i > 0; i--) {
+			result = statement(lets[i - 1], result);
+		}
+
+		memory_free(lets);
+	}
+
+	arena_reset(machine->arena);
+
+	return result;
+}
+
+// normal form of ast compiled and run on a temporary machine
+struct ast_t * ast_normalize_lazy(struct ast_t * ast) {
+	struct bytecode_t * code = bytecode_compile(ast);
+
+	struct machine_t machine;
+
+	machine_init(&machine, code);
+
+	struct ast_t * result = machine_normalize(&machine);
+
+	machine_destroy(&machine);
+	bytecode_free(code);
+
+	return result;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scratch arenas
+//
+// Every allocation of the ast, the names, the maps and the hashing passes goes
+// through memory_alloc. By default it forwards to the global heap, but a thread
+// can install a scratch arena with memory_set_scratch, after that all the
+// allocations of that thread are bump allocated from the arena, memory_free
+// becomes a no-op and everything is released at once with arena_reset. Arena
+// allocations are aligned like malloc, to alignof(max_align_t).
+
+// the data of a block starts after it, aligned
+typedef struct alignas(max_align_t) arena_block_t {
+	struct arena_block_t * next;
+
+	size_t capacity;
+	size_t used;
+} arena_block_t;
+
+typedef struct arena_t {
+	size_t block_size;
+
+	struct arena_block_t * head;
+	struct arena_block_t * current;
+} arena_t;
+
+// every arena allocation is prefixed by its size so it can be reallocated,
+// padded so the allocation after it is aligned
+typedef struct alignas(max_align_t) arena_header_t {
+	size_t size;
+} arena_header_t;
+
+struct arena_block_t * arena_block_allocate(size_t capacity) {
+	struct arena_block_t * block = (struct arena_block_t*)malloc(sizeof(struct arena_block_t) + capacity);
+
+	block->next = 0;
+	block->capacity = capacity;
+	block->used = 0;
+
+	return block;
+}
+
+char * arena_block_data(struct arena_block_t * block) {
+	return (char*)(block + 1);
+}
+
+struct arena_t * arena_create(size_t block_size) {
+	struct arena_t * arena = (struct arena_t*)malloc(sizeof(struct arena_t));
+
+	arena->block_size = block_size;
+	arena->head = arena_block_allocate(block_size);
+	arena->current = arena->head;
+
+	return arena;
+}
+
+void arena_destroy(struct arena_t * arena) {
+	struct arena_block_t * block = arena->head;
+
+	while(block) {
+		struct arena_block_t * next = block->next;
+		free(block);
+		block = next;
+	}
+
+	free(arena);
+}
+
+// releases every allocation at once, the blocks are kept for the next use
+void arena_reset(struct arena_t * arena) {
+	for(struct arena_block_t * block = arena->head; block; block = block->next) {
+		block->used = 0;
+	}
+
+	arena->current = arena->head;
+}
+
+void * arena_alloc(struct arena_t * arena, size_t size) {
+	size_t needed = (sizeof(struct arena_header_t) + size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+	struct arena_block_t * block = arena->current;
+
+	while(block->used + needed > block->capacity) {
+		if(block->next == 0) {
+			size_t capacity = needed > arena->block_size ? needed : arena->block_size;
+			block->next = arena_block_allocate(capacity);
+		}
+
+		block = block->next;
+	}
+
+	arena->current = block;
+
+	struct arena_header_t * header = (struct arena_header_t*)(arena_block_data(block) + block->used);
+
+	header->size = size;
+
+	block->used += needed;
+
+	return header + 1;
+}
+
+static thread_local struct arena_t * memory_scratch = 0;
+
+// number of memory_alloc and memory_realloc calls made by the calling thread
+static thread_local unsigned long memory_allocations = 0;
+
+unsigned long memory_allocation_count() {
+	return memory_allocations;
+}
+
+// installs arena as the allocator of the calling thread, 0 restores the heap
+void memory_set_scratch(struct arena_t * arena) {
+	memory_scratch = arena;
+}
+
+void * memory_alloc(size_t size) {
+	memory_allocations += 1;
+
+	if(memory_scratch) {
+		return arena_alloc(memory_scratch, size);
+	}
+
+	return malloc(size);
+}
+
+void * memory_realloc(void * ptr, size_t size) {
+	memory_allocations += 1;
+
+	if(memory_scratch == 0) {
+		return realloc(ptr, size);
+	}
+
+	void * result = arena_alloc(memory_scratch, size);
+
+	if(ptr) {
+		struct arena_header_t * header = (struct arena_header_t*)ptr - 1;
+		memcpy(result, ptr, header->size < size ? header->size : size);
+	}
+
+	return result;
+}
+
+void memory_free(void * ptr) {
+	if(memory_scratch) return;
+
+	free(ptr);
+}
+
+#endif
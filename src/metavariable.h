@@ -0,0 +1,420 @@
+#ifndef METAVARIABLE_H
+#define METAVARIABLE_H
+
+#include "ast.h"
+#include "memory.h"
+#include "name.h"
+#include "reduction.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Metavariables
+//
+// A metavariable stands for a term the elaborator has to find, like an
+// implicit argument. In terms it is a VAR named ?k, a name the parser never
+// produces, where k is its index in the store. Metavariables made equal are
+// merged in a union-find forest, by rank and with path compression, and the
+// solution of a class is kept on its root. Terms are never rewritten when a
+// metavariable is solved: the solution is found through the root when the
+// term is looked at, and meta_zonk substitutes them all when a term is done.
+//
+// A constraint that cannot be solved yet waits on the metavariable blocking
+// it and is woken up when that metavariable is solved or merged.
+//
+// Every change is recorded on a trail while a mark is taken, and meta_undo
+// rolls back to the mark: solutions, merges, path compressions, scopes, new
+// metavariables and constraints. Without a mark nothing is recorded.
+
+enum meta_trail_kind_t {
+	META_TRAIL_PARENT,
+	META_TRAIL_RANK,
+	META_TRAIL_SCOPE,
+	META_TRAIL_SOLUTION,
+	META_TRAIL_WAITING,
+	META_TRAIL_ACTIVE,
+};
+
+typedef struct meta_trail_t {
+	enum meta_trail_kind_t kind;
+	unsigned index;
+	int old;
+	struct ast_t * old_solution;
+} meta_trail_t;
+
+typedef struct meta_constraint_t {
+	struct ast_t * lhs;
+	struct ast_t * rhs;
+
+	// next constraint waiting on the same metavariable, -1 if none
+	int next;
+
+	int active;
+} meta_constraint_t;
+
+typedef struct meta_mark_t {
+	unsigned trail;
+	unsigned count;
+	unsigned constraints;
+} meta_mark_t;
+
+typedef struct meta_store_t {
+	unsigned count;
+	unsigned capacity;
+
+	int * parent;
+	int * rank;
+
+	// number of context entries the solution may refer to
+	int * scope;
+
+	// on the roots
+	struct ast_t ** solution;
+
+	// 1 if the solution had no unsolved metavariable when it was assigned
+	int * ground;
+
+	struct ast_t ** type;
+
+	// first constraint waiting on the root, -1 if none
+	int * waiting;
+
+	unsigned constraints_count;
+	unsigned constraints_capacity;
+	struct meta_constraint_t * constraints;
+
+	// heads of the lists of woken constraints
+	unsigned woken_size;
+	unsigned woken_capacity;
+	int * woken;
+
+	unsigned marks;
+	unsigned trail_size;
+	unsigned trail_capacity;
+	struct meta_trail_t * trail;
+
+	unsigned long unions;
+	unsigned long solutions;
+	unsigned long postponed;
+	unsigned long undone;
+} meta_store_t;
+
+void meta_store_init(struct meta_store_t * store) {
+	store->count = 0;
+	store->capacity = 0;
+
+	store->parent = 0;
+	store->rank = 0;
+	store->scope = 0;
+	store->solution = 0;
+	store->ground = 0;
+	store->type = 0;
+	store->waiting = 0;
+
+	store->constraints_count = 0;
+	store->constraints_capacity = 0;
+	store->constraints = 0;
+
+	store->woken_size = 0;
+	store->woken_capacity = 0;
+	store->woken = 0;
+
+	store->marks = 0;
+	store->trail_size = 0;
+	store->trail_capacity = 0;
+	store->trail = 0;
+
+	store->unions = 0;
+	store->solutions = 0;
+	store->postponed = 0;
+	store->undone = 0;
+}
+
+void meta_store_destroy(struct meta_store_t * store) {
+	memory_free(store->parent);
+	memory_free(store->rank);
+	memory_free(store->scope);
+	memory_free(store->solution);
+	memory_free(store->ground);
+	memory_free(store->type);
+	memory_free(store->waiting);
+	memory_free(store->constraints);
+	memory_free(store->woken);
+	memory_free(store->trail);
+}
+
+void meta_trail_push(struct meta_store_t * store, enum meta_trail_kind_t kind, unsigned index, int old, struct ast_t * old_solution) {
+	if(store->marks == 0) return;
+
+	if(store->trail_size == store->trail_capacity) {
+		store->trail_capacity = store->trail_capacity ? store->trail_capacity * 2 : 64;
+		store->trail = (struct meta_trail_t*)memory_realloc(store->trail, sizeof(struct meta_trail_t) * store->trail_capacity);
+	}
+
+	store->trail[store->trail_size++] = { kind, index, old, old_solution };
+}
+
+// index of the metavariable ast is, -1 if it is not one
+int meta_index(struct ast_t * ast) {
+	if(ast == 0 || ast->kind != VAR || ast->name->identifier[0] != '?') return -1;
+
+	return atoi(ast->name->identifier + 1);
+}
+
+// fresh metavariable of the given type, solvable with terms whose free names
+// are the first scope entries of the context
+struct ast_t * meta_fresh(struct meta_store_t * store, struct ast_t * type, int scope) {
+	if(store->count == store->capacity) {
+		store->capacity = store->capacity ? store->capacity * 2 : 64;
+
+		store->parent = (int*)memory_realloc(store->parent, sizeof(int) * store->capacity);
+		store->rank = (int*)memory_realloc(store->rank, sizeof(int) * store->capacity);
+		store->scope = (int*)memory_realloc(store->scope, sizeof(int) * store->capacity);
+		store->solution = (struct ast_t**)memory_realloc(store->solution, sizeof(struct ast_t*) * store->capacity);
+		store->ground = (int*)memory_realloc(store->ground, sizeof(int) * store->capacity);
+		store->type = (struct ast_t**)memory_realloc(store->type, sizeof(struct ast_t*) * store->capacity);
+		store->waiting = (int*)memory_realloc(store->waiting, sizeof(int) * store->capacity);
+	}
+
+	unsigned index = store->count++;
+
+	store->parent[index] = index;
+	store->rank[index] = 0;
+	store->scope[index] = scope;
+	store->solution[index] = 0;
+	store->ground[index] = 0;
+	store->type[index] = type;
+	store->waiting[index] = -1;
+
+	char buffer[16];
+
+	snprintf(buffer, sizeof(buffer), "?%u", index);
+
+	return var(buffer);
+}
+
+unsigned meta_find(struct meta_store_t * store, unsigned index) {
+	unsigned root = index;
+
+	while(store->parent[root] != (int)root) {
+		root = store->parent[root];
+	}
+
+	// path compression
+	while(store->parent[index] != (int)root) {
+		unsigned next = store->parent[index];
+
+		meta_trail_push(store, META_TRAIL_PARENT, index, store->parent[index], 0);
+		store->parent[index] = root;
+
+		index = next;
+	}
+
+	return root;
+}
+
+struct ast_t * meta_solution(struct meta_store_t * store, unsigned index) {
+	return store->solution[meta_find(store, index)];
+}
+
+// the solution of ast while it is a solved metavariable
+struct ast_t * meta_force(struct meta_store_t * store, struct ast_t * ast) {
+	int index;
+
+	while((index = meta_index(ast)) != -1) {
+		struct ast_t * solution = meta_solution(store, index);
+
+		if(solution == 0) break;
+
+		ast = solution;
+	}
+
+	return ast;
+}
+
+void meta_set_scope(struct meta_store_t * store, unsigned root, int scope) {
+	if(scope >= store->scope[root]) return;
+
+	meta_trail_push(store, META_TRAIL_SCOPE, root, store->scope[root], 0);
+	store->scope[root] = scope;
+}
+
+// moves the constraints waiting on root to the woken ones
+void meta_wake(struct meta_store_t * store, unsigned root) {
+	if(store->waiting[root] == -1) return;
+
+	if(store->woken_size == store->woken_capacity) {
+		store->woken_capacity = store->woken_capacity ? store->woken_capacity * 2 : 16;
+		store->woken = (int*)memory_realloc(store->woken, sizeof(int) * store->woken_capacity);
+	}
+
+	store->woken[store->woken_size++] = store->waiting[root];
+
+	meta_trail_push(store, META_TRAIL_WAITING, root, store->waiting[root], 0);
+	store->waiting[root] = -1;
+}
+
+// solves the root of an unsolved class, the flag is only read while the
+// solution is set and needs no trail
+void meta_assign(struct meta_store_t * store, unsigned root, struct ast_t * solution, int ground) {
+	meta_trail_push(store, META_TRAIL_SOLUTION, root, 0, store->solution[root]);
+	store->solution[root] = solution;
+	store->ground[root] = ground;
+	store->solutions += 1;
+
+	meta_wake(store, root);
+}
+
+// merges the classes of two unsolved roots
+void meta_union(struct meta_store_t * store, unsigned a, unsigned b) {
+	if(a == b) return;
+
+	if(store->rank[a] < store->rank[b]) {
+		unsigned t = a;
+		a = b;
+		b = t;
+	}
+
+	meta_trail_push(store, META_TRAIL_PARENT, b, store->parent[b], 0);
+	store->parent[b] = a;
+
+	if(store->rank[a] == store->rank[b]) {
+		meta_trail_push(store, META_TRAIL_RANK, a, store->rank[a], 0);
+		store->rank[a] += 1;
+	}
+
+	meta_set_scope(store, a, store->scope[b]);
+
+	store->unions += 1;
+
+	// they wait on a from now on
+	meta_wake(store, b);
+}
+
+void meta_postpone(struct meta_store_t * store, unsigned root, struct ast_t * lhs, struct ast_t * rhs) {
+	if(store->constraints_count == store->constraints_capacity) {
+		store->constraints_capacity = store->constraints_capacity ? store->constraints_capacity * 2 : 16;
+		store->constraints = (struct meta_constraint_t*)memory_realloc(store->constraints, sizeof(struct meta_constraint_t) * store->constraints_capacity);
+	}
+
+	int index = store->constraints_count++;
+
+	store->constraints[index] = { lhs, rhs, store->waiting[root], 1 };
+
+	meta_trail_push(store, META_TRAIL_WAITING, root, store->waiting[root], 0);
+	store->waiting[root] = index;
+
+	store->postponed += 1;
+}
+
+void meta_deactivate(struct meta_store_t * store, unsigned constraint) {
+	meta_trail_push(store, META_TRAIL_ACTIVE, constraint, store->constraints[constraint].active, 0);
+	store->constraints[constraint].active = 0;
+}
+
+unsigned meta_active_constraints(struct meta_store_t * store) {
+	unsigned active = 0;
+
+	for(unsigned i = 0; i < store->constraints_count; i++) {
+		active += store->constraints[i].active;
+	}
+
+	return active;
+}
+
+struct meta_mark_t meta_mark(struct meta_store_t * store) {
+	store->marks += 1;
+
+	return { store->trail_size, store->count, store->constraints_count };
+}
+
+// keeps the changes made since the innermost mark
+void meta_commit(struct meta_store_t * store) {
+	store->marks -= 1;
+
+	if(store->marks == 0) {
+		store->trail_size = 0;
+	}
+}
+
+// rolls back every change made since the mark
+void meta_undo(struct meta_store_t * store, struct meta_mark_t mark) {
+	while(store->trail_size > mark.trail) {
+		struct meta_trail_t * entry = &store->trail[--store->trail_size];
+
+		switch(entry->kind) {
+		case META_TRAIL_PARENT: store->parent[entry->index] = entry->old; break;
+		case META_TRAIL_RANK: store->rank[entry->index] = entry->old; break;
+		case META_TRAIL_SCOPE: store->scope[entry->index] = entry->old; break;
+		case META_TRAIL_SOLUTION: store->solution[entry->index] = entry->old_solution; break;
+		case META_TRAIL_WAITING: store->waiting[entry->index] = entry->old; break;
+		case META_TRAIL_ACTIVE: store->constraints[entry->index].active = entry->old; break;
+		}
+
+		store->undone += 1;
+	}
+
+	store->count = mark.count;
+	store->constraints_count = mark.constraints;
+	store->woken_size = 0;
+
+	meta_commit(store);
+}
+
+// 1 if ast has a solved metavariable
+int meta_solved_occurs(struct meta_store_t * store, struct ast_t * ast) {
+	if(ast == 0) return 0;
+
+	int index = meta_index(ast);
+
+	if(index != -1) return meta_solution(store, index) != 0;
+
+	return meta_solved_occurs(store, ast->lhs) || meta_solved_occurs(store, ast->rhs);
+}
+
+struct ast_t * meta_zonk_copy(struct meta_store_t * store, struct ast_t * ast) {
+	if(ast == 0) return 0;
+
+	ast = meta_force(store, ast);
+
+	if(ast->kind == VAR) return ast_copy(ast);
+
+	struct ast_t * copy = ast_node(ast->kind, meta_zonk_copy(store, ast->lhs), meta_zonk_copy(store, ast->rhs));
+
+	if(ast->name) {
+		copy->name = name_copy(ast->name);
+	}
+
+	return copy;
+}
+
+// ast with every solved metavariable replaced by its solution, ast itself if
+// it has none
+struct ast_t * meta_zonk(struct meta_store_t * store, struct ast_t * ast) {
+	return meta_solved_occurs(store, ast) ? meta_zonk_copy(store, ast) : ast;
+}
+
+// 1 if ast has an unsolved metavariable
+int meta_unsolved_occurs(struct meta_store_t * store, struct ast_t * ast) {
+	if(ast == 0) return 0;
+
+	int index = meta_index(ast);
+
+	if(index != -1) {
+		struct ast_t * solution = meta_solution(store, index);
+
+		return solution == 0 || meta_unsolved_occurs(store, solution);
+	}
+
+	return meta_unsolved_occurs(store, ast->lhs) || meta_unsolved_occurs(store, ast->rhs);
+}
+
+void meta_store_report(struct meta_store_t * store, FILE * out) {
+	fprintf(out, "metavariables:       %u\n", store->count);
+	fprintf(out, "solutions:           %lu\n", store->solutions);
+	fprintf(out, "unions:              %lu\n", store->unions);
+	fprintf(out, "postponed:           %lu\n", store->postponed);
+	fprintf(out, "undone:              %lu\n", store->undone);
+}
+
+#endif
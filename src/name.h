@@ -3,7 +3,7 @@
 
 #include "hash.h"
 #include <cstring>
-#include <malloc/_malloc.h>
+#include "memory.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -15,10 +15,10 @@ typedef struct name_t {
 
 
 struct name_t * allocate_name(const char * id) {
-	struct name_t * name = (struct name_t*)malloc(sizeof(struct name_t));
+	struct name_t * name = (struct name_t*)memory_alloc(sizeof(struct name_t));
 
 	name->length = strlen(id);
-	name->identifier = (char*)malloc(sizeof(char) * name->length);
+	name->identifier = (char*)memory_alloc(sizeof(char) * (name->length + 1));
 
 	strcpy(name->identifier, id);
 	
@@ -28,8 +28,8 @@ struct name_t * allocate_name(const char * id) {
 }
 
 void name_free(struct name_t * name) {
-	free(name->identifier);
-	free(name);
+	memory_free(name->identifier);
+	memory_free(name);
 }
 
 const char* name_get_str(const name_t * name) {
@@ -40,11 +40,15 @@ unsigned name_get_length(const name_t * name) {
 	return name->length;
 }
 
+int name_equal(const name_t * a, const name_t * b) {
+	return a == b || (a->hash.crc32 == b->hash.crc32 && a->length == b->length && memcmp(a->identifier, b->identifier, a->length) == 0);
+}
+
 struct name_t * name_copy(struct name_t * name) {
-	struct name_t * copy = (struct name_t*)malloc(sizeof(struct name_t));
+	struct name_t * copy = (struct name_t*)memory_alloc(sizeof(struct name_t));
 
 	copy->hash = name->hash;
-	copy->identifier = (char*)malloc(sizeof(char) * name->length);
+	copy->identifier = (char*)memory_alloc(sizeof(char) * (name->length + 1));
 	copy->length = name->length;
 	
 	strcpy(copy->identifier, name->identifier);
@@ -0,0 +1,845 @@
+#ifndef NBE_H
+#define NBE_H
+
+#include "ast.h"
+#include "name.h"
+#include "memory.h"
+#include "swiss_table.h"
+#include "ast_hash.h"
+#include "reduction.h"
+#include "normal_form_cache.h"
+#include "case_tree.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Normalization by evaluation
+//
+// Terms are evaluated into a semantic domain where lambdas and Pi types are
+// closures, a body with the environment it was evaluated in, and a variable
+// with no value is a neutral term that accumulates the arguments it is applied
+// to. Applying a closure evaluates its body in the extended environment, no
+// term is ever copied or substituted. The normal form is read back from the
+// value, going under a binder applies the closure to a fresh neutral variable.
+//
+// Arguments are evaluated lazily and at most once (thunks), so terms whose
+// normal form exists are normalized even when an argument has none. Values,
+// thunks and environments live in an arena that is released after each read
+// back, the normal form is a new ast allocated with memory_alloc.
+//
+// As in reduction.h, LAMBDA and ARROW_TYPE nodes whose lhs is a BIND are the
+// binders and the type of the binder is outside of its scope.
+//
+// A case list is a closure too, applied to its arguments one at a time. Once
+// it has all of them the first matching case is taken, through the decision
+// tree of the list (case_tree.h), which is compiled on first use and kept until
+// the end of the normalization. An argument is forced only when the tree tests
+// it. A case list applied to a value that is not a constructor, or that no case
+// matches, is a neutral term.
+//
+// With a normal_form_cache_t installed the normal forms of the terms that do not
+// depend on a previous definition are looked up by tag before being evaluated.
+
+enum value_kind_t {
+	VALUE_LAMBDA = 0,
+	VALUE_PI,
+	VALUE_FREE,
+	VALUE_BOUND,
+	VALUE_APP,
+	VALUE_CASE,
+};
+
+struct value_t;
+struct thunk_t;
+
+typedef struct env_t {
+	struct name_t * name;
+	struct thunk_t * thunk;
+	struct env_t * next;
+} env_t;
+
+typedef struct thunk_t {
+	struct ast_t * ast;
+	struct env_t * env;
+
+	// 0 until forced
+	struct value_t * value;
+} thunk_t;
+
+typedef struct value_t {
+	enum value_kind_t kind;
+
+	// LAMBDA and PI closures, name is 0 for non dependent arrows and type is 0 for
+	// lambdas without a type. FREE variables only have a name.
+	struct name_t * name;
+	struct thunk_t * type;
+	struct ast_t * body;
+	struct env_t * env;
+
+	// BOUND variables are numbered by the depth of their binder in the read back
+	unsigned level;
+
+	// APP of a neutral head. A CASE closure (body is the CASE_LIST) applied
+	// to level arguments has the closure applied to the previous ones as head.
+	struct value_t * head;
+	struct thunk_t * arg;
+
+	struct case_tree_t * tree;
+} value_t;
+
+unsigned swiss_key_hash(struct ast_t * key) {
+	return (unsigned)((unsigned long)key >> 4) * 2654435769u;
+}
+
+int swiss_key_equal(struct ast_t * a, struct ast_t * b) {
+	return a == b;
+}
+
+typedef struct nbe_t {
+	struct arena_t * arena;
+
+	// names of the binders being read back, indexed by level
+	unsigned depth;
+	unsigned capacity;
+	struct name_t ** names;
+
+	// free names of the term, the read back binders are renamed to avoid them
+	swiss_table_t<name_t*, unsigned> used;
+
+	// let definitions in scope while normalizing a program
+	swiss_table_t<name_t*, unsigned> defined;
+
+	// optional, shared with other engines
+	struct normal_form_cache_t * cache;
+
+	// decision trees of the case lists evaluated, by CASE_LIST node
+	swiss_table_t<ast_t*, case_tree_t*> trees;
+
+	// 0 tries the cases one after the other instead
+	int decision_trees;
+
+	// closures applied and cases taken
+	unsigned long steps;
+} nbe_t;
+
+#define NBE_ARENA_BLOCK_SIZE (1 << 16)
+
+// engine with its values in arena, which nbe_destroy releases
+void nbe_init_in(struct nbe_t * nbe, struct arena_t * arena) {
+	nbe->arena = arena;
+
+	nbe->depth = 0;
+	nbe->capacity = 16;
+	nbe->names = (struct name_t**)memory_alloc(sizeof(struct name_t*) * nbe->capacity);
+
+	swiss_table_init(&nbe->used);
+	swiss_table_init(&nbe->defined);
+
+	nbe->cache = 0;
+
+	swiss_table_init(&nbe->trees);
+
+	nbe->decision_trees = 1;
+
+	nbe->steps = 0;
+}
+
+void nbe_init(struct nbe_t * nbe) {
+	nbe_init_in(nbe, arena_create(NBE_ARENA_BLOCK_SIZE));
+}
+
+void nbe_free_trees(struct nbe_t * nbe) {
+	for(unsigned i = 0; i < nbe->trees.capacity; i++) {
+		if(nbe->trees.keys[i]) case_tree_free(nbe->trees.vals[i]);
+	}
+
+	swiss_table_clear(&nbe->trees);
+}
+
+void nbe_destroy(struct nbe_t * nbe) {
+	nbe_free_trees(nbe);
+	arena_destroy(nbe->arena);
+	swiss_table_destroy(&nbe->used);
+	swiss_table_destroy(&nbe->defined);
+	swiss_table_destroy(&nbe->trees);
+	memory_free(nbe->names);
+}
+
+struct value_t * nbe_value(struct nbe_t * nbe, enum value_kind_t kind) {
+	struct value_t * value = (struct value_t*)arena_alloc(nbe->arena, sizeof(struct value_t));
+
+	memset(value, 0, sizeof(struct value_t));
+
+	value->kind = kind;
+
+	return value;
+}
+
+struct thunk_t * nbe_thunk(struct nbe_t * nbe, struct ast_t * ast, struct env_t * env, struct value_t * value) {
+	struct thunk_t * thunk = (struct thunk_t*)arena_alloc(nbe->arena, sizeof(struct thunk_t));
+
+	thunk->ast = ast;
+	thunk->env = env;
+	thunk->value = value;
+
+	return thunk;
+}
+
+struct env_t * nbe_extend(struct nbe_t * nbe, struct env_t * env, struct name_t * name, struct thunk_t * thunk) {
+	struct env_t * entry = (struct env_t*)arena_alloc(nbe->arena, sizeof(struct env_t));
+
+	entry->name = name;
+	entry->thunk = thunk;
+	entry->next = env;
+
+	return entry;
+}
+
+struct value_t * nbe_eval(struct nbe_t * nbe, struct env_t * env, struct ast_t * ast);
+
+struct value_t * nbe_force(struct nbe_t * nbe, struct thunk_t * thunk) {
+	if(thunk->value == 0) {
+		thunk->value = nbe_eval(nbe, thunk->env, thunk->ast);
+	}
+
+	return thunk->value;
+}
+
+struct value_t * nbe_closure(struct nbe_t * nbe, enum value_kind_t kind, struct env_t * env, struct ast_t * ast) {
+	struct value_t * value = nbe_value(nbe, kind);
+
+	struct ast_t * binder = ast->lhs;
+
+	if(binder->kind == BIND) {
+		value->name = binder->lhs->name;
+		value->type = nbe_thunk(nbe, binder->rhs, env, 0);
+	} else if(kind == VALUE_LAMBDA) {
+		value->name = binder->name;
+	} else {
+		value->type = nbe_thunk(nbe, binder, env, 0);
+	}
+
+	value->body = ast->rhs;
+	value->env = env;
+
+	return value;
+}
+
+// body of the closure with its variable bound to arg
+struct value_t * nbe_instantiate(struct nbe_t * nbe, struct value_t * closure, struct thunk_t * arg) {
+	if(closure->name == 0) {
+		return nbe_eval(nbe, closure->env, closure->body);
+	}
+
+	return nbe_eval(nbe, nbe_extend(nbe, closure->env, closure->name, arg), closure->body);
+}
+
+struct case_tree_t * nbe_case_tree(struct nbe_t * nbe, struct ast_t * cases) {
+	struct case_tree_t ** found = swiss_table_get(&nbe->trees, cases);
+
+	if(found) return *found;
+
+	struct case_tree_t * tree = case_tree_compile(cases);
+
+	if(tree == 0) {
+		printf("nbe: the cases of a case list have different numbers of patterns\n");
+		abort();
+	}
+
+	swiss_table_insert(&nbe->trees, cases, tree);
+
+	return tree;
+}
+
+// the arguments of a saturated case closure, in order
+struct thunk_t ** nbe_case_arguments(struct nbe_t * nbe, struct value_t * value, unsigned size) {
+	struct thunk_t ** registers = (struct thunk_t**)arena_alloc(nbe->arena, sizeof(struct thunk_t*) * (size + 1));
+
+	for(; value->level; value = value->head) {
+		registers[value->level - 1] = value->arg;
+	}
+
+	return registers;
+}
+
+// head of the spine of a neutral value and its number of arguments
+struct value_t * nbe_spine(struct value_t * value, unsigned * arity) {
+	*arity = 0;
+
+	while(value->kind == VALUE_APP) {
+		value = value->head;
+		*arity += 1;
+	}
+
+	return value;
+}
+
+int nbe_is_constructor(struct value_t * head) {
+	return head->kind == VALUE_FREE && ast_is_constructor(head->name);
+}
+
+// the body of the case the tree selects, 0 if the case list is stuck
+struct value_t * nbe_match_tree(struct nbe_t * nbe, struct value_t * value) {
+	struct thunk_t ** registers = nbe_case_arguments(nbe, value, value->tree->registers);
+
+	struct case_node_t * node = value->tree->root;
+
+	while(node->kind == CASE_NODE_SWITCH) {
+		struct value_t * scrutinee = nbe_force(nbe, registers[node->occurrence]);
+
+		unsigned arity;
+
+		struct value_t * head = nbe_spine(scrutinee, &arity);
+
+		if(!nbe_is_constructor(head)) return 0;
+
+		struct case_node_t * branch = case_node_branch(node, head->name, arity);
+
+		if(branch == 0) return 0;
+
+		if(branch != node->fallback) {
+			for(unsigned k = arity; k > 0; k--, scrutinee = scrutinee->head) {
+				registers[node->first + k - 1] = scrutinee->arg;
+			}
+		}
+
+		node = branch;
+	}
+
+	if(node->kind == CASE_NODE_FAIL) return 0;
+
+	struct env_t * env = value->env;
+
+	unsigned i = 0;
+
+	ast_pattern_foreach_variable(node->match->lhs, [&](struct ast_t * x) {
+		env = nbe_extend(nbe, env, x->name, registers[node->registers[i++]]);
+	});
+
+	nbe->steps += 1;
+
+	return nbe_eval(nbe, env, node->match->rhs);
+}
+
+int nbe_match_pattern(struct nbe_t * nbe, struct ast_t * pattern, struct thunk_t * thunk, struct env_t ** env);
+
+// matches the fields of a constructor pattern with the arguments of value
+int nbe_match_fields(struct nbe_t * nbe, struct ast_t * pattern, struct value_t * value, struct env_t ** env) {
+	if(pattern->kind != APP) return 1;
+
+	int matched = nbe_match_fields(nbe, pattern->lhs, value->head, env);
+
+	if(matched != 1) return matched;
+
+	return nbe_match_pattern(nbe, pattern->rhs, value->arg, env);
+}
+
+// 1 if the value of thunk matches pattern, its variables are then bound in
+// env, 0 if it does not and -1 if it can not be decided
+int nbe_match_pattern(struct nbe_t * nbe, struct ast_t * pattern, struct thunk_t * thunk, struct env_t ** env) {
+	if(pattern->kind == VAR && !ast_is_constructor(pattern->name)) {
+		if(!ast_is_wildcard(pattern->name)) {
+			*env = nbe_extend(nbe, *env, pattern->name, thunk);
+		}
+
+		return 1;
+	}
+
+	struct value_t * value = nbe_force(nbe, thunk);
+
+	unsigned arity;
+	unsigned value_arity;
+
+	struct name_t * name = case_pattern_head(pattern, &arity)->name;
+	struct value_t * head = nbe_spine(value, &value_arity);
+
+	if(!nbe_is_constructor(head)) return -1;
+
+	if(!name_equal(head->name, name)) return 0;
+
+	if(value_arity != arity) return -1;
+
+	return nbe_match_fields(nbe, pattern, value, env);
+}
+
+// the body of the first case that matches, tried in order
+struct value_t * nbe_match_cases(struct nbe_t * nbe, struct value_t * value) {
+	struct thunk_t ** arguments = nbe_case_arguments(nbe, value, value->level);
+
+	for(struct ast_t * list = value->body; list; list = list->rhs) {
+		struct env_t * env = value->env;
+
+		int matched = 1;
+		unsigned i = 0;
+
+		for(struct ast_t * patterns = list->lhs->lhs; patterns && matched == 1; patterns = patterns->rhs) {
+			matched = nbe_match_pattern(nbe, patterns->lhs, arguments[i++], &env);
+		}
+
+		if(matched == -1) return 0;
+
+		if(matched == 1) {
+			nbe->steps += 1;
+			return nbe_eval(nbe, env, list->lhs->rhs);
+		}
+	}
+
+	return 0;
+}
+
+struct value_t * nbe_apply(struct nbe_t * nbe, struct value_t * fn, struct thunk_t * arg) {
+	if(fn->kind == VALUE_LAMBDA) {
+		nbe->steps += 1;
+		return nbe_instantiate(nbe, fn, arg);
+	}
+
+	if(fn->kind == VALUE_CASE && fn->level < fn->tree->arity) {
+		struct value_t * value = nbe_value(nbe, VALUE_CASE);
+
+		value->body = fn->body;
+		value->env = fn->env;
+		value->tree = fn->tree;
+		value->head = fn;
+		value->arg = arg;
+		value->level = fn->level + 1;
+
+		if(value->level < value->tree->arity) return value;
+
+		struct value_t * taken = nbe->decision_trees ? nbe_match_tree(nbe, value) : nbe_match_cases(nbe, value);
+
+		return taken ? taken : value;
+	}
+
+	if(fn->kind == VALUE_PI) {
+		printf("nbe: a Pi type can not be applied\n");
+		abort();
+	}
+
+	struct value_t * value = nbe_value(nbe, VALUE_APP);
+
+	value->head = fn;
+	value->arg = arg;
+
+	return value;
+}
+
+struct value_t * nbe_eval(struct nbe_t * nbe, struct env_t * env, struct ast_t * ast) {
+	switch(ast->kind) {
+	case VAR: {
+		for(struct env_t * entry = env; entry; entry = entry->next) {
+			if(name_equal(entry->name, ast->name)) {
+				return nbe_force(nbe, entry->thunk);
+			}
+		}
+
+		struct value_t * value = nbe_value(nbe, VALUE_FREE);
+
+		value->name = ast->name;
+
+		return value;
+	}
+
+	case LAMBDA:
+		return nbe_closure(nbe, VALUE_LAMBDA, env, ast);
+
+	case ARROW_TYPE:
+		return nbe_closure(nbe, VALUE_PI, env, ast);
+
+	case APP:
+		return nbe_apply(nbe, nbe_eval(nbe, env, ast->lhs), nbe_thunk(nbe, ast->rhs, env, 0));
+
+	case BIND:
+		// the annotation is erased
+		return nbe_eval(nbe, env, ast->lhs);
+
+	case CASE_LIST: {
+		struct value_t * value = nbe_value(nbe, VALUE_CASE);
+
+		value->body = ast;
+		value->env = env;
+		value->tree = nbe_case_tree(nbe, ast);
+
+		return value;
+	}
+
+	default:
+		printf("nbe: statements can only appear at the top level\n");
+		abort();
+	}
+}
+
+int nbe_name_in_scope(struct nbe_t * nbe, struct name_t * name) {
+	if(swiss_table_get(&nbe->used, name)) return 1;
+
+	for(unsigned i = 0; i < nbe->depth; i++) {
+		if(name_equal(nbe->names[i], name)) return 1;
+	}
+
+	return 0;
+}
+
+// pushes a name for the binder at the current depth, the name of the binder
+// with primes appended until it is not used by the term or an outer binder
+void nbe_push_name(struct nbe_t * nbe, struct name_t * base) {
+	unsigned length = base->length;
+
+	char * buffer = (char*)memory_alloc(length + 1);
+
+	memcpy(buffer, base->identifier, length + 1);
+
+	struct name_t * name = allocate_name(buffer);
+
+	while(nbe_name_in_scope(nbe, name)) {
+		buffer = (char*)memory_realloc(buffer, length + 2);
+		buffer[length++] = '\'';
+		buffer[length] = 0;
+
+		name_free(name);
+		name = allocate_name(buffer);
+	}
+
+	memory_free(buffer);
+
+	if(nbe->depth == nbe->capacity) {
+		nbe->capacity *= 2;
+		nbe->names = (struct name_t**)memory_realloc(nbe->names, sizeof(struct name_t*) * nbe->capacity);
+	}
+
+	nbe->names[nbe->depth++] = name;
+}
+
+void nbe_pop_name(struct nbe_t * nbe) {
+	name_free(nbe->names[--nbe->depth]);
+}
+
+struct ast_t * nbe_read_back(struct nbe_t * nbe, struct value_t * value);
+
+// copy of pattern with its variables renamed to the names pushed from index
+struct ast_t * nbe_read_back_pattern(struct nbe_t * nbe, struct ast_t * pattern, unsigned * index) {
+	if(pattern == 0) return 0;
+
+	if(pattern->kind == VAR) {
+		int variable = !ast_is_constructor(pattern->name) && !ast_is_wildcard(pattern->name);
+
+		return var(name_get_str(variable ? nbe->names[(*index)++] : pattern->name));
+	}
+
+	struct ast_t * lhs = nbe_read_back_pattern(nbe, pattern->lhs, index);
+
+	return ast_node(pattern->kind, lhs, nbe_read_back_pattern(nbe, pattern->rhs, index));
+}
+
+// the cases from list of a case closure, each body read back with its pattern
+// variables bound
+struct ast_t * nbe_read_back_cases(struct nbe_t * nbe, struct value_t * closure, struct ast_t * list) {
+	struct ast_t * match = list->lhs;
+
+	unsigned base = nbe->depth;
+
+	struct env_t * env = closure->env;
+
+	ast_pattern_foreach_variable(match->lhs, [&](struct ast_t * x) {
+		struct value_t * bound = nbe_value(nbe, VALUE_BOUND);
+
+		bound->level = nbe->depth;
+
+		nbe_push_name(nbe, x->name);
+
+		env = nbe_extend(nbe, env, x->name, nbe_thunk(nbe, 0, 0, bound));
+	});
+
+	unsigned index = base;
+
+	struct ast_t * patterns = nbe_read_back_pattern(nbe, match->lhs, &index);
+	struct ast_t * body = nbe_read_back(nbe, nbe_eval(nbe, env, match->rhs));
+
+	while(nbe->depth > base) {
+		nbe_pop_name(nbe);
+	}
+
+	struct ast_t * tail = list->rhs ? nbe_read_back_cases(nbe, closure, list->rhs) : 0;
+
+	return case_list(case_statement(patterns, body), tail);
+}
+
+struct ast_t * nbe_read_back(struct nbe_t * nbe, struct value_t * value) {
+	switch(value->kind) {
+	case VALUE_FREE:
+		return var(name_get_str(value->name));
+
+	case VALUE_BOUND:
+		return var(name_get_str(nbe->names[value->level]));
+
+	case VALUE_APP: {
+		struct ast_t * head = nbe_read_back(nbe, value->head);
+		return app(head, nbe_read_back(nbe, nbe_force(nbe, value->arg)));
+	}
+
+	case VALUE_CASE: {
+		if(value->level == 0) return nbe_read_back_cases(nbe, value, value->body);
+
+		struct ast_t * head = nbe_read_back(nbe, value->head);
+		return app(head, nbe_read_back(nbe, nbe_force(nbe, value->arg)));
+	}
+
+	default: {
+		struct ast_t * type = value->type ? nbe_read_back(nbe, nbe_force(nbe, value->type)) : 0;
+
+		if(value->name == 0) {
+			struct ast_t * body = nbe_read_back(nbe, nbe_instantiate(nbe, value, 0));
+			return arrow(type, body);
+		}
+
+		struct value_t * bound = nbe_value(nbe, VALUE_BOUND);
+
+		bound->level = nbe->depth;
+
+		nbe_push_name(nbe, value->name);
+
+		struct ast_t * binder = var(name_get_str(nbe->names[bound->level]));
+
+		if(type) {
+			binder = bind(binder, type);
+		}
+
+		struct ast_t * body = nbe_read_back(nbe, nbe_instantiate(nbe, value, nbe_thunk(nbe, 0, 0, bound)));
+
+		nbe_pop_name(nbe);
+
+		struct ast_t * node = alloc_node(value->kind == VALUE_LAMBDA ? LAMBDA : ARROW_TYPE);
+
+		node->lhs = binder;
+		node->rhs = body;
+
+		binder->parent = node;
+		body->parent = node;
+
+		return node;
+	}
+	}
+}
+
+// scope extended with the pattern variables of a case
+struct env_t * nbe_case_scope(struct nbe_t * nbe, struct ast_t * match, struct env_t * scope) {
+	ast_pattern_foreach_variable(match->lhs, [&](struct ast_t * x) {
+		scope = nbe_extend(nbe, scope, x->name, 0);
+	});
+
+	return scope;
+}
+
+// adds the free variables of ast to the used names, scope holds the bound ones
+void nbe_collect_free(struct nbe_t * nbe, struct ast_t * ast, struct env_t * scope) {
+	if(ast == 0) return;
+
+	if(ast->kind == VAR) {
+		for(struct env_t * entry = scope; entry; entry = entry->next) {
+			if(name_equal(entry->name, ast->name)) return;
+		}
+
+		swiss_table_insert(&nbe->used, ast->name, 1u);
+
+		return;
+	}
+
+	if(ast->kind == LAMBDA || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND)) {
+		struct env_t inner;
+
+		inner.next = scope;
+
+		if(ast->lhs->kind == BIND) {
+			nbe_collect_free(nbe, ast->lhs->rhs, scope);
+			inner.name = ast->lhs->lhs->name;
+		} else {
+			inner.name = ast->lhs->name;
+		}
+
+		nbe_collect_free(nbe, ast->rhs, &inner);
+
+		return;
+	}
+
+	if(ast->kind == CASE) {
+		nbe_collect_free(nbe, ast->rhs, nbe_case_scope(nbe, ast, scope));
+
+		return;
+	}
+
+	if(ast->kind == STATEMENT) {
+		struct ast_t * let = ast->lhs;
+		struct ast_t * binding = let->lhs;
+
+		nbe_collect_free(nbe, binding->rhs, scope);
+
+		if(let->kind == ASSIGNMENT) {
+			nbe_collect_free(nbe, let->rhs, scope);
+		} else {
+			// declared names stay free in the normal forms
+			swiss_table_insert(&nbe->used, binding->lhs->name, 1u);
+		}
+
+		struct env_t inner;
+
+		inner.name = binding->lhs->name;
+		inner.next = scope;
+
+		nbe_collect_free(nbe, ast->rhs, let->kind == ASSIGNMENT ? &inner : scope);
+
+		return;
+	}
+
+	nbe_collect_free(nbe, ast->lhs, scope);
+	nbe_collect_free(nbe, ast->rhs, scope);
+}
+
+// The normal form of ast depends on nothing but ast when none of its free
+// variables is a let definition. Binders whose type mentions their own name are
+// left out too, the hash and the alpha equivalence put the type in the scope of
+// the binder but the evaluation does not.
+int nbe_cacheable(struct nbe_t * nbe, struct ast_t * ast, struct env_t * scope) {
+	if(ast == 0) return 1;
+
+	if(ast->kind == VAR) {
+		for(struct env_t * entry = scope; entry; entry = entry->next) {
+			if(name_equal(entry->name, ast->name)) return 1;
+		}
+
+		return swiss_table_get(&nbe->defined, ast->name) == 0;
+	}
+
+	if(ast->kind == LAMBDA || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND)) {
+		struct env_t inner;
+
+		inner.next = scope;
+
+		if(ast->lhs->kind == BIND) {
+			inner.name = ast->lhs->lhs->name;
+
+			if(!nbe_cacheable(nbe, ast->lhs->rhs, scope) || ast_occurs_free(ast->lhs->rhs, inner.name)) return 0;
+		} else {
+			inner.name = ast->lhs->name;
+		}
+
+		return nbe_cacheable(nbe, ast->rhs, &inner);
+	}
+
+	if(ast->kind == CASE) {
+		return nbe_cacheable(nbe, ast->rhs, nbe_case_scope(nbe, ast, scope));
+	}
+
+	return nbe_cacheable(nbe, ast->lhs, scope) && nbe_cacheable(nbe, ast->rhs, scope);
+}
+
+// normal form of the value of thunk, through the cache when there is one
+struct ast_t * nbe_normalize_thunk(struct nbe_t * nbe, struct thunk_t * thunk) {
+	int cached = nbe->cache && nbe_cacheable(nbe, thunk->ast, 0);
+
+	if(cached) {
+		struct ast_t * normal = normal_form_cache_get(nbe->cache, thunk->ast);
+
+		if(normal) return normal;
+	}
+
+	struct ast_t * normal = nbe_read_back(nbe, nbe_force(nbe, thunk));
+
+	if(cached) {
+		normal_form_cache_put(nbe->cache, thunk->ast, normal);
+	}
+
+	return normal;
+}
+
+struct ast_t * nbe_normalize_in(struct nbe_t * nbe, struct env_t * env, struct ast_t * ast) {
+	return nbe_normalize_thunk(nbe, nbe_thunk(nbe, ast, env, 0));
+}
+
+// Normal form of ast, which is left untouched. Every definition of a program is
+// normalized with the previous definitions unfolded, declarations stay free.
+struct ast_t * nbe_normalize(struct nbe_t * nbe, struct ast_t * ast) {
+	TRACE_OUTER_SCOPE("nbe_normalize");
+
+	swiss_table_clear(&nbe->used);
+
+	swiss_table_clear(&nbe->defined);
+
+	nbe_collect_free(nbe, ast, 0);
+
+	if(nbe->cache) {
+		ast_hash(ast);
+	}
+
+	struct ast_t * result = 0;
+
+	if(ast->kind != STATEMENT) {
+		result = nbe_normalize_in(nbe, 0, ast);
+	} else {
+		unsigned count = 0;
+
+		for(struct ast_t * statement = ast; statement; statement = statement->rhs) {
+			count += 1;
+		}
+
+		struct ast_t ** lets = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * count);
+
+		struct env_t * env = 0;
+
+		count = 0;
+
+		for(struct ast_t * statement = ast; statement; statement = statement->rhs) {
+			struct ast_t * let = statement->lhs;
+			struct ast_t * binding = let->lhs;
+
+			struct name_t * name = binding->lhs->name;
+
+			struct ast_t * type = nbe_normalize_in(nbe, env, binding->rhs);
+
+			struct thunk_t * thunk = 0;
+
+			if(let->kind == ASSIGNMENT) {
+				thunk = nbe_thunk(nbe, let->rhs, env, 0);
+				lets[count++] = assign(bind(var(name_get_str(name)), type), nbe_normalize_thunk(nbe, thunk));
+			} else {
+				struct value_t * free = nbe_value(nbe, VALUE_FREE);
+				free->name = name;
+				thunk = nbe_thunk(nbe, 0, 0, free);
+				lets[count++] = declaration(bind(var(name_get_str(name)), type));
+			}
+
+			env = nbe_extend(nbe, env, name, thunk);
+
+			if(let->kind == ASSIGNMENT) {
+				swiss_table_insert(&nbe->defined, name, 1u);
+			} else {
+				swiss_table_remove(&nbe->defined, name, (struct name_t**)0, (unsigned*)0);
+			}
+		}
+
+		while(count) {
+			result = statement(lets[--count], result);
+		}
+
+		memory_free(lets);
+	}
+
+	arena_reset(nbe->arena);
+
+	nbe_free_trees(nbe);
+
+	return result;
+}
+
+// normal form of ast with a temporary engine
+struct ast_t * ast_normalize(struct ast_t * ast) {
+	struct nbe_t nbe;
+
+	nbe_init(&nbe);
+
+	struct ast_t * result = nbe_normalize(&nbe, ast);
+
+	nbe_destroy(&nbe);
+
+	return result;
+}
+
+#endif
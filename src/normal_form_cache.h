@@ -0,0 +1,279 @@
+#ifndef NORMAL_FORM_CACHE_H
+#define NORMAL_FORM_CACHE_H
+
+#include "ast.h"
+#include "alpha_equivalence.h"
+#include "memory.h"
+#include "swiss_table.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+
+// Normal form cache
+//
+// Bounded table from the tag of a term to its normal form, shared by any number
+// of threads. Alpha equivalent terms share their tag, so a term is normalized
+// once for all of its renamings. The entries keep a copy of the term they were
+// computed for and a hit is only reported when the term looked up is alpha
+// equivalent to it, tags that collide are counted and never return a wrong
+// normal form.
+//
+// The table is split in shards selected by the tag, each with its own lock and
+// its own least recently used list. When a shard goes over its share of the
+// entry or node budget the least recently used entries are evicted. The terms
+// must be hashed with ast_hash before being looked up or inserted.
+
+#define NORMAL_FORM_CACHE_SHARDS 16
+
+typedef struct normal_form_entry_t {
+	struct hash_t tag;
+
+	struct ast_t * term;
+	struct ast_t * normal;
+
+	// nodes of term and normal
+	unsigned long size;
+
+	// least recently used list of the shard, most recent first
+	struct normal_form_entry_t * prev;
+	struct normal_form_entry_t * next;
+} normal_form_entry_t;
+
+unsigned swiss_key_hash(struct normal_form_entry_t * key) {
+	return key->tag.crc32 * 2654435769u;
+}
+
+int swiss_key_equal(struct normal_form_entry_t * a, struct normal_form_entry_t * b) {
+	return a->tag.crc32 == b->tag.crc32;
+}
+
+typedef struct normal_form_shard_t {
+	std::mutex lock;
+
+	// used as a set of entries keyed by their tags
+	swiss_table_t<normal_form_entry_t*, char> entries;
+
+	struct normal_form_entry_t * head;
+	struct normal_form_entry_t * tail;
+
+	unsigned long count;
+	unsigned long size;
+} normal_form_shard_t;
+
+typedef struct normal_form_cache_t {
+	// budgets of the whole cache, 0 is unbounded
+	unsigned long max_entries;
+	unsigned long max_size;
+
+	struct normal_form_shard_t shards[NORMAL_FORM_CACHE_SHARDS];
+
+	std::atomic<unsigned long> hits;
+	std::atomic<unsigned long> misses;
+	std::atomic<unsigned long> collisions;
+	std::atomic<unsigned long> insertions;
+	std::atomic<unsigned long> evictions;
+} normal_form_cache_t;
+
+unsigned long ast_count_nodes(struct ast_t * ast) {
+	return ast ? 1 + ast_count_nodes(ast->lhs) + ast_count_nodes(ast->rhs) : 0;
+}
+
+void normal_form_cache_init(struct normal_form_cache_t * cache, unsigned long max_entries, unsigned long max_size) {
+	cache->max_entries = max_entries;
+	cache->max_size = max_size;
+
+	for(unsigned i = 0; i < NORMAL_FORM_CACHE_SHARDS; i++) {
+		struct normal_form_shard_t * shard = &cache->shards[i];
+
+		swiss_table_init(&shard->entries);
+
+		shard->head = 0;
+		shard->tail = 0;
+		shard->count = 0;
+		shard->size = 0;
+	}
+
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->collisions = 0;
+	cache->insertions = 0;
+	cache->evictions = 0;
+}
+
+void normal_form_entry_free(struct normal_form_entry_t * entry) {
+	ast_free(entry->term);
+	ast_free(entry->normal);
+	memory_free(entry);
+}
+
+void normal_form_cache_destroy(struct normal_form_cache_t * cache) {
+	struct arena_t * scratch = memory_scratch;
+
+	memory_set_scratch(0);
+
+	for(unsigned i = 0; i < NORMAL_FORM_CACHE_SHARDS; i++) {
+		struct normal_form_shard_t * shard = &cache->shards[i];
+
+		struct normal_form_entry_t * entry = shard->head;
+
+		while(entry) {
+			struct normal_form_entry_t * next = entry->next;
+			normal_form_entry_free(entry);
+			entry = next;
+		}
+
+		swiss_table_destroy(&shard->entries);
+	}
+
+	memory_set_scratch(scratch);
+}
+
+struct normal_form_shard_t * normal_form_cache_shard(struct normal_form_cache_t * cache, struct hash_t tag) {
+	// the low bits pick the slot inside the shard table, use the high ones here
+	return &cache->shards[(tag.crc32 * 2654435769u) >> 28 & (NORMAL_FORM_CACHE_SHARDS - 1)];
+}
+
+void normal_form_shard_unlink(struct normal_form_shard_t * shard, struct normal_form_entry_t * entry) {
+	if(entry->prev) entry->prev->next = entry->next;
+	else shard->head = entry->next;
+
+	if(entry->next) entry->next->prev = entry->prev;
+	else shard->tail = entry->prev;
+}
+
+void normal_form_shard_push_front(struct normal_form_shard_t * shard, struct normal_form_entry_t * entry) {
+	entry->prev = 0;
+	entry->next = shard->head;
+
+	if(shard->head) shard->head->prev = entry;
+	else shard->tail = entry;
+
+	shard->head = entry;
+}
+
+struct normal_form_entry_t * normal_form_shard_find(struct normal_form_shard_t * shard, struct hash_t tag) {
+	struct normal_form_entry_t probe;
+
+	probe.tag = tag;
+
+	int slot = swiss_table_find(&shard->entries, &probe);
+
+	return slot == -1 ? 0 : shard->entries.keys[slot];
+}
+
+// Copy of the cached normal form of term or 0. The copy is allocated with
+// memory_alloc and owned by the caller.
+struct ast_t * normal_form_cache_get(struct normal_form_cache_t * cache, struct ast_t * term) {
+	struct normal_form_shard_t * shard = normal_form_cache_shard(cache, term->tag);
+
+	std::lock_guard<std::mutex> guard(shard->lock);
+
+	struct normal_form_entry_t * entry = normal_form_shard_find(shard, term->tag);
+
+	if(entry == 0) {
+		cache->misses.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	if(!ast_alpha_equivalent(entry->term, term)) {
+		cache->collisions.fetch_add(1, std::memory_order_relaxed);
+		cache->misses.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	cache->hits.fetch_add(1, std::memory_order_relaxed);
+
+	normal_form_shard_unlink(shard, entry);
+	normal_form_shard_push_front(shard, entry);
+
+	return ast_copy(entry->normal);
+}
+
+void normal_form_shard_evict(struct normal_form_cache_t * cache, struct normal_form_shard_t * shard) {
+	unsigned long max_entries = cache->max_entries ? (cache->max_entries + NORMAL_FORM_CACHE_SHARDS - 1) / NORMAL_FORM_CACHE_SHARDS : 0;
+	unsigned long max_size = cache->max_size ? (cache->max_size + NORMAL_FORM_CACHE_SHARDS - 1) / NORMAL_FORM_CACHE_SHARDS : 0;
+
+	while(shard->tail && ((max_entries && shard->count > max_entries) || (max_size && shard->size > max_size))) {
+		struct normal_form_entry_t * entry = shard->tail;
+
+		normal_form_shard_unlink(shard, entry);
+
+		swiss_table_remove(&shard->entries, entry, (struct normal_form_entry_t**)0, (char*)0);
+
+		shard->count -= 1;
+		shard->size -= entry->size;
+
+		normal_form_entry_free(entry);
+
+		cache->evictions.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Stores copies of term and its normal form. An entry already cached for the
+// tag is kept, even when it belongs to a colliding term.
+void normal_form_cache_put(struct normal_form_cache_t * cache, struct ast_t * term, struct ast_t * normal) {
+	struct normal_form_shard_t * shard = normal_form_cache_shard(cache, term->tag);
+
+	// the entries outlive any scratch arena of the calling thread
+	struct arena_t * scratch = memory_scratch;
+
+	memory_set_scratch(0);
+
+	struct normal_form_entry_t * entry = (struct normal_form_entry_t*)memory_alloc(sizeof(struct normal_form_entry_t));
+
+	entry->tag = term->tag;
+	entry->term = ast_copy(term);
+	entry->normal = ast_copy(normal);
+	entry->size = ast_count_nodes(term) + ast_count_nodes(normal);
+
+	{
+		std::lock_guard<std::mutex> guard(shard->lock);
+
+		if(normal_form_shard_find(shard, term->tag)) {
+			normal_form_entry_free(entry);
+		} else {
+			swiss_table_insert(&shard->entries, entry, (char)1);
+
+			normal_form_shard_push_front(shard, entry);
+
+			shard->count += 1;
+			shard->size += entry->size;
+
+			cache->insertions.fetch_add(1, std::memory_order_relaxed);
+
+			normal_form_shard_evict(cache, shard);
+		}
+	}
+
+	memory_set_scratch(scratch);
+}
+
+double normal_form_cache_hit_rate(struct normal_form_cache_t * cache) {
+	unsigned long hits = cache->hits.load();
+	unsigned long lookups = hits + cache->misses.load();
+
+	return lookups ? (double)hits / lookups : 0;
+}
+
+void normal_form_cache_report(struct normal_form_cache_t * cache, FILE * out) {
+	unsigned long entries = 0;
+	unsigned long size = 0;
+
+	for(unsigned i = 0; i < NORMAL_FORM_CACHE_SHARDS; i++) {
+		std::lock_guard<std::mutex> guard(cache->shards[i].lock);
+
+		entries += cache->shards[i].count;
+		size += cache->shards[i].size;
+	}
+
+	fprintf(out, "entries / nodes:     %lu / %lu\n", entries, size);
+	fprintf(out, "hits:                %lu\n", cache->hits.load());
+	fprintf(out, "misses:              %lu\n", cache->misses.load());
+	fprintf(out, "hit rate:            %.3f\n", normal_form_cache_hit_rate(cache));
+	fprintf(out, "collisions:          %lu\n", cache->collisions.load());
+	fprintf(out, "insertions:          %lu\n", cache->insertions.load());
+	fprintf(out, "evictions:           %lu\n", cache->evictions.load());
+}
+
+#endif
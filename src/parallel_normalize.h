@@ -0,0 +1,228 @@
+#ifndef PARALLEL_NORMALIZE_H
+#define PARALLEL_NORMALIZE_H
+
+#include "ast.h"
+#include "memory.h"
+#include "reduction.h"
+#include "nbe.h"
+#include "task_pool.h"
+
+// Parallel strong normalization
+//
+// The normal form of a term in weak head normal form is built from the normal
+// forms of its parts: the type and the body of a lambda, both sides of an
+// ARROW_TYPE, or the arguments of a variable applied to them. These are
+// independent and are normalized as separate tasks on a work stealing pool.
+//
+// A task owns a subterm and the slot of the result tree it fills. Subterms of
+// at least threshold nodes are head reduced in place with beta_reduction,
+// which only contracts redexes on the spine, and their parts are spawned again.
+// Smaller ones, and the ones whose head reduction would copy more than a few
+// times the threshold, are normalized by the evaluator of the worker. Tasks never
+// wait for each other, the result is complete when the pool is done.
+//
+// The result only depends on the term: the head reduction is deterministic and
+// the evaluator picks the names of a subterm from its own free names, so the
+// same tree, with the same names, comes out for any number of threads and any
+// schedule. It is alpha equivalent to ast_normalize. Programs are normalized by
+// ast_normalize on the calling thread, the definitions depend on each other.
+
+#define PARALLEL_NORMALIZE_THRESHOLD 256
+
+// nodes the head reduction of a task may copy, in multiples of the threshold
+#define PARALLEL_NORMALIZE_HEAD_BUDGET 2
+
+typedef struct parallel_normalize_t {
+	struct task_pool_t pool;
+
+	// one evaluator per worker
+	struct nbe_t * engines;
+
+	unsigned long threshold;
+
+	std::atomic<unsigned long> head_steps;
+} parallel_normalize_t;
+
+typedef struct parallel_normalize_task_t {
+	struct parallel_normalize_t * normalizer;
+
+	// owned by the task, its normal form goes to *slot
+	struct ast_t * term;
+	struct ast_t ** slot;
+	struct ast_t * parent;
+} parallel_normalize_task_t;
+
+// size of ast if it has less than limit nodes, limit otherwise
+unsigned long ast_count_nodes_upto(struct ast_t * ast, unsigned long limit) {
+	if(ast == 0 || limit == 0) return 0;
+
+	unsigned long count = 1;
+
+	count += ast_count_nodes_upto(ast->lhs, limit - count);
+
+	if(count < limit) {
+		count += ast_count_nodes_upto(ast->rhs, limit - count);
+	}
+
+	return count;
+}
+
+// slot of the leftmost outermost redex if it is on the spine of *expr
+struct ast_t ** ast_head_redex(struct ast_t ** expr) {
+	while((*expr)->kind == APP) {
+		if((*expr)->lhs->kind == LAMBDA) return expr;
+
+		expr = &(*expr)->lhs;
+	}
+
+	return 0;
+}
+
+void parallel_normalize_task(void * arg, unsigned worker);
+
+void parallel_normalize_spawn(struct parallel_normalize_t * normalizer, struct ast_t ** slot, struct ast_t * parent) {
+	struct parallel_normalize_task_t * task = (struct parallel_normalize_task_t*)memory_alloc(sizeof(struct parallel_normalize_task_t));
+
+	task->normalizer = normalizer;
+	task->term = *slot;
+	task->slot = slot;
+	task->parent = parent;
+
+	task_pool_spawn(&normalizer->pool, parallel_normalize_task, task);
+}
+
+void parallel_normalize_fill(struct parallel_normalize_task_t * task, struct ast_t * normal) {
+	*task->slot = normal;
+	normal->parent = task->parent;
+}
+
+void parallel_normalize_task(void * arg, unsigned worker) {
+	struct parallel_normalize_task_t * task = (struct parallel_normalize_task_t*)arg;
+	struct parallel_normalize_t * normalizer = task->normalizer;
+
+	struct ast_t * term = task->term;
+
+	unsigned long size = ast_count_nodes_upto(term, normalizer->threshold);
+
+	struct ast_t ** redex = 0;
+
+	if(size == normalizer->threshold) {
+		unsigned long budget = PARALLEL_NORMALIZE_HEAD_BUDGET * normalizer->threshold;
+		unsigned long steps = 0;
+
+		term->parent = task->parent;
+
+		while((redex = ast_head_redex(&term))) {
+			// the body is copied, the argument at least once if it occurs
+			unsigned long copied = ast_count_nodes_upto((*redex)->lhs->rhs, budget + 1);
+
+			copied += ast_count_nodes_upto((*redex)->rhs, budget + 1);
+
+			if(copied > budget) break;
+
+			budget -= copied;
+
+			*redex = beta_reduction(*redex);
+			steps += 1;
+		}
+
+		normalizer->head_steps.fetch_add(steps, std::memory_order_relaxed);
+	}
+
+	// small, or its head does not reduce cheaply by substitution
+	if(size < normalizer->threshold || redex) {
+		struct ast_t * normal = nbe_normalize(&normalizer->engines[worker], term);
+
+		ast_free(term);
+
+		parallel_normalize_fill(task, normal);
+
+		memory_free(task);
+
+		return;
+	}
+
+	parallel_normalize_fill(task, term);
+
+	// the node stays in place, its parts are replaced by their normal forms
+	if(term->kind == LAMBDA || term->kind == ARROW_TYPE) {
+		if(term->lhs->kind == BIND) {
+			parallel_normalize_spawn(normalizer, &term->lhs->rhs, term->lhs);
+		} else if(term->kind == ARROW_TYPE) {
+			parallel_normalize_spawn(normalizer, &term->lhs, term);
+		}
+
+		parallel_normalize_spawn(normalizer, &term->rhs, term);
+	} else if(term->kind == APP) {
+		struct ast_t * spine = term;
+
+		while(spine->kind == APP) {
+			struct ast_t * head = spine->lhs;
+
+			parallel_normalize_spawn(normalizer, &spine->rhs, spine);
+
+			// a stuck head that is not a variable, the slot may change from now on
+			if(head->kind != APP && head->kind != VAR) {
+				parallel_normalize_spawn(normalizer, &spine->lhs, spine);
+			}
+
+			spine = head;
+		}
+	}
+
+	memory_free(task);
+}
+
+// threads = 0 uses one thread per core, threshold = 0 the default
+void parallel_normalize_init(struct parallel_normalize_t * normalizer, unsigned threads, unsigned long threshold) {
+	task_pool_init(&normalizer->pool, threads);
+
+	normalizer->engines = (struct nbe_t*)memory_alloc(sizeof(struct nbe_t) * normalizer->pool.workers);
+
+	for(unsigned i = 0; i < normalizer->pool.workers; i++) {
+		nbe_init(&normalizer->engines[i]);
+	}
+
+	normalizer->threshold = threshold ? threshold : PARALLEL_NORMALIZE_THRESHOLD;
+	normalizer->head_steps = 0;
+}
+
+void parallel_normalize_destroy(struct parallel_normalize_t * normalizer) {
+	for(unsigned i = 0; i < normalizer->pool.workers; i++) {
+		nbe_destroy(&normalizer->engines[i]);
+	}
+
+	memory_free(normalizer->engines);
+
+	task_pool_destroy(&normalizer->pool);
+}
+
+// Normal form of ast, which is left untouched.
+struct ast_t * parallel_normalize(struct parallel_normalize_t * normalizer, struct ast_t * ast) {
+	if(ast->kind == STATEMENT) {
+		return nbe_normalize(&normalizer->engines[0], ast);
+	}
+
+	struct ast_t * result = ast_copy(ast);
+
+	parallel_normalize_spawn(normalizer, &result, 0);
+
+	task_pool_run(&normalizer->pool);
+
+	return result;
+}
+
+// normal form of ast with a temporary pool
+struct ast_t * ast_normalize_parallel(struct ast_t * ast, unsigned threads) {
+	struct parallel_normalize_t normalizer;
+
+	parallel_normalize_init(&normalizer, threads, 0);
+
+	struct ast_t * result = parallel_normalize(&normalizer, ast);
+
+	parallel_normalize_destroy(&normalizer);
+
+	return result;
+}
+
+#endif
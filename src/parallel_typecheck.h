@@ -0,0 +1,416 @@
+#ifndef PARALLEL_TYPECHECK_H
+#define PARALLEL_TYPECHECK_H
+
+#include "ast.h"
+#include "memory.h"
+#include "swiss_table.h"
+#include "task_pool.h"
+#include "typecheck.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+// Parallel checking of top level definitions
+//
+// The lets of a program only see the definitions their free names refer to.
+// Those free names are in the fv_to_ctx_map of each let once the program has
+// been prepared by the checker. The definition graph has an edge from a
+// definition to every later let referring to it. Each definition is checked and
+// normalized as a task of a work stealing pool once its dependencies are done,
+// so independent definitions are checked concurrently. The dependencies of a
+// definition are complete before it starts, and so are the definitions named
+// in their types and values.
+//
+// The names of a definition are looked up at its position in the program, as
+// the sequential checker does. A definition that redefines a name is a barrier:
+// it waits for every definition before it and every definition after it waits
+// for it. Once a name is defined again, the same free name can refer to
+// different definitions at different positions, and the barriers keep the
+// lookups the same as in the sequential order.
+//
+// Every worker has its own checker and arena. A definition whose dependency
+// failed is not checked. The error reported is the one of the first failing
+// definition in program order, the one typecheck_program reports.
+
+typedef struct parallel_typecheck_t parallel_typecheck_t;
+
+typedef struct definition_t {
+	struct typecheck_entry_t entry;
+
+	struct ast_t * let;
+
+	// earlier definition of the same name, -1 if none
+	int previous;
+
+	// longest chain of dependencies ending here
+	unsigned depth;
+
+	// dependencies not done yet
+	std::atomic<unsigned> waiting;
+
+	// a dependency failed or was not checked
+	std::atomic<int> blocked;
+
+	int failed;
+
+	// the definitions waiting for it, in dependents[first, first + count)
+	unsigned long first;
+	unsigned count;
+
+	struct parallel_typecheck_t * owner;
+} definition_t;
+
+typedef struct definition_graph_t {
+	unsigned size;
+	struct definition_t * definitions;
+
+	unsigned long edges;
+	unsigned * dependents;
+
+	unsigned depth;
+	unsigned barriers;
+
+	// last definition of each name
+	swiss_table_t<name_t*, unsigned> last;
+} definition_graph_t;
+
+// index of the definition name refers to in the let at position, -1 if none
+int definition_graph_resolve(struct definition_graph_t * graph, struct name_t * name, unsigned position) {
+	unsigned * last = swiss_table_get(&graph->last, name);
+
+	if(last == 0) return -1;
+
+	int index = *last;
+
+	while(index >= (int)position) {
+		index = graph->definitions[index].previous;
+	}
+
+	return index;
+}
+
+// calls edge(from, to) for every dependency of the definitions, in order
+template<typename F>
+void definition_graph_edges(struct definition_graph_t * graph, F edge) {
+	int barrier = -1;
+
+	for(unsigned i = 0; i < graph->size; i++) {
+		struct definition_t * definition = &graph->definitions[i];
+
+		if(definition->previous != -1) {
+			for(unsigned j = barrier == -1 ? 0 : barrier; j < i; j++) {
+				edge(j, i);
+			}
+
+			barrier = i;
+
+			continue;
+		}
+
+		if(barrier != -1) {
+			edge(barrier, i);
+		}
+
+		struct name_name_map_t * names = definition->let->fv_to_ctx_map;
+
+		for(unsigned k = 0; k < names->capacity; k++) {
+			if(names->keys[k] == 0) continue;
+
+			int j = definition_graph_resolve(graph, names->keys[k], i);
+
+			// the barrier is already a dependency
+			if(j > barrier) {
+				edge(j, i);
+			}
+		}
+	}
+}
+
+// Builds the graph of the statements of a prepared program. The arrays are
+// allocated with memory_alloc.
+void definition_graph_build(struct definition_graph_t * graph, struct ast_t * program, struct parallel_typecheck_t * owner) {
+	graph->size = 0;
+
+	for(struct ast_t * statement = program; statement && statement->kind == STATEMENT; statement = statement->rhs) {
+		graph->size += 1;
+	}
+
+	graph->definitions = (struct definition_t*)memory_alloc(sizeof(struct definition_t) * graph->size);
+	graph->barriers = 0;
+
+	swiss_table_init(&graph->last);
+
+	struct ast_t * statement = program;
+
+	for(unsigned i = 0; i < graph->size; i++, statement = statement->rhs) {
+		struct definition_t * definition = &graph->definitions[i];
+		struct ast_t * let = statement->lhs;
+
+		typecheck_entry_init(&definition->entry, let->lhs->lhs->name, let->lhs->rhs, 0);
+		definition->let = let;
+		definition->depth = 1;
+		definition->waiting.store(0, std::memory_order_relaxed);
+		definition->blocked.store(0, std::memory_order_relaxed);
+		definition->failed = 0;
+		definition->count = 0;
+		definition->owner = owner;
+
+		unsigned * last = swiss_table_get(&graph->last, definition->entry.name);
+
+		if(last) {
+			definition->previous = *last;
+			*last = i;
+
+			graph->barriers += 1;
+		} else {
+			definition->previous = -1;
+
+			swiss_table_insert(&graph->last, definition->entry.name, i);
+		}
+	}
+
+	// counted first, then placed
+	graph->edges = 0;
+	graph->depth = 0;
+
+	definition_graph_edges(graph, [&](unsigned from, unsigned to) {
+		graph->definitions[from].count += 1;
+		graph->definitions[to].waiting.fetch_add(1, std::memory_order_relaxed);
+		graph->edges += 1;
+	});
+
+	graph->dependents = (unsigned*)memory_alloc(sizeof(unsigned) * (graph->edges ? graph->edges : 1));
+
+	unsigned long first = 0;
+
+	for(unsigned i = 0; i < graph->size; i++) {
+		graph->definitions[i].first = first;
+		first += graph->definitions[i].count;
+		graph->definitions[i].count = 0;
+	}
+
+	definition_graph_edges(graph, [&](unsigned from, unsigned to) {
+		struct definition_t * definition = &graph->definitions[from];
+
+		graph->dependents[definition->first + definition->count++] = to;
+
+		// the edges come by increasing target, the depth of from is final
+		if(graph->definitions[to].depth < definition->depth + 1) {
+			graph->definitions[to].depth = definition->depth + 1;
+		}
+	});
+
+	for(unsigned i = 0; i < graph->size; i++) {
+		if(graph->depth < graph->definitions[i].depth) {
+			graph->depth = graph->definitions[i].depth;
+		}
+	}
+}
+
+// position of the definition a worker is checking
+typedef struct definition_scope_t {
+	struct definition_graph_t * graph;
+	unsigned position;
+} definition_scope_t;
+
+struct typecheck_entry_t * definition_scope_resolve(void * arg, struct name_t * name) {
+	struct definition_scope_t * scope = (struct definition_scope_t*)arg;
+
+	int index = definition_graph_resolve(scope->graph, name, scope->position);
+
+	return index == -1 ? 0 : &scope->graph->definitions[index].entry;
+}
+
+typedef struct parallel_typecheck_t {
+	struct task_pool_t pool;
+
+	// one checker per worker
+	struct typecheck_t * checkers;
+	struct definition_scope_t * scopes;
+
+	struct definition_graph_t graph;
+
+	std::mutex lock;
+
+	// first failing definition, -1 if none
+	long error_definition;
+	char error[256];
+} parallel_typecheck_t;
+
+// threads = 0 uses one thread per core
+void parallel_typecheck_init(struct parallel_typecheck_t * checker, unsigned threads) {
+	task_pool_init(&checker->pool, threads);
+
+	checker->checkers = (struct typecheck_t*)memory_alloc(sizeof(struct typecheck_t) * checker->pool.workers);
+	checker->scopes = (struct definition_scope_t*)memory_alloc(sizeof(struct definition_scope_t) * checker->pool.workers);
+
+	for(unsigned i = 0; i < checker->pool.workers; i++) {
+		typecheck_init(&checker->checkers[i]);
+
+		checker->checkers[i].resolve = definition_scope_resolve;
+		checker->checkers[i].resolve_arg = &checker->scopes[i];
+
+		checker->scopes[i].graph = &checker->graph;
+		checker->scopes[i].position = 0;
+	}
+
+	checker->graph.size = 0;
+
+	checker->error_definition = -1;
+	checker->error[0] = 0;
+}
+
+void parallel_typecheck_destroy(struct parallel_typecheck_t * checker) {
+	for(unsigned i = 0; i < checker->pool.workers; i++) {
+		typecheck_destroy(&checker->checkers[i]);
+	}
+
+	memory_free(checker->checkers);
+	memory_free(checker->scopes);
+
+	task_pool_destroy(&checker->pool);
+}
+
+void parallel_typecheck_task(void * arg, unsigned worker) {
+	struct definition_t * definition = (struct definition_t*)arg;
+	struct parallel_typecheck_t * owner = definition->owner;
+	struct definition_graph_t * graph = &owner->graph;
+
+	unsigned position = definition - graph->definitions;
+
+	if(!definition->blocked.load(std::memory_order_relaxed)) {
+		struct typecheck_t * checker = &owner->checkers[worker];
+
+		owner->scopes[worker].position = position;
+
+		checker->failed = 0;
+		checker->error[0] = 0;
+
+		struct arena_t * scratch = memory_scratch;
+
+		memory_set_scratch(checker->arena);
+
+		definition->failed = !typecheck_definition(checker, definition->let, &definition->entry);
+
+		memory_set_scratch(scratch);
+
+		if(definition->failed) {
+			std::lock_guard<std::mutex> guard(owner->lock);
+
+			if(owner->error_definition == -1 || owner->error_definition > (long)position) {
+				owner->error_definition = position;
+				strcpy(owner->error, checker->error);
+			}
+		}
+	}
+
+	int blocked = definition->failed || definition->blocked.load(std::memory_order_relaxed);
+
+	for(unsigned i = 0; i < definition->count; i++) {
+		struct definition_t * dependent = &graph->definitions[graph->dependents[definition->first + i]];
+
+		if(blocked) {
+			dependent->blocked.store(1, std::memory_order_relaxed);
+		}
+
+		// the last dependency to finish schedules it
+		if(dependent->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			task_pool_spawn(&owner->pool, parallel_typecheck_task, dependent);
+		}
+	}
+}
+
+// Checks the program like typecheck_program, with its definitions checked
+// concurrently, and returns 1 when it is well typed. Otherwise the first
+// error is in checker->error.
+int parallel_typecheck_program(struct parallel_typecheck_t * checker, struct ast_t * program) {
+	struct arena_t * scratch = memory_scratch;
+
+	for(unsigned i = 0; i < checker->pool.workers; i++) {
+		memory_set_scratch(checker->checkers[i].arena);
+
+		typecheck_reset(&checker->checkers[i]);
+	}
+
+	checker->error_definition = -1;
+	checker->error[0] = 0;
+
+	// the program and the graph stay in the arena of the first worker
+	struct typecheck_t * first = &checker->checkers[0];
+
+	memory_set_scratch(first->arena);
+
+	// no definition is visible to an expression
+	checker->graph.size = 0;
+	checker->graph.edges = 0;
+	checker->graph.depth = 0;
+	checker->graph.barriers = 0;
+
+	swiss_table_init(&checker->graph.last);
+
+	struct ast_t * copy = typecheck_prepare(first, program);
+
+	if(copy && copy->kind != STATEMENT) {
+		typecheck_infer(first, copy);
+	}
+
+	if(copy == 0 || copy->kind != STATEMENT) {
+		if(first->failed) {
+			checker->error_definition = 0;
+			strcpy(checker->error, first->error);
+		}
+
+		memory_set_scratch(scratch);
+
+		return !first->failed;
+	}
+
+	definition_graph_build(&checker->graph, copy, checker);
+
+	// the deques of the pool are allocated on the heap
+	memory_set_scratch(0);
+
+	for(unsigned i = 0; i < checker->graph.size; i++) {
+		if(checker->graph.definitions[i].waiting.load(std::memory_order_relaxed) == 0) {
+			task_pool_spawn(&checker->pool, parallel_typecheck_task, &checker->graph.definitions[i]);
+		}
+	}
+
+	task_pool_run(&checker->pool);
+
+	memory_set_scratch(scratch);
+
+	return checker->error_definition == -1;
+}
+
+void parallel_typecheck_report(struct parallel_typecheck_t * checker, FILE * out) {
+	if(checker->error_definition != -1) {
+		fprintf(out, "error:               %s\n", checker->error);
+	}
+
+	unsigned long conversions = 0;
+	unsigned long tag_hits = 0;
+	unsigned long memo_hits = 0;
+	unsigned long memo_misses = 0;
+
+	for(unsigned i = 0; i < checker->pool.workers; i++) {
+		conversions += checker->checkers[i].conversions;
+		tag_hits += checker->checkers[i].tag_hits;
+		memo_hits += checker->checkers[i].memo_hits;
+		memo_misses += checker->checkers[i].memo_misses;
+	}
+
+	fprintf(out, "definitions:         %u\n", checker->graph.size);
+	fprintf(out, "dependencies:        %lu\n", checker->graph.edges);
+	fprintf(out, "depth:               %u\n", checker->graph.depth);
+	fprintf(out, "barriers:            %u\n", checker->graph.barriers);
+	fprintf(out, "workers:             %u\n", checker->pool.workers);
+	fprintf(out, "stolen:              %lu\n", checker->pool.stolen.load());
+	fprintf(out, "conversions:         %lu\n", conversions);
+	fprintf(out, "tag hits:            %lu\n", tag_hits);
+	fprintf(out, "memo hit rate:       %.3f\n", memo_hits + memo_misses ? (double)memo_hits / (memo_hits + memo_misses) : 0.0);
+}
+
+#endif
@@ -2,9 +2,24 @@
 #define PARSER
 
 #include "ast.h"
+#include "trace.h"
 
 #include <cstdlib>
+#include <setjmp.h>
+#include <stdio.h>
+
+// default limits of parse_checked, whose sources may be untrusted. Deeper
+// nesting of parentheses, lambdas, arrows and applications, or longer chains of
+// lets, are a syntax error rather than a stack overflow here or in the
+// recursive passes that run on the tree. The checker of an unoptimized build takes a few
+// kilobytes of stack per level of nesting, and about a kilobyte per let.
+#ifndef PARSE_MAX_DEPTH
+#define PARSE_MAX_DEPTH 1024
+#endif
 
+#ifndef PARSE_MAX_LETS
+#define PARSE_MAX_LETS 8192
+#endif
 
 enum token_type_t {
 	TOKEN_EOF = (1 << 0),
@@ -44,7 +59,12 @@ typedef struct lexer_t {
 	token_t previous;
 	token_t current;
 	token_t next;
- 
+
+	// recursive parse calls in progress and lets read, with their limits
+	unsigned depth;
+	unsigned lets;
+	unsigned max_depth;
+	unsigned max_lets;
 } lexer_t;
 
 unsigned lexer_read_keyword(struct lexer_t* lex, const char * str) {
@@ -72,23 +92,32 @@ void copy_keyword_to_token(struct lexer_t * lex, struct token_t * token, unsigne
 }
 
 struct lexer_t* lexer_create(const char* src) {
-	struct lexer_t* lex = (struct lexer_t*)malloc(sizeof(lexer_t));
+	struct lexer_t* lex = (struct lexer_t*)memory_alloc(sizeof(lexer_t));
 	lex->col = 1;
 	lex->row = 1;
 	lex->src = src;
 	lex->head = 0;
+	lex->depth = 0;
+	lex->lets = 0;
+	lex->max_depth = ~0u;
+	lex->max_lets = ~0u;
 	return lex;
 }
 
 void lexer_destroy(struct lexer_t* lex) {
-	free(lex);
+	memory_free(lex);
 }
 
 unsigned lexer_is_at_stopping_symbol(struct lexer_t* lex) {
 	return lex->src[lex->head] == '\0' || lex->src[lex->head] == ' ' ||	lex->src[lex->head] == '\n' || lex->src[lex->head] == ';' || lex->src[lex->head] == '(' || lex->src[lex->head] == ')' || lex->src[lex->head] == ',' || lex->src[lex->head] == '{' || lex->src[lex->head] == '}' || lex->src[lex->head] == ':' || lex->src[lex->head] == '.' || lex->src[lex->head] == '|' || lex->src[lex->head] == '=';
 }
 
+// the time spent lexing, in spans of 1024 tokens
+TRACE_BATCH_DEFINE(trace_lexer_batch, "lexer_eat", 1024);
+
 struct token_t lexer_eat(struct lexer_t * lex) {
+	TRACE_BATCH_SCOPE(trace_lexer_batch);
+
 	while(lex->src[lex->head] == '\n' || lex->src[lex->head] == ' ') {
 		if(lex->src[lex->head] == '\n') {
 			lex->row += 1;
@@ -234,43 +263,74 @@ token_t lexer_peek(struct lexer_t * lex) {
 	return lex->next;
 }
 
-token_t lexer_read(struct lexer_t* lex, token_type_t type) {
-	struct token_t tok = lexer_eat(lex);
-	//printf("read : '%s'\n", tok.data);
-	
-	if(tok.type != type) {
-		printf("expecting '%s', found '%s' at line %u, column %u\n", token_type_to_str(type),  token_type_to_str(tok.type), tok.row, tok.col);
+// set by parse_checked, a syntax error then jumps back to it with the message
+// instead of aborting
+static thread_local jmp_buf * parse_recover = 0;
+static thread_local char parse_error_message[256];
 
-		char buffer0[33] = {'\0'};
-		char buffer1[33] = {'\0'};
+// reports parse_error_message at tok
+void parse_fail(struct lexer_t * lex, struct token_t tok) {
+	if(parse_recover) longjmp(*parse_recover, 1);
 
-		unsigned length = 0;
+	printf("%s\n", parse_error_message);
 
-		for(length = 0; length < 8; length++) {
-			if(tok.data[length] == '\0') break;
-		}
+	char buffer0[33] = {'\0'};
+	char buffer1[33] = {'\0'};
 
-		int i = 0;
+	unsigned length = 0;
 
-		for(i = 0; i < 32; i++) {
-			int at = lex->head - 16 + i;
+	for(length = 0; length < 8; length++) {
+		if(tok.data[length] == '\0') break;
+	}
 
-			buffer0[i] = lex->src[at > 0 ? at : 0];
+	int i = 0;
 
-			if(buffer0[i] == '\0') break;
-			
-			buffer1[i] = at >= tok.at && at < tok.at + length ? '^' : '-';
-		}
-		
-		buffer0[i + 1] = '\0';
-		buffer1[i + 1] = '\0';
-		
-		printf("'...%s...'\n", buffer0);
-		printf(" ---%s--- \n", buffer1);
+	for(i = 0; i < 32; i++) {
+		int at = lex->head - 16 + i;
+
+		buffer0[i] = lex->src[at > 0 ? at : 0];
+
+		if(buffer0[i] == '\0') break;
 		
-		abort();
+		buffer1[i] = at >= (int)tok.at && at < (int)(tok.at + length) ? '^' : '-';
 	}
 	
+	buffer0[i + 1] = '\0';
+	buffer1[i + 1] = '\0';
+	
+	printf("'...%s...'\n", buffer0);
+	printf(" ---%s--- \n", buffer1);
+	
+	abort();
+}
+
+void parse_error(struct lexer_t * lex, struct token_t tok, const char * expected) {
+	snprintf(parse_error_message, sizeof(parse_error_message), "expecting '%s', found '%s' at line %u, column %u", expected, token_type_to_str(tok.type), tok.row, tok.col);
+
+	parse_fail(lex, tok);
+}
+
+// counts a recursive parse call, matched by parse_leave on return
+void parse_enter(struct lexer_t * lex) {
+	if(++lex->depth <= lex->max_depth) return;
+
+	struct token_t tok = lexer_peek(lex);
+
+	snprintf(parse_error_message, sizeof(parse_error_message), "nesting deeper than %u at line %u, column %u", lex->max_depth, tok.row, tok.col);
+
+	parse_fail(lex, tok);
+}
+
+void parse_leave(struct lexer_t * lex) {
+	lex->depth -= 1;
+}
+
+token_t lexer_read(struct lexer_t* lex, token_type_t type) {
+	struct token_t tok = lexer_eat(lex);
+	//printf("read : '%s'\n", tok.data);
+	
+	if(tok.type != type) parse_error(lex, tok, token_type_to_str(type));
+	
 	return tok;
 }
 
@@ -293,7 +353,23 @@ struct ast_t * parse_app(struct lexer_t * lex);
 struct ast_t * parse_bind(struct lexer_t * lex);
 
 struct ast_t * parse_var(struct lexer_t * lex) {
-	return var(lexer_read(lex, TOKEN_IDENTIFIER).data);
+	struct token_t tok = lexer_read(lex, TOKEN_IDENTIFIER);
+
+	// a symbol the lexer does not know, it would be read again forever
+	if(tok.data[0] == '\0') parse_error(lex, tok, "variable name");
+
+	return var(tok.data);
+}
+
+// the binder of a lambda or a let. The ast constructors assert that it is
+// typed, under parse_checked an untyped one is a syntax error instead, so an
+// untrusted source cannot abort the process
+struct ast_t * parse_binder(struct lexer_t * lex) {
+	struct ast_t * bind = parse_bind(lex);
+
+	if(parse_recover && bind->kind != BIND) parse_error(lex, lexer_peek(lex), ":");
+
+	return bind;
 }
 
 struct ast_t * parse_primary(struct lexer_t * lex) {
@@ -311,15 +387,22 @@ struct ast_t * parse_primary(struct lexer_t * lex) {
 }
 
 struct ast_t * parse_app(struct lexer_t* lex) {
+	parse_enter(lex);
+
 	struct ast_t * lhs = parse_primary(lex);
 
-	if (is_at_stopping_token(lex)) return lhs;
+	if (is_at_stopping_token(lex)) {
+		parse_leave(lex);
+		return lhs;
+	}
 	
 	struct ast_t * rhs = parse_primary(lex);
 
-	if (is_at_stopping_token(lex)) return app(lhs, rhs);
+	struct ast_t * ast = is_at_stopping_token(lex) ? app(lhs, rhs) : app(app(lhs, rhs), parse_app(lex));
 
-	return app(app(lhs, rhs), parse_app(lex));
+	parse_leave(lex);
+
+	return ast;
 }
 
 struct ast_t * parse_union(struct lexer_t * lex) {
@@ -338,47 +421,56 @@ struct ast_t * parse_union(struct lexer_t * lex) {
 	return head;
 }
 
-		/*
+// patterns are separated by dots: case Zero . n then n
 struct ast_t * parse_pattern_list(struct lexer_t * lex) {
-		struct ast_t * head = parse_app(lex);
-		if(lexer_peek(lex).type == TOKEN_THEN_KEYWORD) {
-			return pattern_list(head, 0);
-		}
-		lexer_read(lex, TOKEN_DOT);
-		
-		return pattern_list(head, parse_pattern_list(lex));
+	struct ast_t * head = parse_app(lex);
+
+	if(lexer_peek(lex).type == TOKEN_THEN_KEYWORD) {
+		return pattern_list(head, 0);
+	}
+
+	lexer_read(lex, TOKEN_DOT);
+
+	parse_enter(lex);
+
+	struct ast_t * tail = parse_pattern_list(lex);
+
+	parse_leave(lex);
+
+	return pattern_list(head, tail);
 }
 
-struct ast_t* parse_case(struct lexer_t * lex) {
-		lexer_read(lex, TOKEN_CASE_KEYWORD);
+struct ast_t * parse_case(struct lexer_t * lex) {
+	lexer_read(lex, TOKEN_CASE_KEYWORD);
 
-		struct ast_t * head = parse_pattern_list(lex);
+	struct ast_t * head = parse_pattern_list(lex);
 
-		lexer_read(lex, TOKEN_THEN_KEYWORD);
-		
-		struct ast_t * body = parse_app(lex);
+	lexer_read(lex, TOKEN_THEN_KEYWORD);
 
-		struct ast_t * match = case_statement(head, body);
+	struct ast_t * body = parse_app(lex);
 
-		if(lexer_peek(lex).type == TOKEN_COMMA) {
-			lexer_read(lex, TOKEN_COMMA);
+	struct ast_t * match = case_statement(head, body);
 
-			struct ast_t * tail = parse_case(lex);
+	if(lexer_peek(lex).type == TOKEN_COMMA) {
+		lexer_read(lex, TOKEN_COMMA);
 
-			return case_list(match, tail);
-		}
-		
-		return case_list(match, 0);
+		parse_enter(lex);
+
+		struct ast_t * rest = parse_case(lex);
+
+		parse_leave(lex);
+
+		return case_list(match, rest);
+	}
+
+	return case_list(match, 0);
 }
-/**/
 
 struct ast_t * parse_case_list(struct lexer_t * lex) {
-	/*
 	if(lexer_peek(lex).type == TOKEN_CASE_KEYWORD) {
 		return parse_case(lex);
 	}
-	*/
-	
+
 	return parse_union(lex);
 }
 
@@ -391,9 +483,13 @@ struct ast_t * parse_type(struct lexer_t * lex) {
 
 	if(lexer_peek(lex).type == TOKEN_ARROW_TYPE) {
 		lexer_read(lex, TOKEN_ARROW_TYPE);
+
+		parse_enter(lex);
 		
 		struct ast_t * rhs = parse_type(lex);
 
+		parse_leave(lex);
+
 		return arrow(lhs, rhs);
 	}
 	
@@ -419,7 +515,7 @@ struct ast_t * parse_lambda(struct lexer_t * lex) {
 	if(lexer_peek(lex).type == TOKEN_FN_KEYWORD) {
 		lexer_read(lex, TOKEN_FN_KEYWORD);
 		
-	  struct ast_t * bind = parse_bind(lex);
+	  struct ast_t * bind = parse_binder(lex);
 
 		lexer_read(lex, TOKEN_DOT);
 
@@ -434,9 +530,15 @@ struct ast_t * parse_lambda(struct lexer_t * lex) {
 
 struct ast_t * parse_program(struct lexer_t * lex) {
 	if (lexer_peek(lex).type == TOKEN_LET_KEYWORD) {
-		lexer_read(lex, TOKEN_LET_KEYWORD);
+		struct token_t tok = lexer_read(lex, TOKEN_LET_KEYWORD);
+
+		if(++lex->lets > lex->max_lets) {
+			snprintf(parse_error_message, sizeof(parse_error_message), "more than %u lets at line %u, column %u", lex->max_lets, tok.row, tok.col);
 
-		struct ast_t * lhs = parse_bind(lex);
+			parse_fail(lex, tok);
+		}
+
+		struct ast_t * lhs = parse_binder(lex);
 
 		if(lexer_peek(lex).type == TOKEN_EQUAL) {
 		
@@ -451,6 +553,8 @@ struct ast_t * parse_program(struct lexer_t * lex) {
 			}
 
 			lexer_read(lex, TOKEN_IN_KEYWORD);
+
+			if(lexer_peek(lex).type != TOKEN_LET_KEYWORD) parse_error(lex, lexer_peek(lex), "let");
 		
 			return statement(let, parse_program(lex));
 		} else {
@@ -461,6 +565,8 @@ struct ast_t * parse_program(struct lexer_t * lex) {
 			}
 
 			lexer_read(lex, TOKEN_IN_KEYWORD);
+
+			if(lexer_peek(lex).type != TOKEN_LET_KEYWORD) parse_error(lex, lexer_peek(lex), "let");
 		
 			return statement(let, parse_program(lex));
 		}
@@ -470,6 +576,8 @@ struct ast_t * parse_program(struct lexer_t * lex) {
 }
 
 struct ast_t * parse(const char * src) {
+	TRACE_SCOPE("parse");
+
 	struct lexer_t * lex = lexer_create(src);
 
 	lexer_eat(lex);
@@ -478,7 +586,46 @@ struct ast_t * parse(const char * src) {
 
 	lexer_destroy(lex);
 
+	TRACE_BATCH_FLUSH(trace_lexer_batch);
+
 	return program;
 } 
 
+// parse, returning 0 on a syntax error with its message in error instead of
+// aborting. Sources nested deeper than max_depth or with more than max_lets
+// lets are an error, a trusted source can lift the limits with ~0u. The nodes read before the error are not freed, a caller parsing
+// untrusted sources should have a scratch arena installed.
+struct ast_t * parse_checked(const char * src, char * error, unsigned size, unsigned max_depth = PARSE_MAX_DEPTH, unsigned max_lets = PARSE_MAX_LETS) {
+	jmp_buf recover;
+
+	struct lexer_t * lex = lexer_create(src);
+
+	if(setjmp(recover)) {
+		parse_recover = 0;
+
+		snprintf(error, size, "%s", parse_error_message);
+
+		lexer_destroy(lex);
+
+		return 0;
+	}
+
+	parse_recover = &recover;
+
+	lex->max_depth = max_depth;
+	lex->max_lets = max_lets;
+
+	lexer_eat(lex);
+
+	struct ast_t * program = parse_program(lex);
+
+	parse_recover = 0;
+
+	lexer_destroy(lex);
+
+	TRACE_BATCH_FLUSH(trace_lexer_batch);
+
+	return program;
+}
+
 #endif
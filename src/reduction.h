@@ -1,106 +1,494 @@
 #ifndef REDUCTION_HPP
 #define REDUCTION_HPP
 
-#include "ast.hpp"
+#include "ast.h"
+#include "ast_hash.h"
+#include "name.h"
+#include "memory.h"
+#include "normal_form_cache.h"
+#include "trace.h"
 
-int can_insert_bound_variable(struct ast_t * expr) {
-	return expr->kind == STATEMENT || expr->kind == LAMBDA ? 1 : 0;
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Substitution based reduction
+//
+// Normal order reduction that contracts one redex at a time, the body of the
+// lambda is copied with the argument substituted for the bound variable. A
+// binder that would capture a free variable of the argument is renamed by
+// appending primes to its name. LAMBDA and ARROW_TYPE nodes whose lhs is a BIND
+// are the binders, the type of the binder is outside of its scope.
+//
+// Every step copies the whole body and searches the redex from the root again,
+// this is the simple reference for the evaluator in nbe.h.
+//
+// While reduction_stats points to a reduction_stats_t, the reductions of the
+// thread are counted there. reduce_with_budget installs it and stops after a
+// number of steps, when the term grows past a number of bytes or after a
+// number of seconds.
+
+enum reduction_status_t {
+	REDUCTION_NORMAL = 0,
+	REDUCTION_OUT_OF_STEPS,
+	REDUCTION_OUT_OF_MEMORY,
+	REDUCTION_OUT_OF_TIME,
+};
+
+typedef struct reduction_stats_t {
+	enum reduction_status_t status;
+
+	// beta steps, occurrences replaced by an argument, binders renamed
+	unsigned long steps;
+	unsigned long substitutions;
+	unsigned long renamings;
+
+	// nodes built by the substitutions
+	unsigned long nodes_copied;
+
+	// nodes of the term, a node is sizeof(struct ast_t) bytes
+	unsigned long live_nodes;
+	unsigned long peak_live_nodes;
+
+	// lookups of the whole term in the normal form cache
+	unsigned long cache_hits;
+	unsigned long cache_misses;
+
+	// seconds spent finding redexes, copying bodies and freeing redexes
+	double search_time;
+	double substitute_time;
+	double free_time;
+} reduction_stats_t;
+
+static thread_local struct reduction_stats_t * reduction_stats = 0;
+
+double reduction_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-void offset_de_bruijn_indices_of_free_variables(struct ast_t * expr, int increment, unsigned depth) {
-	if(expr == 0) return;
-	
-	depth = depth + can_insert_bound_variable(expr);
-	
-	if(expr->de_bruijn_indice != -1 && expr->de_bruijn_indice > depth) {
-		expr->de_bruijn_indice += increment;
+struct ast_t * ast_node(enum ast_kind_t kind, struct ast_t * lhs, struct ast_t * rhs) {
+	struct ast_t * node = alloc_node(kind);
+
+	node->lhs = lhs;
+	node->rhs = rhs;
+
+	if(lhs) lhs->parent = node;
+	if(rhs) rhs->parent = node;
+
+	return node;
+}
+
+int ast_is_binder(struct ast_t * ast) {
+	return ast->kind == LAMBDA || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND);
+}
+
+int ast_occurs_free(struct ast_t * ast, struct name_t * x) {
+	if(ast == 0) return 0;
+
+	if(ast->kind == VAR) {
+		return name_equal(ast->name, x);
 	}
-	
-	offset_de_bruijn_indices_of_free_variables(expr->lhs, increment, depth);
-	offset_de_bruijn_indices_of_free_variables(expr->rhs, increment, depth);
+
+	// the other names of the patterns are constructors
+	if(ast->kind == CASE && ast_case_binds(ast, x)) return 0;
+
+	if(ast_is_binder(ast)) {
+		if(ast_occurs_free(ast->lhs->rhs, x)) return 1;
+
+		return !name_equal(ast->lhs->lhs->name, x) && ast_occurs_free(ast->rhs, x);
+	}
+
+	return ast_occurs_free(ast->lhs, x) || ast_occurs_free(ast->rhs, x);
 }
 
-void offset_de_bruijn_indices_of_free_variables(struct ast_t * expr, int increment) {
-	offset_de_bruijn_indices_of_free_variables(expr, increment, 0);
+// y with primes appended until it is not free in a nor in b
+struct name_t * ast_fresh_name(struct name_t * y, struct ast_t * a, struct ast_t * b) {
+	char * buffer = (char*)memory_alloc(y->length + 2);
+
+	memcpy(buffer, y->identifier, y->length + 1);
+
+	unsigned length = y->length;
+
+	struct name_t * name = allocate_name(buffer);
+
+	while(ast_occurs_free(a, name) || ast_occurs_free(b, name)) {
+		buffer = (char*)memory_realloc(buffer, length + 2);
+		buffer[length++] = '\'';
+		buffer[length] = 0;
+
+		name_free(name);
+		name = allocate_name(buffer);
+	}
+
+	memory_free(buffer);
+
+	return name;
 }
 
-void replace_in_parent(ast_t * parent, ast_t * expr, ast_t * replacement) {
-	if(parent == 0) return;
-	
-	if(parent->lhs == expr) {
-		parent->lhs = replacement;
+struct ast_t * ast_substitute(struct ast_t * ast, struct name_t * x, struct ast_t * arg);
+
+// copy of the pattern with the variable y renamed to z
+struct ast_t * ast_rename_pattern(struct ast_t * pattern, struct name_t * y, struct name_t * z) {
+	if(pattern == 0) return 0;
+
+	if(pattern->kind == VAR) {
+		return var(name_get_str(name_equal(pattern->name, y) ? z : pattern->name));
 	}
 
-	if(parent->rhs == expr) {
-		parent->rhs = replacement;
+	return ast_node(pattern->kind, ast_rename_pattern(pattern->lhs, y, z), ast_rename_pattern(pattern->rhs, y, z));
+}
+
+// The patterns of a case bind their variables in its body. The constructors
+// of the patterns are matched by name and are never substituted.
+struct ast_t * ast_substitute_case(struct ast_t * match, struct name_t * x, struct ast_t * arg) {
+	if(ast_case_binds(match, x) || !ast_occurs_free(match->rhs, x)) {
+		return ast_copy(match);
 	}
+
+	struct ast_t * patterns = ast_copy(match->lhs);
+	struct ast_t * body = ast_copy(match->rhs);
+
+	ast_pattern_foreach_variable(match->lhs, [&](struct ast_t * y) {
+		if(!ast_occurs_free(arg, y->name)) return;
+
+		struct name_t * fresh = ast_fresh_name(y->name, arg, body);
+
+		struct ast_t * bound = var(name_get_str(fresh));
+
+		struct ast_t * renamed = ast_rename_pattern(patterns, y->name, fresh);
+		ast_free(patterns);
+		patterns = renamed;
+
+		renamed = ast_substitute(body, y->name, bound);
+		ast_free(body);
+		body = renamed;
+
+		if(reduction_stats) reduction_stats->renamings += 1;
+
+		ast_free(bound);
+		name_free(fresh);
+	});
+
+	struct ast_t * result = ast_substitute(body, x, arg);
+
+	ast_free(body);
+
+	return ast_node(CASE, patterns, result);
 }
 
-void replace_indice_at_depth(struct ast_t * expr, unsigned from_indice, ast_t * node, int depth) {
-	if(expr == 0) return;
-	
-	if(from_indice == -1) return;
- 
-	if(expr->de_bruijn_indice == from_indice + depth) {
-		expr->kind = node->kind;
-		expr->de_bruijn_indice = node->de_bruijn_indice;
-		expr->declaration_indice = node->declaration_indice;
-		for(unsigned i = 0; i < 8; i++) {
-			expr->identifier[i] = node->identifier[i];
+// copy of ast with the free occurrences of x replaced by copies of arg
+struct ast_t * ast_substitute(struct ast_t * ast, struct name_t * x, struct ast_t * arg) {
+	if(ast == 0) return 0;
+
+	if(ast->kind == CASE) {
+		return ast_substitute_case(ast, x, arg);
+	}
+
+	if(ast->kind == VAR) {
+		if(!name_equal(ast->name, x)) return ast_copy(ast);
+
+		if(reduction_stats) reduction_stats->substitutions += 1;
+
+		return ast_copy(arg);
+	}
+
+	if(ast_is_binder(ast)) {
+		struct name_t * y = ast->lhs->lhs->name;
+
+		struct ast_t * type = ast_substitute(ast->lhs->rhs, x, arg);
+		struct ast_t * body = 0;
+		struct ast_t * bound = 0;
+
+		if(name_equal(y, x)) {
+			bound = var(name_get_str(y));
+			body = ast_copy(ast->rhs);
+		} else if(ast_occurs_free(arg, y) && ast_occurs_free(ast->rhs, x)) {
+			struct name_t * fresh = ast_fresh_name(y, arg, ast->rhs);
+
+			bound = var(name_get_str(fresh));
+
+			struct ast_t * renamed = ast_substitute(ast->rhs, y, bound);
+
+			if(reduction_stats) {
+				reduction_stats->renamings += 1;
+				reduction_stats->nodes_copied += ast_count_nodes(renamed);
+			}
+
+			body = ast_substitute(renamed, x, arg);
+
+			ast_free(renamed);
+			name_free(fresh);
+		} else {
+			bound = var(name_get_str(y));
+			body = ast_substitute(ast->rhs, x, arg);
 		}
-		ast_free(expr->lhs);
-		ast_free(expr->rhs);
-		
-		expr->lhs = ast_copy(node->lhs);
-		if(expr->lhs) expr->lhs->parent = expr;
 
-		expr->rhs = ast_copy(node->rhs);
-		if(expr->rhs) expr->rhs->parent = expr;
+		return ast_node(ast->kind, ast_node(BIND, bound, type), body);
+	}
+
+	struct ast_t * node = ast_node(ast->kind, ast_substitute(ast->lhs, x, arg), ast_substitute(ast->rhs, x, arg));
+
+	if(ast->name) {
+		node->name = name_copy(ast->name);
+	}
+
+	return node;
+}
+
+// contracts the redex expr, which is freed, and returns the result
+struct ast_t * beta_reduction(struct ast_t * expr) {
+	assert(expr->kind == APP && expr->lhs->kind == LAMBDA);
+
+	struct ast_t * lam = expr->lhs;
+
+	if(reduction_stats == 0) {
+		struct ast_t * result = ast_substitute(lam->rhs, lam->lhs->lhs->name, expr->rhs);
+
+		result->parent = expr->parent;
+
+		ast_free(expr);
+
+		return result;
+	}
+
+	double start = reduction_now();
 
-		return;
+	struct ast_t * result = ast_substitute(lam->rhs, lam->lhs->lhs->name, expr->rhs);
+
+	result->parent = expr->parent;
+
+	double substituted = reduction_now();
+
+	unsigned long copied = ast_count_nodes(result);
+	unsigned long freed = ast_count_nodes(expr);
+
+	ast_free(expr);
+
+	reduction_stats->free_time += reduction_now() - substituted;
+	reduction_stats->substitute_time += substituted - start;
+
+	reduction_stats->steps += 1;
+	reduction_stats->nodes_copied += copied;
+	reduction_stats->live_nodes += copied;
+
+	// the result and the redex are both alive until the redex is freed
+	if(reduction_stats->live_nodes > reduction_stats->peak_live_nodes) {
+		reduction_stats->peak_live_nodes = reduction_stats->live_nodes;
 	}
 
-	replace_indice_at_depth(expr->lhs, from_indice, node, depth);
+	reduction_stats->live_nodes -= freed;
 
-	depth += can_insert_bound_variable(expr);
-	
-	replace_indice_at_depth(expr->rhs, from_indice, node, depth);
+	return result;
 }
 
-void replace_de_bruijn_indice_in_expression_by(struct ast_t * expr, unsigned indice, struct ast_t* to) {
-	replace_indice_at_depth(expr, indice, to, 0);
+// contracts the leftmost outermost redex of *expr, returns 0 if there is none
+int ast_reduce_step(struct ast_t ** expr) {
+	struct ast_t * ast = *expr;
+
+	if(ast == 0 || ast->kind == VAR) return 0;
+
+	if(ast->kind == APP && ast->lhs->kind == LAMBDA) {
+		*expr = beta_reduction(ast);
+		return 1;
+	}
+
+	if(ast_is_binder(ast)) {
+		return ast_reduce_step(&ast->lhs->rhs) || ast_reduce_step(&ast->rhs);
+	}
+
+	return ast_reduce_step(&ast->lhs) || ast_reduce_step(&ast->rhs);
 }
 
-struct ast_t * get_lambda_from_variable(struct ast_t * lam) {
-	if(lam == 0) return 0;
-	
-	if (lam->kind == VAR) {
-		ast_t* decl = find_declaration(lam);
-		lam = decl->parent->rhs;
+// reduces expr, which is consumed, to its normal form and counts the steps
+struct ast_t * ast_reduce(struct ast_t * expr, unsigned long * steps) {
+	TRACE_OUTER_SCOPE("ast_reduce");
+
+	while(ast_reduce_step(&expr)) {
+		if(steps) *steps += 1;
 	}
 
-	if(lam->kind != LAMBDA) return 0;
-	
-	return lam;
+	return expr;
 }
 
-void beta_reduction(struct ast_t * expr) {
-	if (expr->kind != APPL)	return;
+// Definitions are substituted into the following ones, so every definition of
+// a program is reduced in place to a normal form without references to the
+// previous definitions. Declarations stay free.
+struct ast_t * ast_reduce_program(struct ast_t * program, unsigned long * steps) {
+	TRACE_SCOPE("ast_reduce_program");
 
-	struct ast_t* lam =	get_lambda_from_variable(expr->lhs);
+	if(program == 0 || program->kind != STATEMENT) {
+		return ast_reduce(program, steps);
+	}
 
-	if(lam == 0) return;
+	unsigned count = 0;
+	unsigned capacity = 16;
 
-	struct ast_t* body = ast_copy(lam->rhs);
-	struct ast_t* arg  = expr->rhs;
+	struct ast_t ** definitions = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * capacity);
 
-	unsigned offset = expr->declaration_indice - lam->declaration_indice;
+	for(struct ast_t * statement = program; statement; statement = statement->rhs) {
+		struct ast_t * let = statement->lhs;
+		struct ast_t * binding = let->lhs;
 
-	offset_de_bruijn_indices_of_free_variables(body, offset);
-	replace_de_bruijn_indice_in_expression_by(body, 0, arg);
-	replace_in_parent(expr->parent, expr, body);
-	
-	ast_free(expr);
+		// the latest definitions go first, they shadow the earlier ones
+		for(unsigned i = count; i > 0; i--) {
+			struct ast_t * definition = definitions[i - 1];
+
+			struct ast_t * type = ast_substitute(binding->rhs, definition->lhs->lhs->name, definition->rhs);
+			ast_free(binding->rhs);
+			binding->rhs = type;
+			type->parent = binding;
+
+			if(let->kind == ASSIGNMENT) {
+				struct ast_t * value = ast_substitute(let->rhs, definition->lhs->lhs->name, definition->rhs);
+				ast_free(let->rhs);
+				let->rhs = value;
+				value->parent = let;
+			}
+		}
+
+		binding->rhs = ast_reduce(binding->rhs, steps);
+		binding->rhs->parent = binding;
+
+		unsigned kept = 0;
+
+		for(unsigned i = 0; i < count; i++) {
+			if(!name_equal(definitions[i]->lhs->lhs->name, binding->lhs->name)) {
+				definitions[kept++] = definitions[i];
+			}
+		}
+
+		count = kept;
+
+		if(let->kind == ASSIGNMENT) {
+			let->rhs = ast_reduce(let->rhs, steps);
+			let->rhs->parent = let;
+
+			if(count == capacity) {
+				capacity *= 2;
+				definitions = (struct ast_t**)memory_realloc(definitions, sizeof(struct ast_t*) * capacity);
+			}
+
+			definitions[count++] = let;
+		}
+	}
+
+	memory_free(definitions);
+
+	return program;
+}
+
+void reduction_stats_init(struct reduction_stats_t * stats) {
+	memset(stats, 0, sizeof(struct reduction_stats_t));
+}
+
+// Reduces *term in normal order until it is normal, max_steps beta steps were
+// made, its nodes take more than max_bytes or max_seconds passed, 0 is
+// unbounded. The counters and
+// the reason it stopped are returned, *term is left partially reduced when the
+// budget runs out. With a cache the normal form of the whole term is looked up
+// first and stored when it is reached.
+struct reduction_stats_t reduce_with_budget(struct ast_t ** term, unsigned long max_steps, unsigned long max_bytes, struct normal_form_cache_t * cache = 0, double max_seconds = 0) {
+	TRACE_SCOPE("reduce_with_budget");
+
+	struct reduction_stats_t stats;
+
+	reduction_stats_init(&stats);
+
+	stats.live_nodes = ast_count_nodes(*term);
+	stats.peak_live_nodes = stats.live_nodes;
+
+	struct ast_t * original = 0;
+
+	if(cache) {
+		ast_hash(*term);
+
+		struct ast_t * normal = normal_form_cache_get(cache, *term);
+
+		if(normal) {
+			stats.cache_hits += 1;
+
+			ast_free(*term);
+			*term = normal;
+
+			stats.live_nodes = ast_count_nodes(normal);
+			stats.peak_live_nodes = stats.live_nodes;
+
+			return stats;
+		}
+
+		stats.cache_misses += 1;
+
+		original = ast_copy(*term);
+		original->tag = (*term)->tag;
+	}
+
+	struct reduction_stats_t * outer = reduction_stats;
+
+	reduction_stats = &stats;
+
+	double start = reduction_now();
+
+	while(1) {
+		if(max_steps && stats.steps >= max_steps) {
+			stats.status = REDUCTION_OUT_OF_STEPS;
+			break;
+		}
+
+		if(max_bytes && stats.live_nodes * sizeof(struct ast_t) > max_bytes) {
+			stats.status = REDUCTION_OUT_OF_MEMORY;
+			break;
+		}
+
+		if(max_seconds && reduction_now() - start > max_seconds) {
+			stats.status = REDUCTION_OUT_OF_TIME;
+			break;
+		}
+
+		if(!ast_reduce_step(term)) break;
+	}
+
+	stats.search_time = reduction_now() - start - stats.substitute_time - stats.free_time;
+
+	reduction_stats = outer;
+
+	if(original) {
+		if(stats.status == REDUCTION_NORMAL) {
+			normal_form_cache_put(cache, original, *term);
+		}
+
+		ast_free(original);
+	}
+
+	return stats;
+}
+
+const char * reduction_status_to_str(enum reduction_status_t status) {
+	switch(status) {
+		case REDUCTION_NORMAL: return "normal";
+		case REDUCTION_OUT_OF_STEPS: return "out_of_steps";
+		case REDUCTION_OUT_OF_MEMORY: return "out_of_memory";
+		case REDUCTION_OUT_OF_TIME: return "out_of_time";
+	}
+
+	return "unknown";
+}
+
+void reduction_stats_print_json(struct reduction_stats_t * stats, FILE * out) {
+	fprintf(out, "{");
+	fprintf(out, "\"status\": \"%s\", ", reduction_status_to_str(stats->status));
+	fprintf(out, "\"steps\": %lu, ", stats->steps);
+	fprintf(out, "\"substitutions\": %lu, ", stats->substitutions);
+	fprintf(out, "\"renamings\": %lu, ", stats->renamings);
+	fprintf(out, "\"nodes_copied\": %lu, ", stats->nodes_copied);
+	fprintf(out, "\"live_nodes\": %lu, ", stats->live_nodes);
+	fprintf(out, "\"peak_live_nodes\": %lu, ", stats->peak_live_nodes);
+	fprintf(out, "\"peak_bytes\": %lu, ", stats->peak_live_nodes * (unsigned long)sizeof(struct ast_t));
+	fprintf(out, "\"cache_hits\": %lu, ", stats->cache_hits);
+	fprintf(out, "\"cache_misses\": %lu, ", stats->cache_misses);
+	fprintf(out, "\"search_seconds\": %.9f, ", stats->search_time);
+	fprintf(out, "\"substitute_seconds\": %.9f, ", stats->substitute_time);
+	fprintf(out, "\"free_seconds\": %.9f", stats->free_time);
+	fprintf(out, "}\n");
 }
 
 #endif
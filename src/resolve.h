@@ -0,0 +1,310 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include "ast.h"
+#include "alpha_equivalence.h"
+#include "hash.h"
+#include "memory.h"
+#include "name.h"
+#include "parser.h"
+#include "symbol.h"
+#include "swiss_table.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Locally nameless terms
+//
+// ast_resolve numbers every bound variable with its de Bruijn index and interns
+// the name of every free one. The binders are LAMBDA, ARROW_TYPE whose lhs is a
+// BIND (Pi) and let statements, whose names are in scope in the rest of the
+// program. As in reduction.h the type of a binder, and the value of a let, are
+// outside of its scope. The names are kept, so a resolved term still prints,
+// but the functions below only look at the indices and the symbols: comparing,
+// hashing and substituting bound variables are integer operations and
+// substitution never renames.
+
+void ast_resolve(struct ast_t * ast, struct binder_stack_t * binders) {
+	if(ast == 0) return;
+
+	// the shifts below only know binders of one variable
+	if(ast->kind == CASE_LIST) {
+		printf("resolve: case lists are not supported\n");
+		abort();
+	}
+
+	if(ast->kind == VAR) {
+		ast->de_bruijn_indice = binder_stack_index_of(binders, ast->name);
+
+		if(ast->de_bruijn_indice == AST_FREE) {
+			ast->symbol = symbol_intern(ast->name);
+		}
+
+		return;
+	}
+
+	if(ast->kind == LAMBDA || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND)) {
+		struct ast_t * binder = ast->lhs->kind == BIND ? ast->lhs->lhs : ast->lhs;
+
+		if(ast->lhs->kind == BIND) {
+			ast_resolve(ast->lhs->rhs, binders);
+		}
+
+		binder->de_bruijn_indice = AST_BINDER;
+
+		binder_stack_push(binders, binder->name);
+		ast_resolve(ast->rhs, binders);
+		binder_stack_pop(binders);
+
+		return;
+	}
+
+	if(ast->kind == STATEMENT) {
+		struct ast_t * let = ast->lhs;
+		struct ast_t * binding = let->lhs;
+
+		ast_resolve(binding->rhs, binders);
+
+		if(let->kind == ASSIGNMENT) {
+			ast_resolve(let->rhs, binders);
+		}
+
+		// a definition is named by the program, its name is part of the term
+		binding->lhs->de_bruijn_indice = AST_BINDER;
+		binding->lhs->symbol = symbol_intern(binding->lhs->name);
+
+		binder_stack_push(binders, binding->lhs->name);
+		ast_resolve(ast->rhs, binders);
+		binder_stack_pop(binders);
+
+		return;
+	}
+
+	ast_resolve(ast->lhs, binders);
+	ast_resolve(ast->rhs, binders);
+}
+
+void ast_resolve(struct ast_t * ast) {
+	struct binder_stack_t binders;
+
+	binder_stack_init(&binders);
+
+	ast_resolve(ast, &binders);
+
+	binder_stack_destroy(&binders);
+}
+
+struct ast_t * parse_resolved(const char * src) {
+	struct ast_t * ast = parse(src);
+
+	ast_resolve(ast);
+
+	return ast;
+}
+
+int ast_is_resolved_binder(struct ast_t * ast) {
+	return ast->kind == LAMBDA || ast->kind == STATEMENT || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND);
+}
+
+// alpha equivalence of resolved terms
+int ast_resolved_equal(struct ast_t * a, struct ast_t * b) {
+	if(a == 0 || b == 0) return a == b;
+
+	if(a->kind != b->kind) return 0;
+
+	if(a->kind == VAR) {
+		return a->de_bruijn_indice == b->de_bruijn_indice && (a->de_bruijn_indice >= 0 || a->symbol == b->symbol);
+	}
+
+	return ast_resolved_equal(a->lhs, b->lhs) && ast_resolved_equal(a->rhs, b->rhs);
+}
+
+struct hash_t ast_resolved_hash(struct ast_t * ast) {
+	if(ast == 0) return hash(0u);
+
+	if(ast->kind == VAR) {
+		if(ast->de_bruijn_indice < 0) {
+			return hash_combine(hash(1u), hash(ast->symbol));
+		}
+
+		return hash_combine(hash(2u), hash((unsigned)ast->de_bruijn_indice));
+	}
+
+	return hash_combine(hash((unsigned)ast->kind + 3), hash_combine(ast_resolved_hash(ast->lhs), ast_resolved_hash(ast->rhs)));
+}
+
+// copy of ast with the indices of the variables bound outside of it, the ones
+// at or above cutoff, moved by shift
+struct ast_t * ast_resolved_copy(struct ast_t * ast, int shift, int cutoff) {
+	if(ast == 0) return 0;
+
+	struct ast_t * copy = alloc_node(ast->kind);
+
+	if(ast->name) {
+		copy->name = name_copy(ast->name);
+	}
+
+	copy->de_bruijn_indice = ast->de_bruijn_indice;
+	copy->symbol = ast->symbol;
+
+	if(ast->kind == VAR && ast->de_bruijn_indice >= cutoff) {
+		copy->de_bruijn_indice += shift;
+	}
+
+	int inner = ast_is_resolved_binder(ast) ? cutoff + 1 : cutoff;
+
+	copy->lhs = ast_resolved_copy(ast->lhs, shift, cutoff);
+	copy->rhs = ast_resolved_copy(ast->rhs, shift, inner);
+
+	if(copy->lhs) copy->lhs->parent = copy;
+	if(copy->rhs) copy->rhs->parent = copy;
+
+	return copy;
+}
+
+// copy of the body of a binder with its variable, index depth inside of body,
+// replaced by arg and the variables bound further out moved one binder in
+struct ast_t * ast_resolved_open(struct ast_t * body, struct ast_t * arg, int depth) {
+	if(body == 0) return 0;
+
+	if(body->kind == VAR && body->de_bruijn_indice == depth) {
+		return ast_resolved_copy(arg, depth, 0);
+	}
+
+	struct ast_t * copy = alloc_node(body->kind);
+
+	if(body->name) {
+		copy->name = name_copy(body->name);
+	}
+
+	copy->de_bruijn_indice = body->de_bruijn_indice;
+	copy->symbol = body->symbol;
+
+	if(body->kind == VAR && body->de_bruijn_indice > depth) {
+		copy->de_bruijn_indice -= 1;
+	}
+
+	int inner = ast_is_resolved_binder(body) ? depth + 1 : depth;
+
+	copy->lhs = ast_resolved_open(body->lhs, arg, depth);
+	copy->rhs = ast_resolved_open(body->rhs, arg, inner);
+
+	if(copy->lhs) copy->lhs->parent = copy;
+	if(copy->rhs) copy->rhs->parent = copy;
+
+	return copy;
+}
+
+// contracts the resolved redex expr, which is freed, and returns the result
+struct ast_t * ast_resolved_beta(struct ast_t * expr) {
+	assert(expr->kind == APP && expr->lhs->kind == LAMBDA);
+
+	struct ast_t * result = ast_resolved_open(expr->lhs->rhs, expr->rhs, 0);
+
+	result->parent = expr->parent;
+
+	ast_free(expr);
+
+	return result;
+}
+
+int ast_resolved_reduce_step(struct ast_t ** expr) {
+	struct ast_t * ast = *expr;
+
+	if(ast == 0 || ast->kind == VAR) return 0;
+
+	if(ast->kind == APP && ast->lhs->kind == LAMBDA) {
+		*expr = ast_resolved_beta(ast);
+		return 1;
+	}
+
+	return ast_resolved_reduce_step(&ast->lhs) || ast_resolved_reduce_step(&ast->rhs);
+}
+
+// normal order reduction of a resolved expression, as ast_reduce without names
+struct ast_t * ast_resolved_reduce(struct ast_t * expr, unsigned long * steps) {
+	while(ast_resolved_reduce_step(&expr)) {
+		if(steps) *steps += 1;
+	}
+
+	return expr;
+}
+
+void ast_collect_free_names(struct ast_t * ast, swiss_table_t<name_t*, unsigned> * names) {
+	if(ast == 0) return;
+
+	if(ast->kind == VAR && ast->de_bruijn_indice == AST_FREE) {
+		swiss_table_insert(names, ast->name, 1u);
+	}
+
+	ast_collect_free_names(ast->lhs, names);
+	ast_collect_free_names(ast->rhs, names);
+}
+
+void ast_unresolve(struct ast_t * ast, swiss_table_t<name_t*, unsigned> * free, struct binder_stack_t * binders) {
+	if(ast == 0) return;
+
+	if(ast->kind == VAR) {
+		if(ast->de_bruijn_indice >= 0) {
+			name_free(ast->name);
+			ast->name = name_copy(binders->names[binders->size - 1 - ast->de_bruijn_indice]);
+		}
+
+		return;
+	}
+
+	if(!ast_is_resolved_binder(ast)) {
+		ast_unresolve(ast->lhs, free, binders);
+		ast_unresolve(ast->rhs, free, binders);
+		return;
+	}
+
+	struct ast_t * binding = ast->kind == STATEMENT ? ast->lhs->lhs : ast->lhs;
+	struct ast_t * binder = binding->kind == BIND ? binding->lhs : binding;
+
+	ast_unresolve(binding->rhs, free, binders);
+
+	if(ast->kind == STATEMENT && ast->lhs->kind == ASSIGNMENT) {
+		ast_unresolve(ast->lhs->rhs, free, binders);
+	}
+
+	// the names of the definitions of a program are kept
+	while(ast->kind != STATEMENT && (swiss_table_get(free, binder->name) || binder_stack_index_of(binders, binder->name) != -1)) {
+		char * identifier = (char*)memory_alloc(binder->name->length + 2);
+
+		memcpy(identifier, binder->name->identifier, binder->name->length);
+
+		identifier[binder->name->length] = '\'';
+		identifier[binder->name->length + 1] = 0;
+
+		name_free(binder->name);
+		binder->name = allocate_name(identifier);
+
+		memory_free(identifier);
+	}
+
+	binder_stack_push(binders, binder->name);
+	ast_unresolve(ast->rhs, free, binders);
+	binder_stack_pop(binders);
+}
+
+// renames the binders of a resolved term, and its bound variables after them,
+// so the names agree with the indices again, after substitutions they may not
+void ast_unresolve(struct ast_t * ast) {
+	swiss_table_t<name_t*, unsigned> free;
+
+	swiss_table_init(&free);
+
+	ast_collect_free_names(ast, &free);
+
+	struct binder_stack_t binders;
+
+	binder_stack_init(&binders);
+
+	ast_unresolve(ast, &free, &binders);
+
+	binder_stack_destroy(&binders);
+	swiss_table_destroy(&free);
+}
+
+#endif
@@ -0,0 +1,664 @@
+#ifndef STATIC_PARSER_H
+#define STATIC_PARSER_H
+
+#include "ast.h"
+#include "ast_hash.h"
+#include "hash.h"
+#include "memory.h"
+#include "parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Compile time parsing
+//
+// static_parse runs the lexer and the grammar of parser.h in a constexpr
+// function, so a string literal becomes a table of nodes when the program is
+// compiled:
+//
+//   constexpr auto prelude = STATIC_PARSE_HASHED("let id : Nat -> Nat = fn x:Nat. x;");
+//
+// The table has no pointers, children are indices and identifiers are stored
+// in the node, so a constexpr table lives in .rodata. Children always come
+// before their parent and the root is the last node. static_hash computes the
+// tags of ast_hash on the table, in one pass in node order with the maps of
+// free variables kept as lists threaded through the VAR nodes.
+//
+// A table holds as many nodes as the literal has bytes, no program has more,
+// STATIC_PARSE and STATIC_PARSE_HASHED size it to the program instead.
+// A syntax error calls static_parse_error, which is not constexpr, so a bad
+// literal does not compile, and aborts when static_parse runs at runtime.
+// static_program_ast builds the ast_t of a table, with its tags when it was
+// hashed, without lexing nor hashing.
+//
+// Literals longer than the constexpr loop limit of the compiler, 262144
+// iterations for gcc, have to be split or the limit raised.
+
+typedef struct static_node_t {
+	enum ast_kind_t kind;
+
+	// indices of the children, -1 for none
+	int lhs;
+	int rhs;
+
+	// identifier of a VAR, zero padded like the data of a token
+	char name[8];
+
+	struct hash_t tag;
+} static_node_t;
+
+template<unsigned N>
+struct static_program_t {
+	struct static_node_t nodes[N];
+	unsigned size;
+
+	int root;
+
+	// 1 once static_hash wrote the tags
+	int hashed;
+};
+
+typedef struct static_keyword_t {
+	const char * text;
+	enum token_type_t type;
+} static_keyword_t;
+
+// in the order lexer_eat tries them
+constexpr struct static_keyword_t static_keywords[] = {
+	{ "->", TOKEN_ARROW_TYPE },
+	{ ".", TOKEN_DOT },
+	{ "let", TOKEN_LET_KEYWORD },
+	{ "in", TOKEN_IN_KEYWORD },
+	{ "fn", TOKEN_FN_KEYWORD },
+	{ ":", TOKEN_COLON },
+	{ ";", TOKEN_SEMICOLON },
+	{ "=", TOKEN_EQUAL },
+	{ "(", TOKEN_OPENING_PARENTESIS },
+	{ ")", TOKEN_CLOSING_PARENTESIS },
+	{ "|", TOKEN_PIPE },
+	{ ",", TOKEN_COMMA },
+	{ "case", TOKEN_CASE_KEYWORD },
+	{ "const", TOKEN_CONST_KEYWORD },
+	{ "then", TOKEN_THEN_KEYWORD },
+};
+
+typedef struct static_lexer_t {
+	const char * src;
+	unsigned head;
+
+	unsigned row;
+	unsigned col;
+
+	struct token_t current;
+	struct token_t next;
+} static_lexer_t;
+
+// not constexpr, reaching it while compiling is the compile error
+void static_parse_error(const char * expected, struct token_t token) {
+	printf("expecting %s, found '%s' at line %u, column %u\n", expected, token_type_to_str(token.type), token.row, token.col);
+	abort();
+}
+
+constexpr unsigned static_lexer_keyword(struct static_lexer_t * lex, const char * str) {
+	unsigned i = 0;
+
+	for(i = 0; str[i] != '\0' && i < 7; i++) {
+		if(lex->src[lex->head + i] != str[i]) return 0;
+	}
+
+	lex->head += i;
+
+	return i;
+}
+
+constexpr int static_lexer_is_at_stopping_symbol(struct static_lexer_t * lex) {
+	char c = lex->src[lex->head];
+
+	return c == '\0' || c == ' ' || c == '\n' || c == ';' || c == '(' || c == ')' || c == ',' || c == '{' || c == '}' || c == ':' || c == '.' || c == '|' || c == '=';
+}
+
+// lexer_eat, returns the token that was the lookahead
+constexpr struct token_t static_lexer_eat(struct static_lexer_t * lex) {
+	while(lex->src[lex->head] == '\n' || lex->src[lex->head] == ' ') {
+		if(lex->src[lex->head] == '\n') {
+			lex->row += 1;
+			lex->col = 1;
+		}
+
+		lex->col += 1;
+		lex->head += 1;
+	}
+
+	struct token_t tok = {};
+
+	tok.col = lex->col;
+	tok.row = lex->row;
+	tok.at = lex->head;
+	tok.type = TOKEN_IDENTIFIER;
+
+	unsigned keyword = 0;
+
+	if(lex->src[lex->head] == '\0') {
+		tok.type = TOKEN_EOF;
+		keyword = 1;
+	}
+
+	for(unsigned k = 0; k < sizeof(static_keywords) / sizeof(static_keywords[0]) && keyword == 0; k++) {
+		if(unsigned len = static_lexer_keyword(lex, static_keywords[k].text)) {
+			tok.type = static_keywords[k].type;
+			lex->col += len;
+			keyword = 1;
+		}
+	}
+
+	if(keyword == 0) {
+		unsigned i = 0;
+
+		for(i = 0; static_lexer_is_at_stopping_symbol(lex) == 0 && i < 7; i++) {
+			tok.data[i] = lex->src[lex->head++];
+		}
+
+		// parse would read an empty name forever
+		if(i == 0) static_parse_error("a name", tok);
+
+		lex->col += i;
+	}
+
+	lex->current = lex->next;
+	lex->next = tok;
+
+	return lex->current;
+}
+
+template<unsigned N>
+struct static_parser_t {
+	struct static_lexer_t lex;
+	struct static_program_t<N> program;
+};
+
+template<unsigned N>
+constexpr enum token_type_t static_parser_peek(struct static_parser_t<N> * parser) {
+	return parser->lex.next.type;
+}
+
+template<unsigned N>
+constexpr struct token_t static_parser_read(struct static_parser_t<N> * parser, enum token_type_t type) {
+	struct token_t tok = static_lexer_eat(&parser->lex);
+
+	if(tok.type != type) static_parse_error(token_type_to_str(type), tok);
+
+	return tok;
+}
+
+template<unsigned N>
+constexpr int static_parser_node(struct static_parser_t<N> * parser, enum ast_kind_t kind, int lhs, int rhs) {
+	struct static_program_t<N> * program = &parser->program;
+
+	if(program->size == N) static_parse_error("fewer nodes", parser->lex.next);
+
+	struct static_node_t * node = &program->nodes[program->size];
+
+	node->kind = kind;
+	node->lhs = lhs;
+	node->rhs = rhs;
+
+	return (int)program->size++;
+}
+
+template<unsigned N>
+constexpr enum ast_kind_t static_parser_kind(struct static_parser_t<N> * parser, int node) {
+	return parser->program.nodes[node].kind;
+}
+
+template<unsigned N>
+constexpr int static_parser_is_at_stopping_token(struct static_parser_t<N> * parser) {
+	return static_parser_peek(parser) & (
+		TOKEN_ARROW_TYPE |
+		TOKEN_EQUAL |
+		TOKEN_DOT |
+		TOKEN_SEMICOLON |
+		TOKEN_IN_KEYWORD |
+		TOKEN_EOF |
+		TOKEN_CLOSING_PARENTESIS |
+		TOKEN_PIPE |
+		TOKEN_COMMA |
+		TOKEN_THEN_KEYWORD);
+}
+
+template<unsigned N> constexpr int static_parse_app(struct static_parser_t<N> * parser);
+template<unsigned N> constexpr int static_parse_lambda(struct static_parser_t<N> * parser);
+template<unsigned N> constexpr int static_parse_bind(struct static_parser_t<N> * parser);
+
+template<unsigned N>
+constexpr int static_parse_var(struct static_parser_t<N> * parser) {
+	struct token_t tok = static_parser_read(parser, TOKEN_IDENTIFIER);
+
+	int node = static_parser_node(parser, VAR, -1, -1);
+
+	for(unsigned i = 0; i < 8; i++) parser->program.nodes[node].name[i] = tok.data[i];
+
+	return node;
+}
+
+template<unsigned N>
+constexpr int static_parse_primary(struct static_parser_t<N> * parser) {
+	if(static_parser_peek(parser) == TOKEN_OPENING_PARENTESIS) {
+		static_parser_read(parser, TOKEN_OPENING_PARENTESIS);
+
+		int lhs = static_parse_app(parser);
+
+		static_parser_read(parser, TOKEN_CLOSING_PARENTESIS);
+
+		return lhs;
+	}
+
+	return static_parse_lambda(parser);
+}
+
+template<unsigned N>
+constexpr int static_parse_app(struct static_parser_t<N> * parser) {
+	int lhs = static_parse_primary(parser);
+
+	if(static_parser_is_at_stopping_token(parser)) return lhs;
+
+	int rhs = static_parse_primary(parser);
+
+	if(static_parser_is_at_stopping_token(parser)) return static_parser_node(parser, APP, lhs, rhs);
+
+	int head = static_parser_node(parser, APP, lhs, rhs);
+
+	return static_parser_node(parser, APP, head, static_parse_app(parser));
+}
+
+template<unsigned N>
+constexpr int static_parse_pattern_list(struct static_parser_t<N> * parser) {
+	int head = static_parse_app(parser);
+
+	if(static_parser_peek(parser) == TOKEN_THEN_KEYWORD) {
+		return static_parser_node(parser, PATTERN_LIST, head, -1);
+	}
+
+	static_parser_read(parser, TOKEN_DOT);
+
+	return static_parser_node(parser, PATTERN_LIST, head, static_parse_pattern_list(parser));
+}
+
+template<unsigned N>
+constexpr int static_parse_case(struct static_parser_t<N> * parser) {
+	static_parser_read(parser, TOKEN_CASE_KEYWORD);
+
+	int head = static_parse_pattern_list(parser);
+
+	static_parser_read(parser, TOKEN_THEN_KEYWORD);
+
+	int body = static_parse_app(parser);
+
+	int match = static_parser_node(parser, CASE, head, body);
+
+	if(static_parser_peek(parser) == TOKEN_COMMA) {
+		static_parser_read(parser, TOKEN_COMMA);
+
+		return static_parser_node(parser, CASE_LIST, match, static_parse_case(parser));
+	}
+
+	return static_parser_node(parser, CASE_LIST, match, -1);
+}
+
+template<unsigned N>
+constexpr int static_parse_case_list(struct static_parser_t<N> * parser) {
+	if(static_parser_peek(parser) == TOKEN_CASE_KEYWORD) {
+		return static_parse_case(parser);
+	}
+
+	return static_parse_app(parser);
+}
+
+template<unsigned N>
+constexpr int static_parse_type(struct static_parser_t<N> * parser) {
+	if(static_parser_peek(parser) == TOKEN_CONST_KEYWORD) {
+		static_parser_read(parser, TOKEN_CONST_KEYWORD);
+	}
+
+	int lhs = static_parse_app(parser);
+
+	if(static_parser_peek(parser) == TOKEN_ARROW_TYPE) {
+		static_parser_read(parser, TOKEN_ARROW_TYPE);
+
+		int rhs = static_parse_type(parser);
+
+		return static_parser_node(parser, ARROW_TYPE, lhs, rhs);
+	}
+
+	return lhs;
+}
+
+template<unsigned N>
+constexpr int static_parse_bind(struct static_parser_t<N> * parser) {
+	int lhs = static_parse_var(parser);
+
+	if(static_parser_peek(parser) == TOKEN_COLON) {
+		static_parser_read(parser, TOKEN_COLON);
+
+		int rhs = static_parse_type(parser);
+
+		return static_parser_node(parser, BIND, lhs, rhs);
+	}
+
+	return lhs;
+}
+
+// a binder of a lambda or a let, which the ast constructors assert is typed
+template<unsigned N>
+constexpr int static_parse_typed_bind(struct static_parser_t<N> * parser) {
+	int bind = static_parse_bind(parser);
+
+	if(static_parser_kind(parser, bind) != BIND) static_parse_error("':'", parser->lex.next);
+
+	return bind;
+}
+
+template<unsigned N>
+constexpr int static_parse_lambda(struct static_parser_t<N> * parser) {
+	if(static_parser_peek(parser) == TOKEN_FN_KEYWORD) {
+		static_parser_read(parser, TOKEN_FN_KEYWORD);
+
+		int bind = static_parse_typed_bind(parser);
+
+		static_parser_read(parser, TOKEN_DOT);
+
+		int body = static_parse_app(parser);
+
+		return static_parser_node(parser, LAMBDA, bind, body);
+	}
+
+	return static_parse_bind(parser);
+}
+
+// parse_program with a loop over the lets, preludes are long chains of them,
+// the statements are linked once all the lets are read so that they come after
+// their children
+template<unsigned N>
+constexpr int static_parse_program(struct static_parser_t<N> * parser) {
+	if(static_parser_peek(parser) != TOKEN_LET_KEYWORD) return static_parse_app(parser);
+
+	int lets[N] = {};
+	unsigned count = 0;
+
+	for(;;) {
+		static_parser_read(parser, TOKEN_LET_KEYWORD);
+
+		int lhs = static_parse_typed_bind(parser);
+
+		if(static_parser_peek(parser) == TOKEN_EQUAL) {
+			static_parser_read(parser, TOKEN_EQUAL);
+
+			int rhs = static_parse_case_list(parser);
+
+			lets[count++] = static_parser_node(parser, ASSIGNMENT, lhs, rhs);
+		} else {
+			lets[count++] = static_parser_node(parser, DECLARATION, lhs, -1);
+		}
+
+		if(static_parser_peek(parser) == TOKEN_SEMICOLON) break;
+
+		static_parser_read(parser, TOKEN_IN_KEYWORD);
+
+		// statement asserts the rest of the program is a let as well
+		if(static_parser_peek(parser) != TOKEN_LET_KEYWORD) static_parse_error("'let'", parser->lex.next);
+	}
+
+	int statement = -1;
+
+	while(count) {
+		statement = static_parser_node(parser, STATEMENT, lets[--count], statement);
+	}
+
+	return statement;
+}
+
+// the table of parse(src), without tags, with room for M nodes
+template<unsigned M, unsigned N>
+constexpr struct static_program_t<M> static_parse_sized(const char (&src)[N]) {
+	struct static_parser_t<M> parser = {};
+
+	parser.lex.src = src;
+	parser.lex.row = 1;
+	parser.lex.col = 1;
+
+	static_lexer_eat(&parser.lex);
+
+	parser.program.root = static_parse_program(&parser);
+
+	return parser.program;
+}
+
+template<unsigned N>
+constexpr struct static_program_t<N> static_parse(const char (&src)[N]) {
+	return static_parse_sized<N>(src);
+}
+
+template<unsigned N>
+constexpr unsigned static_parse_size(const char (&src)[N]) {
+	return static_parse(src).size;
+}
+
+// the maps of free variables of ast_hash_fused: the map of a frame is a list of
+// VAR nodes, one per free name, linked through next, each holding the position
+// of its name in the frame
+template<unsigned N>
+struct static_hasher_t {
+	struct static_program_t<N> * program;
+
+	struct hash_t names[N];
+	struct hash_t positions[N];
+	int next[N];
+
+	// per node
+	struct hash_t structures[N];
+	struct hash_t digests[N];
+	int heads[N];
+	unsigned sizes[N];
+};
+
+template<unsigned N>
+constexpr int static_hasher_same_name(struct static_hasher_t<N> * hasher, int a, int b) {
+	if(hasher->names[a].crc32 != hasher->names[b].crc32) return 0;
+
+	for(unsigned i = 0; i < 8; i++) {
+		if(hasher->program->nodes[a].name[i] != hasher->program->nodes[b].name[i]) return 0;
+	}
+
+	return 1;
+}
+
+template<unsigned N>
+constexpr unsigned static_hasher_entry(struct static_hasher_t<N> * hasher, int var) {
+	return position_hash_entry(hasher->names[var], hasher->positions[var]).crc32;
+}
+
+// position_hash_map_remove, the position of the name of var in the map of
+// frame, or position_hash_none
+template<unsigned N>
+constexpr struct hash_t static_hasher_remove(struct static_hasher_t<N> * hasher, int frame, int var) {
+	int * link = &hasher->heads[frame];
+
+	while(*link != -1 && !static_hasher_same_name(hasher, *link, var)) link = &hasher->next[*link];
+
+	if(*link == -1) return position_hash_none();
+
+	int entry = *link;
+
+	*link = hasher->next[entry];
+
+	hasher->digests[frame].crc32 ^= static_hasher_entry(hasher, entry);
+	hasher->sizes[frame] -= 1;
+
+	return hasher->positions[entry];
+}
+
+// position_hash_map_merge of the map of child into the map of frame, once the
+// structure of frame is known
+template<unsigned N>
+constexpr void static_hasher_merge(struct static_hasher_t<N> * hasher, int frame, int child) {
+	int entry = hasher->heads[child];
+
+	while(entry != -1) {
+		int next = hasher->next[entry];
+
+		struct hash_t position = static_hasher_remove(hasher, frame, entry);
+
+		hasher->positions[entry] = position_hash_join(hasher->structures[frame], position, hasher->positions[entry]);
+		hasher->next[entry] = hasher->heads[frame];
+		hasher->heads[frame] = entry;
+		hasher->digests[frame].crc32 ^= static_hasher_entry(hasher, entry);
+		hasher->sizes[frame] += 1;
+
+		entry = next;
+	}
+}
+
+template<unsigned N>
+constexpr void static_hasher_bind(struct static_hasher_t<N> * hasher, int frame, int var) {
+	struct hash_t position = static_hasher_remove(hasher, frame, var);
+
+	hasher->structures[frame] = hash_combine(hasher->structures[frame], position);
+}
+
+// ast_pattern_foreach_variable
+template<unsigned N>
+constexpr void static_hasher_bind_patterns(struct static_hasher_t<N> * hasher, int frame, int pattern) {
+	if(pattern == -1) return;
+
+	const struct static_node_t * node = &hasher->program->nodes[pattern];
+
+	if(node->kind == VAR) {
+		int constructor = node->name[0] >= 'A' && node->name[0] <= 'Z';
+		int wildcard = node->name[0] == '_' && node->name[1] == 0;
+
+		if(!constructor && !wildcard) static_hasher_bind(hasher, frame, pattern);
+
+		return;
+	}
+
+	static_hasher_bind_patterns(hasher, frame, node->lhs);
+	static_hasher_bind_patterns(hasher, frame, node->rhs);
+}
+
+// program with the tags ast_hash gives to its ast
+template<unsigned N>
+constexpr struct static_program_t<N> static_hash(struct static_program_t<N> program) {
+	struct static_hasher_t<N> hasher = {};
+
+	hasher.program = &program;
+
+	for(unsigned i = 0; i < program.size; i++) {
+		struct static_node_t * node = &program.nodes[i];
+
+		if(node->kind == VAR) {
+			unsigned length = 0;
+
+			while(length < 7 && node->name[length]) length++;
+
+			hasher.names[i] = hash(node->name, length);
+			hasher.positions[i] = position_hash_here();
+			hasher.next[i] = -1;
+
+			hasher.heads[i] = i;
+			hasher.sizes[i] = 1;
+			hasher.digests[i] = hash(static_hasher_entry(&hasher, i));
+			hasher.structures[i] = hash_combine(hash_structure_of(VAR, hash(""), hash("")), hash("R"));
+
+			node->tag = hash_combine(hasher.structures[i], hasher.digests[i]);
+
+			continue;
+		}
+
+		int lhs = node->lhs;
+		int rhs = node->rhs;
+
+		unsigned left_bigger = lhs != -1 && rhs != -1 ? hasher.sizes[lhs] >= hasher.sizes[rhs] : lhs != -1;
+
+		int bigger = left_bigger ? lhs : rhs;
+		int smaller = left_bigger ? rhs : lhs;
+
+		hasher.heads[i] = bigger != -1 ? hasher.heads[bigger] : -1;
+		hasher.sizes[i] = bigger != -1 ? hasher.sizes[bigger] : 0;
+		hasher.digests[i] = bigger != -1 ? hasher.digests[bigger] : hash((unsigned)0);
+
+		hasher.structures[i] = hash_structure_of(node->kind, lhs != -1 ? hasher.structures[lhs] : hash(""), rhs != -1 ? hasher.structures[rhs] : hash(""));
+		hasher.structures[i] = hash_combine(hasher.structures[i], hash(left_bigger ? "L" : "R"));
+
+		if(smaller != -1) static_hasher_merge(&hasher, i, smaller);
+
+		if(node->kind == LAMBDA) {
+			static_hasher_bind(&hasher, i, program.nodes[lhs].lhs);
+		}
+
+		if(node->kind == ARROW_TYPE && program.nodes[lhs].kind == BIND) {
+			static_hasher_bind(&hasher, i, program.nodes[lhs].lhs);
+		}
+
+		if(node->kind == CASE) {
+			static_hasher_bind_patterns(&hasher, i, lhs);
+		}
+
+		node->tag = hash_combine(hasher.structures[i], hasher.digests[i]);
+	}
+
+	program.hashed = 1;
+
+	return program;
+}
+
+template<unsigned N>
+constexpr struct static_program_t<N> static_parse_hashed(const char (&src)[N]) {
+	return static_hash(static_parse(src));
+}
+
+// tables of exactly as many nodes as the program has, the literal is parsed
+// twice
+#define STATIC_PARSE(src) static_parse_sized<static_parse_size(src)>(src)
+#define STATIC_PARSE_HASHED(src) static_hash(static_parse_sized<static_parse_size(src)>(src))
+
+// tag of the root, 0 before static_hash
+template<unsigned N>
+constexpr struct hash_t static_program_tag(const struct static_program_t<N> * program) {
+	return program->hashed ? program->nodes[program->root].tag : hash((unsigned)0);
+}
+
+// the ast of program, as parse would return it, with the tags when the table
+// was hashed
+template<unsigned N>
+struct ast_t * static_program_ast(const struct static_program_t<N> * program) {
+	struct ast_t ** asts = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * program->size);
+
+	for(unsigned i = 0; i < program->size; i++) {
+		const struct static_node_t * node = &program->nodes[i];
+
+		struct ast_t * ast = 0;
+
+		if(node->kind == VAR) {
+			ast = var(node->name);
+		} else {
+			ast = alloc_node(node->kind);
+
+			ast->lhs = node->lhs != -1 ? asts[node->lhs] : 0;
+			ast->rhs = node->rhs != -1 ? asts[node->rhs] : 0;
+
+			if(ast->lhs) ast->lhs->parent = ast;
+			if(ast->rhs) ast->rhs->parent = ast;
+		}
+
+		if(program->hashed) ast->tag = node->tag;
+
+		asts[i] = ast;
+	}
+
+	struct ast_t * root = asts[program->root];
+
+	memory_free(asts);
+
+	return root;
+}
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef SWISS_TABLE_H
+#define SWISS_TABLE_H
+
+#include "memory.h"
+#include "name.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Swiss table
+//
+// Open addressing table with a power of two capacity and one control byte per
+// slot. A control byte is either SWISS_EMPTY or the 7 high bits of the hash of
+// the key in the slot. Lookups compare a whole group of SWISS_GROUP control
+// bytes against the 7 bits at once (with SSE2 when available) and only compare
+// the keys of the matching slots.
+//
+// Probing is linear, a group is loaded starting at any slot, so every key sits
+// after its home slot with no empty slot in between. That allows deletions to
+// shift the following entries back instead of leaving tombstones. The table
+// only grows, at 7/8 load, so the cost of the rehashes is amortized.
+//
+// Tables of up to N entries do not allocate slots at all, the entries live in
+// arrays inside the struct and are searched linearly (ctrl is 0 in that mode).
+// The first insertion past N spills them to the hashed slots. keys and vals
+// point to the inline arrays while small, so a table must not be copied by
+// value.
+//
+// In both modes empty slots hold a null key, so the entries can be visited with
+//   for(i = 0; i < table->capacity; i++) if(table->keys[i]) ...
+
+#define SWISS_GROUP 16
+#define SWISS_EMPTY ((int8_t)-128)
+#define SWISS_MIN_CAPACITY 4
+
+// entries stored inline before spilling, 0 disables the small mode
+#ifndef SWISS_SMALL_CAPACITY
+#define SWISS_SMALL_CAPACITY 4
+#endif
+
+// key hashing and comparison, overloaded for each key type
+
+unsigned swiss_key_hash(struct name_t * key) {
+	return key->hash.crc32 * 2654435769u;
+}
+
+int swiss_key_equal(struct name_t * a, struct name_t * b) {
+	return a == b || (a->hash.crc32 == b->hash.crc32 && a->length == b->length && memcmp(a->identifier, b->identifier, a->length) == 0);
+}
+
+template<typename K, typename V, unsigned N = SWISS_SMALL_CAPACITY>
+struct swiss_table_t {
+	unsigned size;
+	unsigned capacity;
+
+	// capacity + SWISS_GROUP bytes, the tail mirrors the first slots so a group
+	// can be loaded at any slot without wrapping, 0 while the table is small
+	int8_t * ctrl;
+
+	K * keys;
+	V * vals;
+
+	K small_keys[N ? N : 1];
+	V small_vals[N ? N : 1];
+};
+
+int8_t swiss_h2(unsigned h) {
+	return (int8_t)(h >> 25);
+}
+
+// bit i is set when the i-th control byte of the group equals byte
+unsigned swiss_group_match(const int8_t * group, int8_t byte) {
+#if defined(__SSE2__)
+	__m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+	unsigned mask = 0;
+
+	for(unsigned i = 0; i < SWISS_GROUP; i++) {
+		mask |= (unsigned)(group[i] == byte) << i;
+	}
+
+	return mask;
+#endif
+}
+
+unsigned swiss_lowest_bit(unsigned mask) {
+	return __builtin_ctz(mask);
+}
+
+template<typename K, typename V, unsigned N>
+void swiss_table_set_ctrl(struct swiss_table_t<K, V, N> * table, unsigned slot, int8_t byte) {
+	// small tables are mirrored more than once in the tail
+	for(unsigned i = slot; i < table->capacity + SWISS_GROUP; i += table->capacity) {
+		table->ctrl[i] = byte;
+	}
+}
+
+template<typename K, typename V, unsigned N>
+void swiss_table_allocate_slots(struct swiss_table_t<K, V, N> * table, unsigned capacity) {
+	table->capacity = capacity;
+
+	// control bytes, keys and values share a single allocation
+	size_t ctrl_bytes = (capacity + SWISS_GROUP + 7) & ~(size_t)7;
+
+	char * block = (char*)memory_alloc(ctrl_bytes + (sizeof(K) + sizeof(V)) * capacity);
+
+	table->ctrl = (int8_t*)block;
+	table->keys = (K*)(block + ctrl_bytes);
+	table->vals = (V*)(block + ctrl_bytes + sizeof(K) * capacity);
+
+	memset(table->ctrl, SWISS_EMPTY, capacity + SWISS_GROUP);
+	memset((void*)table->keys, 0, sizeof(K) * capacity);
+}
+
+template<typename K, typename V, unsigned N>
+void swiss_table_use_small(struct swiss_table_t<K, V, N> * table) {
+	table->capacity = N;
+	table->ctrl = 0;
+	table->keys = table->small_keys;
+	table->vals = table->small_vals;
+
+	memset((void*)table->small_keys, 0, sizeof(table->small_keys));
+}
+
+template<typename K, typename V, unsigned N>
+void swiss_table_init(struct swiss_table_t<K, V, N> * table, unsigned capacity = 0) {
+	table->size = 0;
+
+	if(N && capacity <= N) {
+		swiss_table_use_small(table);
+		return;
+	}
+
+	unsigned pow2 = SWISS_MIN_CAPACITY;
+
+	while(pow2 < capacity) pow2 *= 2;
+
+	swiss_table_allocate_slots(table, pow2);
+}
+
+// releases the slots, keys and values are owned by the caller
+template<typename K, typename V, unsigned N>
+void swiss_table_destroy(struct swiss_table_t<K, V, N> * table) {
+	if(table->ctrl) {
+		memory_free(table->ctrl);
+	}
+}
+
+// forgets every entry, keeps the capacity
+template<typename K, typename V, unsigned N>
+void swiss_table_clear(struct swiss_table_t<K, V, N> * table) {
+	if(table->ctrl) {
+		memset(table->ctrl, SWISS_EMPTY, table->capacity + SWISS_GROUP);
+	}
+
+	memset((void*)table->keys, 0, sizeof(K) * table->capacity);
+
+	table->size = 0;
+}
+
+// slot of key or -1
+template<typename K, typename V, unsigned N>
+int swiss_table_find(struct swiss_table_t<K, V, N> * table, K key) {
+	if(table->ctrl == 0) {
+		for(unsigned i = 0; i < N; i++) {
+			if(table->keys[i] && swiss_key_equal(table->keys[i], key)) {
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	unsigned h = swiss_key_hash(key);
+	unsigned mask = table->capacity - 1;
+	unsigned pos = h & mask;
+
+	int8_t h2 = swiss_h2(h);
+
+	while(1) {
+		const int8_t * group = table->ctrl + pos;
+
+		for(unsigned match = swiss_group_match(group, h2); match; match &= match - 1) {
+			unsigned slot = (pos + swiss_lowest_bit(match)) & mask;
+
+			if(swiss_key_equal(table->keys[slot], key)) {
+				return slot;
+			}
+		}
+
+		if(swiss_group_match(group, SWISS_EMPTY)) {
+			return -1;
+		}
+
+		pos = (pos + SWISS_GROUP) & mask;
+	}
+}
+
+template<typename K, typename V, unsigned N>
+void swiss_table_place(struct swiss_table_t<K, V, N> * table, K key, V val, unsigned h) {
+	unsigned mask = table->capacity - 1;
+	unsigned pos = h & mask;
+
+	while(1) {
+		unsigned empty = swiss_group_match(table->ctrl + pos, SWISS_EMPTY);
+
+		if(empty) {
+			unsigned slot = (pos + swiss_lowest_bit(empty)) & mask;
+
+			swiss_table_set_ctrl(table, slot, swiss_h2(h));
+
+			table->keys[slot] = key;
+			table->vals[slot] = val;
+			table->size += 1;
+
+			return;
+		}
+
+		pos = (pos + SWISS_GROUP) & mask;
+	}
+}
+
+// moves the entries to hashed slots of the given capacity
+template<typename K, typename V, unsigned N>
+void swiss_table_rehash(struct swiss_table_t<K, V, N> * table, unsigned capacity) {
+	int8_t * ctrl = table->ctrl;
+	K * keys = table->keys;
+	V * vals = table->vals;
+
+	unsigned old_cap = table->capacity;
+
+	swiss_table_allocate_slots(table, capacity);
+
+	table->size = 0;
+
+	for(unsigned i = 0; i < old_cap; i++) {
+		if(keys[i]) {
+			swiss_table_place(table, keys[i], vals[i], swiss_key_hash(keys[i]));
+		}
+	}
+
+	if(ctrl) {
+		memory_free(ctrl);
+	}
+}
+
+// returns 0 and leaves the table untouched if key is already present
+template<typename K, typename V, unsigned N>
+int swiss_table_insert(struct swiss_table_t<K, V, N> * table, K key, V val) {
+	if(swiss_table_find(table, key) != -1) return 0;
+
+	if(table->ctrl == 0) {
+		if(table->size < N) {
+			unsigned slot = 0;
+
+			while(table->keys[slot]) slot++;
+
+			table->keys[slot] = key;
+			table->vals[slot] = val;
+			table->size += 1;
+
+			return 1;
+		}
+
+		// spill, twice the inline capacity leaves room to grow
+		swiss_table_rehash(table, N * 2 > SWISS_MIN_CAPACITY ? N * 2 : SWISS_MIN_CAPACITY);
+	} else if(8 * (table->size + 1) > 7 * table->capacity) {
+		swiss_table_rehash(table, table->capacity * 2);
+	}
+
+	swiss_table_place(table, key, val, swiss_key_hash(key));
+
+	return 1;
+}
+
+// empties slot and shifts the entries after it back to keep probing linear
+template<typename K, typename V, unsigned N>
+void swiss_table_erase_slot(struct swiss_table_t<K, V, N> * table, unsigned slot) {
+	table->size -= 1;
+
+	if(table->ctrl == 0) {
+		table->keys[slot] = 0;
+		return;
+	}
+
+	unsigned mask = table->capacity - 1;
+	unsigned hole = slot;
+	unsigned next = (slot + 1) & mask;
+
+	while(table->ctrl[next] != SWISS_EMPTY) {
+		unsigned home = swiss_key_hash(table->keys[next]) & mask;
+
+		if(((next - home) & mask) >= ((next - hole) & mask)) {
+			swiss_table_set_ctrl(table, hole, table->ctrl[next]);
+
+			table->keys[hole] = table->keys[next];
+			table->vals[hole] = table->vals[next];
+
+			hole = next;
+		}
+
+		next = (next + 1) & mask;
+	}
+
+	swiss_table_set_ctrl(table, hole, SWISS_EMPTY);
+
+	table->keys[hole] = 0;
+}
+
+// removes key, the stored key is written to removed_key and its value to val
+template<typename K, typename V, unsigned N>
+int swiss_table_remove(struct swiss_table_t<K, V, N> * table, K key, K * removed_key, V * val) {
+	int slot = swiss_table_find(table, key);
+
+	if(slot == -1) return 0;
+
+	if(removed_key) *removed_key = table->keys[slot];
+	if(val) *val = table->vals[slot];
+
+	swiss_table_erase_slot(table, slot);
+
+	return 1;
+}
+
+template<typename K, typename V, unsigned N>
+V * swiss_table_get(struct swiss_table_t<K, V, N> * table, K key) {
+	int slot = swiss_table_find(table, key);
+
+	return slot == -1 ? 0 : &table->vals[slot];
+}
+
+#endif
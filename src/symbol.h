@@ -0,0 +1,71 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include "memory.h"
+#include "name.h"
+#include "swiss_table.h"
+
+#include <mutex>
+
+// Interned symbols
+//
+// Every distinct name gets a small integer for the whole run, so free
+// variables can be compared and hashed as integers. Symbols start at 1, 0 means
+// no symbol. The table is shared by all threads and never shrinks, the names
+// are kept on the global heap even when the caller has a scratch arena.
+
+typedef struct symbol_table_t {
+	std::mutex lock;
+
+	swiss_table_t<name_t*, unsigned> index;
+
+	unsigned size;
+	unsigned capacity;
+	struct name_t ** names;
+} symbol_table_t;
+
+static struct symbol_table_t symbols;
+
+unsigned symbol_intern(struct name_t * name) {
+	std::lock_guard<std::mutex> guard(symbols.lock);
+
+	struct arena_t * scratch = memory_scratch;
+
+	memory_set_scratch(0);
+
+	if(symbols.capacity == 0) {
+		swiss_table_init(&symbols.index);
+
+		symbols.size = 1;
+		symbols.capacity = 64;
+		symbols.names = (struct name_t**)memory_alloc(sizeof(struct name_t*) * symbols.capacity);
+		symbols.names[0] = 0;
+	}
+
+	unsigned * found = swiss_table_get(&symbols.index, name);
+
+	unsigned symbol = found ? *found : symbols.size;
+
+	if(found == 0) {
+		if(symbols.size == symbols.capacity) {
+			symbols.capacity *= 2;
+			symbols.names = (struct name_t**)memory_realloc(symbols.names, sizeof(struct name_t*) * symbols.capacity);
+		}
+
+		symbols.names[symbols.size++] = name_copy(name);
+
+		swiss_table_insert(&symbols.index, symbols.names[symbol], symbol);
+	}
+
+	memory_set_scratch(scratch);
+
+	return symbol;
+}
+
+struct name_t * symbol_name(unsigned symbol) {
+	std::lock_guard<std::mutex> guard(symbols.lock);
+
+	return symbols.names[symbol];
+}
+
+#endif
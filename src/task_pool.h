@@ -0,0 +1,182 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include "memory.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// Work stealing task pool
+//
+// Every worker owns a deque of tasks. A task spawned by a worker goes at the
+// back of its own deque and the worker takes its next task from the back too,
+// so it keeps working depth first on the subproblem it just split. An idle
+// worker steals from the front of the other deques, where the oldest and
+// usually largest tasks are. Each deque has its own lock, only held while a
+// task is pushed or taken.
+//
+// Tasks receive the index of the worker running them, so they can use state
+// owned by that worker without locking. task_pool_run returns when every task,
+// including the ones spawned while it runs, has completed.
+
+typedef void (*task_function_t)(void * arg, unsigned worker);
+
+typedef struct task_t {
+	task_function_t function;
+	void * arg;
+} task_t;
+
+typedef struct task_deque_t {
+	std::mutex lock;
+
+	// ring buffer, the tasks are in [front, back)
+	struct task_t * tasks;
+
+	unsigned long front;
+	unsigned long back;
+	unsigned long capacity;
+} task_deque_t;
+
+typedef struct task_pool_t {
+	unsigned workers;
+
+	struct task_deque_t * deques;
+
+	// spawned and not completed
+	std::atomic<unsigned long> pending;
+
+	std::atomic<unsigned long> spawned;
+	std::atomic<unsigned long> stolen;
+} task_pool_t;
+
+// index of the worker of the calling thread in the pool it runs for
+static thread_local unsigned task_pool_worker = 0;
+
+// threads = 0 uses one thread per core
+void task_pool_init(struct task_pool_t * pool, unsigned threads) {
+	if(threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+
+	if(threads == 0) {
+		threads = 1;
+	}
+
+	pool->workers = threads;
+	pool->deques = new task_deque_t[threads];
+
+	for(unsigned i = 0; i < threads; i++) {
+		pool->deques[i].capacity = 64;
+		pool->deques[i].front = 0;
+		pool->deques[i].back = 0;
+		pool->deques[i].tasks = (struct task_t*)memory_alloc(sizeof(struct task_t) * pool->deques[i].capacity);
+	}
+
+	pool->pending = 0;
+	pool->spawned = 0;
+	pool->stolen = 0;
+}
+
+void task_pool_destroy(struct task_pool_t * pool) {
+	for(unsigned i = 0; i < pool->workers; i++) {
+		memory_free(pool->deques[i].tasks);
+	}
+
+	delete[] pool->deques;
+}
+
+// Queues function(arg) on the deque of the calling worker, or of the first
+// worker when called before task_pool_run.
+void task_pool_spawn(struct task_pool_t * pool, task_function_t function, void * arg) {
+	struct task_deque_t * deque = &pool->deques[task_pool_worker];
+
+	pool->pending.fetch_add(1);
+	pool->spawned.fetch_add(1, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> guard(deque->lock);
+
+	if(deque->back - deque->front == deque->capacity) {
+		struct task_t * tasks = (struct task_t*)memory_alloc(sizeof(struct task_t) * deque->capacity * 2);
+
+		for(unsigned long i = deque->front; i < deque->back; i++) {
+			tasks[i % (deque->capacity * 2)] = deque->tasks[i % deque->capacity];
+		}
+
+		memory_free(deque->tasks);
+
+		deque->tasks = tasks;
+		deque->capacity *= 2;
+	}
+
+	deque->tasks[deque->back++ % deque->capacity] = { function, arg };
+}
+
+int task_pool_take(struct task_pool_t * pool, unsigned worker, struct task_t * task) {
+	struct task_deque_t * deque = &pool->deques[worker];
+
+	{
+		std::lock_guard<std::mutex> guard(deque->lock);
+
+		if(deque->back > deque->front) {
+			*task = deque->tasks[--deque->back % deque->capacity];
+			return 1;
+		}
+	}
+
+	for(unsigned i = 1; i < pool->workers; i++) {
+		struct task_deque_t * victim = &pool->deques[(worker + i) % pool->workers];
+
+		std::lock_guard<std::mutex> guard(victim->lock);
+
+		if(victim->back > victim->front) {
+			*task = victim->tasks[victim->front++ % victim->capacity];
+
+			pool->stolen.fetch_add(1, std::memory_order_relaxed);
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void task_pool_work(struct task_pool_t * pool, unsigned worker) {
+	unsigned outer = task_pool_worker;
+
+	task_pool_worker = worker;
+
+	struct task_t task;
+
+	while(pool->pending.load() > 0) {
+		if(task_pool_take(pool, worker, &task)) {
+			task.function(task.arg, worker);
+
+			// after the task, its own spawns are already counted
+			pool->pending.fetch_sub(1);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+
+	task_pool_worker = outer;
+}
+
+// Runs the spawned tasks on the calling thread and workers - 1 new threads.
+void task_pool_run(struct task_pool_t * pool) {
+	std::thread * threads = new std::thread[pool->workers - 1];
+
+	for(unsigned i = 0; i < pool->workers - 1; i++) {
+		threads[i] = std::thread(task_pool_work, pool, i + 1);
+	}
+
+	task_pool_work(pool, 0);
+
+	for(unsigned i = 0; i < pool->workers - 1; i++) {
+		threads[i].join();
+	}
+
+	delete[] threads;
+}
+
+#endif
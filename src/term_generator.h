@@ -0,0 +1,152 @@
+#ifndef TERM_GENERATOR_H
+#define TERM_GENERATOR_H
+
+#include "ast.h"
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+// Term generators
+//
+// Well scoped terms of about a given number of nodes in a few shapes, for
+// the hashing benchmarks and the hash verification tests. The binders are
+// typed by the free variable t and only generate_free has other free
+// variables.
+
+// xorshift, fixed seed so every run hashes the same terms
+unsigned long long generator_random_state = 88172645463325252ull;
+
+unsigned generator_random(unsigned bound) {
+	generator_random_state ^= generator_random_state << 13;
+	generator_random_state ^= generator_random_state >> 7;
+	generator_random_state ^= generator_random_state << 17;
+
+	return bound ? generator_random_state % bound : 0;
+}
+
+typedef struct generator_t {
+	std::vector<std::string> scope;
+
+	unsigned binders;
+	unsigned nodes;
+} generator_t;
+
+struct ast_t * generator_var(struct generator_t * g, const std::string & name) {
+	g->nodes += 1;
+	return var(name.c_str());
+}
+
+// a variable in scope, t outside of every binder
+struct ast_t * generator_bound(struct generator_t * g) {
+	if(g->scope.empty()) return generator_var(g, "t");
+
+	return generator_var(g, g->scope[generator_random(g->scope.size())]);
+}
+
+// a fresh name pushed in scope, popped by generator_lambda
+std::string generator_open(struct generator_t * g) {
+	std::string name = "x" + std::to_string(g->binders++);
+
+	g->scope.push_back(name);
+
+	return name;
+}
+
+struct ast_t * generator_lambda(struct generator_t * g, const std::string & name, struct ast_t * body) {
+	g->scope.pop_back();
+	g->nodes += 2;
+
+	struct ast_t * x = generator_var(g, name);
+	struct ast_t * t = generator_var(g, "t");
+
+	return lambda(bind(x, t), body);
+}
+
+struct ast_t * generator_app(struct generator_t * g, struct ast_t * lhs, struct ast_t * rhs) {
+	g->nodes += 1;
+	return app(lhs, rhs);
+}
+
+// about size nodes, applications split evenly and a lambda now and then
+struct ast_t * generate_balanced(struct generator_t * g, unsigned size) {
+	if(size < 4) return generator_bound(g);
+
+	if(generator_random(4) == 0) {
+		std::string x = generator_open(g);
+		struct ast_t * body = generate_balanced(g, size - 4);
+		return generator_lambda(g, x, body);
+	}
+
+	unsigned half = (size - 1) / 2;
+
+	struct ast_t * lhs = generate_balanced(g, half);
+	struct ast_t * rhs = generate_balanced(g, size - 1 - half);
+
+	return generator_app(g, lhs, rhs);
+}
+
+// fn x0 ... fn x3. ((x0 a) b) ... with a spine of applications
+struct ast_t * generate_left_deep(struct generator_t * g, unsigned size) {
+	std::string names[4];
+
+	for(unsigned i = 0; i < 4; i++) names[i] = generator_open(g);
+
+	struct ast_t * spine = generator_bound(g);
+
+	while(g->nodes + 16 < size) spine = generator_app(g, spine, generator_bound(g));
+
+	for(unsigned i = 4; i-- > 0;) spine = generator_lambda(g, names[i], spine);
+
+	return spine;
+}
+
+// fn x0. xi (fn x1. xj (fn x2. ...)), every level binds one more name
+struct ast_t * generate_right_deep(struct generator_t * g, unsigned size) {
+	unsigned depth = size / 6;
+
+	for(unsigned i = 0; i < depth; i++) generator_open(g);
+
+	// inside out, the innermost body sees every binder
+	struct ast_t * body = generator_bound(g);
+
+	for(unsigned i = depth; i-- > 0;) {
+		std::string name = g->scope.back();
+		struct ast_t * head = generator_bound(g);
+
+		body = generator_lambda(g, name, generator_app(g, head, body));
+	}
+
+	return body;
+}
+
+// x0 applied to sqrt(size) balanced arguments of sqrt(size) nodes each
+struct ast_t * generate_wide(struct generator_t * g, unsigned size) {
+	unsigned width = (unsigned)sqrt((double)size);
+
+	std::string names[4];
+
+	for(unsigned i = 0; i < 4; i++) names[i] = generator_open(g);
+
+	struct ast_t * spine = generator_var(g, names[0]);
+
+	for(unsigned i = 0; i < width; i++) spine = generator_app(g, spine, generate_balanced(g, width));
+
+	for(unsigned i = 4; i-- > 0;) spine = generator_lambda(g, names[i], spine);
+
+	return spine;
+}
+
+// a balanced tree of applications of distinct free variables
+struct ast_t * generate_free(struct generator_t * g, unsigned size) {
+	if(size < 2) return generator_var(g, "v" + std::to_string(g->binders++));
+
+	unsigned half = (size - 1) / 2;
+
+	struct ast_t * lhs = generate_free(g, half);
+	struct ast_t * rhs = generate_free(g, size - 1 - half);
+
+	return generator_app(g, lhs, rhs);
+}
+
+#endif
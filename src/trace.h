@@ -0,0 +1,292 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Tracing
+//
+// With TRACE set to 1 the phases of the compiler record spans, a name, a start
+// and a duration, into a ring buffer owned by the recording thread, so
+// recording takes no lock and a full buffer overwrites its oldest spans.
+// trace_write_json writes every buffer as Chrome trace events, to be opened in
+// chrome://tracing or Perfetto, and should be called while no traced thread
+// is running. With TRACE set to 0, the default, the TRACE_ macros expand to
+// nothing and the phases are not touched.
+//
+// TRACE_SCOPE records the enclosing block. TRACE_OUTER_SCOPE is for recursive
+// functions and only records the outermost call on each thread. Phases made of
+// many tiny calls, like lexer_eat, add their time to a batch instead, which
+// records one span of the summed time every size calls. Reading the clock
+// costs about as much as such a call, so a batch only times one call in
+// TRACE_BATCH_SAMPLE, less the cost of the clock, and scales the sum.
+//
+// The buffers are allocated with malloc and not memory_alloc, they outlive
+// the scratch arenas and the threads that recorded them. The buffer of a thread
+// that exited is handed to the next thread that records, so a process that
+// keeps starting threads, like task_pool_run, holds as many buffers as it ever
+// had threads running at once. Its spans then share a tid, one after another.
+
+#ifndef TRACE
+#define TRACE 0
+#endif
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS (1 << 16)
+#endif
+
+#ifndef TRACE_BATCH_SAMPLE
+#define TRACE_BATCH_SAMPLE 16
+#endif
+
+typedef struct trace_event_t {
+	const char * name;
+
+	// nanoseconds
+	unsigned long long start;
+	unsigned long long duration;
+
+	// calls a batch span stands for, 0 for the other spans
+	unsigned long long calls;
+} trace_event_t;
+
+typedef struct trace_buffer_t {
+	struct trace_event_t * events;
+
+	// events ever recorded, the last TRACE_BUFFER_EVENTS of them are kept
+	unsigned long long written;
+
+	unsigned thread;
+
+	// set while a running thread records into the buffer
+	int owned;
+
+	struct trace_buffer_t * next;
+} trace_buffer_t;
+
+static std::mutex trace_lock;
+static struct trace_buffer_t * trace_buffers = 0;
+static unsigned trace_threads = 0;
+
+static thread_local struct trace_buffer_t * trace_local = 0;
+
+// gives the buffer of the thread back when the thread exits, apart from
+// trace_local so that recording does not go through a thread_local destructor
+typedef struct trace_owner_t {
+	struct trace_buffer_t * buffer;
+
+	~trace_owner_t() {
+		std::lock_guard<std::mutex> guard(trace_lock);
+
+		buffer->owned = 0;
+	}
+} trace_owner_t;
+
+// nanoseconds a sampled call spends reading the clock, measured once
+static unsigned long long trace_clock_cost = 0;
+
+unsigned long long trace_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_measure_clock() {
+	unsigned long long start = trace_now();
+	unsigned long long last = start;
+
+	for(unsigned i = 0; i < 64; i++) last = trace_now();
+
+	trace_clock_cost = (last - start) / 64;
+}
+
+// the buffer of the calling thread, taken over from an exited thread or
+// registered on first use
+struct trace_buffer_t * trace_buffer() {
+	if(trace_local) return trace_local;
+
+	static thread_local struct trace_owner_t owner;
+
+	std::lock_guard<std::mutex> guard(trace_lock);
+
+	struct trace_buffer_t * buffer = trace_buffers;
+
+	while(buffer && buffer->owned) buffer = buffer->next;
+
+	if(buffer == 0) {
+		if(trace_threads == 0) trace_measure_clock();
+
+		buffer = (struct trace_buffer_t*)malloc(sizeof(struct trace_buffer_t));
+
+		buffer->events = (struct trace_event_t*)malloc(sizeof(struct trace_event_t) * TRACE_BUFFER_EVENTS);
+		buffer->written = 0;
+		buffer->thread = trace_threads++;
+		buffer->next = trace_buffers;
+
+		trace_buffers = buffer;
+	}
+
+	buffer->owned = 1;
+
+	owner.buffer = buffer;
+	trace_local = buffer;
+
+	return buffer;
+}
+
+void trace_record(const char * name, unsigned long long start, unsigned long long duration, unsigned long long calls) {
+	struct trace_buffer_t * buffer = trace_buffer();
+
+	struct trace_event_t * event = &buffer->events[buffer->written % TRACE_BUFFER_EVENTS];
+
+	event->name = name;
+	event->start = start;
+	event->duration = duration;
+	event->calls = calls;
+
+	buffer->written += 1;
+}
+
+typedef struct trace_span_t {
+	const char * name;
+	unsigned long long start;
+
+	trace_span_t(const char * name) : name(name), start(trace_now()) {}
+
+	~trace_span_t() {
+		trace_record(name, start, trace_now() - start, 0);
+	}
+} trace_span_t;
+
+// records only when *active is not set, that is outside of another call
+typedef struct trace_outer_span_t {
+	int * active;
+	const char * name;
+	unsigned long long start;
+
+	trace_outer_span_t(const char * name, int * active) : active(*active ? 0 : active), name(name), start(0) {
+		if(this->active) {
+			*this->active = 1;
+			start = trace_now();
+		}
+	}
+
+	~trace_outer_span_t() {
+		if(active) {
+			trace_record(name, start, trace_now() - start, 0);
+			*active = 0;
+		}
+	}
+} trace_outer_span_t;
+
+typedef struct trace_batch_t {
+	const char * name;
+	unsigned size;
+
+	// estimated time of the calls since the last flush
+	unsigned long long accumulated;
+	unsigned long long calls;
+} trace_batch_t;
+
+// records the calls of batch since the last flush as one span ending now, as
+// long as the time they took
+void trace_batch_flush(struct trace_batch_t * batch) {
+	if(batch->calls == 0) return;
+
+	trace_record(batch->name, trace_now() - batch->accumulated, batch->accumulated, batch->calls);
+
+	batch->accumulated = 0;
+	batch->calls = 0;
+}
+
+typedef struct trace_batch_span_t {
+	struct trace_batch_t * batch;
+	unsigned long long start;
+
+	trace_batch_span_t(struct trace_batch_t * batch) : batch(batch), start(batch->calls % TRACE_BATCH_SAMPLE ? 0 : trace_now()) {}
+
+	~trace_batch_span_t() {
+		if(start) {
+			unsigned long long elapsed = trace_now() - start;
+
+			elapsed = elapsed > trace_clock_cost ? elapsed - trace_clock_cost : 0;
+
+			batch->accumulated += elapsed * TRACE_BATCH_SAMPLE;
+		}
+
+		batch->calls += 1;
+
+		if(batch->calls == batch->size) trace_batch_flush(batch);
+	}
+} trace_batch_span_t;
+
+// drops the recorded spans, the buffers stay registered
+void trace_clear() {
+	std::lock_guard<std::mutex> guard(trace_lock);
+
+	for(struct trace_buffer_t * buffer = trace_buffers; buffer; buffer = buffer->next) {
+		buffer->written = 0;
+	}
+}
+
+// number of spans kept in the buffers
+unsigned long long trace_count() {
+	std::lock_guard<std::mutex> guard(trace_lock);
+
+	unsigned long long count = 0;
+
+	for(struct trace_buffer_t * buffer = trace_buffers; buffer; buffer = buffer->next) {
+		count += buffer->written < TRACE_BUFFER_EVENTS ? buffer->written : TRACE_BUFFER_EVENTS;
+	}
+
+	return count;
+}
+
+// writes the kept spans as complete events, oldest first on each thread, with
+// the timestamps in microseconds
+void trace_write_json(FILE * out) {
+	std::lock_guard<std::mutex> guard(trace_lock);
+
+	fprintf(out, "{\"traceEvents\":[");
+
+	const char * separator = "\n";
+
+	for(struct trace_buffer_t * buffer = trace_buffers; buffer; buffer = buffer->next) {
+		unsigned long long first = buffer->written > TRACE_BUFFER_EVENTS ? buffer->written - TRACE_BUFFER_EVENTS : 0;
+
+		for(unsigned long long i = first; i < buffer->written; i++) {
+			struct trace_event_t * event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+
+			fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", separator, event->name, buffer->thread, event->start / 1e3, event->duration / 1e3);
+
+			if(event->calls) fprintf(out, ",\"args\":{\"calls\":%llu}", event->calls);
+
+			fprintf(out, "}");
+
+			separator = ",\n";
+		}
+	}
+
+	fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if TRACE
+#define TRACE_SCOPE(name) struct trace_span_t TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_OUTER_SCOPE(name) \
+	static thread_local int TRACE_CONCAT(trace_active_, __LINE__) = 0; \
+	struct trace_outer_span_t TRACE_CONCAT(trace_span_, __LINE__)(name, &TRACE_CONCAT(trace_active_, __LINE__))
+#define TRACE_BATCH_DEFINE(batch, name, size) static thread_local struct trace_batch_t batch = { name, size, 0, 0 }
+#define TRACE_BATCH_SCOPE(batch) struct trace_batch_span_t TRACE_CONCAT(trace_span_, __LINE__)(&batch)
+#define TRACE_BATCH_FLUSH(batch) trace_batch_flush(&batch)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_OUTER_SCOPE(name)
+#define TRACE_BATCH_DEFINE(batch, name, size)
+#define TRACE_BATCH_SCOPE(batch)
+#define TRACE_BATCH_FLUSH(batch)
+#endif
+
+#endif
@@ -0,0 +1,1621 @@
+#ifndef TYPECHECK_H
+#define TYPECHECK_H
+
+#include "ast.h"
+#include "ast_hash.h"
+#include "alpha_equivalence.h"
+#include "memory.h"
+#include "name.h"
+#include "reduction.h"
+#include "nbe.h"
+#include "swiss_table.h"
+#include "metavariable.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Bidirectional type checking
+//
+// Checks programs of the dependent calculus with Type : Type. Terms are
+// inferred (variables, applications, annotated lambdas and types) or checked
+// against a type (lambdas, with or without annotation, and anything that can
+// be inferred followed by a conversion). Pi types are ARROW_TYPE nodes whose
+// lhs is a BIND, the other arrows are not dependent. The parser reads the
+// signature x:A -> B as a BIND of x to the arrow A -> B, it is rewritten to the
+// Pi type (x:A) -> B before checking. Declarations are postulates, definitions
+// are unfolded by the conversion.
+//
+// Every type the checker holds has been hashed with ast_hash, so the conversion
+// first compares the alpha invariant tags. Equal tags are confirmed with
+// ast_alpha_equivalent, so the fast path is linear in the size of the types
+// rather than O(1), but it never reduces, and only different tags lead to
+// normalizing both sides with nbe.h. TYPECHECK_TRUST_TAGS accepts equal tags
+// without the confirmation, for measurements only: it is unsound, the tags
+// are 32 bits and among tens of thousands of distinct types some share one,
+// and then the checker accepts ill typed programs.
+//
+// The checker works on a copy of the program allocated in its arena, together
+// with every type it builds, the input is left untouched. Nothing is freed
+// before the next program. As in ast_hash and
+// alpha_equivalence.h, the tags compare the type of a binder inside its scope,
+// a binder whose type mentions its own name is compared as they see it.
+//
+// Inferred types are memoized by the tag of the term and a hash of the part
+// of the context it depends on: its free names, then the free names of their
+// types and definitions, and so on. Every name of that closure contributes the
+// identity of its innermost entry, so a term seen again under the same entries
+// reuses its type, and shadowing or redefining one of them, or binding it
+// again, changes the key and leaves the stale type unreachable. Annotated
+// lambdas checked against a type memoize the Pi type they are checked against.
+// The normal forms of definitions are kept with the types. Hits confirm the
+// term like conversions, the context hash is 64 bits. The free names of every node the checker looks at
+// are kept in its fv_to_ctx_map.
+//
+// The names a signature passes as arguments without defining them are its
+// implicit arguments, as A and n in Cons : A -> Vec A n -> Vec A (Succ n).
+// Their types are found while the signature is checked, and every use of the
+// definition replaces them with fresh metavariables (metavariable.h). The conversion of
+// types with metavariables unifies them: a metavariable, or one applied to
+// distinct bound variables (a pattern), is solved with the other side if it
+// does not occur in it and only refers to the entries in scope where it was
+// created. The other constraints on a metavariable wait until it is solved.
+// Syntactic unification is tried first and undone if it fails, then both
+// sides are normalized and unified again. The implicit arguments are erased,
+// the values of the definitions are normalized as written. A definition with
+// an unsolved metavariable or constraint is rejected. Any other unbound name
+// of a signature, as a misspelled type, is an unbound variable.
+//
+// A case list is checked against the signature of its definition. Each
+// pattern is checked against the domain of its argument, a constructor with
+// fresh metavariables for its implicit arguments, and the arguments the rest
+// of the type depends on are replaced by their patterns before the body is
+// checked. Whether the cases cover every constructor is not checked, a case
+// list applied to a value no case matches is stuck.
+
+#ifndef TYPECHECK_TRUST_TAGS
+#define TYPECHECK_TRUST_TAGS 0
+#endif
+
+#define TYPECHECK_ARENA_BLOCK_SIZE (1 << 16)
+
+typedef struct typecheck_entry_t {
+	struct name_t * name;
+	struct ast_t * type;
+
+	// normal form of a definition, 0 for declarations and bound variables
+	struct ast_t * value;
+
+	// entry of the same name it shadows, -1 if none
+	int shadowed;
+
+	// number of the push that made the entry, never reused by a checker
+	unsigned long serial;
+
+	// implicit arguments of the type and their types, in order
+	unsigned implicit_count;
+	struct name_t ** implicits;
+	struct ast_t ** implicit_types;
+} typecheck_entry_t;
+
+typedef struct typecheck_memo_t {
+	struct hash_t tag;
+	unsigned long context;
+
+	struct ast_t * term;
+	struct ast_t * type;
+
+	// normal form of term once a definition needed it
+	struct ast_t * normal;
+} typecheck_memo_t;
+
+unsigned swiss_key_hash(struct typecheck_memo_t * key) {
+	return (key->tag.crc32 ^ (unsigned)(key->context >> 32) ^ (unsigned)key->context) * 2654435769u;
+}
+
+int swiss_key_equal(struct typecheck_memo_t * a, struct typecheck_memo_t * b) {
+	return a->tag.crc32 == b->tag.crc32 && a->context == b->context;
+}
+
+// entry of a name defined outside of the checker, or 0
+typedef struct typecheck_entry_t * (*typecheck_resolve_t)(void * arg, struct name_t * name);
+
+typedef struct typecheck_t {
+	struct arena_t * arena;
+
+	// normalizes the types of the conversions, its values are in nbe_arena,
+	// reset after each conversion, and its tables in arena
+	struct arena_t * nbe_arena;
+	struct nbe_t nbe;
+
+	// innermost entry last
+	unsigned size;
+	unsigned capacity;
+	struct typecheck_entry_t * entries;
+
+	// index of the innermost entry of each name
+	swiss_table_t<name_t*, int> scope;
+
+	// consulted for the names that are not in scope
+	typecheck_resolve_t resolve;
+	void * resolve_arg;
+
+	// the type of Type
+	struct ast_t * universe;
+
+	// definition being checked, for the error messages
+	struct name_t * definition;
+
+	// inferred type of the last program when it is an expression, in the arena
+	struct ast_t * type;
+
+	int failed;
+	char error[256];
+
+	// implicit arguments are elaborated, unbound names of signatures otherwise
+	int implicits;
+	struct meta_store_t metas;
+
+	// metavariables made before the current definition
+	unsigned definition_metas;
+
+	// entries pushed since typecheck_init
+	unsigned long serials;
+
+	// inferred types, used as a set of entries keyed by tag and context
+	int memoize;
+	swiss_table_t<typecheck_memo_t*, char> memo;
+
+	// closure of the free names while hashing a context
+	swiss_table_t<name_t*, char> visited;
+	unsigned pending_size;
+	unsigned pending_capacity;
+	struct name_t ** pending;
+
+	unsigned long memo_hits;
+	unsigned long memo_misses;
+	unsigned long memo_collisions;
+	unsigned long memo_normal_hits;
+
+	unsigned long conversions;
+	unsigned long tag_hits;
+	unsigned long normalizations;
+} typecheck_t;
+
+void typecheck_init(struct typecheck_t * checker) {
+	checker->arena = arena_create(TYPECHECK_ARENA_BLOCK_SIZE);
+	checker->nbe_arena = arena_create(NBE_ARENA_BLOCK_SIZE);
+
+	checker->size = 0;
+	checker->capacity = 0;
+	checker->entries = 0;
+
+	checker->resolve = 0;
+	checker->resolve_arg = 0;
+
+	checker->universe = 0;
+	checker->definition = 0;
+	checker->type = 0;
+
+	checker->failed = 0;
+	checker->error[0] = 0;
+
+	checker->conversions = 0;
+	checker->tag_hits = 0;
+	checker->normalizations = 0;
+
+	checker->serials = 0;
+
+	checker->memoize = 1;
+	checker->implicits = 1;
+
+	meta_store_init(&checker->metas);
+	checker->definition_metas = 0;
+
+	checker->memo_hits = 0;
+	checker->memo_misses = 0;
+	checker->memo_collisions = 0;
+	checker->memo_normal_hits = 0;
+}
+
+void typecheck_destroy(struct typecheck_t * checker) {
+	arena_destroy(checker->arena);
+	arena_destroy(checker->nbe_arena);
+}
+
+// records the first error, later ones are consequences of it
+void typecheck_error(struct typecheck_t * checker, const char * format, ...) {
+	if(checker->failed) return;
+
+	checker->failed = 1;
+
+	int length = 0;
+
+	if(checker->definition) {
+		length = snprintf(checker->error, sizeof(checker->error), "in %s: ", name_get_str(checker->definition));
+	}
+
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(checker->error + length, sizeof(checker->error) - length, format, args);
+	va_end(args);
+}
+
+void typecheck_push_entry(struct typecheck_t * checker, struct typecheck_entry_t * entry) {
+	if(checker->size == checker->capacity) {
+		checker->capacity = checker->capacity ? checker->capacity * 2 : 64;
+		checker->entries = (struct typecheck_entry_t*)memory_realloc(checker->entries, sizeof(struct typecheck_entry_t) * checker->capacity);
+	}
+
+	int * innermost = swiss_table_get(&checker->scope, entry->name);
+
+	checker->entries[checker->size] = *entry;
+	checker->entries[checker->size].shadowed = innermost ? *innermost : -1;
+	checker->entries[checker->size].serial = ++checker->serials;
+
+	if(innermost) {
+		*innermost = checker->size;
+	} else {
+		swiss_table_insert(&checker->scope, entry->name, (int)checker->size);
+	}
+
+	checker->size += 1;
+}
+
+void typecheck_entry_init(struct typecheck_entry_t * entry, struct name_t * name, struct ast_t * type, struct ast_t * value) {
+	entry->name = name;
+	entry->type = type;
+	entry->value = value;
+	entry->shadowed = -1;
+	entry->serial = 0;
+	entry->implicit_count = 0;
+	entry->implicits = 0;
+	entry->implicit_types = 0;
+}
+
+void typecheck_push(struct typecheck_t * checker, struct name_t * name, struct ast_t * type, struct ast_t * value) {
+	struct typecheck_entry_t entry;
+
+	typecheck_entry_init(&entry, name, type, value);
+	typecheck_push_entry(checker, &entry);
+}
+
+void typecheck_pop(struct typecheck_t * checker) {
+	struct typecheck_entry_t * entry = &checker->entries[--checker->size];
+
+	if(entry->shadowed == -1) {
+		swiss_table_remove(&checker->scope, entry->name, (struct name_t**)0, (int*)0);
+	} else {
+		*swiss_table_get(&checker->scope, entry->name) = entry->shadowed;
+	}
+}
+
+struct typecheck_entry_t * typecheck_lookup(struct typecheck_t * checker, struct name_t * name) {
+	int * innermost = swiss_table_get(&checker->scope, name);
+
+	if(innermost) return &checker->entries[*innermost];
+
+	return checker->resolve ? checker->resolve(checker->resolve_arg, name) : 0;
+}
+
+// fills the fv_to_ctx_map of ast and its subterms with their free names, the
+// type of a binder is outside of its scope
+void typecheck_free_names(struct ast_t * ast) {
+	if(ast == 0 || ast->fv_to_ctx_map->complete) return;
+
+	ast->fv_to_ctx_map->complete = 1;
+
+	// the maps of ast_hash hold the free names already
+	if(ast->fv_to_ctx_map->size) return;
+
+	typecheck_free_names(ast->lhs);
+	typecheck_free_names(ast->rhs);
+
+	if(ast->kind == VAR) {
+		name_name_map_add(ast->fv_to_ctx_map, name_copy(ast->name), name_copy(ast->name));
+		return;
+	}
+
+	// only the lets of a program are looked at, the names free in the rest of
+	// every statement would make the maps quadratic
+	if(ast->kind == STATEMENT) return;
+
+	struct name_t * binder = 0;
+
+	if(ast->kind == LAMBDA || (ast->kind == ARROW_TYPE && ast->lhs->kind == BIND)) {
+		binder = ast->lhs->kind == BIND ? ast->lhs->lhs->name : ast->lhs->name;
+	}
+
+	struct ast_t * children[2] = { ast->lhs, ast->rhs };
+
+	for(unsigned c = 0; c < 2; c++) {
+		if(children[c] == 0) continue;
+
+		// the variable of a BIND and the binder of an unannotated lambda
+		if(c == 0 && (ast->kind == BIND || (ast->kind == LAMBDA && children[c]->kind == VAR))) continue;
+
+		struct name_name_map_t * map = children[c]->fv_to_ctx_map;
+
+		for(unsigned i = 0; i < map->capacity; i++) {
+			struct name_t * name = map->keys[i];
+
+			if(name == 0 || (c == 1 && binder && name_equal(name, binder))) continue;
+
+			// the pattern variables of a case are bound in both of its children
+			if(ast->kind == CASE && ast_case_binds(ast, name)) continue;
+
+			if(name_name_map_get(ast->fv_to_ctx_map, name) == 0) {
+				name_name_map_add(ast->fv_to_ctx_map, name_copy(name), name_copy(name));
+			}
+		}
+	}
+}
+
+struct ast_t * typecheck_hashed(struct ast_t * type) {
+	ast_hash(type);
+	typecheck_free_names(type);
+	return type;
+}
+
+int ast_is_pi(struct ast_t * type) {
+	return type->kind == ARROW_TYPE && type->lhs->kind == BIND;
+}
+
+// (x:domain) -> codomain, or domain -> codomain when x does not occur, so
+// that both spellings of a non dependent function type are the same term
+struct ast_t * typecheck_pi(struct name_t * x, struct ast_t * domain, struct ast_t * codomain) {
+	if(!ast_occurs_free(codomain, x)) {
+		return ast_node(ARROW_TYPE, domain, codomain);
+	}
+
+	return ast_node(ARROW_TYPE, ast_node(BIND, var(name_get_str(x)), domain), codomain);
+}
+
+// Rewrites the bindings x:(A -> B) the parser builds in type positions into
+// the Pi types (x:A) -> B, and the Pi types whose binder does not occur into
+// arrows. The BIND nodes of lambdas and lets are left alone.
+void typecheck_elaborate(struct typecheck_t * checker, struct ast_t ** slot) {
+	struct ast_t * ast = *slot;
+
+	if(ast == 0) return;
+
+	if(ast->kind == BIND) {
+		struct ast_t * arrow = ast->rhs;
+
+		if(arrow == 0 || arrow->kind != ARROW_TYPE || arrow->lhs->kind == BIND) {
+			typecheck_error(checker, "%s is bound in a type but not to a function type", name_get_str(ast->lhs->name));
+			return;
+		}
+
+		ast->rhs = arrow->lhs;
+		ast->rhs->parent = ast;
+
+		arrow->lhs = ast;
+		arrow->parent = ast->parent;
+		ast->parent = arrow;
+
+		*slot = ast = arrow;
+	}
+
+	// the binding itself stays, its type is elaborated
+	int binding = ast->kind == LAMBDA || ast->kind == ASSIGNMENT || ast->kind == DECLARATION || ast_is_pi(ast);
+
+	if(binding && ast->lhs->kind == BIND) {
+		typecheck_elaborate(checker, &ast->lhs->rhs);
+	} else {
+		typecheck_elaborate(checker, &ast->lhs);
+	}
+
+	typecheck_elaborate(checker, &ast->rhs);
+
+	if(ast_is_pi(ast) && !ast_occurs_free(ast->rhs, ast->lhs->lhs->name)) {
+		ast->lhs = ast->lhs->rhs;
+		ast->lhs->parent = ast;
+	}
+}
+
+// ast with the definitions in scope unfolded, ast itself if none occurs. Their
+// values are normal forms of unfolded terms, a single pass over the free names
+// is enough.
+struct ast_t * typecheck_unfold(struct typecheck_t * checker, struct ast_t * ast) {
+	struct ast_t * result = ast;
+
+	typecheck_free_names(ast);
+
+	struct name_name_map_t * names = ast->fv_to_ctx_map;
+
+	for(unsigned i = 0; i < names->capacity; i++) {
+		if(names->keys[i] == 0) continue;
+
+		struct typecheck_entry_t * entry = typecheck_lookup(checker, names->keys[i]);
+
+		if(entry && entry->value) {
+			result = ast_substitute(result, entry->name, entry->value);
+		}
+	}
+
+	return result;
+}
+
+struct ast_t * typecheck_normalize(struct typecheck_t * checker, struct ast_t * ast) {
+	return nbe_normalize(&checker->nbe, typecheck_unfold(checker, meta_zonk(&checker->metas, ast)));
+}
+
+// 1 if the metavariables made by the current definition are in play
+int typecheck_has_metas(struct typecheck_t * checker) {
+	return checker->metas.count > checker->definition_metas;
+}
+
+// name of the binder of a LAMBDA or a Pi type
+struct name_t * typecheck_binder(struct ast_t * ast) {
+	return ast->lhs->kind == BIND ? ast->lhs->lhs->name : ast->lhs->name;
+}
+
+// Checks that root can be solved with solution: root does not occur in it and
+// its free names are entries in the scope of root, the names of the spine or
+// names bound inside solution. Variables bound by the unification are in
+// bound. Metavariables of solution are restricted to the scope of root, and
+// *ground is cleared if one is unsolved. A ground solution in scope is not
+// walked again, so solving a chain of metavariables one by one stays linear.
+int typecheck_solvable(struct typecheck_t * checker, unsigned root, struct ast_t * ast, struct name_t ** spine, unsigned spine_size, struct binder_stack_t * bound, struct binder_stack_t * locals, int * ground) {
+	if(ast == 0) return 1;
+
+	struct meta_store_t * metas = &checker->metas;
+
+	if(ast->kind == VAR) {
+		int index = meta_index(ast);
+
+		if(index != -1) {
+			unsigned other = meta_find(metas, index);
+
+			if(metas->solution[other]) {
+				if(metas->ground[other] && metas->scope[other] <= metas->scope[root]) return 1;
+
+				return typecheck_solvable(checker, root, metas->solution[other], spine, spine_size, bound, locals, ground);
+			}
+
+			if(other == root) return 0;
+
+			meta_set_scope(metas, other, metas->scope[root]);
+
+			*ground = 0;
+
+			return 1;
+		}
+
+		if(binder_stack_index_of(locals, ast->name) != -1) return 1;
+
+		for(unsigned i = 0; i < spine_size; i++) {
+			if(name_equal(spine[i], ast->name)) return 1;
+		}
+
+		if(binder_stack_index_of(bound, ast->name) != -1) return 0;
+
+		struct typecheck_entry_t * entry = typecheck_lookup(checker, ast->name);
+
+		// entries of the resolve hook are outside of the context
+		if(entry && entry >= checker->entries && entry < checker->entries + checker->size) {
+			return entry - checker->entries < metas->scope[root];
+		}
+
+		return 1;
+	}
+
+	if(ast_is_binder(ast)) {
+		if(ast->lhs->kind == BIND && !typecheck_solvable(checker, root, ast->lhs->rhs, spine, spine_size, bound, locals, ground)) return 0;
+
+		binder_stack_push(locals, typecheck_binder(ast));
+
+		int solvable = typecheck_solvable(checker, root, ast->rhs, spine, spine_size, bound, locals, ground);
+
+		binder_stack_pop(locals);
+
+		return solvable;
+	}
+
+	return typecheck_solvable(checker, root, ast->lhs, spine, spine_size, bound, locals, ground) && typecheck_solvable(checker, root, ast->rhs, spine, spine_size, bound, locals, ground);
+}
+
+struct ast_t * typecheck_function_type(struct typecheck_t * checker, struct ast_t * type);
+
+// solves root with fn spine. solution, the binders are annotated with the
+// domains of the type of root
+int typecheck_solve(struct typecheck_t * checker, unsigned root, struct name_t ** spine, unsigned spine_size, struct ast_t * solution, struct binder_stack_t * bound) {
+	struct binder_stack_t locals;
+
+	binder_stack_init(&locals);
+
+	int ground = 1;
+
+	int solvable = typecheck_solvable(checker, root, solution, spine, spine_size, bound, &locals, &ground);
+
+	binder_stack_destroy(&locals);
+
+	if(!solvable) return 0;
+
+	if(spine_size) {
+		struct ast_t ** domains = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * spine_size);
+
+		struct ast_t * type = checker->metas.type[root];
+
+		for(unsigned i = 0; i < spine_size; i++) {
+			struct ast_t * pi = type ? typecheck_function_type(checker, type) : 0;
+
+			if(pi == 0) {
+				memory_free(domains);
+				return 0;
+			}
+
+			if(ast_is_pi(pi)) {
+				domains[i] = pi->lhs->rhs;
+				type = typecheck_hashed(ast_substitute(pi->rhs, pi->lhs->lhs->name, var(name_get_str(spine[i]))));
+			} else {
+				domains[i] = pi->lhs;
+				type = pi->rhs;
+			}
+		}
+
+		solution = ast_copy(solution);
+
+		for(unsigned i = spine_size; i > 0; i--) {
+			solution = ast_node(LAMBDA, ast_node(BIND, var(name_get_str(spine[i - 1])), ast_copy(domains[i - 1])), solution);
+		}
+
+		memory_free(domains);
+
+		typecheck_hashed(solution);
+	}
+
+	meta_assign(&checker->metas, root, solution, ground);
+
+	return 1;
+}
+
+// head of the spine of applications of ast
+struct ast_t * typecheck_spine_head(struct typecheck_t * checker, struct ast_t * ast) {
+	while(ast->kind == APP) {
+		ast = ast->lhs;
+	}
+
+	return meta_force(&checker->metas, ast);
+}
+
+int typecheck_unify(struct typecheck_t * checker, struct ast_t * a, struct ast_t * b, struct binder_stack_t * as, struct binder_stack_t * bs);
+
+// Unifies a metavariable applied to arguments with other. When the arguments
+// are distinct variables bound by the unification or by the context after the
+// metavariable was made, it is a pattern and the metavariable is solved with a
+// function of them. Otherwise the constraint waits, outside of binders only.
+int typecheck_unify_flex(struct typecheck_t * checker, struct ast_t * flex, struct ast_t * other, struct binder_stack_t * fs, struct binder_stack_t * os) {
+	struct meta_store_t * metas = &checker->metas;
+
+	unsigned root = meta_find(metas, meta_index(typecheck_spine_head(checker, flex)));
+
+	unsigned spine_size = 0;
+
+	for(struct ast_t * node = flex; node->kind == APP; node = node->lhs) {
+		spine_size += 1;
+	}
+
+	struct name_t ** spine = (struct name_t**)memory_alloc(sizeof(struct name_t*) * spine_size);
+
+	int pattern = 1;
+
+	struct ast_t * node = flex;
+
+	for(unsigned i = spine_size; i > 0 && pattern; i--, node = node->lhs) {
+		struct ast_t * arg = meta_force(metas, node->rhs);
+
+		pattern = arg->kind == VAR && meta_index(arg) == -1;
+
+		if(!pattern) break;
+
+		int index = binder_stack_index_of(fs, arg->name);
+
+		if(index != -1) {
+			// the same variable on the side of other
+			spine[i - 1] = os->names[os->size - 1 - index];
+		} else {
+			struct typecheck_entry_t * entry = typecheck_lookup(checker, arg->name);
+
+			pattern = entry && entry >= checker->entries && entry - checker->entries >= metas->scope[root];
+
+			spine[i - 1] = arg->name;
+		}
+	}
+
+	for(unsigned i = 0; i < spine_size && pattern; i++) {
+		for(unsigned j = i + 1; j < spine_size && pattern; j++) {
+			pattern = !name_equal(spine[i], spine[j]);
+		}
+	}
+
+	if(pattern) {
+		return typecheck_solve(checker, root, spine, spine_size, other, os);
+	}
+
+	if(fs->size || os->size) return 0;
+
+	meta_postpone(metas, root, flex, other);
+
+	return 1;
+}
+
+// syntactic unification, up to the names of the bound variables
+int typecheck_unify(struct typecheck_t * checker, struct ast_t * a, struct ast_t * b, struct binder_stack_t * as, struct binder_stack_t * bs) {
+	struct meta_store_t * metas = &checker->metas;
+
+	a = meta_force(metas, a);
+	b = meta_force(metas, b);
+
+	int ma = meta_index(a);
+	int mb = meta_index(b);
+
+	if(ma != -1 && mb != -1) {
+		meta_union(metas, meta_find(metas, ma), meta_find(metas, mb));
+		return 1;
+	}
+
+	if(ma != -1) return typecheck_solve(checker, meta_find(metas, ma), 0, 0, b, bs);
+	if(mb != -1) return typecheck_solve(checker, meta_find(metas, mb), 0, 0, a, as);
+
+	if(a->kind == APP && meta_index(typecheck_spine_head(checker, a)) != -1) {
+		return typecheck_unify_flex(checker, a, b, as, bs);
+	}
+
+	if(b->kind == APP && meta_index(typecheck_spine_head(checker, b)) != -1) {
+		return typecheck_unify_flex(checker, b, a, bs, as);
+	}
+
+	if(a->kind != b->kind) return 0;
+
+	if(a->kind == VAR) {
+		int ia = binder_stack_index_of(as, a->name);
+		int ib = binder_stack_index_of(bs, b->name);
+
+		return ia == ib && (ia != -1 || name_equal(a->name, b->name));
+	}
+
+	if(a->kind == APP) {
+		return typecheck_unify(checker, a->lhs, b->lhs, as, bs) && typecheck_unify(checker, a->rhs, b->rhs, as, bs);
+	}
+
+	if(ast_is_binder(a) != ast_is_binder(b)) return 0;
+
+	if(!ast_is_binder(a)) {
+		if(a->kind != ARROW_TYPE) return 0;
+
+		return typecheck_unify(checker, a->lhs, b->lhs, as, bs) && typecheck_unify(checker, a->rhs, b->rhs, as, bs);
+	}
+
+	if((a->lhs->kind == BIND) != (b->lhs->kind == BIND)) return 0;
+
+	if(a->lhs->kind == BIND && !typecheck_unify(checker, a->lhs->rhs, b->lhs->rhs, as, bs)) return 0;
+
+	binder_stack_push(as, typecheck_binder(a));
+	binder_stack_push(bs, typecheck_binder(b));
+
+	int unified = typecheck_unify(checker, a->rhs, b->rhs, as, bs);
+
+	binder_stack_pop(as);
+	binder_stack_pop(bs);
+
+	return unified;
+}
+
+// unifies a and b, then the constraints their solutions woke up
+int typecheck_unify_types(struct typecheck_t * checker, struct ast_t * a, struct ast_t * b) {
+	struct meta_store_t * metas = &checker->metas;
+
+	struct binder_stack_t as;
+	struct binder_stack_t bs;
+
+	binder_stack_init(&as);
+	binder_stack_init(&bs);
+
+	if(!typecheck_unify(checker, a, b, &as, &bs)) return 0;
+
+	while(metas->woken_size) {
+		int constraint = metas->woken[--metas->woken_size];
+
+		while(constraint != -1) {
+			int next = metas->constraints[constraint].next;
+
+			if(metas->constraints[constraint].active) {
+				meta_deactivate(metas, constraint);
+
+				struct ast_t * lhs = metas->constraints[constraint].lhs;
+				struct ast_t * rhs = metas->constraints[constraint].rhs;
+
+				if(!typecheck_unify(checker, lhs, rhs, &as, &bs)) return 0;
+			}
+
+			constraint = next;
+		}
+	}
+
+	return 1;
+}
+
+// definitional equality of two hashed types
+int typecheck_convertible(struct typecheck_t * checker, struct ast_t * a, struct ast_t * b) {
+	checker->conversions += 1;
+
+	if(a->tag.crc32 == b->tag.crc32 && (TYPECHECK_TRUST_TAGS || ast_alpha_equivalent(a, b))) {
+		checker->tag_hits += 1;
+		return 1;
+	}
+
+	if(typecheck_has_metas(checker)) {
+		struct meta_mark_t mark = meta_mark(&checker->metas);
+
+		if(typecheck_unify_types(checker, a, b)) {
+			meta_commit(&checker->metas);
+			return 1;
+		}
+
+		meta_undo(&checker->metas, mark);
+
+		checker->normalizations += 1;
+
+		return typecheck_unify_types(checker, typecheck_normalize(checker, a), typecheck_normalize(checker, b));
+	}
+
+	checker->normalizations += 1;
+
+	return ast_alpha_equivalent(typecheck_normalize(checker, a), typecheck_normalize(checker, b));
+}
+
+// type itself if it is a Pi type or an arrow, or its normal form if that is
+struct ast_t * typecheck_function_type(struct typecheck_t * checker, struct ast_t * type) {
+	type = meta_force(&checker->metas, type);
+
+	if(type->kind == ARROW_TYPE) return type;
+
+	struct ast_t * normal = typecheck_normalize(checker, type);
+
+	if(normal->kind == ARROW_TYPE) return typecheck_hashed(normal);
+
+	return 0;
+}
+
+void typecheck_pending_push(struct typecheck_t * checker, struct name_name_map_t * names) {
+	for(unsigned i = 0; i < names->capacity; i++) {
+		if(names->keys[i] == 0) continue;
+
+		if(checker->pending_size == checker->pending_capacity) {
+			checker->pending_capacity = checker->pending_capacity ? checker->pending_capacity * 2 : 64;
+			checker->pending = (struct name_t**)memory_realloc(checker->pending, sizeof(struct name_t*) * checker->pending_capacity);
+		}
+
+		checker->pending[checker->pending_size++] = names->keys[i];
+	}
+}
+
+// murmur3 64 bit finalizer
+unsigned long typecheck_mix(unsigned long seed, unsigned long value) {
+	unsigned long x = seed ^ value;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdul;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ul;
+	x ^= x >> 33;
+
+	return x;
+}
+
+// the entry itself rather than what its type looks like: its serial if the
+// checker holds it, its address if it was resolved outside, and the nodes of
+// its type and value, which are replaced when metavariables are solved
+unsigned long typecheck_entry_identity(struct typecheck_t * checker, struct typecheck_entry_t * entry) {
+	int local = entry >= checker->entries && entry < checker->entries + checker->size;
+
+	unsigned long h = local ? entry->serial : (unsigned long)entry | (1ul << 63);
+
+	h = typecheck_mix(h, (unsigned long)entry->type);
+	h = typecheck_mix(h, (unsigned long)entry->value);
+
+	return h;
+}
+
+// Hash of the entries ast depends on, by identity, so two contexts only share
+// a key when they hold the same entries. Tags would not do, types with equal
+// tags are not always convertible. The names are visited in any order, their
+// contributions are summed.
+unsigned long typecheck_context_hash(struct typecheck_t * checker, struct ast_t * ast) {
+	swiss_table_clear(&checker->visited);
+
+	checker->pending_size = 0;
+
+	typecheck_pending_push(checker, ast->fv_to_ctx_map);
+
+	unsigned long result = 0;
+
+	while(checker->pending_size) {
+		struct name_t * name = checker->pending[--checker->pending_size];
+
+		if(!swiss_table_insert(&checker->visited, name, (char)1)) continue;
+
+		struct typecheck_entry_t * entry = typecheck_lookup(checker, name);
+
+		unsigned long h = typecheck_mix(name->hash.crc32, entry ? typecheck_entry_identity(checker, entry) : 0);
+
+		if(entry) {
+			typecheck_pending_push(checker, entry->type->fv_to_ctx_map);
+
+			if(entry->value) typecheck_pending_push(checker, entry->value->fv_to_ctx_map);
+		}
+
+		result += typecheck_mix(h, 0x9e3779b97f4a7c15ul);
+	}
+
+	return result;
+}
+
+struct typecheck_memo_t * typecheck_memo_find(struct typecheck_t * checker, struct ast_t * ast, unsigned long context) {
+	struct typecheck_memo_t probe;
+
+	probe.tag = ast->tag;
+	probe.context = context;
+
+	int slot = swiss_table_find(&checker->memo, &probe);
+
+	if(slot == -1) return 0;
+
+	struct typecheck_memo_t * memo = checker->memo.keys[slot];
+
+	if(!TYPECHECK_TRUST_TAGS && !ast_alpha_equivalent(memo->term, ast)) {
+		checker->memo_collisions += 1;
+		return 0;
+	}
+
+	return memo;
+}
+
+// memoized type of ast in the current context or 0
+struct ast_t * typecheck_memo_get(struct typecheck_t * checker, struct ast_t * ast, unsigned long context) {
+	struct typecheck_memo_t * memo = typecheck_memo_find(checker, ast, context);
+
+	if(memo == 0) {
+		checker->memo_misses += 1;
+		return 0;
+	}
+
+	checker->memo_hits += 1;
+
+	return memo->type;
+}
+
+void typecheck_memo_put(struct typecheck_t * checker, struct ast_t * ast, unsigned long context, struct ast_t * type) {
+	struct typecheck_memo_t * memo = (struct typecheck_memo_t*)memory_alloc(sizeof(struct typecheck_memo_t));
+
+	memo->tag = ast->tag;
+	memo->context = context;
+	memo->term = ast;
+	memo->type = type;
+	memo->normal = 0;
+
+	// a colliding term keeps the slot
+	swiss_table_insert(&checker->memo, memo, (char)1);
+}
+
+struct ast_t * typecheck_infer(struct typecheck_t * checker, struct ast_t * ast);
+int typecheck_check(struct typecheck_t * checker, struct ast_t * ast, struct ast_t * type);
+
+int typecheck_check_type(struct typecheck_t * checker, struct ast_t * ast) {
+	return typecheck_check(checker, ast, checker->universe);
+}
+
+// copy of ast with the free implicit arguments of entry replaced by metas
+struct ast_t * typecheck_instantiate_copy(struct typecheck_entry_t * entry, struct ast_t ** metas, struct ast_t * ast, struct binder_stack_t * locals) {
+	if(ast == 0) return 0;
+
+	if(ast->kind == VAR) {
+		if(binder_stack_index_of(locals, ast->name) == -1) {
+			for(unsigned i = 0; i < entry->implicit_count; i++) {
+				if(name_equal(entry->implicits[i], ast->name)) return ast_copy(metas[i]);
+			}
+		}
+
+		return ast_copy(ast);
+	}
+
+	if(ast_is_binder(ast)) {
+		struct ast_t * binding = ast->lhs;
+
+		if(binding->kind == BIND) {
+			binding = ast_node(BIND, ast_copy(binding->lhs), typecheck_instantiate_copy(entry, metas, binding->rhs, locals));
+		} else {
+			binding = ast_copy(binding);
+		}
+
+		binder_stack_push(locals, typecheck_binder(ast));
+
+		struct ast_t * body = typecheck_instantiate_copy(entry, metas, ast->rhs, locals);
+
+		binder_stack_pop(locals);
+
+		return ast_node(ast->kind, binding, body);
+	}
+
+	struct ast_t * copy = ast_node(ast->kind, typecheck_instantiate_copy(entry, metas, ast->lhs, locals), typecheck_instantiate_copy(entry, metas, ast->rhs, locals));
+
+	if(ast->name) {
+		copy->name = name_copy(ast->name);
+	}
+
+	return copy;
+}
+
+// type of a use of entry, with fresh metavariables for its implicit arguments
+struct ast_t * typecheck_instantiate(struct typecheck_t * checker, struct typecheck_entry_t * entry) {
+	if(entry->implicit_count == 0) return entry->type;
+
+	struct ast_t ** metas = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * entry->implicit_count);
+
+	for(unsigned i = 0; i < entry->implicit_count; i++) {
+		metas[i] = typecheck_hashed(meta_fresh(&checker->metas, 0, checker->size));
+	}
+
+	struct binder_stack_t locals;
+
+	binder_stack_init(&locals);
+
+	// the type of an implicit argument may mention the others
+	for(unsigned i = 0; i < entry->implicit_count; i++) {
+		struct ast_t * type = typecheck_instantiate_copy(entry, metas, entry->implicit_types[i], &locals);
+
+		checker->metas.type[meta_index(metas[i])] = typecheck_hashed(type);
+	}
+
+	return typecheck_hashed(typecheck_instantiate_copy(entry, metas, entry->type, &locals));
+}
+
+struct ast_t * typecheck_infer_term(struct typecheck_t * checker, struct ast_t * ast) {
+	if(ast->kind == VAR) {
+		int meta = meta_index(ast);
+
+		if(meta != -1) return checker->metas.type[meta];
+
+		struct typecheck_entry_t * entry = typecheck_lookup(checker, ast->name);
+
+		if(entry) return typecheck_instantiate(checker, entry);
+
+		if(strcmp(name_get_str(ast->name), "Type") == 0) return checker->universe;
+
+		typecheck_error(checker, "unbound variable %s", name_get_str(ast->name));
+
+		return 0;
+	}
+
+	if(ast->kind == APP) {
+		struct ast_t * function = typecheck_infer(checker, ast->lhs);
+
+		if(function == 0) return 0;
+
+		struct ast_t * pi = typecheck_function_type(checker, function);
+
+		if(pi == 0) {
+			typecheck_error(checker, "applying a term whose type is not a function type");
+			return 0;
+		}
+
+		struct ast_t * domain = ast_is_pi(pi) ? pi->lhs->rhs : pi->lhs;
+
+		if(!typecheck_check(checker, ast->rhs, domain)) return 0;
+
+		if(!ast_is_pi(pi)) return pi->rhs;
+
+		return typecheck_hashed(ast_substitute(pi->rhs, pi->lhs->lhs->name, ast->rhs));
+	}
+
+	if(ast->kind == LAMBDA) {
+		if(ast->lhs->kind != BIND) {
+			typecheck_error(checker, "cannot infer the type of %s without an annotation", name_get_str(ast->lhs->name));
+			return 0;
+		}
+
+		struct ast_t * domain = ast->lhs->rhs;
+
+		if(!typecheck_check_type(checker, domain)) return 0;
+
+		typecheck_push(checker, ast->lhs->lhs->name, domain, 0);
+
+		struct ast_t * codomain = typecheck_infer(checker, ast->rhs);
+
+		typecheck_pop(checker);
+
+		if(codomain == 0) return 0;
+
+		return typecheck_hashed(typecheck_pi(ast->lhs->lhs->name, ast_copy(domain), ast_copy(codomain)));
+	}
+
+	if(ast->kind == ARROW_TYPE) {
+		if(ast_is_pi(ast)) {
+			if(!typecheck_check_type(checker, ast->lhs->rhs)) return 0;
+
+			typecheck_push(checker, ast->lhs->lhs->name, ast->lhs->rhs, 0);
+
+			int checked = typecheck_check_type(checker, ast->rhs);
+
+			typecheck_pop(checker);
+
+			return checked ? checker->universe : 0;
+		}
+
+		if(!typecheck_check_type(checker, ast->lhs) || !typecheck_check_type(checker, ast->rhs)) return 0;
+
+		return checker->universe;
+	}
+
+	if(ast->kind == CASE_LIST) {
+		typecheck_error(checker, "cannot infer the type of a case list without a signature");
+		return 0;
+	}
+
+	typecheck_error(checker, "cannot infer the type of this term");
+
+	return 0;
+}
+
+struct ast_t * typecheck_infer(struct typecheck_t * checker, struct ast_t * ast) {
+	if(checker->failed) return 0;
+
+	// a lookup costs more than inferring a variable, and the types found with
+	// metavariables may still be undone
+	if(!checker->memoize || ast->kind == VAR || typecheck_has_metas(checker)) {
+		return typecheck_infer_term(checker, ast);
+	}
+
+	unsigned long context = typecheck_context_hash(checker, ast);
+
+	struct ast_t * type = typecheck_memo_get(checker, ast, context);
+
+	if(type) return type;
+
+	type = typecheck_infer_term(checker, ast);
+
+	if(type && !typecheck_has_metas(checker)) {
+		typecheck_memo_put(checker, ast, context, type);
+	}
+
+	return type;
+}
+
+// Copy of pattern with its wildcards named _#1, _#2 and so on from *count,
+// names no program can write. The type of the rest of the arguments may
+// depend on what a wildcard matches.
+struct ast_t * typecheck_name_wildcards(struct ast_t * pattern, unsigned * count) {
+	if(pattern->kind == VAR && ast_is_wildcard(pattern->name)) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "_#%u", ++*count);
+
+		return var(name);
+	}
+
+	if(pattern->kind == VAR) return var(name_get_str(pattern->name));
+
+	return ast_node(pattern->kind, typecheck_name_wildcards(pattern->lhs, count), typecheck_name_wildcards(pattern->rhs, count));
+}
+
+// codomain of the function type pi for the argument matched by pattern
+struct ast_t * typecheck_pattern_codomain(struct ast_t * pi, struct ast_t * pattern) {
+	if(!ast_is_pi(pi)) return pi->rhs;
+
+	return typecheck_hashed(ast_substitute(pi->rhs, pi->lhs->lhs->name, pattern));
+}
+
+// Checks that pattern matches values of type, pushing an entry for each of
+// its variables and named wildcards, defined as a metavariable. The entries
+// from base are those of the current case.
+int typecheck_pattern(struct typecheck_t * checker, struct ast_t * pattern, struct ast_t * type, unsigned base) {
+	if(pattern->kind == VAR && !ast_is_constructor(pattern->name)) {
+		for(unsigned i = base; i < checker->size; i++) {
+			if(name_equal(checker->entries[i].name, pattern->name)) {
+				typecheck_error(checker, "%s is bound twice in a case", name_get_str(pattern->name));
+				return 0;
+			}
+		}
+
+		// refined by the constructors matched after it
+		struct ast_t * value = typecheck_hashed(meta_fresh(&checker->metas, type, checker->size));
+
+		typecheck_push(checker, pattern->name, type, value);
+
+		return 1;
+	}
+
+	unsigned arity;
+
+	struct ast_t * head = case_pattern_head(pattern, &arity);
+
+	if(head->kind != VAR || !ast_is_constructor(head->name)) {
+		typecheck_error(checker, "a pattern applies something other than a constructor");
+		return 0;
+	}
+
+	struct typecheck_entry_t * entry = typecheck_lookup(checker, head->name);
+
+	if(entry == 0 || entry->value) {
+		typecheck_error(checker, "%s is not a constructor", name_get_str(head->name));
+		return 0;
+	}
+
+	struct ast_t * constructor = typecheck_instantiate(checker, entry);
+
+	// the fields, left to right
+	struct ast_t ** fields = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * (arity + 1));
+
+	struct ast_t * spine = pattern;
+
+	for(unsigned k = arity; k > 0; k--, spine = spine->lhs) {
+		fields[k - 1] = spine->rhs;
+	}
+
+	for(unsigned k = 0; k < arity; k++) {
+		struct ast_t * pi = typecheck_function_type(checker, constructor);
+
+		if(pi == 0) {
+			typecheck_error(checker, "%s is matched with too many fields", name_get_str(head->name));
+			return 0;
+		}
+
+		if(!typecheck_pattern(checker, fields[k], ast_is_pi(pi) ? pi->lhs->rhs : pi->lhs, base)) return 0;
+
+		constructor = typecheck_pattern_codomain(pi, fields[k]);
+	}
+
+	if(!typecheck_convertible(checker, constructor, type)) {
+		typecheck_error(checker, "the pattern %s does not have the type of the value it matches", name_get_str(head->name));
+		return 0;
+	}
+
+	return 1;
+}
+
+// The pattern variables of a case, from base, and the metavariables made
+// while checking its patterns, from first, that the patterns did not solve
+// stand for themselves in the body. The others are defined as their solution.
+void typecheck_case_scope(struct typecheck_t * checker, unsigned base, unsigned first) {
+	struct meta_store_t * metas = &checker->metas;
+
+	for(unsigned i = base; i < checker->size; i++) {
+		struct typecheck_entry_t * entry = &checker->entries[i];
+
+		unsigned root = meta_find(metas, meta_index(entry->value));
+
+		if(metas->solution[root] == 0) {
+			meta_assign(metas, root, typecheck_hashed(var(name_get_str(entry->name))), 1);
+		}
+	}
+
+	for(unsigned i = first; i < metas->count; i++) {
+		unsigned root = meta_find(metas, i);
+
+		if(metas->solution[root] == 0) {
+			char name[16];
+
+			snprintf(name, sizeof(name), "_#%u", i);
+
+			meta_assign(metas, root, typecheck_hashed(var(name)), 1);
+		}
+	}
+
+	for(unsigned i = base; i < checker->size; i++) {
+		struct typecheck_entry_t * entry = &checker->entries[i];
+
+		struct ast_t * value = meta_zonk(metas, entry->value);
+
+		entry->value = value->kind == VAR && name_equal(value->name, entry->name) ? 0 : typecheck_hashed(value);
+	}
+}
+
+// Checks every case of a list against type, a function type of as many
+// arguments as each case has patterns. The variables of the patterns are in
+// scope in the body, and the arguments the rest of the type depends on are
+// replaced by their patterns: in the case Succ k . xs against
+// (n:Nat) -> Vec A n -> B, xs has the type Vec A (Succ k). Matching a
+// constructor unifies the indices of its type with those expected, which
+// refines the pattern variables before it: in the case m . Empty against
+// (n:Nat) -> Vec A n -> B, m is Zero in the body.
+int typecheck_check_cases(struct typecheck_t * checker, struct ast_t * ast, struct ast_t * type) {
+	unsigned arity = 0;
+
+	for(struct ast_t * patterns = ast->lhs->lhs; patterns; patterns = patterns->rhs) {
+		arity += 1;
+	}
+
+	for(struct ast_t * list = ast; list; list = list->rhs) {
+		struct ast_t * match = list->lhs;
+		struct ast_t * remaining = type;
+
+		unsigned count = 0;
+
+		for(struct ast_t * patterns = match->lhs; patterns; patterns = patterns->rhs) {
+			count += 1;
+		}
+
+		if(count != arity) {
+			typecheck_error(checker, "the cases of a list have different numbers of patterns");
+			return 0;
+		}
+
+		unsigned base = checker->size;
+		unsigned first = checker->metas.count;
+
+		int checked = 1;
+
+		unsigned wildcards = 0;
+
+		for(struct ast_t * patterns = match->lhs; patterns && checked; patterns = patterns->rhs) {
+			struct ast_t * pattern = typecheck_name_wildcards(patterns->lhs, &wildcards);
+
+			struct ast_t * pi = typecheck_function_type(checker, remaining);
+
+			if(pi == 0) {
+				typecheck_error(checker, "a case has more patterns than its type has arguments");
+				checked = 0;
+				break;
+			}
+
+			checked = typecheck_pattern(checker, pattern, ast_is_pi(pi) ? pi->lhs->rhs : pi->lhs, base);
+
+			if(checked) {
+				remaining = typecheck_pattern_codomain(pi, pattern);
+			}
+		}
+
+		if(checked) {
+			typecheck_case_scope(checker, base, first);
+
+			checked = typecheck_check(checker, match->rhs, typecheck_hashed(meta_zonk(&checker->metas, remaining)));
+		}
+
+		while(checker->size > base) {
+			typecheck_pop(checker);
+		}
+
+		if(!checked) return 0;
+	}
+
+	return 1;
+}
+
+int typecheck_check(struct typecheck_t * checker, struct ast_t * ast, struct ast_t * type) {
+	if(checker->failed) return 0;
+
+	if(ast->kind == CASE_LIST) {
+		return typecheck_check_cases(checker, ast, type);
+	}
+
+	if(ast->kind != LAMBDA) {
+		struct ast_t * inferred = typecheck_infer(checker, ast);
+
+		if(inferred == 0) return 0;
+
+		if(!typecheck_convertible(checker, inferred, type)) {
+			typecheck_error(checker, "type mismatch");
+			return 0;
+		}
+
+		return 1;
+	}
+
+	struct ast_t * pi = typecheck_function_type(checker, type);
+
+	struct name_t * x = ast->lhs->kind == BIND ? ast->lhs->lhs->name : ast->lhs->name;
+
+	if(pi == 0) {
+		typecheck_error(checker, "fn %s is checked against a type that is not a function type", name_get_str(x));
+		return 0;
+	}
+
+	struct ast_t * domain = ast_is_pi(pi) ? pi->lhs->rhs : pi->lhs;
+	struct ast_t * codomain = pi->rhs;
+
+	unsigned long context = 0;
+
+	int memoize = checker->memoize && ast->lhs->kind == BIND && !typecheck_has_metas(checker);
+
+	if(memoize) {
+		context = typecheck_context_hash(checker, ast);
+
+		struct ast_t * memoized = typecheck_memo_get(checker, ast, context);
+
+		if(memoized) {
+			if(!typecheck_convertible(checker, memoized, type)) {
+				typecheck_error(checker, "type mismatch");
+				return 0;
+			}
+
+			return 1;
+		}
+	}
+
+	if(ast->lhs->kind == BIND) {
+		if(!typecheck_check_type(checker, ast->lhs->rhs)) return 0;
+
+		if(!typecheck_convertible(checker, ast->lhs->rhs, domain)) {
+			typecheck_error(checker, "the annotation of %s does not match the expected domain", name_get_str(x));
+			return 0;
+		}
+	}
+
+	struct name_t * y = ast_is_pi(pi) ? pi->lhs->lhs->name : 0;
+
+	struct ast_t * body = ast->rhs;
+
+	// the binder would capture a free variable of the codomain, rename it
+	if(!(y && name_equal(y, x)) && ast_occurs_free(codomain, x)) {
+		struct name_t * fresh = ast_fresh_name(x, codomain, body);
+
+		body = typecheck_hashed(ast_substitute(body, x, var(name_get_str(fresh))));
+		x = fresh;
+	}
+
+	if(y && !name_equal(y, x)) {
+		struct ast_t * bound = var(name_get_str(x));
+
+		codomain = typecheck_hashed(ast_substitute(codomain, y, bound));
+	}
+
+	typecheck_push(checker, x, domain, 0);
+
+	int checked = typecheck_check(checker, body, codomain);
+
+	typecheck_pop(checker);
+
+	// (x:A) -> B for the annotation A, where the body checked against B
+	if(checked && memoize && !typecheck_has_metas(checker)) {
+		struct ast_t * inferred = typecheck_pi(x, ast_copy(ast->lhs->rhs), ast_copy(codomain));
+
+		typecheck_memo_put(checker, ast, context, typecheck_hashed(inferred));
+	}
+
+	return checked;
+}
+
+// normal form of the value of a definition, shared by the copies of the same
+// value under the same entries
+struct ast_t * typecheck_value(struct typecheck_t * checker, struct ast_t * ast) {
+	struct typecheck_memo_t * memo = 0;
+
+	if(checker->memoize) {
+		memo = typecheck_memo_find(checker, ast, typecheck_context_hash(checker, ast));
+	}
+
+	if(memo && memo->normal) {
+		checker->memo_normal_hits += 1;
+		return memo->normal;
+	}
+
+	struct ast_t * normal = typecheck_hashed(typecheck_normalize(checker, ast));
+
+	if(memo) memo->normal = normal;
+
+	return normal;
+}
+
+// Clears the state of the previous program, with the arena of the checker
+// installed as the scratch allocator.
+void typecheck_reset(struct typecheck_t * checker) {
+	arena_reset(checker->arena);
+
+	checker->size = 0;
+	checker->capacity = 0;
+	checker->entries = 0;
+	checker->definition = 0;
+	checker->type = 0;
+	checker->failed = 0;
+	checker->error[0] = 0;
+
+	swiss_table_init(&checker->scope);
+	swiss_table_init(&checker->memo);
+	swiss_table_init(&checker->visited);
+
+	checker->pending_size = 0;
+	checker->pending_capacity = 0;
+	checker->pending = 0;
+
+	meta_store_init(&checker->metas);
+	checker->definition_metas = 0;
+
+	nbe_init_in(&checker->nbe, checker->nbe_arena);
+
+	checker->universe = typecheck_hashed(var("Type"));
+}
+
+// elaborated and hashed copy of program, 0 if it cannot be elaborated
+struct ast_t * typecheck_prepare(struct typecheck_t * checker, struct ast_t * program) {
+	struct ast_t * copy = ast_copy(program);
+
+	typecheck_elaborate(checker, &copy);
+
+	if(checker->failed) return 0;
+
+	return typecheck_hashed(copy);
+}
+
+// Collects the names the signature type uses without binding them, in order
+// of appearance, as the implicit arguments of entry.
+void typecheck_collect_implicits(struct typecheck_t * checker, struct typecheck_entry_t * entry, struct ast_t * ast, struct binder_stack_t * locals) {
+	if(ast == 0) return;
+
+	if(ast->kind == VAR) {
+		if(binder_stack_index_of(locals, ast->name) != -1 || meta_index(ast) != -1) return;
+		if(typecheck_lookup(checker, ast->name) || strcmp(name_get_str(ast->name), "Type") == 0) return;
+
+		for(unsigned i = 0; i < entry->implicit_count; i++) {
+			if(name_equal(entry->implicits[i], ast->name)) return;
+		}
+
+		entry->implicits = (struct name_t**)memory_realloc(entry->implicits, sizeof(struct name_t*) * (entry->implicit_count + 1));
+		entry->implicits[entry->implicit_count++] = ast->name;
+
+		return;
+	}
+
+	if(ast_is_binder(ast)) {
+		if(ast->lhs->kind == BIND) {
+			typecheck_collect_implicits(checker, entry, ast->lhs->rhs, locals);
+		}
+
+		binder_stack_push(locals, typecheck_binder(ast));
+		typecheck_collect_implicits(checker, entry, ast->rhs, locals);
+		binder_stack_pop(locals);
+
+		return;
+	}
+
+	typecheck_collect_implicits(checker, entry, ast->lhs, locals);
+	typecheck_collect_implicits(checker, entry, ast->rhs, locals);
+}
+
+// 1 when the free name x is the argument of an application in ast, as n in
+// Vec A n. Only such names are determined by the uses of a signature.
+int typecheck_is_argument(struct ast_t * ast, struct name_t * x) {
+	if(ast == 0 || ast->kind == VAR) return 0;
+
+	if(ast->kind == APP && ast->rhs->kind == VAR && name_equal(ast->rhs->name, x)) return 1;
+
+	if(ast_is_binder(ast)) {
+		if(ast->lhs->kind == BIND && typecheck_is_argument(ast->lhs->rhs, x)) return 1;
+
+		return !name_equal(typecheck_binder(ast), x) && typecheck_is_argument(ast->rhs, x);
+	}
+
+	return typecheck_is_argument(ast->lhs, x) || typecheck_is_argument(ast->rhs, x);
+}
+
+// Checks the type and the value of the let of a statement, with its implicit
+// arguments in scope. Fills entry with the normal form of the value, 0 for a
+// declaration, and the implicit arguments with their types.
+int typecheck_definition(struct typecheck_t * checker, struct ast_t * let, struct typecheck_entry_t * entry) {
+	struct ast_t * binding = let->lhs;
+
+	checker->definition = binding->lhs->name;
+	checker->definition_metas = checker->metas.count;
+
+	typecheck_entry_init(entry, binding->lhs->name, binding->rhs, 0);
+
+	if(checker->implicits) {
+		struct binder_stack_t locals;
+
+		binder_stack_init(&locals);
+
+		typecheck_collect_implicits(checker, entry, binding->rhs, &locals);
+
+		// a name no argument determines is a typo, not an implicit argument
+		for(unsigned i = 0; i < entry->implicit_count; i++) {
+			if(!typecheck_is_argument(binding->rhs, entry->implicits[i])) {
+				typecheck_error(checker, "unbound variable %s", name_get_str(entry->implicits[i]));
+				return 0;
+			}
+		}
+	}
+
+	entry->implicit_types = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * entry->implicit_count);
+
+	for(unsigned i = 0; i < entry->implicit_count; i++) {
+		entry->implicit_types[i] = typecheck_hashed(meta_fresh(&checker->metas, checker->universe, checker->size));
+
+		typecheck_push(checker, entry->implicits[i], entry->implicit_types[i], 0);
+	}
+
+	int checked = typecheck_check_type(checker, binding->rhs);
+
+	if(checked && let->kind == ASSIGNMENT) {
+		checked = typecheck_check(checker, let->rhs, binding->rhs);
+	}
+
+	for(unsigned i = 0; i < entry->implicit_count; i++) {
+		typecheck_pop(checker);
+	}
+
+	if(!checked) return 0;
+
+	struct meta_store_t * metas = &checker->metas;
+
+	for(unsigned i = 0; i < entry->implicit_count; i++) {
+		if(meta_unsolved_occurs(metas, entry->implicit_types[i])) {
+			typecheck_error(checker, "cannot infer the type of the implicit argument %s", name_get_str(entry->implicits[i]));
+			return 0;
+		}
+
+		entry->implicit_types[i] = typecheck_hashed(meta_zonk(metas, entry->implicit_types[i]));
+	}
+
+	if(meta_active_constraints(metas)) {
+		typecheck_error(checker, "unsolved constraints");
+		return 0;
+	}
+
+	for(unsigned i = checker->definition_metas; i < metas->count; i++) {
+		if(meta_solution(metas, i) == 0) {
+			typecheck_error(checker, "cannot infer an implicit argument");
+			return 0;
+		}
+	}
+
+	if(let->kind == ASSIGNMENT) {
+		entry->value = typecheck_value(checker, let->rhs);
+	}
+
+	checker->definition = 0;
+
+	return 1;
+}
+
+// Checks every statement of the program, or the expression, and returns 1 when
+// it is well typed. Otherwise the first error is in checker->error.
+int typecheck_program(struct typecheck_t * checker, struct ast_t * program) {
+	struct arena_t * scratch = memory_scratch;
+
+	memory_set_scratch(checker->arena);
+
+	typecheck_reset(checker);
+
+	struct ast_t * copy = typecheck_prepare(checker, program);
+
+	if(copy && copy->kind != STATEMENT) {
+		checker->type = typecheck_infer(checker, copy);
+	}
+
+	for(struct ast_t * statement = copy; statement && statement->kind == STATEMENT; statement = statement->rhs) {
+		struct typecheck_entry_t entry;
+
+		if(!typecheck_definition(checker, statement->lhs, &entry)) break;
+
+		typecheck_push_entry(checker, &entry);
+	}
+
+	checker->definition = 0;
+
+	memory_set_scratch(scratch);
+
+	return !checker->failed;
+}
+
+void typecheck_report(struct typecheck_t * checker, FILE * out) {
+	if(checker->failed) {
+		fprintf(out, "error:               %s\n", checker->error);
+	}
+
+	fprintf(out, "conversions:         %lu\n", checker->conversions);
+	fprintf(out, "tag hits:            %lu\n", checker->tag_hits);
+	fprintf(out, "normalizations:      %lu\n", checker->normalizations);
+
+	unsigned long lookups = checker->memo_hits + checker->memo_misses;
+
+	fprintf(out, "memo hits:           %lu\n", checker->memo_hits);
+	fprintf(out, "memo misses:         %lu\n", checker->memo_misses);
+	fprintf(out, "memo hit rate:       %.3f\n", lookups ? (double)checker->memo_hits / lookups : 0.0);
+	fprintf(out, "memo collisions:     %lu\n", checker->memo_collisions);
+	fprintf(out, "memo normal forms:   %lu\n", checker->memo_normal_hits);
+
+	meta_store_report(&checker->metas, out);
+}
+
+#endif
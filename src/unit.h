@@ -0,0 +1,676 @@
+#ifndef UNIT_H
+#define UNIT_H
+
+#include "alpha_equivalence.h"
+#include "ast.h"
+#include "ast_hash.h"
+#include "ast_serialize.h"
+#include "hash.h"
+#include "memory.h"
+#include "name.h"
+#include "parser.h"
+#include "swiss_table.h"
+#include "typecheck.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Separate compilation
+//
+// A build is a set of units, programs of lets that import other units. A unit
+// sees the definitions of the units it imports, directly or not, the last
+// unit of the build order first, and exports all of its own definitions: their
+// signatures with their implicit arguments, and the normal forms of their
+// values. Only the definitions of types and type families, whose type ends in
+// Type, unfold in the units that import them. The values of the others are
+// opaque outside of their unit, so the units that import it only depend on its
+// signatures and type definitions. The interface hash of a unit is the hash
+// of their de Bruijn form written out, in order, so it only changes when they
+// stop being alpha-equivalent, short of a collision of the 32 bit hash of two
+// different byte strings.
+//
+// The artifact of a compiled unit holds its exports and the key it was
+// compiled with: the hash of its source and the interface hashes of the units
+// it sees. A unit whose key did not change is neither parsed nor checked, its
+// exports are read from the artifact. Artifacts are kept in memory and, with a
+// directory, in the file <directory>/<unit>.unit, written to a temporary file
+// renamed over the old one. Editing the value of a definition that is not a
+// type recompiles its own unit and nothing else.
+//
+// Unit names are used as file names. A unit defines each name once.
+
+#define UNIT_ARTIFACT_MAGIC 0x54494e55u
+#define UNIT_ARTIFACT_VERSION 2u
+
+#define UNIT_ARENA_BLOCK_SIZE (1 << 16)
+
+typedef struct unit_t {
+	char * name;
+	char * source;
+
+	// units imported directly
+	unsigned import_count;
+	unsigned * imports;
+
+	// last artifact compiled or read, 0 if none
+	char * artifact;
+	unsigned long artifact_size;
+
+	struct hash_t source_hash;
+	struct hash_t interface_hash;
+
+	// exports read from the artifact for the current build
+	unsigned export_count;
+	struct typecheck_entry_t * exports;
+
+	// compiled by the current build, not read from its artifact
+	int compiled;
+
+	int failed;
+	char error[256];
+} unit_t;
+
+typedef struct build_t {
+	// 0 keeps the artifacts in memory only
+	char * directory;
+
+	unsigned size;
+	unsigned capacity;
+	struct unit_t * units;
+
+	// units in build order, each after the units it imports
+	unsigned * order;
+
+	// exports of the current build
+	struct arena_t * arena;
+
+	struct typecheck_t checker;
+
+	// exports seen by the unit being compiled
+	swiss_table_t<name_t*, typecheck_entry_t*> imported;
+
+	// last build
+	unsigned compiled;
+	unsigned loaded;
+	unsigned read;
+	unsigned interfaces_changed;
+	unsigned failed;
+
+	char error[256];
+} build_t;
+
+char * unit_strdup(const char * str) {
+	unsigned long length = strlen(str);
+
+	char * copy = (char*)memory_alloc(length + 1);
+
+	memcpy(copy, str, length + 1);
+
+	return copy;
+}
+
+void build_init(struct build_t * build, const char * directory) {
+	build->directory = directory ? unit_strdup(directory) : 0;
+
+	if(directory) {
+		mkdir(directory, 0755);
+	}
+
+	build->size = 0;
+	build->capacity = 0;
+	build->units = 0;
+	build->order = 0;
+
+	build->arena = arena_create(UNIT_ARENA_BLOCK_SIZE);
+
+	typecheck_init(&build->checker);
+
+	swiss_table_init(&build->imported);
+
+	build->compiled = 0;
+	build->loaded = 0;
+	build->read = 0;
+	build->interfaces_changed = 0;
+	build->failed = 0;
+	build->error[0] = 0;
+}
+
+void build_destroy(struct build_t * build) {
+	for(unsigned i = 0; i < build->size; i++) {
+		struct unit_t * unit = &build->units[i];
+
+		memory_free(unit->name);
+		memory_free(unit->source);
+		memory_free(unit->imports);
+		memory_free(unit->artifact);
+	}
+
+	memory_free(build->units);
+	memory_free(build->order);
+	memory_free(build->directory);
+
+	arena_destroy(build->arena);
+	typecheck_destroy(&build->checker);
+	swiss_table_destroy(&build->imported);
+}
+
+// index of the unit, -1 if none
+int build_find(struct build_t * build, const char * name) {
+	for(unsigned i = 0; i < build->size; i++) {
+		if(strcmp(build->units[i].name, name) == 0) return i;
+	}
+
+	return -1;
+}
+
+unsigned build_add_unit(struct build_t * build, const char * name, const char * source) {
+	if(build->size == build->capacity) {
+		build->capacity = build->capacity ? build->capacity * 2 : 8;
+		build->units = (struct unit_t*)memory_realloc(build->units, sizeof(struct unit_t) * build->capacity);
+	}
+
+	struct unit_t * unit = &build->units[build->size];
+
+	unit->name = unit_strdup(name);
+	unit->source = unit_strdup(source);
+	unit->import_count = 0;
+	unit->imports = 0;
+	unit->artifact = 0;
+	unit->artifact_size = 0;
+	unit->source_hash = hash(source);
+	unit->interface_hash = hash(0u);
+	unit->export_count = 0;
+	unit->exports = 0;
+	unit->compiled = 0;
+	unit->failed = 0;
+	unit->error[0] = 0;
+
+	return build->size++;
+}
+
+void build_import(struct build_t * build, unsigned unit, unsigned imported) {
+	struct unit_t * importer = &build->units[unit];
+
+	importer->imports = (unsigned*)memory_realloc(importer->imports, sizeof(unsigned) * (importer->import_count + 1));
+	importer->imports[importer->import_count++] = imported;
+}
+
+// a new source for the next build
+void build_set_source(struct build_t * build, unsigned unit, const char * source) {
+	memory_free(build->units[unit].source);
+
+	build->units[unit].source = unit_strdup(source);
+	build->units[unit].source_hash = hash(source);
+}
+
+// 1 if the type of a definition is Type or a function type ending in Type
+int unit_is_type_family(struct ast_t * type) {
+	while(type->kind == ARROW_TYPE) {
+		type = type->rhs;
+	}
+
+	return type->kind == VAR && strcmp(name_get_str(type->name), "Type") == 0;
+}
+
+// Fills build->order, depth first from each unit in the order they were
+// added. Returns 0 on a cycle of imports.
+int build_sort(struct build_t * build) {
+	build->order = (unsigned*)memory_realloc(build->order, sizeof(unsigned) * (build->size + 1));
+
+	// 0 not visited, 1 on the path, 2 ordered
+	char * state = (char*)memory_alloc(build->size + 1);
+	unsigned * stack = (unsigned*)memory_alloc(sizeof(unsigned) * (build->size + 1));
+	unsigned * next = (unsigned*)memory_alloc(sizeof(unsigned) * (build->size + 1));
+
+	memset(state, 0, build->size);
+
+	unsigned size = 0;
+	int sorted = 1;
+
+	for(unsigned root = 0; root < build->size && sorted; root++) {
+		if(state[root]) continue;
+
+		unsigned depth = 0;
+
+		stack[depth] = root;
+		next[depth++] = 0;
+		state[root] = 1;
+
+		while(depth && sorted) {
+			struct unit_t * unit = &build->units[stack[depth - 1]];
+
+			if(next[depth - 1] == unit->import_count) {
+				state[stack[depth - 1]] = 2;
+				build->order[size++] = stack[--depth];
+				continue;
+			}
+
+			unsigned imported = unit->imports[next[depth - 1]++];
+
+			if(state[imported] == 1) {
+				snprintf(build->error, sizeof(build->error), "%s imports itself through %s", build->units[imported].name, unit->name);
+				sorted = 0;
+			} else if(state[imported] == 0) {
+				state[imported] = 1;
+				stack[depth] = imported;
+				next[depth++] = 0;
+			}
+		}
+	}
+
+	memory_free(state);
+	memory_free(stack);
+	memory_free(next);
+
+	return sorted;
+}
+
+// fills seen with the units unit sees, in build order, and returns their count
+unsigned build_seen(struct build_t * build, unsigned unit, unsigned * seen) {
+	char * reached = (char*)memory_alloc(build->size + 1);
+
+	memset(reached, 0, build->size);
+
+	unsigned * stack = (unsigned*)memory_alloc(sizeof(unsigned) * (build->size + 1));
+	unsigned depth = 0;
+
+	stack[depth++] = unit;
+
+	while(depth) {
+		struct unit_t * current = &build->units[stack[--depth]];
+
+		for(unsigned i = 0; i < current->import_count; i++) {
+			unsigned imported = current->imports[i];
+
+			if(!reached[imported]) {
+				reached[imported] = 1;
+				stack[depth++] = imported;
+			}
+		}
+	}
+
+	unsigned count = 0;
+
+	for(unsigned i = 0; i < build->size; i++) {
+		if(reached[build->order[i]]) seen[count++] = build->order[i];
+	}
+
+	memory_free(reached);
+	memory_free(stack);
+
+	return count;
+}
+
+// 1 if the artifact of unit was compiled from its source with the interfaces
+// of the units it sees
+int unit_artifact_current(struct build_t * build, struct unit_t * unit, unsigned * seen, unsigned count) {
+	struct byte_reader_t reader;
+
+	byte_reader_init(&reader, unit->artifact, unit->artifact_size);
+
+	if(byte_reader_u32(&reader) != UNIT_ARTIFACT_MAGIC || byte_reader_u32(&reader) != UNIT_ARTIFACT_VERSION) return 0;
+
+	if(byte_reader_u32(&reader) != unit->source_hash.crc32) return 0;
+
+	if(byte_reader_u32(&reader) != count) return 0;
+
+	for(unsigned i = 0; i < count && !reader.failed; i++) {
+		struct unit_t * other = &build->units[seen[i]];
+
+		char * name = byte_reader_string(&reader);
+
+		int same = name && strcmp(name, other->name) == 0 && byte_reader_u32(&reader) == other->interface_hash.crc32;
+
+		memory_free(name);
+
+		if(!same) return 0;
+	}
+
+	return !reader.failed;
+}
+
+// Reads the exports of the artifact into the arena of the build and computes
+// the interface hash. Returns 0 on a malformed artifact.
+int unit_load(struct build_t * build, struct unit_t * unit) {
+	struct arena_t * scratch = memory_scratch;
+
+	memory_set_scratch(build->arena);
+
+	struct byte_reader_t reader;
+
+	byte_reader_init(&reader, unit->artifact, unit->artifact_size);
+
+	// magic, version and source hash
+	byte_reader_bytes(&reader, 12);
+
+	unsigned count = byte_reader_u32(&reader);
+
+	for(unsigned i = 0; i < count && !reader.failed; i++) {
+		memory_free(byte_reader_string(&reader));
+		byte_reader_u32(&reader);
+	}
+
+	unit->export_count = byte_reader_u32(&reader);
+
+	if(unit->export_count > unit->artifact_size) {
+		reader.failed = 1;
+		unit->export_count = 0;
+	}
+
+	unit->exports = (struct typecheck_entry_t*)memory_alloc(sizeof(struct typecheck_entry_t) * (unit->export_count + 1));
+
+	// the exports as the units importing this one see them
+	struct byte_buffer_t interface;
+
+	byte_buffer_init(&interface);
+	byte_buffer_u32(&interface, unit->export_count);
+
+	for(unsigned i = 0; i < unit->export_count && !reader.failed; i++) {
+		struct typecheck_entry_t * entry = &unit->exports[i];
+
+		char * name = byte_reader_string(&reader);
+
+		int transparent = byte_reader_u8(&reader);
+
+		struct ast_t * type = ast_deserialize(&reader);
+		struct ast_t * value = ast_deserialize(&reader);
+
+		if(name == 0 || type == 0) {
+			reader.failed = 1;
+			break;
+		}
+
+		typecheck_entry_init(entry, allocate_name(name), typecheck_hashed(type), transparent && value ? typecheck_hashed(value) : 0);
+
+		entry->implicit_count = byte_reader_u32(&reader);
+
+		byte_buffer_string(&interface, name);
+		ast_serialize_de_bruijn(&interface, type);
+		ast_serialize_de_bruijn(&interface, entry->value);
+		byte_buffer_u32(&interface, entry->implicit_count);
+
+		if(entry->implicit_count > unit->artifact_size) {
+			reader.failed = 1;
+			break;
+		}
+
+		entry->implicits = (struct name_t**)memory_alloc(sizeof(struct name_t*) * (entry->implicit_count + 1));
+		entry->implicit_types = (struct ast_t**)memory_alloc(sizeof(struct ast_t*) * (entry->implicit_count + 1));
+
+		for(unsigned k = 0; k < entry->implicit_count && !reader.failed; k++) {
+			char * implicit = byte_reader_string(&reader);
+			struct ast_t * implicit_type = ast_deserialize(&reader);
+
+			if(implicit == 0 || implicit_type == 0) {
+				reader.failed = 1;
+				break;
+			}
+
+			entry->implicits[k] = allocate_name(implicit);
+			entry->implicit_types[k] = typecheck_hashed(implicit_type);
+
+			byte_buffer_string(&interface, implicit);
+			ast_serialize_de_bruijn(&interface, implicit_type);
+		}
+	}
+
+	struct hash_t interface_hash = hash(interface.data ? interface.data : "", interface.size);
+
+	byte_buffer_destroy(&interface);
+
+	memory_set_scratch(scratch);
+
+	if(reader.failed || reader.at != reader.size) {
+		unit->export_count = 0;
+		return 0;
+	}
+
+	unit->interface_hash = interface_hash;
+
+	return 1;
+}
+
+struct typecheck_entry_t * build_resolve(void * arg, struct name_t * name) {
+	struct build_t * build = (struct build_t*)arg;
+
+	struct typecheck_entry_t ** entry = swiss_table_get(&build->imported, name);
+
+	return entry ? *entry : 0;
+}
+
+// Checks the source of unit with the exports of the units it sees and
+// replaces its artifact. Returns 0 if it is not well typed.
+int unit_compile(struct build_t * build, struct unit_t * unit, unsigned * seen, unsigned count) {
+	swiss_table_clear(&build->imported);
+
+	for(unsigned i = 0; i < count; i++) {
+		struct unit_t * other = &build->units[seen[i]];
+
+		for(unsigned k = 0; k < other->export_count; k++) {
+			struct typecheck_entry_t ** found = swiss_table_get(&build->imported, other->exports[k].name);
+
+			if(found) {
+				*found = &other->exports[k];
+			} else {
+				swiss_table_insert(&build->imported, other->exports[k].name, &other->exports[k]);
+			}
+		}
+	}
+
+	struct typecheck_t * checker = &build->checker;
+
+	checker->resolve = build_resolve;
+	checker->resolve_arg = build;
+
+	struct ast_t * program = parse(unit->source);
+
+	int definitions = program->kind == STATEMENT;
+	int checked = definitions && typecheck_program(checker, program);
+
+	ast_free(program);
+
+	if(!checked) {
+		snprintf(unit->error, sizeof(unit->error), "%s", definitions ? checker->error : "a unit is a list of definitions");
+		unit->failed = 1;
+		return 0;
+	}
+
+	// the entries of the program, in order
+	for(unsigned i = 0; i < checker->size; i++) {
+		if(checker->entries[i].shadowed != -1) {
+			snprintf(unit->error, sizeof(unit->error), "%s is defined twice", name_get_str(checker->entries[i].name));
+			unit->failed = 1;
+			return 0;
+		}
+	}
+
+	struct byte_buffer_t buffer;
+
+	byte_buffer_init(&buffer);
+
+	byte_buffer_u32(&buffer, UNIT_ARTIFACT_MAGIC);
+	byte_buffer_u32(&buffer, UNIT_ARTIFACT_VERSION);
+	byte_buffer_u32(&buffer, unit->source_hash.crc32);
+
+	byte_buffer_u32(&buffer, count);
+
+	for(unsigned i = 0; i < count; i++) {
+		byte_buffer_string(&buffer, build->units[seen[i]].name);
+		byte_buffer_u32(&buffer, build->units[seen[i]].interface_hash.crc32);
+	}
+
+	byte_buffer_u32(&buffer, checker->size);
+
+	for(unsigned i = 0; i < checker->size; i++) {
+		struct typecheck_entry_t * entry = &checker->entries[i];
+
+		byte_buffer_string(&buffer, name_get_str(entry->name));
+		byte_buffer_u8(&buffer, unit_is_type_family(entry->type));
+
+		ast_serialize(&buffer, entry->type);
+		ast_serialize(&buffer, entry->value);
+
+		byte_buffer_u32(&buffer, entry->implicit_count);
+
+		for(unsigned k = 0; k < entry->implicit_count; k++) {
+			byte_buffer_string(&buffer, name_get_str(entry->implicits[k]));
+			ast_serialize(&buffer, entry->implicit_types[k]);
+		}
+	}
+
+	memory_free(unit->artifact);
+
+	unit->artifact = buffer.data;
+	unit->artifact_size = buffer.size;
+
+	return 1;
+}
+
+char * unit_path(struct build_t * build, struct unit_t * unit, const char * suffix) {
+	unsigned long length = strlen(build->directory) + strlen(unit->name) + strlen(suffix) + 32;
+
+	char * path = (char*)memory_alloc(length);
+
+	snprintf(path, length, "%s/%s%s", build->directory, unit->name, suffix);
+
+	return path;
+}
+
+// reads the artifact of unit from the directory, returns 0 if there is none
+int unit_read(struct build_t * build, struct unit_t * unit) {
+	char * path = unit_path(build, unit, ".unit");
+
+	struct byte_buffer_t buffer;
+
+	byte_buffer_init(&buffer);
+
+	int read = byte_buffer_read_file(&buffer, path);
+
+	memory_free(path);
+
+	if(!read) {
+		byte_buffer_destroy(&buffer);
+		return 0;
+	}
+
+	memory_free(unit->artifact);
+
+	unit->artifact = buffer.data;
+	unit->artifact_size = buffer.size;
+
+	return 1;
+}
+
+void unit_write(struct build_t * build, struct unit_t * unit) {
+	char * path = unit_path(build, unit, ".unit");
+
+	byte_buffer_write_file(path, unit->artifact, unit->artifact_size);
+
+	memory_free(path);
+}
+
+// Builds every unit, compiling the ones whose artifact is not current.
+// Returns 1 if they are all well typed, the errors are in the units.
+int build_run(struct build_t * build) {
+	build->compiled = 0;
+	build->loaded = 0;
+	build->read = 0;
+	build->interfaces_changed = 0;
+	build->failed = 0;
+	build->error[0] = 0;
+
+	arena_reset(build->arena);
+
+	for(unsigned i = 0; i < build->size; i++) {
+		build->units[i].export_count = 0;
+		build->units[i].exports = 0;
+		build->units[i].compiled = 0;
+		build->units[i].failed = 0;
+		build->units[i].error[0] = 0;
+	}
+
+	if(!build_sort(build)) {
+		build->failed = build->size;
+		return 0;
+	}
+
+	unsigned * seen = (unsigned*)memory_alloc(sizeof(unsigned) * (build->size + 1));
+
+	for(unsigned i = 0; i < build->size; i++) {
+		struct unit_t * unit = &build->units[build->order[i]];
+
+		for(unsigned k = 0; k < unit->import_count && !unit->failed; k++) {
+			struct unit_t * imported = &build->units[unit->imports[k]];
+
+			if(imported->failed) {
+				snprintf(unit->error, sizeof(unit->error), "imports %s, which failed", imported->name);
+				unit->failed = 1;
+			}
+		}
+
+		if(unit->failed) {
+			build->failed += 1;
+			continue;
+		}
+
+		unsigned count = build_seen(build, build->order[i], seen);
+
+		if(unit->artifact == 0 && build->directory && unit_read(build, unit)) {
+			build->read += 1;
+		}
+
+		if(unit->artifact && unit_artifact_current(build, unit, seen, count) && unit_load(build, unit)) {
+			build->loaded += 1;
+			continue;
+		}
+
+		struct hash_t previous = unit->interface_hash;
+
+		int had_artifact = unit->artifact != 0;
+
+		if(!unit_compile(build, unit, seen, count)) {
+			build->failed += 1;
+			continue;
+		}
+
+		unit->compiled = 1;
+		build->compiled += 1;
+
+		unit_load(build, unit);
+
+		if(!had_artifact || previous.crc32 != unit->interface_hash.crc32) {
+			build->interfaces_changed += 1;
+		}
+
+		if(build->directory) {
+			unit_write(build, unit);
+		}
+	}
+
+	memory_free(seen);
+
+	return build->failed == 0;
+}
+
+void build_report(struct build_t * build, FILE * out) {
+	fprintf(out, "units:               %u\n", build->size);
+	fprintf(out, "compiled:            %u\n", build->compiled);
+	fprintf(out, "up to date:          %u\n", build->loaded);
+	fprintf(out, "artifacts read:      %u\n", build->read);
+	fprintf(out, "interfaces changed:  %u\n", build->interfaces_changed);
+	fprintf(out, "failed:              %u\n", build->failed);
+
+	if(build->error[0]) {
+		fprintf(out, "error:               %s\n", build->error);
+	}
+
+	for(unsigned i = 0; i < build->size; i++) {
+		if(build->units[i].failed) {
+			fprintf(out, "error in %s: %s\n", build->units[i].name, build->units[i].error);
+		}
+	}
+}
+
+#endif
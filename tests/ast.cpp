@@ -1,5 +1,224 @@
 #include "parser.h"
 #include "ast_hash.h"
+#include "ast_hash_batch.h"
+#include "alpha_equivalence.h"
+#include "reduction.h"
+#include "nbe.h"
+#include "normal_form_cache.h"
+#include "machine.h"
+#include "resolve.h"
+#include "parallel_normalize.h"
+#include "graph_reduction.h"
+#include "typecheck.h"
+#include "parallel_typecheck.h"
+#include "unit.h"
+#include "ast_printer.h"
+#include "ast_cache.h"
+#include "trace.h"
+#include "static_parser.h"
+#include "term_generator.h"
+#include "daemon.h"
+
+// same tree with the same names
+int ast_identical(struct ast_t * a, struct ast_t * b) {
+	if(a == 0 || b == 0) return a == b;
+
+	if(a->kind != b->kind || (a->name == 0) != (b->name == 0)) return 0;
+
+	if(a->name && strcmp(a->name->identifier, b->name->identifier) != 0) return 0;
+
+	return ast_identical(a->lhs, b->lhs) && ast_identical(a->rhs, b->rhs);
+}
+
+// same tree with the same names and tags
+int ast_identical_tags(struct ast_t * a, struct ast_t * b) {
+	if(a == 0 || b == 0) return a == b;
+
+	return a->tag.crc32 == b->tag.crc32 && a->kind == b->kind && ast_identical_tags(a->lhs, b->lhs) && ast_identical_tags(a->rhs, b->rhs) && ast_identical(a, b);
+}
+
+// the text ast_print writes to stdout
+std::string ast_print_captured(struct ast_t * ast, int tag) {
+	FILE * capture = tmpfile();
+
+	fflush(stdout);
+
+	int saved = dup(1);
+
+	dup2(fileno(capture), 1);
+
+	if(tag) print_hashed_ast(ast); else ast_print(ast);
+
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+
+	std::string text;
+	char chunk[4096];
+	unsigned long read;
+
+	rewind(capture);
+
+	while((read = fread(chunk, 1, sizeof(chunk), capture)) > 0) text.append(chunk, read);
+
+	fclose(capture);
+
+	return text;
+}
+
+// the text of the buffered printer matches ast_print
+int ast_printer_matches(struct ast_printer_t * printer, struct ast_t * ast) {
+	struct byte_buffer_t buffer;
+
+	byte_buffer_init(&buffer);
+
+	ast_printer_print(printer, &buffer, ast);
+
+	int matches = ast_print_captured(ast, printer->flags & AST_PRINT_TAG) == std::string(buffer.data ? buffer.data : "", buffer.size);
+
+	byte_buffer_destroy(&buffer);
+
+	return matches;
+}
+
+// programs parsed and hashed when the tests are compiled
+#define STATIC_PRELUDE \
+	"let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in\n" \
+	"let Vec : A:Type -> Nat -> Type in let Cons : A -> Vec A n -> Vec A (Succ n) in\n" \
+	"let pred : Nat -> Nat = case Zero then Zero, case Succ k then k in\n" \
+	"let tail : n:Nat -> Vec Nat (Succ n) -> Vec Nat n = case _ . Cons x xs then xs in\n" \
+	"let twice : x:Nat -> Nat = fn x:Nat. Succ (Succ x);"
+
+constexpr auto static_prelude = STATIC_PARSE_HASHED(STATIC_PRELUDE);
+constexpr auto static_term = static_parse_hashed("fn x:t. fn y:t. (g x) y (h y)");
+constexpr auto static_unhashed = static_parse("fn x:t. x");
+
+static_assert(static_program_tag(&static_prelude).crc32 != 0, "the prelude is hashed");
+static_assert(static_program_tag(&static_unhashed).crc32 == 0, "static_parse does not hash");
+static_assert(static_prelude.nodes[static_prelude.root].kind == STATEMENT, "a program of lets");
+static_assert(sizeof(static_prelude.nodes) == sizeof(struct static_node_t) * static_prelude.size, "sized to the program");
+
+// alpha equivalent terms have the same tag, already when compiling
+constexpr auto static_renamed = static_parse_hashed("fn a:t. fn b:t. (g a) b (h b)");
+constexpr auto static_swapped = static_parse_hashed("fn a:t. fn b:t. (g a) b (h a)");
+
+static_assert(static_program_tag(&static_term).crc32 == static_program_tag(&static_renamed).crc32, "alpha equivalent");
+static_assert(static_program_tag(&static_term).crc32 != static_program_tag(&static_swapped).crc32, "not alpha equivalent");
+
+// xorshift, fixed seed so every run checks the same terms
+unsigned random_term_state = 2463534242u;
+
+unsigned random_term_next(unsigned bound) {
+	random_term_state ^= random_term_state << 13;
+	random_term_state ^= random_term_state >> 17;
+	random_term_state ^= random_term_state << 5;
+
+	return random_term_state % bound;
+}
+
+// a term of three free names and two binder names, with shadowing and
+// dependent arrows, most small terms have alpha-equivalent twins in the set
+struct ast_t * random_term(unsigned depth) {
+	const char * names[] = { "f", "g", "h", "x", "y" };
+
+	unsigned r = random_term_next(depth ? 8 : 1);
+
+	if(r < 3) return var(names[random_term_next(5)]);
+	if(r < 6) return app(random_term(depth - 1), random_term(depth - 1));
+	if(r < 7) return lambda(bind(var(names[3 + random_term_next(2)]), var("t")), random_term(depth - 1));
+
+	struct ast_t * domain = random_term_next(2) ? bind(var(names[3 + random_term_next(2)]), random_term(depth - 1)) : random_term(depth - 1);
+
+	return arrow(domain, random_term(depth - 1));
+}
+
+// every entry of a hashed table is reachable from its home slot without
+// crossing an empty slot, and the tail of the control bytes mirrors the head
+template<typename K, typename V, unsigned N>
+int swiss_table_consistent(struct swiss_table_t<K, V, N> * table) {
+	if(table->ctrl == 0) return 1;
+
+	unsigned mask = table->capacity - 1;
+	unsigned size = 0;
+
+	for(unsigned i = 0; i < table->capacity + SWISS_GROUP; i++) {
+		if(table->ctrl[i] != table->ctrl[i & mask]) return 0;
+	}
+
+	for(unsigned slot = 0; slot < table->capacity; slot++) {
+		if((table->ctrl[slot] == SWISS_EMPTY) != (table->keys[slot] == 0)) return 0;
+
+		if(table->keys[slot] == 0) continue;
+
+		size += 1;
+
+		if(table->ctrl[slot] != swiss_h2(swiss_key_hash(table->keys[slot]))) return 0;
+
+		for(unsigned i = swiss_key_hash(table->keys[slot]) & mask; i != slot; i = (i + 1) & mask) {
+			if(table->keys[i] == 0) return 0;
+		}
+	}
+
+	return size == table->size;
+}
+
+// a name whose home slot in a table of capacity is home, the first after index
+struct name_t * swiss_name_at(unsigned capacity, unsigned home, unsigned * index) {
+	char identifier[32];
+
+	while(1) {
+		snprintf(identifier, sizeof(identifier), "k%u", (*index)++);
+
+		struct name_t * name = allocate_name(identifier);
+
+		if((swiss_key_hash(name) & (capacity - 1)) == home) return name;
+
+		name_free(name);
+	}
+}
+
+// trie keys with a chosen hash, to force shared prefixes and collisions
+typedef struct hamt_test_key_t {
+	unsigned hash;
+	unsigned id;
+} hamt_test_key_t;
+
+// counted values, the trie must give back every reference it takes
+typedef struct hamt_test_value_t {
+	unsigned references;
+	unsigned value;
+} hamt_test_value_t;
+
+unsigned hamt_hash(struct hamt_test_key_t * key) {
+	return key->hash;
+}
+
+int swiss_key_equal(struct hamt_test_key_t * a, struct hamt_test_key_t * b) {
+	return a->id == b->id;
+}
+
+void hamt_value_retain(struct hamt_test_value_t * value) {
+	value->references += 1;
+}
+
+void hamt_value_release(struct hamt_test_value_t * value) {
+	value->references -= 1;
+}
+
+typedef hamt_t<hamt_test_key_t*, hamt_test_value_t*> hamt_test_map_t;
+
+// the values of keys in map, in order, -1 for missing keys
+std::vector<int> hamt_test_values(hamt_test_map_t map, std::vector<struct hamt_test_key_t> & keys) {
+	std::vector<int> values;
+
+	for(struct hamt_test_key_t & key : keys) {
+		struct hamt_test_value_t * value = hamt_get(map, &key);
+
+		values.push_back(value ? (int)value->value : -1);
+	}
+
+	return values;
+}
 
 int main() {
 	const char * src =
@@ -69,4 +288,1698 @@ int main() {
 	printf(">> ");
 	print_hashed_ast(F_prog->lhs->rhs);
 	printf("\n");
+
+	const char * batch_src[] = { A_src, B_src, C_src, D_src, E_src, F_src, src, indexed };
+	struct ast_t * batch_prog[] = { A_prog, B_prog, C_prog, D_prog, E_prog, F_prog, prog, indexed_prog };
+
+	ast_hash(prog);
+	ast_hash(indexed_prog);
+
+	struct hash_t batch_tags[8];
+
+	ast_hash_batch_sources(batch_src, 8, 4, batch_tags);
+
+	for(int i = 0; i < 8; i++) {
+		printf("batch %i: %u\n", i, batch_tags[i].crc32);
+		assert(batch_tags[i].crc32 == batch_prog[i]->tag.crc32);
+	}
+
+	// arena allocations are aligned like malloc, whatever the sizes before them
+	struct arena_t * aligned_arena = arena_create(64);
+
+	for(size_t size = 1; size < 100; size += 7) {
+		assert((size_t)arena_alloc(aligned_arena, size) % alignof(max_align_t) == 0);
+	}
+
+	arena_destroy(aligned_arena);
+
+	const char * G_src = "let k : t = fn x:a. fn y:a. x;";
+	const char * H_src = "let k : t = fn x:a. fn y:a. y;";
+	const char * I_src = "let k : t = fn y:a. fn x:a. y;";
+	const char * J_src = "let k : t = (fn x:a. x x) (fn y:a. y y);";
+
+	struct hash_verifier_t verifier;
+
+	hash_verifier_init(&verifier, 0, 64);
+
+	for(int i = 0; i < 8; i++) {
+		ast_hash_verify(&verifier, batch_prog[i]);
+	}
+
+	struct ast_t * verified_prog[] = { parse(G_src), parse(H_src), parse(I_src), parse(J_src) };
+
+	for(int i = 0; i < 4; i++) {
+		ast_hash_verify(&verifier, verified_prog[i]);
+	}
+
+	hash_verifier_run(&verifier);
+	hash_verifier_report(&verifier, stdout);
+
+	assert(verifier.collisions == 0);
+	assert(verifier.misses == 0);
+
+	hash_verifier_destroy(&verifier);
+
+	for(int i = 0; i < 4; i++) {
+		ast_free(verified_prog[i]);
+	}
+
+	ast_free(indexed_prog);
+	ast_free(B_prog);
+	ast_free(C_prog);
+	ast_free(D_prog);
+	ast_free(F_prog);
+
+	// every subterm of random terms, thousands of alpha classes
+	struct ast_t * random_terms[3000];
+
+	hash_verifier_init(&verifier, 0, 64);
+
+	for(int i = 0; i < 3000; i++) {
+		random_terms[i] = random_term(4);
+		ast_hash_verify(&verifier, random_terms[i]);
+	}
+
+	hash_verifier_run(&verifier);
+	hash_verifier_report(&verifier, stdout);
+
+	assert(verifier.alpha_classes > 4000);
+	assert(verifier.collisions == 0);
+	assert(verifier.misses == 0);
+
+	hash_verifier_destroy(&verifier);
+
+	for(int i = 0; i < 3000; i++) ast_free(random_terms[i]);
+
+	// the shapes of the hashing benchmark, at small sizes
+	typedef struct ast_t * (*generate_t)(struct generator_t *, unsigned);
+
+	generate_t shapes[] = { generate_balanced, generate_left_deep, generate_right_deep, generate_wide, generate_free };
+
+	std::vector<struct ast_t*> generated;
+
+	hash_verifier_init(&verifier, 0, 64);
+
+	for(generate_t generate : shapes) {
+		for(unsigned size = 16; size <= 256; size *= 2) {
+			for(unsigned i = 0; i < 8; i++) {
+				struct generator_t g;
+
+				g.binders = 0;
+				g.nodes = 0;
+
+				generated.push_back(generate(&g, size));
+				ast_hash_verify(&verifier, generated.back());
+			}
+		}
+	}
+
+	hash_verifier_run(&verifier);
+	hash_verifier_report(&verifier, stdout);
+
+	assert(verifier.alpha_classes > 1000);
+	assert(verifier.collisions == 0);
+	assert(verifier.misses == 0);
+
+	hash_verifier_destroy(&verifier);
+
+	for(struct ast_t * ast : generated) ast_free(ast);
+
+	// pairs that only differ in where the free names occur
+	const char * swapped[][2] = {
+		{ "(h f) h", "(h h) f" },
+		{ "f (g h)", "h (g f)" },
+		{ "A -> Nat -> B", "B -> Nat -> A" },
+		{ "Vec A B -> Nat", "Vec B A -> Nat" },
+		{ "g a b", "g b a" },
+	};
+
+	for(auto & pair : swapped) {
+		struct ast_t * a = parse(pair[0]);
+		struct ast_t * b = parse(pair[1]);
+
+		ast_hash(a);
+		ast_hash(b);
+
+		assert(a->tag.crc32 != b->tag.crc32);
+
+		ast_free(a);
+		ast_free(b);
+	}
+
+	// the swiss table grows, erases by shifting back and reuses the slots
+	swiss_table_t<name_t*, unsigned, 0> table;
+	std::vector<struct name_t*> table_names;
+
+	swiss_table_init(&table);
+
+	for(unsigned i = 0; i < 1000; i++) {
+		char identifier[32];
+
+		snprintf(identifier, sizeof(identifier), "n%u", i);
+
+		table_names.push_back(allocate_name(identifier));
+
+		assert(swiss_table_insert(&table, table_names[i], i));
+		assert(!swiss_table_insert(&table, table_names[i], i + 1));
+	}
+
+	assert(table.size == 1000 && table.capacity == 2048 && swiss_table_consistent(&table));
+
+	for(unsigned i = 0; i < 1000; i++) {
+		assert(*swiss_table_get(&table, table_names[i]) == i);
+	}
+
+	for(unsigned i = 0; i < 1000; i += 2) {
+		unsigned removed = 0;
+
+		assert(swiss_table_remove(&table, table_names[i], (struct name_t**)0, &removed) && removed == i);
+		assert(!swiss_table_remove(&table, table_names[i], (struct name_t**)0, (unsigned*)0));
+	}
+
+	assert(table.size == 500 && swiss_table_consistent(&table));
+
+	for(unsigned i = 0; i < 1000; i++) {
+		assert((swiss_table_get(&table, table_names[i]) != 0) == (i % 2 == 1));
+	}
+
+	// no tombstones, churning at a constant size never grows the table
+	for(unsigned round = 0; round < 20; round++) {
+		for(unsigned i = 0; i < 1000; i += 2) {
+			assert(swiss_table_insert(&table, table_names[i], round));
+		}
+
+		for(unsigned i = 0; i < 1000; i += 2) {
+			assert(swiss_table_remove(&table, table_names[i], (struct name_t**)0, (unsigned*)0));
+		}
+	}
+
+	assert(table.size == 500 && table.capacity == 2048 && swiss_table_consistent(&table));
+
+	swiss_table_destroy(&table);
+
+	// a run of entries homed at the last slot wraps to the first ones, erasing
+	// its head shifts every one of them back across the end
+	swiss_table_init(&table, 64);
+
+	unsigned name_index = 0;
+
+	struct name_t * wrapped[6];
+
+	for(unsigned i = 0; i < 6; i++) {
+		wrapped[i] = swiss_name_at(64, 63, &name_index);
+
+		assert(swiss_table_insert(&table, wrapped[i], i));
+	}
+
+	struct name_t * homed = swiss_name_at(64, 1, &name_index);
+
+	assert(swiss_table_insert(&table, homed, 6u));
+
+	assert(table.keys[63] == wrapped[0] && table.keys[4] == wrapped[5] && table.keys[5] == homed);
+	assert(table.ctrl[64] == table.ctrl[0] && swiss_table_consistent(&table));
+
+	assert(swiss_table_remove(&table, wrapped[0], (struct name_t**)0, (unsigned*)0));
+
+	assert(table.keys[63] == wrapped[1] && table.keys[3] == wrapped[5] && table.keys[4] == homed && table.keys[5] == 0);
+	assert(table.ctrl[5] == SWISS_EMPTY && swiss_table_consistent(&table));
+
+	for(unsigned i = 1; i < 6; i++) {
+		assert(*swiss_table_get(&table, wrapped[i]) == i);
+	}
+
+	assert(*swiss_table_get(&table, homed) == 6);
+
+	// the entry homed inside the run shifts back with it, but never before its home
+	assert(swiss_table_remove(&table, wrapped[3], (struct name_t**)0, (unsigned*)0));
+	assert(table.keys[1] == wrapped[4] && table.keys[2] == wrapped[5] && table.keys[3] == homed && table.keys[4] == 0);
+	assert(swiss_table_remove(&table, wrapped[4], (struct name_t**)0, (unsigned*)0));
+	assert(table.keys[1] == wrapped[5] && table.keys[2] == homed && table.keys[3] == 0);
+	assert(swiss_table_remove(&table, wrapped[5], (struct name_t**)0, (unsigned*)0));
+	assert(table.keys[1] == homed && table.keys[2] == 0);
+	assert(swiss_table_remove(&table, wrapped[2], (struct name_t**)0, (unsigned*)0));
+	assert(table.keys[0] == 0 && table.keys[1] == homed);
+	assert(swiss_table_consistent(&table));
+
+	swiss_table_destroy(&table);
+
+	for(struct name_t * name : table_names) name_free(name);
+	for(struct name_t * name : wrapped) name_free(name);
+
+	name_free(homed);
+
+	// small tables keep their entries inline until they spill
+	swiss_table_t<name_t*, unsigned, 4> small;
+	struct name_t * small_names[6];
+
+	for(unsigned i = 0; i < 6; i++) {
+		char identifier[32];
+
+		snprintf(identifier, sizeof(identifier), "s%u", i);
+
+		small_names[i] = allocate_name(identifier);
+	}
+
+	swiss_table_init(&small);
+
+	for(unsigned i = 0; i < 4; i++) assert(swiss_table_insert(&small, small_names[i], i));
+
+	assert(small.ctrl == 0 && small.keys == small.small_keys && small.size == 4);
+	assert(!swiss_table_insert(&small, small_names[2], 9u));
+
+	// erasing in the middle leaves a hole that the next insertion fills
+	assert(swiss_table_remove(&small, small_names[1], (struct name_t**)0, (unsigned*)0));
+	assert(small.keys[1] == 0 && swiss_table_get(&small, small_names[1]) == 0);
+	assert(swiss_table_insert(&small, small_names[4], 4u));
+	assert(small.ctrl == 0 && small.keys[1] == small_names[4]);
+
+	// the fifth entry spills every entry to hashed slots
+	assert(swiss_table_insert(&small, small_names[5], 5u));
+	assert(small.ctrl != 0 && small.keys != small.small_keys && small.size == 5 && swiss_table_consistent(&small));
+
+	for(unsigned i = 0; i < 6; i++) {
+		assert((swiss_table_get(&small, small_names[i]) != 0) == (i != 1));
+	}
+
+	assert(*swiss_table_get(&small, small_names[4]) == 4 && *swiss_table_get(&small, small_names[5]) == 5);
+
+	// erasing below N entries keeps the hashed slots
+	for(unsigned i = 2; i < 6; i++) {
+		assert(swiss_table_remove(&small, small_names[i], (struct name_t**)0, (unsigned*)0));
+	}
+
+	assert(small.ctrl != 0 && small.size == 1 && swiss_table_consistent(&small));
+	assert(*swiss_table_get(&small, small_names[0]) == 0);
+
+	swiss_table_destroy(&small);
+
+	// clearing a small table, and a table sized past N at init
+	swiss_table_init(&small, 4);
+	assert(small.ctrl == 0);
+
+	for(unsigned i = 0; i < 3; i++) assert(swiss_table_insert(&small, small_names[i], i));
+
+	swiss_table_clear(&small);
+
+	assert(small.ctrl == 0 && small.size == 0 && swiss_table_get(&small, small_names[0]) == 0);
+	assert(swiss_table_insert(&small, small_names[0], 1u) && small.keys[0] == small_names[0]);
+
+	swiss_table_destroy(&small);
+	swiss_table_init(&small, 5);
+
+	assert(small.ctrl != 0 && small.capacity == 8);
+
+	for(unsigned i = 0; i < 6; i++) assert(swiss_table_insert(&small, small_names[i], i));
+
+	assert(small.capacity == 8 && swiss_table_consistent(&small));
+
+	swiss_table_destroy(&small);
+
+	for(struct name_t * name : small_names) name_free(name);
+
+	// every version of the persistent trie stays valid after an update
+	std::vector<struct hamt_test_key_t> trie_keys;
+	std::vector<struct hamt_test_value_t> trie_values(64);
+
+	for(unsigned i = 0; i < 40; i++) trie_keys.push_back({ i * 2654435769u, i });
+
+	// a shared 30 bit prefix, then the same full hash three times
+	trie_keys.push_back({ 0x3fffffffu, 40 });
+	trie_keys.push_back({ 0x7fffffffu, 41 });
+	trie_keys.push_back({ 0xffffffffu, 42 });
+	trie_keys.push_back({ 0xffffffffu, 43 });
+	trie_keys.push_back({ 0xffffffffu, 44 });
+
+	for(unsigned i = 0; i < trie_values.size(); i++) trie_values[i] = { 0, i };
+
+	std::vector<hamt_test_map_t> versions = { hamt_empty<hamt_test_key_t*, hamt_test_value_t*>() };
+
+	for(unsigned i = 0; i < trie_keys.size(); i++) {
+		hamt_value_retain(&trie_values[i]);
+		versions.push_back(hamt_insert(versions.back(), &trie_keys[i], &trie_values[i]));
+	}
+
+	// version i holds exactly the first i keys
+	for(unsigned i = 0; i < versions.size(); i++) {
+		std::vector<int> values = hamt_test_values(versions[i], trie_keys);
+
+		assert(versions[i].size == i);
+
+		for(unsigned j = 0; j < trie_keys.size(); j++) assert(values[j] == (j < i ? (int)j : -1));
+	}
+
+	hamt_test_map_t full = versions.back();
+
+	std::vector<int> full_values = hamt_test_values(full, trie_keys);
+
+	// an insertion copies the path to the key only
+	unsigned long nodes_before = hamt_nodes_allocated;
+
+	hamt_value_retain(&trie_values[50]);
+
+	hamt_test_map_t replaced = hamt_insert(full, &trie_keys[5], &trie_values[50]);
+
+	assert(hamt_nodes_allocated - nodes_before <= 7 && replaced.size == full.size);
+	assert(hamt_get(replaced, &trie_keys[5])->value == 50 && hamt_get(full, &trie_keys[5])->value == 5);
+	assert(hamt_test_values(full, trie_keys) == full_values);
+
+	// replacing and removing inside the collision node
+	hamt_value_retain(&trie_values[51]);
+
+	hamt_test_map_t collided = hamt_insert(full, &trie_keys[43], &trie_values[51]);
+
+	assert(collided.size == full.size && hamt_get(collided, &trie_keys[43])->value == 51);
+	assert(hamt_get(collided, &trie_keys[42])->value == 42 && hamt_get(collided, &trie_keys[44])->value == 44);
+
+	struct hamt_test_key_t absent = { 0xffffffffu, 45 };
+
+	assert(hamt_get(collided, &absent) == 0);
+
+	struct hamt_test_value_t * removed_value = 0;
+
+	hamt_test_map_t without_absent = hamt_remove(collided, &absent, &removed_value);
+
+	assert(removed_value == 0 && without_absent.size == collided.size && without_absent.root == collided.root);
+
+	hamt_test_map_t shrunk = hamt_retain(collided);
+
+	for(unsigned id : { 42u, 43u, 44u, 41u, 40u }) {
+		hamt_test_map_t next = hamt_remove(shrunk, &trie_keys[id], &removed_value);
+
+		assert(removed_value && removed_value->value == (id == 43 ? 51u : id));
+		assert(hamt_get(next, &trie_keys[id]) == 0 && next.size == shrunk.size - 1);
+
+		hamt_value_release(removed_value);
+		hamt_release(shrunk);
+
+		shrunk = next;
+	}
+
+	assert(hamt_test_values(shrunk, trie_keys) == hamt_test_values(versions[40], trie_keys));
+	assert(hamt_test_values(full, trie_keys) == full_values);
+
+	// removing everything goes back to the empty trie
+	for(unsigned i = 0; i < 40; i++) {
+		hamt_test_map_t next = hamt_remove(shrunk, &trie_keys[i], &removed_value);
+
+		assert(removed_value == &trie_values[i]);
+
+		hamt_value_release(removed_value);
+		hamt_release(shrunk);
+
+		shrunk = next;
+	}
+
+	assert(shrunk.root == 0 && shrunk.size == 0);
+
+	unsigned visited = 0;
+
+	hamt_foreach(full, [&](struct hamt_test_key_t *, struct hamt_test_value_t *) { visited += 1; });
+
+	assert(visited == trie_keys.size());
+
+	for(hamt_test_map_t version : versions) hamt_release(version);
+
+	hamt_release(replaced);
+	hamt_release(collided);
+	hamt_release(without_absent);
+
+	for(struct hamt_test_value_t & value : trie_values) assert(value.references == 0);
+
+	// the name map owns its names, a copy owns its own
+	struct name_name_map_t * renames = name_name_map_allocate();
+
+	for(unsigned i = 0; i < 40; i++) {
+		char identifier[32], renamed[32];
+
+		snprintf(identifier, sizeof(identifier), "x%u", i);
+		snprintf(renamed, sizeof(renamed), "y%u", i);
+
+		assert(name_name_map_add(renames, allocate_name(identifier), allocate_name(renamed)));
+	}
+
+	struct name_name_map_t * renames_copy = name_name_map_copy(renames);
+
+	struct name_t * x7 = allocate_name("x7");
+	struct name_t * y7 = name_name_map_rem(renames, x7);
+
+	assert(y7 && strcmp(y7->identifier, "y7") == 0);
+	assert(name_name_map_get(renames, x7) == 0 && name_name_map_rem(renames, x7) == 0);
+	assert(strcmp(name_name_map_get(renames_copy, x7)->identifier, "y7") == 0);
+	assert(renames->size == 39 && renames_copy->size == 40);
+
+	name_free(x7);
+	name_free(y7);
+	name_name_map_free(renames);
+	name_name_map_free(renames_copy);
+
+	const char * church_src =
+		"let two : t = fn f:t. fn x:t. f (f x) in\n"
+		"let three : t = fn f:t. fn x:t. f (f (f x)) in\n"
+		"let plus : t = fn m:t. fn n:t. fn f:t. fn x:t. m f (n f x) in\n"
+		"let mult : t = fn m:t. fn n:t. fn f:t. m (n f) in\n"
+		"let five : t = plus two three in\n"
+		"let six : t = mult two three;";
+
+	struct ast_t * church = parse(church_src);
+	struct ast_t * church_nbe = ast_normalize(church);
+	struct ast_t * church_sub = ast_reduce_program(church, 0);
+
+	struct ast_t * five = parse("fn f:t. fn x:t. f (f (f (f (f x))))");
+	struct ast_t * six = parse("fn f:t. fn x:t. f (f (f (f (f (f x)))))");
+
+	assert(ast_alpha_equivalent(church_nbe->rhs->rhs->rhs->rhs->lhs->rhs, five));
+	assert(ast_alpha_equivalent(church_nbe->rhs->rhs->rhs->rhs->rhs->lhs->rhs, six));
+	assert(ast_alpha_equivalent(church_nbe, church_sub));
+
+	// the bound y must not capture the free y
+	struct ast_t * capture = parse("(fn x:t. fn y:t. x) y");
+	struct ast_t * capture_nbe = ast_normalize(capture);
+	struct ast_t * capture_sub = ast_reduce(capture, 0);
+
+	assert(ast_alpha_equivalent(capture_nbe, capture_sub));
+	struct ast_t * renamed = parse("fn z:t. y");
+
+	assert(ast_alpha_equivalent(capture_nbe, renamed));
+
+	ast_free(church_nbe);
+	ast_free(church_sub);
+	ast_free(five);
+	ast_free(capture_nbe);
+	ast_free(capture_sub);
+
+	// renamings of the same terms hit the cache, definitions are never cached
+	struct normal_form_cache_t cache;
+
+	normal_form_cache_init(&cache, 64, 0);
+
+	struct nbe_t nbe;
+
+	nbe_init(&nbe);
+
+	nbe.cache = &cache;
+
+	const char * cached_src[] = {
+		"let Vec : Type in let Succ : Nat -> Nat in let v : Vec A (Succ n) = (fn x:t. fn y:t. x) (Vec A (Succ n)) z;",
+		"let Vec : Type in let Succ : Nat -> Nat in let w : Vec A (Succ n) = (fn a:t. fn b:t. a) (Vec A (Succ n)) z;",
+		"let two : t = fn f:t. fn x:t. f (f x) in let r : t = (fn a:t. fn b:t. a) two z;",
+		"let two : t = fn f:t. fn x:t. x in let r : t = (fn a:t. fn b:t. a) two z;",
+	};
+
+	struct ast_t * cached_normal[4];
+
+	for(int i = 0; i < 4; i++) {
+		struct ast_t * program = parse(cached_src[i]);
+		struct ast_t * expected = ast_reduce_program(parse(cached_src[i]), 0);
+
+		cached_normal[i] = nbe_normalize(&nbe, program);
+
+		assert(ast_alpha_equivalent(cached_normal[i], expected));
+
+		ast_free(program);
+		ast_free(expected);
+	}
+
+	assert(!ast_alpha_equivalent(cached_normal[2], cached_normal[3]));
+
+	for(int i = 0; i < 4; i++) {
+		ast_free(cached_normal[i]);
+	}
+
+	normal_form_cache_report(&cache, stdout);
+
+	assert(cache.hits > 0);
+	assert(cache.collisions == 0);
+
+	nbe_destroy(&nbe);
+	normal_form_cache_destroy(&cache);
+
+	// the lazy machine agrees with the evaluator and does not recurse, 2^16
+	// nested applications of the identity are normalized on the default stack
+	church = parse(church_src);
+
+	struct ast_t * church_lazy = ast_normalize_lazy(church);
+	struct ast_t * church_eager = ast_normalize(church);
+
+	assert(ast_alpha_equivalent(church_lazy, church_eager));
+
+	struct ast_t * deep = parse("((((fn m:t. fn n:t. n m) (fn f:t. fn x:t. f (f x))) (fn g:t. fn y:t. g (g (g (g (g (g (g (g (g (g (g (g (g (g (g (g y))))))))))))))))) (fn z:t. z)) a");
+	struct ast_t * deep_lazy = ast_normalize_lazy(deep);
+
+	assert(deep_lazy->kind == VAR && strcmp(name_get_str(deep_lazy->name), "a") == 0);
+
+	ast_free(church);
+	ast_free(church_lazy);
+	ast_free(church_eager);
+	ast_free(deep);
+	ast_free(deep_lazy);
+
+	// resolved terms compare like named ones and reduce without renaming
+	const char * resolved_src[] = { A_src, B_src, C_src, D_src, E_src, F_src, G_src, H_src, I_src, J_src, src, indexed };
+
+	struct ast_t * named[12];
+	struct ast_t * resolved[12];
+
+	for(int i = 0; i < 12; i++) {
+		named[i] = parse(resolved_src[i]);
+		resolved[i] = parse_resolved(resolved_src[i]);
+	}
+
+	for(int i = 0; i < 12; i++) {
+		for(int j = 0; j < 12; j++) {
+			int equal = ast_resolved_equal(resolved[i], resolved[j]);
+
+			assert(equal == ast_alpha_equivalent(named[i], named[j]));
+			assert(!equal || ast_resolved_hash(resolved[i]).crc32 == ast_resolved_hash(resolved[j]).crc32);
+		}
+	}
+
+	for(int i = 0; i < 12; i++) {
+		ast_free(named[i]);
+		ast_free(resolved[i]);
+	}
+
+	const char * mult_src = "((fn m:t. fn n:t. fn f:t. m (n f)) (fn f:t. fn x:t. f (f x))) (fn g:t. fn y:t. g (g (g y)))";
+
+	struct ast_t * church_resolved = ast_resolved_reduce(parse_resolved(mult_src), 0);
+	struct ast_t * church_named = ast_reduce(parse(mult_src), 0);
+
+	ast_unresolve(church_resolved);
+
+	assert(ast_alpha_equivalent(church_resolved, church_named));
+	assert(ast_alpha_equivalent(church_resolved, six));
+
+	struct ast_t * capture_resolved = ast_resolved_reduce(parse_resolved("(fn x:t. fn y:t. x) y"), 0);
+
+	ast_unresolve(capture_resolved);
+
+	assert(ast_alpha_equivalent(capture_resolved, renamed));
+	assert(strcmp(name_get_str(capture_resolved->lhs->lhs->name), "y") != 0);
+
+	ast_free(renamed);
+	ast_free(church_resolved);
+	ast_free(church_named);
+	ast_free(capture_resolved);
+
+	// the parallel normalizer splits wide terms and always builds the same tree
+	const char * wide_src = "fn k:T. (((k (((fn x:t. fn y:t. x) (fn p:t. p)) q)) (((fn m:t. fn n:t. fn f:t. m (n f)) (fn f:t. fn x:t. f (f x))) (fn g:t. fn y:t. g (g (g y))))) ((fn y:t. fn z:t. y z) z))";
+
+	struct ast_t * wide = parse(wide_src);
+	struct ast_t * wide_sequential = ast_normalize(wide);
+
+	struct ast_t * wide_parallel[3];
+
+	for(unsigned threads = 1; threads <= 3; threads++) {
+		struct parallel_normalize_t normalizer;
+
+		parallel_normalize_init(&normalizer, threads, 4);
+
+		wide_parallel[threads - 1] = parallel_normalize(&normalizer, wide);
+
+		assert(normalizer.pool.spawned > 4);
+		assert(normalizer.head_steps > 0);
+
+		parallel_normalize_destroy(&normalizer);
+
+		assert(ast_alpha_equivalent(wide_parallel[threads - 1], wide_sequential));
+		assert(ast_identical(wide_parallel[threads - 1], wide_parallel[0]));
+	}
+
+	for(unsigned i = 0; i < 3; i++) {
+		ast_free(wide_parallel[i]);
+	}
+
+	ast_free(wide);
+	ast_free(wide_sequential);
+
+	// budgets stop runaway reductions and leave a valid term behind
+	struct ast_t * omega = parse("(fn x:t. x x) (fn x:t. x x)");
+	struct reduction_stats_t omega_stats = reduce_with_budget(&omega, 100, 0);
+
+	assert(omega_stats.status == REDUCTION_OUT_OF_STEPS);
+	assert(omega_stats.steps == 100);
+	assert(omega_stats.substitutions == 200);
+	assert(omega->kind == APP && omega->lhs->kind == LAMBDA);
+
+	struct ast_t * growing = parse("(fn x:t. x x x) (fn x:t. x x x)");
+	struct reduction_stats_t growing_stats = reduce_with_budget(&growing, 0, 64 * 1024);
+
+	assert(growing_stats.status == REDUCTION_OUT_OF_MEMORY);
+	assert(growing_stats.live_nodes * sizeof(struct ast_t) > 64 * 1024);
+	assert(growing_stats.live_nodes == ast_count_nodes(growing));
+
+	reduction_stats_print_json(&growing_stats, stdout);
+
+	struct normal_form_cache_t budget_cache;
+
+	normal_form_cache_init(&budget_cache, 0, 0);
+
+	for(int i = 0; i < 2; i++) {
+		struct ast_t * product = parse(mult_src);
+		struct reduction_stats_t product_stats = reduce_with_budget(&product, 0, 0, &budget_cache);
+
+		assert(product_stats.status == REDUCTION_NORMAL);
+		assert(product_stats.cache_hits == (unsigned long)i);
+		assert((product_stats.steps == 0) == (i == 1));
+		assert(product_stats.live_nodes == ast_count_nodes(product));
+		assert(ast_alpha_equivalent(product, six));
+
+		ast_free(product);
+	}
+
+	normal_form_cache_destroy(&budget_cache);
+
+	ast_free(omega);
+	ast_free(growing);
+
+	// shared arguments are reduced once however many times they are used
+	const char * shared_src = "(fn x:t. c x x) ((fn x:t. c x x) ((fn x:t. c x x) ((fn x:t. c x x) ((fn z:t. z) a))))";
+
+	struct reduction_stats_t tree_stats;
+	struct reduction_stats_t graph_stats;
+
+	reduction_stats_init(&graph_stats);
+
+	struct ast_t * shared_tree = parse(shared_src);
+
+	tree_stats = reduce_with_budget(&shared_tree, 0, 0);
+
+	struct ast_t * shared_input = parse(shared_src);
+	struct ast_t * shared_graph = graph_reduce(shared_input, &graph_stats);
+
+	assert(ast_alpha_equivalent(shared_tree, shared_graph));
+	assert(graph_stats.steps == 5);
+	assert(tree_stats.steps > 16);
+	assert(graph_stats.peak_live_nodes < tree_stats.peak_live_nodes);
+	assert(graph_stats.live_nodes == 0);
+
+	struct ast_t * mult_input = parse(mult_src);
+	struct ast_t * mult_graph = graph_reduce(mult_input, 0);
+	struct ast_t * capture_input = parse("(fn x:t. fn y:t. x y) (fn z:t. y)");
+	struct ast_t * capture_graph = graph_reduce(capture_input, 0);
+	struct ast_t * capture_expected = parse("fn w:t. y");
+
+	assert(ast_alpha_equivalent(mult_graph, six));
+	assert(ast_alpha_equivalent(capture_graph, capture_expected));
+
+	ast_free(shared_tree);
+	ast_free(shared_input);
+	ast_free(shared_graph);
+	ast_free(mult_input);
+	ast_free(mult_graph);
+	ast_free(capture_input);
+	ast_free(capture_graph);
+	ast_free(capture_expected);
+	ast_free(six);
+
+	const char * vec_src =
+		"let Nat : Type in "
+		"let Zero : Nat in "
+		"let Succ : Nat -> Nat in "
+		"let Vec : A:Type -> Nat -> Type in "
+		"let Empty : (A:Type) -> Vec A Zero in "
+		"let Cons : (A:Type) -> (n:Nat) -> A -> Vec A n -> Vec A (Succ n) in "
+		"let id : (A:Type) -> A -> A = fn A:Type. fn x:A. x in "
+		"let one : Nat = (id Nat) (Succ Zero) in "
+		"let v : Vec Nat (Succ Zero) = (((Cons Nat) Zero) one) (Empty Nat);";
+
+	// A and n are implicit, solved by unification at every use
+	const char * implicit_src =
+		"let Nat : Type in "
+		"let Zero : Nat in "
+		"let Succ : Nat -> Nat in "
+		"let Vec : A:Type -> Nat -> Type in "
+		"let Empty : Vec A Zero in "
+		"let Cons : A -> Vec A n -> Vec A (Succ n) in "
+		"let one : Nat = Succ Zero in "
+		"let v : Vec Nat (Succ Zero) = (Cons one) Empty in "
+		"let w : Vec Nat (Succ (Succ Zero)) = (Cons Zero) v;";
+
+	// matching Cons refines the length m of len
+	const char * case_src =
+		"let Nat : Type in "
+		"let Zero : Nat in "
+		"let Succ : Nat -> Nat in "
+		"let Vec : A:Type -> Nat -> Type in "
+		"let Empty : Vec A Zero in "
+		"let Cons : A -> Vec A n -> Vec A (Succ n) in "
+		"let pred : Nat -> Nat = case Zero then Zero, case Succ k then k in "
+		"let tail : n:Nat -> Vec Nat (Succ n) -> Vec Nat n = case _ . Cons x xs then xs in "
+		"let len : n:Nat -> Vec Nat n -> Nat = case m . Empty then m, case m . Cons x xs then m in "
+		"let v : Vec Nat (Succ Zero) = (Cons (pred (Succ Zero))) Empty in "
+		"let t : Vec Nat Zero = tail Zero v in "
+		"let l : Nat = len (Succ Zero) v in "
+		"let s : Nat -> Nat = fn y:Nat. pred (Succ (pred y));";
+
+	const char * ill_typed[] = {
+		"let Nat : Type in let Zero : Nat in let Bool : Type in let b : Bool = Zero;",
+		"let Nat : Type in let Zero : Nat in let z : Nat = Zero Zero;",
+		"let Nat : Type in let f : Nat -> Nat = fn x:Type. x;",
+		"let Nat : Type in let n : Nat = m;",
+		"let Nat : Type in let Zero : Nat in let Vec : A:Type -> Nat -> Type in let Empty : Vec A Zero in let e : Vec Nat (Zero Zero) = Empty;",
+		"let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let Vec : A:Type -> Nat -> Type in let Empty : Vec A Zero in let e : Vec Nat (Succ Zero) = Empty;",
+		"let Nat : Type in let Bool : Type in let Vec : A:Type -> Nat -> Type in let Cons : A -> Vec A n -> Vec A n in let c : Bool -> Vec Nat Bool = Cons;",
+		"let Nat : Type in let Zero : Nat in let Vec : A:Type -> Nat -> Type in let Empty : Vec A Zero in let Len : Vec A n -> Nat in let l : Nat = Len Empty;",
+		"let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let pred : Nat -> Nat = case Zero then Zero, case Succ k k then k;",
+		"let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let Vec : A:Type -> Nat -> Type in let Cons : A -> Vec A n -> Vec A (Succ n) in let bad : n:Nat -> Vec Nat n -> Vec Nat Zero = case m . Cons x xs then xs;",
+	};
+
+	struct typecheck_t checker;
+
+	typecheck_init(&checker);
+
+	struct ast_t * vec_program = parse(vec_src);
+
+	assert(typecheck_program(&checker, vec_program));
+	assert(checker.tag_hits > 0);
+
+	// N unfolds to Nat
+	struct ast_t * unfold_program = parse("let Nat : Type in let Zero : Nat in let N : Type = Nat in let z : N = (fn x:Nat. x) Zero;");
+
+	assert(typecheck_program(&checker, unfold_program));
+
+	ast_free(unfold_program);
+
+	// the copy of a is memoized, redefining N makes b a miss
+	const char * memo_src =
+		"let Nat : Type in let Bool : Type in let Zero : Nat in "
+		"let N : Type = Nat in "
+		"let a : N = (fn x:N. x) Zero in "
+		"let a2 : N = (fn y:N. y) Zero in "
+		"let N : Type = Bool in "
+		"let b : N = (fn x:N. x) Zero;";
+
+	struct ast_t * memo_program = parse(memo_src);
+
+	assert(!typecheck_program(&checker, memo_program));
+	assert(checker.memo_hits > 0);
+
+	checker.memoize = 0;
+
+	assert(!typecheck_program(&checker, memo_program));
+
+	checker.memoize = 1;
+
+	// the memo keys on the entries, not on the tags of their types
+	const char * redeclared_src =
+		"let A : Type in let B : Type in let Nat : Type in let a : A in let z : Nat in "
+		"let f : A -> Nat -> B in let r : B = (f a) z in "
+		"let f : B -> Nat -> A in let s : B = (f a) z;";
+
+	struct ast_t * redeclared_program = parse(redeclared_src);
+
+	assert(!typecheck_program(&checker, redeclared_program));
+
+	checker.memoize = 0;
+
+	assert(!typecheck_program(&checker, redeclared_program));
+
+	checker.memoize = 1;
+
+	ast_free(redeclared_program);
+
+	// the free names of every node are computed once
+	struct ast_t * type_identity = parse("fn x:Type. x");
+
+	typecheck_free_names(type_identity);
+
+	assert(type_identity->fv_to_ctx_map->complete && type_identity->fv_to_ctx_map->size == 1);
+	assert(type_identity->rhs->fv_to_ctx_map->complete && type_identity->rhs->fv_to_ctx_map->size == 1);
+
+	ast_free(type_identity);
+
+	// the flag, not the size of the map, tells the walk is done
+	struct ast_t * universe = var("Type");
+
+	universe->fv_to_ctx_map->complete = 1;
+
+	typecheck_free_names(universe);
+
+	assert(universe->fv_to_ctx_map->size == 0);
+
+	ast_free(universe);
+
+	// a misspelled type of a signature is unbound, not an implicit argument
+	struct ast_t * typo_program = parse("let Nat : Type in let Zero : Nat in let f : Nta -> Nat = fn x:Nat. x;");
+
+	assert(!typecheck_program(&checker, typo_program));
+	assert(strcmp(checker.error, "in f: unbound variable Nta") == 0);
+
+	ast_free(typo_program);
+
+	// a binder named like a free variable of the codomain is renamed, not rejected
+	struct ast_t * capture_program = parse(
+		"let A : Type in let P : A -> Type in let x : A in let c : P x in "
+		"let f : y:A -> P x = fn x:A. c in let g : A -> P x = fn x:A. c;");
+
+	assert(typecheck_program(&checker, capture_program));
+
+	ast_free(capture_program);
+
+	// the renamed binder is not the outer variable of the same name
+	struct ast_t * shadow_program = parse(
+		"let A : Type in let P : A -> Type in let z : A in let h : w:A -> P w in "
+		"let g : A -> P z = fn z:A. h z;");
+
+	assert(!typecheck_program(&checker, shadow_program));
+
+	ast_free(shadow_program);
+
+	// the scheduler agrees with the sequential checker, errors included
+	const char * parallel_sources[] = { vec_src, memo_src, implicit_src, case_src, ill_typed[0], ill_typed[1], ill_typed[2], ill_typed[3], ill_typed[5], ill_typed[7], ill_typed[9] };
+
+	for(unsigned threads = 1; threads <= 3; threads++) {
+		struct parallel_typecheck_t parallel_checker;
+
+		parallel_typecheck_init(&parallel_checker, threads);
+
+		for(unsigned i = 0; i < sizeof(parallel_sources) / sizeof(parallel_sources[0]); i++) {
+			struct ast_t * program = parse(parallel_sources[i]);
+
+			int sequential = typecheck_program(&checker, program);
+
+			assert(parallel_typecheck_program(&parallel_checker, program) == sequential);
+			assert(strcmp(parallel_checker.error, checker.error) == 0);
+
+			ast_free(program);
+		}
+
+		assert(parallel_checker.graph.barriers == 0);
+
+		parallel_typecheck_destroy(&parallel_checker);
+	}
+
+	ast_free(memo_program);
+
+	for(unsigned i = 0; i < sizeof(ill_typed) / sizeof(ill_typed[0]); i++) {
+		struct ast_t * program = parse(ill_typed[i]);
+
+		assert(!typecheck_program(&checker, program));
+
+		ast_free(program);
+	}
+
+	ast_free(vec_program);
+
+	struct ast_t * implicit_program = parse(implicit_src);
+
+	assert(typecheck_program(&checker, implicit_program));
+	assert(checker.metas.solutions > 0);
+
+	checker.implicits = 0;
+
+	assert(!typecheck_program(&checker, implicit_program));
+
+	checker.implicits = 1;
+
+	ast_free(implicit_program);
+
+	// ?F k = Vec Nat k under the binder k is a pattern, solved with a function
+	memory_set_scratch(checker.arena);
+
+	typecheck_reset(&checker);
+
+	// types only parse in signatures
+	auto signature = [&](const char * src) {
+		return typecheck_prepare(&checker, parse(src))->lhs->lhs->rhs;
+	};
+
+	struct ast_t * family = typecheck_hashed(meta_fresh(&checker.metas, signature("let F : Nat -> Type;"), 0));
+
+	struct ast_t * flex = typecheck_hashed(ast_substitute(signature("let t : (k:Nat) -> F k;"), allocate_name("F"), family));
+
+	assert(typecheck_unify_types(&checker, flex, signature("let t : (j:Nat) -> Vec Nat j;")));
+	assert(ast_alpha_equivalent(meta_zonk(&checker.metas, family), parse("fn k:Nat. Vec Nat k")));
+
+	memory_set_scratch(0);
+
+	typecheck_destroy(&checker);
+
+	// undoing to a mark restores the merges, solutions and new metavariables
+	struct meta_store_t metas;
+
+	meta_store_init(&metas);
+
+	struct ast_t * a = meta_fresh(&metas, 0, 0);
+	struct ast_t * b = meta_fresh(&metas, 0, 0);
+	struct ast_t * solution = var("x");
+
+	struct meta_mark_t mark = meta_mark(&metas);
+
+	meta_union(&metas, meta_find(&metas, meta_index(a)), meta_find(&metas, meta_index(b)));
+
+	struct ast_t * undone = meta_fresh(&metas, 0, 0);
+	meta_assign(&metas, meta_find(&metas, meta_index(b)), solution, 1);
+
+	assert(meta_force(&metas, a) == solution);
+
+	meta_undo(&metas, mark);
+
+	assert(metas.count == 2 && metas.trail_size == 0);
+	assert(meta_find(&metas, 0) == 0 && meta_find(&metas, 1) == 1);
+	assert(meta_force(&metas, a) == a && meta_force(&metas, b) == b);
+
+	ast_free(a);
+	ast_free(b);
+	ast_free(undone);
+	ast_free(solution);
+
+	meta_store_destroy(&metas);
+
+	// the case lists of a program are evaluated through decision trees, pred y
+	// is stuck on the variable y
+	struct ast_t * case_program = parse(case_src);
+
+	typecheck_init(&checker);
+
+	assert(typecheck_program(&checker, case_program));
+
+	typecheck_destroy(&checker);
+
+	struct ast_t * case_normal[2];
+
+	for(int trees = 0; trees < 2; trees++) {
+		struct nbe_t nbe;
+
+		nbe_init(&nbe);
+
+		nbe.decision_trees = trees;
+		case_normal[trees] = nbe_normalize(&nbe, case_program);
+
+		nbe_destroy(&nbe);
+	}
+
+	assert(ast_identical(case_normal[0], case_normal[1]));
+
+	struct ast_t * case_values[3];
+
+	struct ast_t * case_statement = case_normal[1];
+
+	while(case_statement->rhs->rhs->rhs) {
+		case_statement = case_statement->rhs;
+	}
+
+	for(unsigned i = 0; i < 3; i++, case_statement = case_statement->rhs) {
+		case_values[i] = case_statement->lhs->rhs;
+	}
+
+	struct ast_t * stuck = parse("fn y:Nat. pred y");
+	struct ast_t * empty = parse("Empty");
+	struct ast_t * one = parse("Succ Zero");
+
+	assert(ast_identical(case_values[0], empty));
+	assert(ast_identical(case_values[1], one));
+	assert(case_values[2]->kind == LAMBDA && case_values[2]->rhs->kind == APP && case_values[2]->rhs->lhs->kind == CASE_LIST);
+	assert(ast_alpha_equivalent(case_values[2]->rhs->rhs, stuck->rhs->rhs));
+
+	ast_free(stuck);
+	ast_free(empty);
+	ast_free(one);
+	ast_free(case_normal[0]);
+	ast_free(case_normal[1]);
+	ast_free(case_program);
+
+	// the trees test each argument once per path and report the cases no
+	// path reaches and the paths no case takes
+	struct ast_t * case_programs[6];
+	unsigned case_count = 0;
+
+	auto case_value = [&](const char * src) {
+		case_programs[case_count] = parse(src);
+		return case_programs[case_count++]->lhs->rhs;
+	};
+
+	struct ast_t * cases = case_value("let f : T = case Zero . Zero then a, case Succ x . Succ y then b, case x . y then c, case Zero . y then d;");
+
+	struct case_tree_t * tree = case_tree_compile(cases);
+
+	assert(tree->arity == 2 && tree->registers == 4);
+	assert(tree->unreachable == 1 && tree->failures == 0);
+	assert(tree->root->kind == CASE_NODE_SWITCH && tree->root->occurrence == 0 && tree->root->count == 2);
+
+	case_tree_free(tree);
+
+	tree = case_tree_compile(case_value("let f : T = case Zero then a;"));
+
+	assert(tree->unreachable == 0 && tree->failures == 1);
+
+	case_tree_free(tree);
+
+	assert(case_tree_compile(case_value("let f : T = case Zero then a, case x . y then b;")) == 0);
+
+	// pattern variables are bound names
+	struct ast_t * case_a = case_value("let f : T = case Succ k . y then k y, case x . y then y;");
+	struct ast_t * case_b = case_value("let f : T = case Succ j . z then j z, case w . y then y;");
+	struct ast_t * case_c = case_value("let f : T = case Succ j . z then z j, case w . y then y;");
+
+	ast_hash(case_a);
+	ast_hash(case_b);
+	ast_hash(case_c);
+
+	assert(case_a->tag.crc32 == case_b->tag.crc32 && ast_alpha_equivalent(case_a, case_b));
+	assert(case_a->tag.crc32 != case_c->tag.crc32 && !ast_alpha_equivalent(case_a, case_c));
+
+	for(unsigned i = 0; i < case_count; i++) {
+		ast_free(case_programs[i]);
+	}
+
+	// units are compiled again when their source or an interface they see
+	// changes, the value of one is opaque to the others
+	char unit_directory[] = "/tmp/unit_test_XXXXXX";
+
+	assert(mkdtemp(unit_directory));
+
+	const char * nat_src = "let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let N : Type = Nat in let one : Nat = Succ Zero;";
+
+	struct build_t build;
+
+	build_init(&build, unit_directory);
+
+	unsigned nat_unit = build_add_unit(&build, "nat", nat_src);
+	unsigned vec_unit = build_add_unit(&build, "vec", "let Vec : A:Type -> Nat -> Type in let Empty : Vec A Zero in let Cons : A -> Vec A n -> Vec A (Succ n) in let v : Vec N (Succ Zero) = (Cons one) Empty;");
+	unsigned use_unit = build_add_unit(&build, "use", "let w : Vec Nat (Succ (Succ Zero)) = (Cons Zero) v;");
+
+	build_import(&build, vec_unit, nat_unit);
+	build_import(&build, use_unit, vec_unit);
+
+	assert(build_run(&build) && build.compiled == 3);
+	assert(build_run(&build) && build.compiled == 0 && build.loaded == 3);
+
+	// a new value for one keeps the interface of nat
+	build_set_source(&build, nat_unit, "let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let N : Type = Nat in let one : Nat = Zero;");
+
+	assert(build_run(&build) && build.compiled == 1 && build.units[nat_unit].compiled);
+
+	// a new definition changes it, use sees nat through vec
+	build_set_source(&build, nat_unit, "let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let N : Type = Nat in let one : Nat = Succ Zero in let two : Nat = Zero;");
+
+	assert(build_run(&build) && build.compiled == 3 && build.interfaces_changed == 1);
+
+	build_destroy(&build);
+
+	// the artifacts on disk are current
+	build_init(&build, unit_directory);
+
+	nat_unit = build_add_unit(&build, "nat", "let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in let N : Type = Nat in let one : Nat = Succ Zero in let two : Nat = Zero;");
+	vec_unit = build_add_unit(&build, "vec", "let Vec : A:Type -> Nat -> Type in let Empty : Vec A Zero in let Cons : A -> Vec A n -> Vec A (Succ n) in let v : Vec N (Succ Zero) = (Cons one) Empty;");
+	use_unit = build_add_unit(&build, "use", "let w : Vec Nat (Succ (Succ Zero)) = (Cons Zero) v;");
+
+	build_import(&build, vec_unit, nat_unit);
+	build_import(&build, use_unit, vec_unit);
+
+	assert(build_run(&build) && build.compiled == 0 && build.read == 3);
+
+	// one is opaque in use, N unfolds
+	build_set_source(&build, use_unit, "let u : Vec N one = (Cons Zero) Empty;");
+
+	assert(!build_run(&build) && build.units[use_unit].failed);
+
+	build_set_source(&build, use_unit, "let u : Vec N (Succ Zero) = (Cons Zero) Empty;");
+
+	assert(build_run(&build) && build.compiled == 1);
+
+	// cycles and failed imports
+	build_import(&build, nat_unit, use_unit);
+
+	assert(!build_run(&build) && build.error[0]);
+
+	build_destroy(&build);
+
+	build_init(&build, 0);
+
+	nat_unit = build_add_unit(&build, "nat", "let Nat : Type in let Zero : Nat in let z : Nat = Nat;");
+	use_unit = build_add_unit(&build, "use", "let y : Nat = Zero;");
+
+	build_import(&build, use_unit, nat_unit);
+
+	assert(!build_run(&build) && build.failed == 2 && build.units[use_unit].failed);
+
+	build_destroy(&build);
+
+	// swapping the types in a signature changes the interface
+	build_init(&build, 0);
+
+	unsigned lib_unit = build_add_unit(&build, "lib", "let A : Type in let B : Type in let Nat : Type in let a : A in let z : Nat in let f : A -> Nat -> B;");
+
+	use_unit = build_add_unit(&build, "use", "let r : B = (f a) z;");
+
+	build_import(&build, use_unit, lib_unit);
+
+	assert(build_run(&build) && build.compiled == 2);
+
+	build_set_source(&build, lib_unit, "let A : Type in let B : Type in let Nat : Type in let a : A in let z : Nat in let f : B -> Nat -> A;");
+
+	assert(!build_run(&build) && build.interfaces_changed == 1 && build.units[use_unit].failed);
+
+	// renaming a bound variable of a signature does not
+	build_set_source(&build, lib_unit, "let A : Type in let B : Type in let Nat : Type in let a : A in let z : Nat in let f : A -> Nat -> B in let P : A -> Type in let g : x:A -> P x -> B;");
+
+	assert(build_run(&build) && build.compiled == 2);
+
+	build_set_source(&build, lib_unit, "let A : Type in let B : Type in let Nat : Type in let a : A in let z : Nat in let f : A -> Nat -> B in let P : A -> Type in let g : y:A -> P y -> B;");
+
+	assert(build_run(&build) && build.compiled == 1 && build.interfaces_changed == 0);
+
+	build_destroy(&build);
+
+	const char * unit_names[] = { "nat", "vec", "use" };
+
+	for(unsigned i = 0; i < 3; i++) {
+		char path[64];
+
+		snprintf(path, sizeof(path), "%s/%s.unit", unit_directory, unit_names[i]);
+		remove(path);
+	}
+
+	rmdir(unit_directory);
+
+	// the buffered printer writes what ast_print does
+	struct ast_printer_t printer;
+
+	ast_printer_init(&printer, 0);
+
+	const char * printed[] = {
+		src,
+		indexed,
+		"let id : A:Type -> A -> A = fn A:Type. fn x:A. x;",
+		"let not : Bool -> Bool = case True . False then True, case False . _ then False;",
+	};
+
+	for(unsigned i = 0; i < sizeof(printed) / sizeof(printed[0]); i++) {
+		struct ast_t * ast = parse(printed[i]);
+
+		assert(ast_printer_matches(&printer, ast));
+
+		ast_free(ast);
+	}
+
+	printer.flags = AST_PRINT_TAG;
+
+	assert(ast_printer_matches(&printer, A_prog->lhs->rhs) && ast_printer_matches(&printer, E_prog->lhs->rhs));
+
+	ast_free(A_prog);
+	ast_free(E_prog);
+
+	// a chain chainer than the call stack allows
+	struct ast_t * chain = var("x");
+
+	for(unsigned i = 0; i < 1000000; i++) chain = app(chain, var("y"));
+
+	struct byte_buffer_t chain_text;
+
+	byte_buffer_init(&chain_text);
+	ast_printer_print(&printer, &chain_text, chain);
+
+	assert(chain_text.size > 4000000 && chain_text.data[chain_text.size - 1] == ')');
+
+	byte_buffer_destroy(&chain_text);
+	ast_printer_destroy(&printer);
+
+	while(chain->kind == APP) {
+		struct ast_t * lhs = chain->lhs;
+
+		ast_free(chain->rhs);
+		ast_free_node(chain);
+
+		chain = lhs;
+	}
+
+	ast_free(chain);
+
+	// bytes are hashed unsigned, the tags of non ascii names are the same
+	// whatever the signedness of char, the crc32 of zlib
+	assert(hash("caf\xc3\xa9").crc32 == 0x98ad42b5u);
+	assert(hash("caf\xc3\xa9 au lait", 5).crc32 == 0x98ad42b5u);
+
+	// the parse cache gives back the parsed and hashed program
+	char cache_directory[] = "/tmp/ast_cache_XXXXXX";
+
+	assert(mkdtemp(cache_directory));
+
+	struct ast_cache_t parse_cache;
+
+	ast_cache_init(&parse_cache, cache_directory);
+
+	struct ast_t * parsed = parse(indexed);
+
+	ast_hash(parsed);
+
+	struct ast_t * missed = ast_cache_parse(&parse_cache, indexed);
+	struct ast_t * hit = ast_cache_parse(&parse_cache, indexed);
+
+	assert(parse_cache.misses == 1 && parse_cache.hits == 1);
+	assert(ast_identical_tags(parsed, missed) && ast_identical_tags(parsed, hit));
+
+	// another source is another entry
+	struct ast_t * other = ast_cache_parse(&parse_cache, src);
+
+	assert(parse_cache.misses == 2 && ast_identical(other, prog));
+
+	// a truncated entry is rejected and written again
+	char * entry = ast_cache_path(&parse_cache, ast_cache_key(indexed, strlen(indexed)));
+
+	assert(truncate(entry, 20) == 0);
+
+	struct ast_t * rewritten = ast_cache_parse(&parse_cache, indexed);
+	struct ast_t * reread = ast_cache_parse(&parse_cache, indexed);
+
+	assert(parse_cache.rejected == 1 && parse_cache.misses == 3 && parse_cache.hits == 2);
+	assert(ast_identical_tags(parsed, rewritten) && ast_identical_tags(parsed, reread));
+
+	char * other_entry = ast_cache_path(&parse_cache, ast_cache_key(src, strlen(src)));
+
+	remove(entry);
+	remove(other_entry);
+	rmdir(cache_directory);
+
+	ast_cache_destroy(&parse_cache);
+
+	ast_free(parsed);
+	ast_free(missed);
+	ast_free(hit);
+	ast_free(other);
+	ast_free(rewritten);
+	ast_free(reread);
+	memory_free(entry);
+	memory_free(other_entry);
+
+	// the static tables build the ast and tags of parse and ast_hash
+	struct ast_t * parsed_prelude = parse(STATIC_PRELUDE);
+	struct ast_t * parsed_term = parse("fn x:t. fn y:t. (g x) y (h y)");
+
+	ast_hash(parsed_prelude);
+	ast_hash(parsed_term);
+
+	unsigned long before_static = memory_allocation_count();
+
+	struct ast_t * static_prelude_ast = static_program_ast(&static_prelude);
+
+	// an array of nodes, then the node, its map and the name of each node
+	assert(memory_allocation_count() - before_static <= 1 + 4 * static_prelude.size);
+
+	struct ast_t * static_term_ast = static_program_ast(&static_term);
+	struct ast_t * static_unhashed_ast = static_program_ast(&static_unhashed);
+
+	assert(ast_identical_tags(static_prelude_ast, parsed_prelude));
+	assert(ast_identical_tags(static_term_ast, parsed_term));
+	assert(static_prelude_ast->tag.crc32 == static_program_tag(&static_prelude).crc32);
+
+	struct ast_t * parsed_unhashed = parse("fn x:t. x");
+
+	assert(ast_identical(static_unhashed_ast, parsed_unhashed));
+
+	// and for src
+	static constexpr auto static_src = static_parse_hashed(
+		"let f : t -> t = fn x:a. x in\n"
+		"let g : t -> t = fn x:a. f x in\n"
+		"let h : t -> t = fn x:a. g f x in\n"
+		"let r : t -> t = fn x:a. r f x in\n"
+		"let q : t -> t -> z = fn x:a. fn y:a. (f x) (f y);\n");
+
+	struct ast_t * static_src_ast = static_program_ast(&static_src);
+	struct ast_t * hashed_src = parse(src);
+
+	ast_hash(hashed_src);
+
+	assert(ast_identical_tags(static_src_ast, hashed_src));
+
+	ast_free(parsed_prelude);
+	ast_free(parsed_term);
+	ast_free(parsed_unhashed);
+	ast_free(hashed_src);
+	ast_free(static_prelude_ast);
+	ast_free(static_term_ast);
+	ast_free(static_unhashed_ast);
+	ast_free(static_src_ast);
+
+	// syntax errors are returned by parse_checked, the nodes read before them
+	// are left in the scratch arena
+	char syntax_error[256];
+
+	struct arena_t * syntax_arena = arena_create(1 << 12);
+
+	memory_set_scratch(syntax_arena);
+
+	assert(parse_checked("let f : t = fn x. x;", syntax_error, sizeof(syntax_error)) == 0);
+	assert(strcmp(syntax_error, "expecting ':', found '.' at line 1, column 17") == 0);
+	assert(parse_checked("f (g x", syntax_error, sizeof(syntax_error)) == 0);
+	assert(parse_checked("let f : t = x in f", syntax_error, sizeof(syntax_error)) == 0);
+	assert(parse_checked("{", syntax_error, sizeof(syntax_error)) == 0);
+
+	memory_set_scratch(0);
+	arena_destroy(syntax_arena);
+
+	// untrusted sources are bounded in nesting and in lets, parse is not
+	std::string nested_src = std::string(PARSE_MAX_DEPTH - 1, '(') + "x" + std::string(PARSE_MAX_DEPTH - 1, ')');
+
+	struct ast_t * nested_checked = parse_checked(nested_src.c_str(), syntax_error, sizeof(syntax_error));
+
+	assert(nested_checked && nested_checked->kind == VAR);
+
+	ast_free(nested_checked);
+
+	nested_src = "(" + nested_src + ")";
+
+	assert(parse_checked(nested_src.c_str(), syntax_error, sizeof(syntax_error)) == 0);
+	assert(strcmp(syntax_error, "nesting deeper than 1024 at line 1, column 1025") == 0);
+
+	nested_checked = parse(nested_src.c_str());
+
+	assert(nested_checked && nested_checked->kind == VAR);
+
+	ast_free(nested_checked);
+
+	std::string lets_src;
+
+	for(unsigned i = 1; i < PARSE_MAX_LETS; i++) lets_src += "let a : t = x in\n";
+
+	struct arena_t * lets_arena = arena_create(1 << 20);
+
+	memory_set_scratch(lets_arena);
+
+	assert(parse_checked((lets_src + "let a : t = x;").c_str(), syntax_error, sizeof(syntax_error)) != 0);
+	assert(parse_checked((lets_src + "let a : t = x in let b : t = a;").c_str(), syntax_error, sizeof(syntax_error)) == 0);
+	assert(strncmp(syntax_error, "more than 8192 lets at line 8192,", 33) == 0);
+
+	memory_set_scratch(0);
+	arena_destroy(lets_arena);
+
+	struct ast_t * checked = parse_checked(src, syntax_error, sizeof(syntax_error));
+
+	assert(ast_identical(checked, prog));
+
+	ast_free(checked);
+
+	// the daemon answers concurrent clients with the prelude in scope
+	char daemon_path[64];
+
+	snprintf(daemon_path, sizeof(daemon_path), "/tmp/ast_tests_daemon_%d.sock", (int)getpid());
+
+	const char * daemon_prelude =
+		"let Nat : Type in let Zero : Nat in let Succ : Nat -> Nat in\n"
+		"let two : Nat = Succ (Succ Zero) in\n"
+		"let id : Nat -> Nat = fn x:Nat. x;";
+
+	struct daemon_t daemon;
+
+	assert(daemon_init(&daemon, daemon_path, daemon_prelude, 2));
+	assert(daemon.prelude.size == 5);
+
+	std::thread daemon_thread(daemon_run, &daemon);
+
+	struct daemon_client_t client;
+
+	assert(daemon_client_connect(&client, daemon_path));
+
+	struct byte_reader_t result;
+
+	// parse
+	assert(daemon_client_call(&client, DAEMON_PARSE, 0, src) && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	struct ast_t * served = ast_deserialize(&result);
+
+	assert(ast_identical(served, prog) && result.at == result.size);
+
+	ast_free(served);
+	ast_free(prog);
+
+	// hash, alpha equivalent sources get the tag of ast_hash
+	struct ast_t * local = parse("fn x:Nat. Succ x");
+
+	ast_hash(local);
+
+	assert(daemon_client_call(&client, DAEMON_HASH, 0, "fn y:Nat. Succ y") && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	assert(byte_reader_u32(&result) == local->tag.crc32);
+
+	ast_free(local);
+
+	// typecheck, with the names of the prelude
+	assert(daemon_client_call(&client, DAEMON_TYPECHECK, 0, "id (Succ two)") && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	struct ast_t * served_type = ast_deserialize(&result);
+
+	assert(served_type && served_type->kind == VAR && strcmp(name_get_str(served_type->name), "Nat") == 0);
+
+	ast_free(served_type);
+
+	assert(daemon_client_call(&client, DAEMON_TYPECHECK, 0, "Succ id") && !daemon_client_ok(&client));
+
+	// normalize, the definitions unfold
+	struct ast_t * three = parse("Succ (Succ (Succ Zero))");
+
+	for(unsigned i = 0; i < 2; i++) {
+		assert(daemon_client_call(&client, DAEMON_NORMALIZE, 0, "id (Succ two)") && daemon_client_ok(&client));
+
+		daemon_client_result(&client, &result);
+
+		assert(byte_reader_u8(&result) == REDUCTION_NORMAL);
+
+		byte_reader_u32(&result);
+		byte_reader_u32(&result);
+
+		struct ast_t * normal = ast_deserialize(&result);
+
+		assert(ast_identical(normal, three));
+
+		ast_free(normal);
+	}
+
+	ast_free(three);
+
+	// a budget that runs out
+	assert(daemon_client_call(&client, DAEMON_NORMALIZE, 10, "(fn x:t. x x) (fn x:t. x x)") && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	assert(byte_reader_u8(&result) == REDUCTION_OUT_OF_STEPS && byte_reader_u32(&result) == 10);
+
+	// errors leave the connection usable
+	assert(daemon_client_call(&client, DAEMON_HASH, 0, "fn x. x") && !daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	char * served_error = byte_reader_string(&result);
+
+	assert(strcmp(served_error, "expecting ':', found '.' at line 1, column 5") == 0);
+
+	memory_free(served_error);
+
+	std::thread daemon_clients[3];
+	std::atomic<unsigned> daemon_answers(0);
+
+	for(unsigned i = 0; i < 3; i++) {
+		daemon_clients[i] = std::thread([&]() {
+			struct daemon_client_t other;
+
+			if(daemon_client_connect(&other, daemon_path)) {
+				for(unsigned k = 0; k < 20; k++) {
+					if(daemon_client_call(&other, DAEMON_NORMALIZE, 0, "id two") && daemon_client_ok(&other)) daemon_answers += 1;
+				}
+			}
+
+			daemon_client_close(&other);
+		});
+	}
+
+	for(unsigned i = 0; i < 3; i++) daemon_clients[i].join();
+
+	assert(daemon_answers == 60);
+
+	assert(daemon_client_call(&client, DAEMON_STATS, 0, 0) && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	unsigned daemon_requests = byte_reader_u32(&result);
+	unsigned daemon_errors = byte_reader_u32(&result);
+	unsigned daemon_hits = byte_reader_u32(&result);
+
+	assert(daemon_requests == 69 && daemon_errors == 2 && daemon_hits >= 60);
+
+	assert(daemon_client_call(&client, DAEMON_STOP, 0, 0) && daemon_client_ok(&client));
+
+	daemon_client_close(&client);
+	daemon_thread.join();
+	daemon_destroy(&daemon);
+
+	// the prelude is trusted, it is not held to the limits of the requests
+	std::string library_src = "let Nat : Type in let d0 : Nat in\n";
+
+	for(unsigned i = 1; i <= PARSE_MAX_LETS; i++) {
+		library_src += "let d" + std::to_string(i) + " : Nat = d" + std::to_string(i - 1) + " in\n";
+	}
+
+	library_src += "let last : Nat = d" + std::to_string(PARSE_MAX_LETS) + ";";
+
+	assert(daemon_init(&daemon, daemon_path, library_src.c_str(), 1));
+	assert(daemon.prelude.size == PARSE_MAX_LETS + 3);
+
+	daemon_thread = std::thread(daemon_run, &daemon);
+
+	assert(daemon_client_connect(&client, daemon_path));
+	assert(daemon_client_call(&client, DAEMON_TYPECHECK, 0, "last") && daemon_client_ok(&client));
+	assert(daemon_client_call(&client, DAEMON_STOP, 0, 0) && daemon_client_ok(&client));
+
+	daemon_client_close(&client);
+	daemon_thread.join();
+	daemon_destroy(&daemon);
+
+	// without a prelude the requests see an empty context
+	assert(daemon_init(&daemon, daemon_path, 0, 1));
+
+	daemon_thread = std::thread(daemon_run, &daemon);
+
+	assert(daemon_client_connect(&client, daemon_path));
+	assert(daemon_client_call(&client, DAEMON_NORMALIZE, 0, "(fn f:t. fn y:t. f (f y)) (fn x:t. x)") && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	assert(byte_reader_u8(&result) == REDUCTION_NORMAL);
+
+	byte_reader_u32(&result);
+	byte_reader_u32(&result);
+
+	struct ast_t * unfolded = ast_deserialize(&result);
+	struct ast_t * identity = parse("fn z:t. z");
+
+	assert(ast_alpha_equivalent(unfolded, identity));
+
+	ast_free(unfolded);
+	ast_free(identity);
+
+	assert(daemon_client_call(&client, DAEMON_TYPECHECK, 0, "fn A:Type. fn x:A. x") && daemon_client_ok(&client));
+	assert(daemon_client_call(&client, DAEMON_TYPECHECK, 0, "fn x:A. x") && !daemon_client_ok(&client));
+
+	// a term that doubles at every step runs out of bytes long before it runs
+	// out of steps
+	std::string doubling_src = "x32";
+
+	for(unsigned i = 32; i > 0; i--) {
+		std::string bound = "x" + std::to_string(i), outer = "x" + std::to_string(i - 1);
+
+		doubling_src = "(fn " + bound + ":t. " + doubling_src + ") (" + outer + " " + outer + ")";
+	}
+
+	assert(daemon_client_call(&client, DAEMON_NORMALIZE, 0, doubling_src.c_str()) && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	// or out of time first on a slow build
+	unsigned char doubling_status = byte_reader_u8(&result);
+
+	assert((doubling_status == REDUCTION_OUT_OF_MEMORY || doubling_status == REDUCTION_OUT_OF_TIME) && byte_reader_u32(&result) < DAEMON_NORMALIZE_STEPS);
+
+	// the step budget of a client is capped, and so is the time of a request
+	assert(daemon_client_call(&client, DAEMON_NORMALIZE, ~0u, "(fn x:t. x x) (fn x:t. x x)") && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	// a slow build may run out of time before the capped steps
+	unsigned char omega_status = byte_reader_u8(&result);
+	unsigned omega_steps = byte_reader_u32(&result);
+
+	assert(omega_status == REDUCTION_OUT_OF_STEPS ? omega_steps == DAEMON_NORMALIZE_STEPS : omega_status == REDUCTION_OUT_OF_TIME && omega_steps < DAEMON_NORMALIZE_STEPS);
+
+	std::string tower_src = "(fn f:t. fn x:t. f (f (f x)))";
+
+	tower_src = tower_src + " " + tower_src + " " + tower_src;
+
+	assert(daemon_client_call(&client, DAEMON_NORMALIZE, 0, tower_src.c_str()) && daemon_client_ok(&client));
+
+	daemon_client_result(&client, &result);
+
+	assert(byte_reader_u8(&result) == REDUCTION_OUT_OF_TIME && byte_reader_u32(&result) < DAEMON_NORMALIZE_STEPS);
+
+	// a deep source is an error, not a stack overflow of the worker
+	std::string deep_src = std::string(300000, '(') + "x" + std::string(300000, ')');
+
+	assert(daemon_client_call(&client, DAEMON_PARSE, 0, deep_src.c_str()) && !daemon_client_ok(&client));
+	assert(daemon_client_call(&client, DAEMON_STOP, 0, 0) && daemon_client_ok(&client));
+
+	daemon_client_close(&client);
+	daemon_thread.join();
+	daemon_destroy(&daemon);
+
+	// tracing is compiled out by default, the spans are recorded by hand
+	struct ast_t * untraced = parse(indexed);
+
+	ast_hash(untraced);
+	ast_free(untraced);
+
+	assert(TRACE || trace_count() == 0);
+
+	trace_clear();
+
+	{
+		struct trace_span_t span("outer");
+		int active = 0;
+
+		for(unsigned i = 0; i < 3; i++) {
+			struct trace_outer_span_t recursive("recursive", &active);
+			struct trace_outer_span_t nested("recursive", &active);
+		}
+
+		struct trace_batch_t batch = { "batch", 4, 0, 0 };
+
+		for(unsigned i = 0; i < 10; i++) {
+			struct trace_batch_span_t call(&batch);
+		}
+
+		trace_batch_flush(&batch);
+	}
+
+	// 1 outer, 3 outermost recursive calls, batches of 4, 4 and 2 calls
+	assert(trace_count() == 7);
+
+	FILE * trace_file = tmpfile();
+
+	trace_write_json(trace_file);
+
+	std::string trace_json;
+	char trace_chunk[4096];
+	unsigned long trace_read;
+
+	rewind(trace_file);
+
+	while((trace_read = fread(trace_chunk, 1, sizeof(trace_chunk), trace_file)) > 0) trace_json.append(trace_chunk, trace_read);
+
+	fclose(trace_file);
+
+	assert(trace_json.find("{\"traceEvents\":[") == 0);
+	assert(trace_json.find("\"name\":\"outer\",\"ph\":\"X\"") != std::string::npos);
+	assert(trace_json.find("\"args\":{\"calls\":2}") != std::string::npos);
+
+	// a full ring keeps the latest spans
+	for(unsigned i = 0; i < TRACE_BUFFER_EVENTS + 10; i++) trace_record("ring", i, 1, 0);
+
+	assert(trace_count() == TRACE_BUFFER_EVENTS && trace_buffer()->events[0].start == TRACE_BUFFER_EVENTS - 7);
+
+	trace_clear();
+
+	// threads started one after another reuse the buffers of the exited ones
+	auto trace_buffer_count = []() {
+		unsigned count = 0;
+
+		for(struct trace_buffer_t * buffer = trace_buffers; buffer; buffer = buffer->next) count += 1;
+
+		return count;
+	};
+
+	std::thread([]() { trace_record("worker", 0, 1, 0); }).join();
+
+	unsigned trace_buffers_used = trace_buffer_count();
+
+	for(unsigned i = 0; i < 8; i++) {
+		std::thread([]() { trace_record("worker", 0, 1, 0); }).join();
+	}
+
+	assert(trace_buffer_count() == trace_buffers_used && trace_count() == 9);
+
+	trace_clear();
 }